@@ -44,128 +44,77 @@ void AABBCollidableComponentUpdater::collideWithVoxels(AabbCollidableComponent&
         }
     }
 
+    // Acquire the box plus a one voxel border for the neighbor checks
+    i32v3 minChunkPos = VoxelSpaceConversions::voxelToChunk(vp - i32v3(1));
+    i32v3 maxChunkPos = VoxelSpaceConversions::voxelToChunk(vp + bounds);
+    m_neighborhood.acquire(grid.accessor, minChunkPos, maxChunkPos - minChunkPos + i32v3(1));
+
     // Find Collidable voxels
     for (auto& it : boundedVoxels) {
-        ChunkHandle chunk = grid.accessor.acquire(it.first);
+        ChunkHandle& chunk = m_neighborhood.getChunk(i32v3(it.first.x, it.first.y, it.first.z));
         if (chunk->genLevel == GEN_DONE) {
-            std::lock_guard<std::mutex> l(chunk->dataMutex);
-            for (auto& i : it.second) {
-                BlockID id = chunk->blocks.get(i);
+            std::shared_lock<ChunkDataLock> l(chunk->dataMutex);
+            const std::vector<ui16>& indices = it.second;
+            if (chunk->blocks.isUniform()) {
+                // One lookup decides every voxel in the chunk
+                BlockID id = chunk->blocks.getUniformValue();
                 if (bp->operator[](id).collide) {
-                    // TODO(Ben): Don't need to look up every time.
-                    cmp.voxelCollisions[it.first].emplace_back(id, i);
+                    auto& collisions = cmp.voxelCollisions[it.first];
+                    for (auto& index : indices) collisions.emplace_back(id, index);
+                }
+            } else {
+                // Indices were pushed in x order, so copy each contiguous row at once
+                ui16 row[CHUNK_WIDTH];
+                for (size_t i = 0; i < indices.size();) {
+                    size_t rowEnd = i + 1;
+                    while (rowEnd < indices.size() && rowEnd - i < CHUNK_WIDTH &&
+                           indices[rowEnd] == indices[rowEnd - 1] + 1) {
+                        rowEnd++;
+                    }
+                    chunk->blocks.copyRange(indices[i], rowEnd - i, row);
+                    for (size_t j = i; j < rowEnd; j++) {
+                        BlockID id = row[j - i];
+                        if (bp->operator[](id).collide) {
+                            // TODO(Ben): Don't need to look up every time.
+                            cmp.voxelCollisions[it.first].emplace_back(id, indices[j]);
+                        }
+                    }
+                    i = rowEnd;
                 }
             }
         }
-        chunk.release();
-    }
-
-    // Helper macro for below code
-#define CHECK_CODE(dir) \
-    /* Acquire new chunk if needed */ \
-    if (id != currentID) { \
-        /* Release current chunk */ \
-        if (chunk.isAquired()) { \
-            chunk->dataMutex.unlock(); \
-            chunk.release(); \
-        } \
-        chunk = grid.accessor.acquire(id); \
-        if (chunk->genLevel != GEN_DONE) { \
-            chunk.release(); \
-            currentID = ChunkID(0xffffffffffffffffu); \
-        } else { \
-            chunk->dataMutex.lock(); \
-            currentID = id; \
-            /* Check the voxel */ \
-            if (chunk->genLevel == GEN_DONE && bp->operator[](chunk->blocks.get(index)).collide) { \
-                cd.dir = true; \
-            } \
-        } \
-    } else {\
-        /* Check the voxel */ \
-        if (chunk->genLevel == GEN_DONE && bp->operator[](chunk->blocks.get(index)).collide) { \
-            cd.dir = true; \
-        } \
     }
 
     // Set neighbor collide flags
-    // TODO(Ben): More than top
-    ChunkID currentID(0xffffffffffffffffu);
-    ChunkHandle chunk;
+    // Only one chunk is read locked at a time, we switch when the neighbor is in another chunk
+    // Same order as the BlockCollisionData flag bits
+    static const i32v3 OFFSETS[6] = {
+        i32v3(-1, 0, 0), i32v3(1, 0, 0), i32v3(0, -1, 0),
+        i32v3(0, 1, 0), i32v3(0, 0, -1), i32v3(0, 0, 1)
+    };
+    Chunk* lockedChunk = nullptr;
     for (auto& it : cmp.voxelCollisions) {
+        i32v3 chunkVoxelPos = i32v3(it.first.x, it.first.y, it.first.z) * CHUNK_WIDTH;
         for (auto& cd : it.second) {
-            { // Left
-                ChunkID id = it.first;
-                int index = (int)cd.index;
-                if ((index & 0x1f) == 0) {
-                    index += CHUNK_WIDTH_M1;
-                    id.x--;
-                } else {
-                    index--;
+            i32v3 p = chunkVoxelPos + i32v3(cd.index & CHUNK_WIDTH_M1,
+                                            cd.index / CHUNK_LAYER,
+                                            (cd.index & (CHUNK_LAYER - 1)) / CHUNK_WIDTH);
+            for (int d = 0; d < 6; d++) {
+                int index;
+                Chunk* chunk = m_neighborhood.getChunkAt(p + OFFSETS[d], index);
+                if (chunk->genLevel != GEN_DONE) continue;
+                if (chunk != lockedChunk) {
+                    if (lockedChunk) lockedChunk->dataMutex.unlock_shared();
+                    lockedChunk = chunk;
+                    lockedChunk->dataMutex.lock_shared();
                 }
-                CHECK_CODE(left);
-            }
-            { // Right
-                ChunkID id = it.first;
-                int index = (int)cd.index;
-                if ((index & 0x1f) == CHUNK_WIDTH_M1) {
-                    index -= CHUNK_WIDTH_M1;
-                    id.x++;
-                } else {
-                    index++;
-                }
-                CHECK_CODE(right);
-            }
-            { // Bottom
-                ChunkID id = it.first;
-                int index = (int)cd.index;
-                if (index < CHUNK_LAYER) {
-                    index += (CHUNK_SIZE - CHUNK_LAYER);
-                    id.y--;
-                } else {
-                    index -= CHUNK_LAYER;
+                if (bp->operator[](chunk->blocks.get(index)).collide) {
+                    cd.neighborCollideFlags |= (ui8)(1 << d);
                 }
-                CHECK_CODE(bottom);
-            }
-            { // Top
-                ChunkID id = it.first;
-                int index = (int)cd.index;
-                if (index >= CHUNK_SIZE - CHUNK_LAYER) {
-                    index -= (CHUNK_SIZE - CHUNK_LAYER);
-                    id.y++;
-                } else {
-                    index += CHUNK_LAYER;
-                }
-                CHECK_CODE(top);
-            }
-            { // Back
-                ChunkID id = it.first;
-                int index = (int)cd.index;
-                if ((index & 0x3ff) / CHUNK_WIDTH == 0) {
-                    index += (CHUNK_LAYER - CHUNK_WIDTH);
-                    id.z--;
-                } else {
-                    index -= CHUNK_WIDTH_M1;
-                }
-                CHECK_CODE(back);
-            }
-            { // Front
-                ChunkID id = it.first;
-                int index = (int)cd.index;
-                if ((index & 0x3ff) / CHUNK_WIDTH == CHUNK_WIDTH_M1) {
-                    index -= (CHUNK_LAYER - CHUNK_WIDTH);
-                    id.z++;
-                } else {
-                    index += CHUNK_WIDTH_M1;
-                }
-                CHECK_CODE(front);
             }
         }
     }
-    // Release chunk if needed
-    if (chunk.isAquired()) {
-        chunk->dataMutex.unlock();
-        chunk.release();
-    }
-#undef CHECK_CODE
+    if (lockedChunk) lockedChunk->dataMutex.unlock_shared();
+
+    m_neighborhood.release();
 }
@@ -17,6 +17,8 @@
 
 #include <Vorb/ecs/Entity.h>
 
+#include "ChunkNeighborhood.h"
+
 class GameSystem;
 class SpaceSystem;
 struct AabbCollidableComponent;
@@ -27,6 +29,8 @@ class AABBCollidableComponentUpdater {
 
 private:
     void collideWithVoxels(AabbCollidableComponent& cmp, GameSystem* gameSystem, SpaceSystem* spaceSystem);
+
+    ChunkNeighborhood m_neighborhood; ///< Reused so its storage isn't reallocated per component
 };
 
 #endif // AABBCollidableComponentUpdater_h__
@@ -72,6 +72,14 @@ struct BiomeInfluence {
 // TODO(Ben): Make the memory one contiguous block
 typedef std::vector<std::vector<BiomeInfluence>> BiomeInfluenceMap;
 
+/// A base biome that is blended into one cell of the base biome map, merged
+/// from the cell and the three neighbours that are interpolated with it.
+struct BiomeCellInfluence {
+    const Biome* b;
+    f32 weight; ///< Weight in the first corner that has the biome
+    f32 cornerWeights[4]; ///< Weight in each interpolation corner, 0 where absent
+};
+
 // TODO(Ben): Optimize the cache
 struct Biome {
     Biome():id("default"), displayName("Default"), mapColor(255, 255, 255), genData(nullptr){}
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "Chunk.h"
 
+#include "ChunkMesh.h"
 #include "VoxelSpaceConversions.h"
 
 Event<ChunkHandle&> Chunk::DataChange;
@@ -10,24 +11,38 @@ void Chunk::init(WorldCubeFace face) {
     m_chunkPosition.pos = i32v3(m_id.x, m_id.y, m_id.z);
     m_chunkPosition.face = face;
     m_voxelPosition = VoxelSpaceConversions::chunkToVoxel(m_chunkPosition);
+    dirtySections = 0;
+    for (auto& s : borderSections) s = 0;
 }
 
-void Chunk::initAndFillEmpty(WorldCubeFace face, vvox::VoxelStorageState /*= vvox::VoxelStorageState::INTERVAL_TREE*/) {
+void Chunk::initAndFillEmpty(WorldCubeFace face, vvox::VoxelStorageState /*= vvox::VoxelStorageState::UNIFORM*/) {
     init(face);
-    IntervalTree<ui16>::LNode blockNode;
-    IntervalTree<ui16>::LNode tertiaryNode;
-    blockNode.set(0, CHUNK_SIZE, 0);
-    tertiaryNode.set(0, CHUNK_SIZE, 0);
-    blocks.initFromSortedArray(vvox::VoxelStorageState::INTERVAL_TREE, &blockNode, 1);
-    tertiary.initFromSortedArray(vvox::VoxelStorageState::INTERVAL_TREE, &tertiaryNode, 1);
+    blocks.initUniform(0);
+    tertiary.initUniform(0);
 }
 
-void Chunk::setRecyclers(vcore::FixedSizeArrayRecycler<CHUNK_SIZE, ui16>* shortRecycler) {
+void Chunk::setRecyclers(vvox::VoxelArrayRecycler<CHUNK_SIZE, ui16>* shortRecycler) {
     blocks.setArrayRecycler(shortRecycler);
     tertiary.setArrayRecycler(shortRecycler);
 }
 
-void Chunk::updateContainers() {
-    blocks.update(dataMutex);
-    tertiary.update(dataMutex);
-}
\ No newline at end of file
+void Chunk::flagDirty(BlockIndex blockIndex) {
+    isDirty = true;
+    int x = blockIndex % CHUNK_WIDTH;
+    int y = blockIndex / CHUNK_LAYER;
+    int z = (blockIndex % CHUNK_LAYER) / CHUNK_WIDTH;
+
+    // Faces and ambient occlusion of the voxels around it change too
+    int lowSection = glm::max(y - 1, 0) / CHUNK_SECTION_HEIGHT;
+    int highSection = glm::min(y + 1, CHUNK_WIDTH - 1) / CHUNK_SECTION_HEIGHT;
+    ui8 sections = (ui8)(((2 << highSection) - 1) & ~((1 << lowSection) - 1));
+    dirtySections |= sections;
+
+    if (x == 0) borderSections[(int)vvox::Cardinal::X_NEG] |= sections;
+    if (x == CHUNK_WIDTH - 1) borderSections[(int)vvox::Cardinal::X_POS] |= sections;
+    // The neighbor below only sees our bottom layer with its top section, and vice versa
+    if (y == 0) borderSections[(int)vvox::Cardinal::Y_NEG] |= (ui8)(1 << (CHUNK_MESH_SECTIONS - 1));
+    if (y == CHUNK_WIDTH - 1) borderSections[(int)vvox::Cardinal::Y_POS] |= 1;
+    if (z == 0) borderSections[(int)vvox::Cardinal::Z_NEG] |= sections;
+    if (z == CHUNK_WIDTH - 1) borderSections[(int)vvox::Cardinal::Z_POS] |= sections;
+}
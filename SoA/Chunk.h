@@ -16,13 +16,14 @@
 #define NChunk_h__
 
 #include "Constants.h"
+#include "ChunkDataLock.h"
 #include "SmartVoxelContainer.hpp"
 #include "VoxelCoordinateSpaces.h"
 #include "PlanetHeightData.h"
 #include "MetaSection.h"
 #include "ChunkGenerator.h"
 #include "ChunkID.h"
-#include <Vorb/FixedSizeArrayRecycler.hpp>
+#include <atomic>
 
 #if defined(_MSC_VER)
 #define ALIGNED_(x) __declspec(align(x))
@@ -69,9 +70,8 @@ class Chunk {
     // Should be called after ChunkAccessor sets m_id
     void init(WorldCubeFace face);
     // Initializes the chunk and sets all voxel data to 0
-    void initAndFillEmpty(WorldCubeFace face, vvox::VoxelStorageState = vvox::VoxelStorageState::INTERVAL_TREE);
-    void setRecyclers(vcore::FixedSizeArrayRecycler<CHUNK_SIZE, ui16>* shortRecycler);
-    void updateContainers();
+    void initAndFillEmpty(WorldCubeFace face, vvox::VoxelStorageState = vvox::VoxelStorageState::UNIFORM);
+    void setRecyclers(vvox::VoxelArrayRecycler<CHUNK_SIZE, ui16>* shortRecycler);
 
     /************************************************************************/
     /* Getters                                                              */
@@ -79,6 +79,8 @@ class Chunk {
     const ChunkPosition3D& getChunkPosition() const { return m_chunkPosition; }
     const VoxelPosition3D& getVoxelPosition() const { return m_voxelPosition; }
     const ChunkID& getID() const { return m_id; }
+    /// Changes every time the voxel data is written
+    ui32 getUpdateVersion() const { return dataMutex.getVersion(); }
 
     inline ui16 getBlockData(int c) const {
         return blocks.get(c);
@@ -86,12 +88,20 @@ class Chunk {
     inline ui16 getTertiaryData(int c) const {
         return tertiary.get(c);
     }
+    /// Tertiary data is only materialized by the first non-zero write, until then it is all 0
+    /// and can be skipped. Caller should hold dataMutex.
+    inline bool hasTertiaryData() const {
+        return !tertiary.isUniform() || tertiary.getUniformValue() != 0;
+    }
     void setBlock(int x, int y, int z, ui16 id) {
         blocks.set(x + y * CHUNK_LAYER + z * CHUNK_WIDTH, id);
     }
 
     // Marks the chunks as dirty and flags for a re-mesh
     void flagDirty() { isDirty = true; }
+    // Also flags the mesh sections, of this chunk and its neighbors, that can see the voxel.
+    // See CHUNK_MESH_SECTIONS.
+    void flagDirty(BlockIndex blockIndex);
 
     /************************************************************************/
     /* Members                                                              */
@@ -115,17 +125,17 @@ class Chunk {
     bool isDirty;
     f32 distance2; //< Squared distance
     int numBlocks;
-    // TODO(Ben): reader/writer lock
-    std::mutex dataMutex;
+    ChunkDataLock dataMutex; ///< Shared for readers, exclusive for writers
+    std::atomic<ui8> dirtySections; ///< Mesh sections changed since the last remesh, 0 if unknown
+    std::atomic<ui8> borderSections[6]; ///< Mesh sections of each neighbor that border a change
 
     volatile bool isAccessible;
 
     // TODO(Ben): Think about data locality.
     vvox::SmartVoxelContainer<ui16> blocks;
-    vvox::SmartVoxelContainer<ui16> tertiary;
+    vvox::SmartVoxelContainer<ui16> tertiary; ///< Optional, see hasTertiaryData()
     // Block indexes where flora must be generated.
     std::vector<ui16> floraToGenerate;
-    volatile ui32 updateVersion;
 
     ChunkAccessor* accessor;
 
@@ -146,9 +156,8 @@ class Chunk {
     /************************************************************************/
     /* Chunk Handle Data                                                    */
     /************************************************************************/
-    std::mutex m_handleMutex;
-    ALIGNED_(4) volatile ui32 m_handleState;
-    ALIGNED_(4) volatile ui32 m_handleRefCount;
+    std::atomic<ui32> m_handleState;
+    std::atomic<ui32> m_handleRefCount; ///< Only drops to 0 under the accessor's lookup lock
 };
 
 #endif // NChunk_h__
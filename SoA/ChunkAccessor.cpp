@@ -3,12 +3,10 @@
 
 #include "ChunkAllocator.h"
 
-const ui32 HANDLE_STATE_ALIVE = 2;
-#ifdef FAST_CHUNK_ACCESS
 const ui32 HANDLE_STATE_DEAD = 0;
-const ui32 HANDLE_STATE_ACQUIRING = 1;
+const ui32 HANDLE_STATE_ADDING = 1;
+const ui32 HANDLE_STATE_ALIVE = 2;
 const ui32 HANDLE_STATE_FREEING = 3;
-#endif
 
 ChunkHandle::ChunkHandle(const ChunkHandle& other) :
     m_accessor(other.m_acquired ? other.m_chunk->accessor : other.m_accessor),
@@ -25,14 +23,11 @@ ChunkHandle& ChunkHandle::operator= (const ChunkHandle& other) {
 }
 
 void ChunkHandle::acquireSelf() {
-    if (!m_acquired) m_chunk->accessor->acquire(*this);
+    if (!m_acquired) *this = m_accessor->acquire(m_id);
 }
 ChunkHandle ChunkHandle::acquire() {
     if (m_acquired) {
-        ChunkHandle h(m_chunk->accessor->acquire(*this));
-        h.m_acquired = true;
-        h.m_chunk = m_chunk;
-        return h;
+        return m_chunk->accessor->acquire(*this);
     } else {
         return m_accessor->acquire(m_id);
     }
@@ -45,154 +40,158 @@ void ChunkAccessor::init(PagedChunkAllocator* allocator) {
     m_allocator = allocator;
 }
 void ChunkAccessor::destroy() {
-    std::unordered_map<ChunkID, ChunkHandle>().swap(m_chunkLookup);
+    for (auto& shard : m_shards) {
+        std::lock_guard<std::mutex> l(shard.lock);
+        std::unordered_map<ChunkID, Chunk*>().swap(shard.chunks);
+    }
+    m_numAlive = 0;
 }
 
-#ifdef FAST_CHUNK_ACCESS
-
 ChunkHandle ChunkAccessor::acquire(ChunkID id) {
-    std::unique_lock<std::mutex> lMap(m_lckLookup);
-    auto& it = m_chunkLookup.find(id);
-    if (it == m_chunkLookup.end()) {
-        ChunkHandle& h = m_chunkLookup[id];
-        h.m_chunk = m_allocator->alloc();
-        h->m_handleRefCount = 1;
-        h->m_id = id;
-        h->accessor = this;
-        h->m_handleState = HANDLE_STATE_ALIVE;
-        lMap.unlock();
-        onAdd(ChunkHandle(h));
-        return h;
+    LookupShard& shard = getShard(id);
+    ChunkHandle h;
+    bool isNew;
+    {
+        std::lock_guard<std::mutex> l(shard.lock);
+        h = acquireLocked(shard, id, isNew);
+    }
+    if (isNew) {
+        finishAdd(h);
     } else {
-        InterlockedIncrement(&it->second->m_handleRefCount);
-        it->second->m_handleState = HANDLE_STATE_ALIVE;
-        return it->second;
+        waitUntilAdded(h);
     }
+    return h;
 }
-ChunkHandle ChunkAccessor::acquire(ChunkHandle& chunk) {
-    switch (InterlockedCompareExchange(&chunk->m_handleState, HANDLE_STATE_ACQUIRING, HANDLE_STATE_ALIVE)) {
-    case HANDLE_STATE_FREEING:
-        return acquire(chunk->m_id);
-    case HANDLE_STATE_ACQUIRING:
-        InterlockedIncrement(&chunk->m_handleRefCount);
-        return chunk;
-    case HANDLE_STATE_ALIVE:
-        InterlockedIncrement(&chunk->m_handleRefCount);
-        InterlockedCompareExchange(&chunk->m_handleState, HANDLE_STATE_ALIVE, HANDLE_STATE_ACQUIRING);
-        return chunk;
-    default:
-        throw std::invalid_argument("INVALID CHUNK HANDLE STATE");
+void ChunkAccessor::acquire(const ChunkID* ids, size_t count, OUT ChunkHandle* out) {
+    // Group requests by shard, keeping the request index in the low bits
+    static thread_local std::vector<ui64> requests;
+    static thread_local std::vector<bool> isNew;
+    requests.resize(count);
+    isNew.assign(count, false);
+    for (size_t i = 0; i < count; i++) {
+        requests[i] = ((ui64)getShardIndex(ids[i]) << 32) | i;
     }
-}
-void ChunkAccessor::release(ChunkHandle& chunk) {
-    ui32 retries = 0;
-
-    // TODO(Cristian): Heavy thread-safety
-    ui32 currentCount = InterlockedDecrement(&chunk->m_handleRefCount);
-RETEST_CHUNK_LIVELINESS:
-    if (currentCount == 0) {
-        // If the chunk is alive, set it to zombie mode. Otherwise, it's being birthed or already dead.
-        switch (InterlockedCompareExchange(&chunk->m_handleState, HANDLE_STATE_FREEING, HANDLE_STATE_ALIVE)) {
-        case HANDLE_STATE_ALIVE:
-        { // Highlander... there can only be one... killer of chunks
-            std::lock_guard<std::mutex> chunkLock(chunk->m_handleMutex);
-            currentCount = InterlockedDecrement(&chunk->m_handleRefCount);
-            if (chunk->m_handleState == HANDLE_STATE_FREEING) {
-                // We are able to kill this chunk
-                safeRemove(chunk);
-            }
-        }
-        case HANDLE_STATE_FREEING:
-            // Let the other thread do the work
-            break;
-        case HANDLE_STATE_ACQUIRING:
-            // Need to retry
-            std::this_thread::yield();
-            currentCount = chunk->m_handleRefCount;
-            retries++;
-            goto RETEST_CHUNK_LIVELINESS;
-        }
+    std::sort(requests.begin(), requests.end());
+
+    for (size_t i = 0; i < count;) {
+        LookupShard& shard = m_shards[requests[i] >> 32];
+        std::lock_guard<std::mutex> l(shard.lock);
+        do {
+            size_t index = (size_t)(requests[i] & 0xFFFFFFFFu);
+            bool wasAdded;
+            out[index] = acquireLocked(shard, ids[index], wasAdded);
+            isNew[index] = wasAdded;
+            i++;
+        } while (i < count && &m_shards[requests[i] >> 32] == &shard);
     }
 
-    // Invalidate the handle
-    chunk.m_chunk = nullptr;
-    if (retries > 2) {
-        printf("A lot of release retries occurred: %d\n", retries);
-        fflush(stdout);
+    // Finish our own adds before waiting on anyone else's, so two batches can't wait on each other
+    for (size_t i = 0; i < count; i++) {
+        if (isNew[i]) finishAdd(out[i]);
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!isNew[i]) waitUntilAdded(out[i]);
     }
 }
+ChunkHandle ChunkAccessor::tryAcquire(ChunkID id) {
+    LookupShard& shard = getShard(id);
+    ChunkHandle h;
+    {
+        std::lock_guard<std::mutex> l(shard.lock);
+        auto it = shard.chunks.find(id);
+        if (it == shard.chunks.end()) return h;
+        // The count only drops to 0 under this lock, so the chunk can't be dying
+        h.m_chunk = it->second;
+        h.m_id = id;
+        h.m_acquired = true;
+        h->m_handleRefCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    waitUntilAdded(h);
+    return h;
+}
+ChunkHandle ChunkAccessor::acquireLocked(LookupShard& shard, const ChunkID& id, OUT bool& isNew) {
+    ChunkHandle h;
+    h.m_id = id;
+    h.m_acquired = true;
+
+    auto it = shard.chunks.find(id);
+    if (it != shard.chunks.end()) {
+        // The count only drops to 0 under this lock, so the chunk can't be dying
+        h.m_chunk = it->second;
+        h->m_handleRefCount.fetch_add(1, std::memory_order_relaxed);
+        isNew = false;
+        return h;
+    }
 
-#else
-
-ChunkHandle ChunkAccessor::acquire(ChunkID id) {
-    bool wasOld;
-    ChunkHandle chunk = safeAdd(id, wasOld);
-
-    if (wasOld) return acquire(chunk);
-
-    chunk.m_acquired = true;
-    return chunk;
+    // We need to add the chunk. Others can find it now, but wait for finishAdd before using it.
+    h.m_chunk = m_allocator->alloc();
+    h->m_id = id;
+    h->accessor = this;
+    h->m_handleRefCount.store(1, std::memory_order_relaxed);
+    h->m_handleState.store(HANDLE_STATE_ADDING, std::memory_order_relaxed);
+    shard.chunks[id] = h.m_chunk;
+    m_numAlive++;
+    isNew = true;
+    return h;
 }
-ChunkHandle ChunkAccessor::acquire(ChunkHandle& chunk) {
-    std::lock_guard<std::mutex> lChunk(chunk->m_handleMutex);
-    if (chunk->m_handleRefCount == 0) {
-        // We need to re-add the chunk
-        bool wasOld = false;
-        chunk.m_acquired = true;
-        return safeAdd(chunk.m_id, wasOld);
-    } else {
-        ChunkHandle retValue = {};
-        memcpy(&retValue, &chunk, sizeof(ChunkHandle));
-        retValue->m_handleRefCount++;
-        retValue.m_acquired = true;
-        return retValue;
+void ChunkAccessor::finishAdd(ChunkHandle& h) {
+    // Listeners get an unacquired handle
+    ChunkHandle tmp;
+    tmp.m_chunk = h.m_chunk;
+    tmp.m_id = h.m_id;
+    onAdd(tmp);
+    h->m_handleState.store(HANDLE_STATE_ALIVE, std::memory_order_release);
+}
+void ChunkAccessor::waitUntilAdded(ChunkHandle& h) {
+    while (h->m_handleState.load(std::memory_order_acquire) == HANDLE_STATE_ADDING) {
+        std::this_thread::yield();
     }
 }
+ChunkHandle ChunkAccessor::acquire(ChunkHandle& chunk) {
+    // The caller holds a reference, so the chunk can't be freed under us
+    assert(chunk->m_handleState.load(std::memory_order_relaxed) == HANDLE_STATE_ALIVE);
+    chunk->m_handleRefCount.fetch_add(1, std::memory_order_relaxed);
+
+    ChunkHandle h;
+    h.m_chunk = chunk.m_chunk;
+    h.m_id = chunk.m_id;
+    h.m_acquired = true;
+    return h;
+}
 void ChunkAccessor::release(ChunkHandle& chunk) {
-    std::lock_guard<std::mutex> lChunk(chunk->m_handleMutex);
-    chunk->m_handleRefCount--;
-    if (chunk->m_handleRefCount == 0) {
-        // We need to remove the chunk
-        safeRemove(chunk);
-    }
+    Chunk* c = chunk.m_chunk;
+    // Invalidate the handle
     chunk.m_acquired = false;
     chunk.m_accessor = this;
-}
-
-#endif
 
-ChunkHandle ChunkAccessor::safeAdd(ChunkID id, bool& wasOld) {
-    std::unique_lock<std::mutex> l(m_lckLookup);
-    auto it = m_chunkLookup.find(id);
-    if (it == m_chunkLookup.end()) {
-        wasOld = false;
-        ChunkHandle& h = m_chunkLookup[id];
-        h.m_chunk = m_allocator->alloc();
-        h.m_id = id;
-        h->m_id = id;
-        h->accessor = this;
-        h->m_handleState = HANDLE_STATE_ALIVE;
-        h->m_handleRefCount = 1;
-        ChunkHandle tmp(h);
-        l.unlock();
-        onAdd(tmp);
-        return h;
-    } else {
-        wasOld = true;
-        return it->second;
+    // Drop references without locking unless this could be the last one
+    ui32 count = c->m_handleRefCount.load(std::memory_order_relaxed);
+    while (count > 1) {
+        if (c->m_handleRefCount.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+            return;
+        }
     }
-}
-void ChunkAccessor::safeRemove(ChunkHandle& chunk) {
-    { // TODO(Cristian): This needs to be added to a free-list?
-        std::lock_guard<std::mutex> l(m_lckLookup);
 
-        // Make sure it can't be accessed until acquired again
-        chunk->accessor = nullptr;
+    // Someone may acquire by ID before we get the lock, so recheck with the decrement
+    LookupShard& shard = getShard(c->m_id);
+    std::unique_lock<std::mutex> l(shard.lock);
+    if (c->m_handleRefCount.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+    // We need to remove the chunk
+    c->m_handleState.store(HANDLE_STATE_FREEING, std::memory_order_relaxed);
+    // Make sure it can't be accessed until acquired again
+    c->accessor = nullptr;
+    // TODO(Ben): Time based free?
+    shard.chunks.erase(c->m_id);
+    m_numAlive--;
+    l.unlock();
 
-        // TODO(Ben): Time based free?
-        m_chunkLookup.erase(chunk.m_id);
-    }
     // Fire event before deallocating
-    onRemove(chunk);
-    m_allocator->free(chunk.m_chunk);
+    ChunkHandle tmp;
+    tmp.m_chunk = c;
+    tmp.m_id = c->m_id;
+    tmp.m_acquired = true;
+    onRemove(tmp);
+    c->m_handleState.store(HANDLE_STATE_DEAD, std::memory_order_relaxed);
+    m_allocator->free(c);
 }
@@ -8,6 +8,10 @@
 //
 // Summary:
 // Fires events for chunk access
+// Handles are reference counted with atomics and the ID lookup is sharded,
+// so only acquiring by ID and dropping the last reference take a lock.
+// onAdd and onRemove fire with no shard locked, so listeners may take their
+// own locks. A chunk found while its onAdd runs is waited on before it is returned.
 //
 
 #pragma once
@@ -20,6 +24,9 @@
 
 #include <Vorb/Events.hpp>
 
+#define CHUNK_LOOKUP_SHARD_BITS 6
+#define CHUNK_LOOKUP_SHARDS (1 << CHUNK_LOOKUP_SHARD_BITS)
+
 class ChunkAccessor {
     friend class ChunkHandle;
 public:
@@ -27,22 +34,50 @@ class ChunkAccessor {
     void destroy();
 
     ChunkHandle acquire(ChunkID id);
+    /// Acquires many chunks, locking each shard once rather than once per chunk
+    /// @param ids: Chunks to acquire
+    /// @param count: Number of ids
+    /// @param out: Receives an acquired handle for each id, in the same order
+    void acquire(const ChunkID* ids, size_t count, OUT ChunkHandle* out);
+    /// Acquires a chunk only if it is alive, never adding it
+    /// @return An acquired handle, or an unacquired one if there is no such chunk
+    ChunkHandle tryAcquire(ChunkID id);
 
     size_t getCountAlive() const {
-        return m_chunkLookup.size();
+        return m_numAlive;
     }
 
     Event<ChunkHandle&> onAdd; ///< Called when a handle is added
     Event<ChunkHandle&> onRemove; ///< Called when a handle is removed
 private:
+    /// Lookup for a slice of the IDs, so threads only contend when their IDs share a shard
+    struct LookupShard {
+        std::mutex lock;
+        std::unordered_map<ChunkID, Chunk*> chunks;
+    };
+
     ChunkHandle acquire(ChunkHandle& chunk);
     void release(ChunkHandle& chunk);
 
-    ChunkHandle safeAdd(ChunkID id, bool& wasOld);
-    void safeRemove(ChunkHandle& chunk);
+    /// Finds or adds the chunk, shard must be locked
+    /// @param isNew: Set when the chunk was added. finishAdd must be called once the shard
+    /// is unlocked, otherwise waitUntilAdded.
+    ChunkHandle acquireLocked(LookupShard& shard, const ChunkID& id, OUT bool& isNew);
+    /// Fires onAdd for a chunk added by acquireLocked and lets others use it
+    void finishAdd(ChunkHandle& h);
+    /// Waits for another thread's finishAdd of the chunk
+    static void waitUntilAdded(ChunkHandle& h);
+
+    static size_t getShardIndex(const ChunkID& id) {
+        // Neighboring IDs differ in the low bits of each axis, so mix before picking
+        return (size_t)((id.id * 0x9E3779B97F4A7C15ull) >> (64 - CHUNK_LOOKUP_SHARD_BITS));
+    }
+    LookupShard& getShard(const ChunkID& id) {
+        return m_shards[getShardIndex(id)];
+    }
 
-    std::mutex m_lckLookup;
-    std::unordered_map<ChunkID, ChunkHandle> m_chunkLookup;
+    LookupShard m_shards[CHUNK_LOOKUP_SHARDS];
+    std::atomic<size_t> m_numAlive{ 0 };
     PagedChunkAllocator* m_allocator = nullptr;
 };
 
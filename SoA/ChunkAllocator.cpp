@@ -2,41 +2,131 @@
 #include "ChunkAllocator.h"
 #include "Chunk.h"
 
+#ifndef VORB_OS_WINDOWS
+#include <sys/mman.h>
+#endif
+
 #define MAX_VOXEL_ARRAYS_TO_CACHE 200
 #define NUM_SHORT_VOXEL_ARRAYS 3
 #define NUM_BYTE_VOXEL_ARRAYS 1
 
-#define INITIAL_UPDATE_VERSION 1
+#define MAGAZINE_SIZE 64
+// Pages are mapped in multiples of this so they can be backed by huge pages
+#define HUGE_PAGE_BYTES (2 * 1024 * 1024)
+// Comment out to map pages without asking for transparent huge pages
+#define USE_TRANSPARENT_HUGE_PAGES
+
+namespace {
+    // Free lists of live allocators, so a magazine never returns chunks to a destroyed allocator
+    std::mutex lckAllocators;
+    std::unordered_map<ui32, moodycamel::ConcurrentQueue<Chunk*>*> liveAllocators;
+    std::atomic<ui32> nextAllocatorID(1);
+
+    size_t roundToHugePages(size_t bytes) {
+        return ((bytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES) * HUGE_PAGE_BYTES;
+    }
+    ui8* alignToHugePage(ui8* address) {
+        return (ui8*)(((uintptr_t)address + HUGE_PAGE_BYTES - 1) & ~(uintptr_t)(HUGE_PAGE_BYTES - 1));
+    }
+
+    // Maps zeroed memory aligned to HUGE_PAGE_BYTES, bytes must be a multiple of it
+    void* mapPageMemory(size_t bytes) {
+#ifdef VORB_OS_WINDOWS
+        // Large pages need a user privilege, so only ask for normal pages.
+        // VirtualAlloc only aligns to 64KB, so find an aligned range in an oversized
+        // reservation and map exactly there. Another thread may grab it in between.
+        for (int attempt = 0; attempt < 8; attempt++) {
+            ui8* reserved = (ui8*)VirtualAlloc(nullptr, bytes + HUGE_PAGE_BYTES, MEM_RESERVE, PAGE_NOACCESS);
+            if (!reserved) return nullptr;
+            ui8* aligned = alignToHugePage(reserved);
+            VirtualFree(reserved, 0, MEM_RELEASE);
+            void* memory = VirtualAlloc(aligned, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+            if (memory) return memory;
+        }
+        return nullptr;
+#else
+        // Over-map so we can trim to an aligned range
+        size_t mappedBytes = bytes + HUGE_PAGE_BYTES;
+        ui8* mapped = (ui8*)mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED) return nullptr;
+        ui8* aligned = alignToHugePage(mapped);
+        if (aligned != mapped) munmap(mapped, aligned - mapped);
+        size_t tail = (mapped + mappedBytes) - (aligned + bytes);
+        if (tail) munmap(aligned + bytes, tail);
+#if defined(USE_TRANSPARENT_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+        madvise(aligned, bytes, MADV_HUGEPAGE);
+#endif
+        return aligned;
+#endif
+    }
+
+    void unmapPageMemory(void* memory, size_t bytes) {
+#ifdef VORB_OS_WINDOWS
+        VirtualFree(memory, 0, MEM_RELEASE);
+#else
+        munmap(memory, bytes);
+#endif
+    }
+}
+
+struct PagedChunkAllocator::ChunkMagazine {
+    ~ChunkMagazine() {
+        flush();
+    }
+    /// Returns cached chunks to the owning allocator, if it still exists
+    void flush() {
+        if (count == 0) return;
+        std::lock_guard<std::mutex> l(lckAllocators);
+        auto it = liveAllocators.find(ownerID);
+        if (it != liveAllocators.end()) it->second->enqueue_bulk(chunks, count);
+        count = 0;
+    }
+
+    ui32 ownerID = 0;
+    size_t count = 0;
+    Chunk* chunks[MAGAZINE_SIZE];
+};
+
+thread_local PagedChunkAllocator::ChunkMagazine PagedChunkAllocator::m_magazine;
 
 PagedChunkAllocator::PagedChunkAllocator() :
+m_id(nextAllocatorID++),
 m_shortFixedSizeArrayRecycler(MAX_VOXEL_ARRAYS_TO_CACHE * NUM_SHORT_VOXEL_ARRAYS) {
-    // Empty
+    std::lock_guard<std::mutex> l(lckAllocators);
+    liveAllocators[m_id] = &m_freeChunks;
 }
 
 PagedChunkAllocator::~PagedChunkAllocator() {
+    {
+        std::lock_guard<std::mutex> l(lckAllocators);
+        liveAllocators.erase(m_id);
+    }
+    // Our chunks may still sit in this thread's magazine
+    if (m_magazine.ownerID == m_id) m_magazine.count = 0;
+
     for (auto& page : m_chunkPages) {
-        delete page;
+        page->~ChunkPage();
+        unmapPageMemory(page, roundToHugePages(sizeof(ChunkPage)));
     }
 }
 
 Chunk* PagedChunkAllocator::alloc() {
     // TODO(Ben): limit
-    std::lock_guard<std::mutex> lock(m_lock);
-
-    // Allocate chunk pages if needed
-    if (m_freeChunks.empty()) {
-        ChunkPage* page = new ChunkPage();
-        m_chunkPages.push_back(page);
-        // Add chunks to free chunks lists
-        for (size_t i = 0; i < CHUNK_PAGE_SIZE; i++) {
-            Chunk* chunk = &page->chunks[CHUNK_PAGE_SIZE - i - 1];
-            chunk->setRecyclers(&m_shortFixedSizeArrayRecycler);
-            m_freeChunks.push_back(chunk);
+    ChunkMagazine& magazine = getMagazine();
+    if (magazine.count) {
+        m_magazineHits++;
+    } else {
+        // Refill half a magazine so the next few frees don't spill right away
+        magazine.count = m_freeChunks.try_dequeue_bulk(magazine.chunks, MAGAZINE_SIZE / 2);
+        if (magazine.count) {
+            m_freeListHits++;
+        } else {
+            allocPage(magazine);
         }
     }
     // Grab a free chunk
-    Chunk* chunk = m_freeChunks.back();
-    m_freeChunks.pop_back();
+    Chunk* chunk = magazine.chunks[--magazine.count];
+    m_numLiveChunks++;
 
     // Set defaults
     chunk->gridData = nullptr;
@@ -46,19 +136,82 @@ Chunk* PagedChunkAllocator::alloc() {
     chunk->pendingGenLevel = ChunkGenLevel::GEN_NONE;
     chunk->isAccessible = false;
     chunk->distance2 = FLT_MAX;
-    chunk->updateVersion = INITIAL_UPDATE_VERSION;
+    chunk->dataMutex.resetVersion();
     memset(chunk->neighbors, 0, sizeof(chunk->neighbors));
     chunk->m_genQueryData.current = nullptr;
+    chunk->m_genQueryData.numCancellableRequests = 0;
     return chunk;
 }
 
 void PagedChunkAllocator::free(Chunk* chunk) {
     // TODO(Ben): Deletion if there is a lot?
-    std::lock_guard<std::mutex> lock(m_lock);
-    m_freeChunks.push_back(chunk);
-
     // Free data
     chunk->blocks.clear();
     chunk->tertiary.clear();
     std::vector<ChunkQuery*>().swap(chunk->m_genQueryData.pending);
+
+    ChunkMagazine& magazine = getMagazine();
+    if (magazine.count == MAGAZINE_SIZE) {
+        // Spill the older half to the global list
+        m_freeChunks.enqueue_bulk(magazine.chunks, MAGAZINE_SIZE / 2);
+        memmove(magazine.chunks, magazine.chunks + MAGAZINE_SIZE / 2, (MAGAZINE_SIZE / 2) * sizeof(Chunk*));
+        magazine.count = MAGAZINE_SIZE / 2;
+    }
+    magazine.chunks[magazine.count++] = chunk;
+    m_numLiveChunks--;
+}
+
+void PagedChunkAllocator::flushThreadCache() {
+    m_magazine.flush();
+}
+
+ChunkAllocatorStats PagedChunkAllocator::getStats() const {
+    ChunkAllocatorStats stats;
+    stats.numPages = m_numPages;
+    stats.numLiveChunks = m_numLiveChunks;
+    size_t numChunks = stats.numPages * CHUNK_PAGE_SIZE;
+    stats.numFreeChunks = numChunks > stats.numLiveChunks ? numChunks - stats.numLiveChunks : 0;
+    stats.magazineHits = m_magazineHits;
+    stats.freeListHits = m_freeListHits;
+    stats.pageMisses = m_pageMisses;
+    stats.recyclerHits = m_shortFixedSizeArrayRecycler.getHits();
+    stats.recyclerMisses = m_shortFixedSizeArrayRecycler.getMisses();
+    return stats;
+}
+
+PagedChunkAllocator::ChunkMagazine& PagedChunkAllocator::getMagazine() {
+    if (m_magazine.ownerID != m_id) {
+        m_magazine.flush();
+        m_magazine.ownerID = m_id;
+    }
+    return m_magazine;
+}
+
+void PagedChunkAllocator::allocPage(ChunkMagazine& magazine) {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    // Another thread may have mapped a page while we waited
+    magazine.count = m_freeChunks.try_dequeue_bulk(magazine.chunks, MAGAZINE_SIZE / 2);
+    if (magazine.count) {
+        m_freeListHits++;
+        return;
+    }
+    m_pageMisses++;
+
+    size_t bytes = roundToHugePages(sizeof(ChunkPage));
+    void* memory = mapPageMemory(bytes);
+    if (!memory) throw std::bad_alloc();
+    ChunkPage* page = new (memory) ChunkPage();
+    m_chunkPages.push_back(page);
+    m_numPages++;
+
+    // Keep the first chunks for ourselves, free the rest
+    Chunk* chunks[CHUNK_PAGE_SIZE];
+    for (size_t i = 0; i < CHUNK_PAGE_SIZE; i++) {
+        chunks[i] = &page->chunks[i];
+        chunks[i]->setRecyclers(&m_shortFixedSizeArrayRecycler);
+    }
+    magazine.count = MAGAZINE_SIZE / 2;
+    memcpy(magazine.chunks, chunks, magazine.count * sizeof(Chunk*));
+    m_freeChunks.enqueue_bulk(chunks + magazine.count, CHUNK_PAGE_SIZE - magazine.count);
 }
@@ -15,12 +15,30 @@
 #ifndef ChunkAllocator_h__
 #define ChunkAllocator_h__
 
-#include <Vorb/FixedSizeArrayRecycler.hpp>
+#include <atomic>
+#include <Vorb/concurrentqueue.h>
 
 #include "Chunk.h"
 #include "Constants.h"
 
+/// Snapshot of PagedChunkAllocator counters
+struct ChunkAllocatorStats {
+    size_t numPages; ///< Pages mapped
+    size_t numLiveChunks; ///< Chunks handed out and not yet freed
+    size_t numFreeChunks; ///< Chunks in the free list and thread caches
+    size_t magazineHits; ///< Allocations served by the calling thread's cache
+    size_t freeListHits; ///< Cache refills served by the global free list
+    size_t pageMisses; ///< Cache refills that had to map a new page
+    size_t recyclerHits; ///< Voxel arrays reused from the shared recycler
+    size_t recyclerMisses; ///< Voxel arrays the shared recycler had to allocate
+};
+
 /*! @brief The chunk allocator.
+ *
+ * Each thread keeps a small magazine of free chunks, so most alloc/free
+ * pairs touch no shared state. Magazines refill from and spill to a
+ * lock-free global free list, and only mapping a new page takes a lock.
+ * Pages are mapped aligned to 2MB so they can be backed by huge pages.
  */
 class PagedChunkAllocator {
     friend class SphericalVoxelComponentUpdater;
@@ -36,16 +54,39 @@ class PagedChunkAllocator {
     Chunk* alloc();
     /// Frees a chunk
     void free(Chunk* chunk);
+
+    /// Returns the chunks cached by the calling thread to their allocator's free list.
+    /// Threads flush when they exit, call this from threads that are done allocating
+    /// but keep running, so their cached chunks can be reused elsewhere.
+    static void flushThreadCache();
+
+    /// Gets allocation counters, values may be slightly stale under contention
+    ChunkAllocatorStats getStats() const;
 protected:
     static const size_t CHUNK_PAGE_SIZE = 2048;
     struct ChunkPage {
         Chunk chunks[CHUNK_PAGE_SIZE];
     };
+    struct ChunkMagazine;
 
-    std::vector<Chunk*> m_freeChunks; ///< List of inactive chunks
+    /// Gets this thread's magazine, returning chunks cached for another allocator
+    ChunkMagazine& getMagazine();
+    /// Maps a new page, keeps some chunks in magazine and frees the rest
+    void allocPage(ChunkMagazine& magazine);
+
+    static thread_local ChunkMagazine m_magazine; ///< Free chunks cached by this thread
+
+    ui32 m_id; ///< Identifies this allocator to thread magazines
+    moodycamel::ConcurrentQueue<Chunk*> m_freeChunks; ///< List of inactive chunks
     std::vector<ChunkPage*> m_chunkPages; ///< All pages
-    vcore::FixedSizeArrayRecycler<CHUNK_SIZE, ui16> m_shortFixedSizeArrayRecycler; ///< For recycling voxel data
-    std::mutex m_lock; ///< Lock access to free-list
+    vvox::VoxelArrayRecycler<CHUNK_SIZE, ui16> m_shortFixedSizeArrayRecycler; ///< For recycling voxel data
+    std::mutex m_lock; ///< Lock for mapping pages
+
+    std::atomic<size_t> m_numPages{ 0 };
+    std::atomic<size_t> m_numLiveChunks{ 0 };
+    std::atomic<size_t> m_magazineHits{ 0 };
+    std::atomic<size_t> m_freeListHits{ 0 };
+    std::atomic<size_t> m_pageMisses{ 0 };
 };
 
 #endif // ChunkAllocator_h__
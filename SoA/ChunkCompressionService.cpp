@@ -0,0 +1,127 @@
+#include "stdafx.h"
+#include "ChunkCompressionService.h"
+
+#include "Chunk.h"
+#include "ChunkGrid.h"
+
+#include <algorithm>
+#include <chrono>
+#include <shared_mutex>
+
+#define COMPRESSION_PERIOD_MS 250
+// Periods a container must go without heavy access before it may be compressed
+#define MIN_QUIET_PERIODS 4
+// Compressions per pass, so a pass after a big memory drop still finishes quickly
+#define MAX_COMPRESSIONS_PER_PASS 512
+
+namespace {
+    struct ColdContainer {
+        vvox::SmartVoxelContainer<ui16>* container;
+        ChunkDataLock* dataLock;
+        int quietPeriods;
+    };
+}
+
+void ChunkCompressionService::init(ChunkGrid* grids, size_t numGrids, size_t memoryTarget /*= DEFAULT_VOXEL_MEMORY_TARGET*/) {
+    m_grids = grids;
+    m_numGrids = numGrids;
+    m_memoryTarget = memoryTarget;
+    m_memoryUsage = 0;
+    m_isRunning = true;
+    m_thread = std::thread(&ChunkCompressionService::workerThread, this);
+}
+
+void ChunkCompressionService::dispose() {
+    {
+        std::lock_guard<std::mutex> l(m_lock);
+        m_isRunning = false;
+    }
+    m_cond.notify_one();
+    if (m_thread.joinable()) m_thread.join();
+    m_grids = nullptr;
+    m_numGrids = 0;
+}
+
+void ChunkCompressionService::workerThread() {
+#ifdef VORB_OS_WINDOWS
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#endif
+    std::unique_lock<std::mutex> l(m_lock);
+    while (m_isRunning) {
+        l.unlock();
+        runPass();
+        l.lock();
+        m_cond.wait_for(l, std::chrono::milliseconds(COMPRESSION_PERIOD_MS), [this] () { return !m_isRunning; });
+    }
+}
+
+void ChunkCompressionService::runPass() {
+    // The active list only holds unacquired handles, so copy the IDs out and take our own
+    // references without holding it. Chunks freed in between are skipped, not recreated.
+    std::vector<ChunkHandle> chunks;
+    std::vector<ChunkID> ids;
+    for (size_t i = 0; i < m_numGrids; i++) {
+        ids.clear();
+        for (const ChunkHandle& h : m_grids[i].acquireActiveChunks()) {
+            ids.push_back(h.getID());
+        }
+        m_grids[i].releaseActiveChunks();
+
+        chunks.reserve(chunks.size() + ids.size());
+        for (const ChunkID& id : ids) {
+            ChunkHandle h = m_grids[i].accessor.tryAcquire(id);
+            if (h.isAquired()) chunks.push_back(std::move(h));
+        }
+    }
+
+    // Age everything and decompress containers that are being written to.
+    // Only the service touches the aging counters outside of writes, so a shared lock will do.
+    std::vector<ColdContainer> coldContainers;
+    size_t memoryUsage = 0;
+    for (auto& chunk : chunks) {
+        if (chunk->genLevel != ChunkGenLevel::GEN_DONE) continue;
+        vvox::SmartVoxelContainer<ui16>* containers[2] = { &chunk->blocks, &chunk->tertiary };
+        for (auto& container : containers) {
+            int quietPeriods;
+            bool isHot;
+            {
+                std::shared_lock<ChunkDataLock> l(chunk->dataMutex);
+                quietPeriods = container->age();
+                isHot = quietPeriods == 0 && container->getState() != vvox::VoxelStorageState::FLAT_ARRAY &&
+                    !container->isUniform();
+            }
+            if (isHot) container->changeState(vvox::VoxelStorageState::FLAT_ARRAY, chunk->dataMutex.metadata());
+            {
+                std::shared_lock<ChunkDataLock> l(chunk->dataMutex);
+                memoryUsage += container->getMemoryUsage();
+                if (container->getState() != vvox::VoxelStorageState::FLAT_ARRAY) continue;
+            }
+            if (quietPeriods >= MIN_QUIET_PERIODS) {
+                coldContainers.push_back({ container, &chunk->dataMutex, quietPeriods });
+            }
+        }
+    }
+
+    // Compress the coldest containers until we are under the target
+    size_t memoryTarget = m_memoryTarget;
+    if (memoryUsage > memoryTarget) {
+        std::sort(coldContainers.begin(), coldContainers.end(), [] (const ColdContainer& a, const ColdContainer& b) {
+            return a.quietPeriods > b.quietPeriods;
+        });
+        size_t numCompressions = 0;
+        for (auto& c : coldContainers) {
+            if (memoryUsage <= memoryTarget || !m_isRunning || numCompressions >= MAX_COMPRESSIONS_PER_PASS) break;
+            if (c.container->compressAsync(c.dataLock->metadata())) {
+                numCompressions++;
+                std::shared_lock<ChunkDataLock> l(*c.dataLock);
+                memoryUsage -= CHUNK_SIZE * sizeof(ui16) - c.container->getMemoryUsage();
+            }
+            std::this_thread::yield();
+        }
+    }
+    m_memoryUsage = memoryUsage;
+
+    for (auto& chunk : chunks) {
+        chunk.release();
+    }
+}
@@ -0,0 +1,61 @@
+///
+/// ChunkCompressionService.h
+/// Seed of Andromeda
+///
+/// Copyright 2014 Regrowth Studios
+/// MIT License
+///
+/// Summary:
+/// Low priority worker that keeps voxel memory near a target by
+/// compressing the coldest chunks off the update thread.
+///
+
+#pragma once
+
+#ifndef ChunkCompressionService_h__
+#define ChunkCompressionService_h__
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class ChunkGrid;
+
+#define DEFAULT_VOXEL_MEMORY_TARGET (256 * 1024 * 1024)
+
+class ChunkCompressionService {
+public:
+    /// Starts the worker thread
+    /// @param grids: Grids whose active chunks are managed
+    /// @param numGrids: Number of grids
+    /// @param memoryTarget: Bytes of voxel data to keep chunks under
+    void init(ChunkGrid* grids, size_t numGrids, size_t memoryTarget = DEFAULT_VOXEL_MEMORY_TARGET);
+    /// Stops and joins the worker thread. Must be called before the grids are destroyed.
+    void dispose();
+
+    void setMemoryTarget(size_t memoryTarget) { m_memoryTarget = memoryTarget; }
+
+    /// Getters
+    size_t getMemoryTarget() const { return m_memoryTarget; }
+    /// @return Voxel memory measured at the end of the last pass
+    size_t getMemoryUsage() const { return m_memoryUsage; }
+private:
+    void workerThread();
+    /// Ages every container, decompresses hot ones and compresses the coldest
+    /// until memory is below the target
+    void runPass();
+
+    ChunkGrid* m_grids = nullptr;
+    size_t m_numGrids = 0;
+
+    std::atomic<size_t> m_memoryTarget{ DEFAULT_VOXEL_MEMORY_TARGET };
+    std::atomic<size_t> m_memoryUsage{ 0 };
+
+    std::thread m_thread;
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    std::atomic<bool> m_isRunning{ false };
+};
+
+#endif // ChunkCompressionService_h__
@@ -0,0 +1,108 @@
+///
+/// ChunkDataLock.h
+/// Seed of Andromeda
+///
+/// Copyright 2014 Regrowth Studios
+/// MIT License
+///
+/// Summary:
+/// Reader/writer lock for chunk voxel data with a sequence
+/// counter, so readers can detect writes made between reads.
+///
+
+#pragma once
+
+#ifndef ChunkDataLock_h__
+#define ChunkDataLock_h__
+
+#include <atomic>
+#include <shared_mutex>
+#include <thread>
+
+// Versions are even while no write is in progress
+#define INITIAL_UPDATE_VERSION 2
+
+/// Exclusive lock on chunk data that doesn't count as a write. For work that
+/// leaves voxel values unchanged, such as compression and aging.
+class ChunkMetadataLock {
+public:
+    ChunkMetadataLock(std::shared_timed_mutex& mutex) : m_mutex(mutex) {}
+
+    void lock() { m_mutex.lock(); }
+    bool try_lock() { return m_mutex.try_lock(); }
+    void unlock() { m_mutex.unlock(); }
+private:
+    std::shared_timed_mutex& m_mutex;
+};
+
+/// Use std::lock_guard / std::unique_lock for writers and std::shared_lock for readers.
+/// Exclusive locks taken through lock() count as writes and bump the version, use
+/// metadata() for exclusive access that doesn't change voxel values.
+class ChunkDataLock {
+public:
+    /************************************************************************/
+    /* Writers                                                              */
+    /************************************************************************/
+    void lock() {
+        m_mutex.lock();
+        m_version.fetch_add(1, std::memory_order_acq_rel);
+    }
+    bool try_lock() {
+        if (!m_mutex.try_lock()) return false;
+        m_version.fetch_add(1, std::memory_order_acq_rel);
+        return true;
+    }
+    void unlock() {
+        m_version.fetch_add(1, std::memory_order_release);
+        m_mutex.unlock();
+    }
+
+    /// @return Lock that excludes readers and writers without bumping the version
+    ChunkMetadataLock& metadata() { return m_metadata; }
+
+    /************************************************************************/
+    /* Readers                                                              */
+    /************************************************************************/
+    void lock_shared() {
+        m_mutex.lock_shared();
+    }
+    bool try_lock_shared() {
+        return m_mutex.try_lock_shared();
+    }
+    void unlock_shared() {
+        m_mutex.unlock_shared();
+    }
+
+    /************************************************************************/
+    /* Sequence                                                             */
+    /************************************************************************/
+    /// Starts a read that may be retried, waiting out any write in progress.
+    /// @return Version to pass to readRetry
+    ui32 readBegin() const {
+        ui32 version = m_version.load(std::memory_order_acquire);
+        while (version & 1) {
+            std::this_thread::yield();
+            version = m_version.load(std::memory_order_acquire);
+        }
+        return version;
+    }
+    /// @return true if the data was written since readBegin returned version
+    bool readRetry(ui32 version) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return m_version.load(std::memory_order_relaxed) != version;
+    }
+    /// @return The current version, odd while a write is in progress
+    ui32 getVersion() const {
+        return m_version.load(std::memory_order_acquire);
+    }
+    /// Resets the version, only call while nobody else can access the data
+    void resetVersion() {
+        m_version.store(INITIAL_UPDATE_VERSION, std::memory_order_relaxed);
+    }
+private:
+    std::shared_timed_mutex m_mutex;
+    std::atomic<ui32> m_version{ INITIAL_UPDATE_VERSION };
+    ChunkMetadataLock m_metadata{ m_mutex };
+};
+
+#endif // ChunkDataLock_h__
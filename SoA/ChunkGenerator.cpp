@@ -5,12 +5,14 @@
 #include "Chunk.h"
 #include "ChunkHandle.h"
 #include "ChunkGrid.h"
+#include "HeightmapCache.h"
 
 void ChunkGenerator::init(vcore::ThreadPool<WorkerData>* threadPool,
                           PlanetGenData* genData,
-                          ChunkGrid* grid) {
+                          ChunkGrid* grid,
+                          OPT HeightSampleCache* sampleCache /*= nullptr*/) {
     m_threadPool = threadPool;
-    m_proceduralGenerator.init(genData);
+    m_proceduralGenerator.init(genData, sampleCache);
     m_grid = grid;
 }
 
@@ -34,10 +36,11 @@ void ChunkGenerator::submitQuery(ChunkQuery* query) {
         if (!chunk.gridData->isLoading) {
             // Send heightmap gen query
             chunk.gridData->isLoading = true;
-            m_threadPool->addTask(&query->genTask);
+            addTask(&query->genTask);
         }
         // Store as a pending query
         m_pendingQueries[chunk.gridData].push_back(query);
+        m_numWaiting++;
     } else {
         if (chunk.m_genQueryData.current) {
             // Only one gen query should be active at a time so just store this one
@@ -45,20 +48,74 @@ void ChunkGenerator::submitQuery(ChunkQuery* query) {
         } else {
             // Submit for generation
             chunk.m_genQueryData.current = query;
-            m_threadPool->addTask(&query->genTask);
+            addTask(&query->genTask);
         }
     }
 }
 
+void ChunkGenerator::generateHeightmap(Chunk* chunk, PlanetHeightData* heightData) {
+    // Skip generation if the column was generated before
+    HeightmapCache* cache = m_grid->m_heightmapCache;
+    if (cache && cache->load(chunk->gridData->gridPosition, heightData)) return;
+    m_proceduralGenerator.generateHeightmap(chunk, heightData);
+}
+
+void ChunkGenerator::addTask(GenerateTask* task, size_t numQueries /*= 1*/) {
+    m_numActive += numQueries;
+    m_threadPool->addTask(task);
+}
+
+void ChunkGenerator::submitColumn(std::vector<ChunkQuery*>& queries) {
+    std::vector<ChunkQuery*> column;
+    column.reserve(queries.size());
+    for (auto& q : queries) {
+        // Chunks may have left range while the heightmap generated
+        if (m_grid->tryCancel(q)) continue;
+        Chunk& chunk = q->chunk;
+        // Anything that isn't a plain terrain gen takes the normal path
+        if (chunk.genLevel >= q->genLevel || chunk.m_genQueryData.current ||
+            (q->genLevel != GEN_TERRAIN && q->genLevel != GEN_DONE)) {
+            submitQuery(q);
+            continue;
+        }
+        if (chunk.pendingGenLevel < q->genLevel) {
+            chunk.pendingGenLevel = q->genLevel;
+        }
+        chunk.m_genQueryData.current = q;
+        column.push_back(q);
+    }
+
+    if (column.size() == 1) {
+        addTask(&column[0]->genTask);
+    } else if (column.size() > 1) {
+        GenerateTask& task = column[0]->genTask;
+        size_t numQueries = column.size();
+        task.initColumn(column);
+        addTask(&task, numQueries);
+    }
+}
+
 void ChunkGenerator::finishQuery(ChunkQuery* query) {
+    m_numActive--;
     m_finishedQueries.enqueue(query);
 }
 
 // Updates finished queries
 void ChunkGenerator::update() {
 #define MAX_QUERIES 100
+// Bounds a frame's work while workers keep finishing queries
+#define MAX_QUERIES_PER_UPDATE 2000
     ChunkQuery* queries[MAX_QUERIES];
-    size_t numQueries = m_finishedQueries.try_dequeue_bulk(queries, MAX_QUERIES);
+    size_t numDrained = 0;
+    size_t numQueries;
+    while (numDrained < MAX_QUERIES_PER_UPDATE &&
+           (numQueries = m_finishedQueries.try_dequeue_bulk(queries, MAX_QUERIES)) > 0) {
+        numDrained += numQueries;
+        updateQueries(queries, numQueries);
+    }
+}
+
+void ChunkGenerator::updateQueries(ChunkQuery** queries, size_t numQueries) {
     for (size_t i = 0; i < numQueries; i++) {
         ChunkQuery* q = queries[i];
         Chunk& chunk = q->chunk;
@@ -71,11 +128,11 @@ void ChunkGenerator::update() {
 
             // Submit all the pending queries on this grid data
             auto it = m_pendingQueries.find(chunk.gridData); // TODO(Ben): Should this be shared? ( I don't think it should )
-            for (auto& p : it->second) {
-                submitQuery(p);
-            }
+            m_numWaiting -= it->second.size();
+            submitColumn(it->second);
             m_pendingQueries.erase(it);
         } else if (chunk.genLevel == GEN_DONE) {
+            if (q->isCancellable && chunk.m_genQueryData.numCancellableRequests == 0) m_grid->m_numWasted++;
             // If the chunk is done generating, we can signal all queries as done.
             for (auto& q2 : chunk.m_genQueryData.pending) {
                 q2->m_isFinished = true;
@@ -113,7 +170,7 @@ void ChunkGenerator::update() {
                 q = chunk.m_genQueryData.pending.back();
                 chunk.m_genQueryData.pending.pop_back();
                 chunk.m_genQueryData.current = q;
-                m_threadPool->addTask(&q->genTask);
+                addTask(&q->genTask);
             }
             // Notify listeners that this chunk is finished
             onGenFinish(q->chunk, q->genLevel);
@@ -17,6 +17,8 @@
 
 #include <Vorb/ThreadPool.h>
 
+#include <atomic>
+
 #include "VoxPool.h"
 #include "ProceduralChunkGenerator.h"
 #include "PlanetGenData.h"
@@ -26,6 +28,7 @@
 class PagedChunkAllocator;
 class ChunkGridData;
 class ChunkGrid;
+class HeightSampleCache;
 
 // Data stored in Chunk and used only by ChunkGenerator
 struct ChunkGenQueryData {
@@ -35,6 +38,7 @@ struct ChunkGenQueryData {
 private:
     ChunkQuery* current = nullptr;
     std::vector<ChunkQuery*> pending;
+    std::atomic<i32> numCancellableRequests{ 0 }; ///< Cancellable queries whose requester still wants the chunk
 };
 
 class ChunkGenerator {
@@ -42,20 +46,41 @@ class ChunkGenerator {
 public:
     void init(vcore::ThreadPool<WorkerData>* threadPool,
               PlanetGenData* genData,
-              ChunkGrid* grid);
+              ChunkGrid* grid,
+              OPT HeightSampleCache* sampleCache = nullptr);
     void submitQuery(ChunkQuery* query);
     void finishQuery(ChunkQuery* query);
-    // Updates finished queries
+    // Updates finished queries. Generators of one grid may be updated in parallel.
     void update();
 
+    /// Queue depths, safe to read from any thread
+    /// @return Queries scheduled on the thread pool
+    size_t getActiveDepth() const { return m_numActive; }
+    /// @return Queries finished but not yet drained by update()
+    size_t getFinishedDepth() const { return m_finishedQueries.size_approx(); }
+    /// @return Queries waiting on a heightmap
+    size_t getWaitingDepth() const { return m_numWaiting; }
+
     Event<ChunkHandle&, ChunkGenLevel> onGenFinish;
 private:
+    /// Loads the column's heightmap from the grid's cache, or generates it. Called by workers.
+    void generateHeightmap(Chunk* chunk, PlanetHeightData* heightData);
+    /// Schedules the gen task of a query that will call finishQuery numQueries times
+    void addTask(GenerateTask* task, size_t numQueries = 1);
+
+    /// Submits the queries waiting on a freshly loaded heightmap, generating
+    /// their terrain as one vertical column task where possible.
+    void submitColumn(std::vector<ChunkQuery*>& queries);
+    void updateQueries(ChunkQuery** queries, size_t numQueries);
     void tryFlagMeshableNeighbors(ChunkHandle& ch);
     void flagMeshbleNeighbor(ChunkHandle& n, ui32 bit);
 
     moodycamel::ConcurrentQueue<ChunkQuery*> m_finishedQueries;
     std::map < ChunkGridData*, std::vector<ChunkQuery*> >m_pendingQueries; ///< Queries waiting on height map
 
+    std::atomic<size_t> m_numActive{ 0 };
+    std::atomic<size_t> m_numWaiting{ 0 };
+
     ChunkGrid* m_grid = nullptr;
     ProceduralChunkGenerator m_proceduralGenerator;
     vcore::ThreadPool<WorkerData>* m_threadPool = nullptr;
@@ -2,21 +2,59 @@
 #include "ChunkGrid.h"
 #include "Chunk.h"
 #include "ChunkAllocator.h"
+#include "HeightmapCache.h"
 #include "soaUtils.h"
 
 #include <Vorb/utils.h>
 
+#include <algorithm>
+#include <thread>
+
+// Finished queries needed before draining generators on more than one thread
+#define PARALLEL_DRAIN_THRESHOLD 256
+// Queries a generator may have in flight. Keeps the thread pool shallow so
+// the closest chunks are generated first.
+#define MAX_ACTIVE_QUERIES_PER_GENERATOR 64
+// Value of m_nextDrain between updates, stale drain tasks can't claim anything from it
+#define NO_DRAIN ((size_t)1 << (sizeof(size_t) * 8 - 2))
+
+/// Helps the update thread drain generators
+class GeneratorDrainTask : public vcore::IThreadPoolTask<WorkerData> {
+public:
+    GeneratorDrainTask(ChunkGrid* grid) : m_grid(grid) {
+        m_grid->m_numDrainTasks++;
+    }
+    ~GeneratorDrainTask() {
+        m_grid->m_numDrainTasks--;
+    }
+
+    void execute(WorkerData* workerData VORB_MAYBE_UNUSED) override {
+        m_grid->drainGenerators();
+    }
+    void cleanup() override {
+        delete this;
+    }
+private:
+    ChunkGrid* m_grid;
+};
+
 void ChunkGrid::init(WorldCubeFace face,
                       OPT vcore::ThreadPool<WorkerData>* threadPool,
                       ui32 generatorsPerRow,
                       PlanetGenData* genData,
-                      PagedChunkAllocator* allocator) {
+                      PagedChunkAllocator* allocator,
+                      OPT HeightmapCache* heightmapCache /*= nullptr*/,
+                      OPT HeightSampleCache* sampleCache /*= nullptr*/) {
     m_face = face;
+    m_heightmapCache = heightmapCache;
+    m_threadPool = threadPool;
+    m_nextDrain = NO_DRAIN;
     this->generatorsPerRow = generatorsPerRow;
     numGenerators = generatorsPerRow * generatorsPerRow;
     generators = new ChunkGenerator[numGenerators];
+    m_queuedQueries.resize(numGenerators);
     for (ui32 i = 0; i < numGenerators; i++) {
-        generators[i].init(threadPool, genData, this);
+        generators[i].init(threadPool, genData, this, sampleCache);
     }
     accessor.init(allocator);
     accessor.onAdd += makeDelegate(*this, &ChunkGrid::onAccessorAdd);
@@ -28,11 +66,14 @@ void ChunkGrid::init(WorldCubeFace face,
 void ChunkGrid::dispose() {
     accessor.onAdd -= makeDelegate(*this, &ChunkGrid::onAccessorAdd);
     accessor.onRemove -= makeDelegate(*this, &ChunkGrid::onAccessorRemove);
+    // Queued drain tasks point at us
+    while (m_numDrainTasks) std::this_thread::yield();
     delete[] generators;
     generators = nullptr;
 }
 
-ChunkQuery* ChunkGrid::submitQuery(const i32v3& chunkPos, ChunkGenLevel genLevel, bool shouldRelease) {
+ChunkQuery* ChunkGrid::submitQuery(const i32v3& chunkPos, ChunkGenLevel genLevel, bool shouldRelease,
+                                   OPT ChunkHandle* outChunk /*= nullptr*/, bool isCancellable /*= false*/) {
     ChunkQuery* query;
     {
         std::lock_guard<std::mutex> l(m_lckQueryRecycler);
@@ -41,15 +82,17 @@ ChunkQuery* ChunkGrid::submitQuery(const i32v3& chunkPos, ChunkGenLevel genLevel
     query->chunkPos = chunkPos;
     query->genLevel = genLevel;
     query->shouldRelease = shouldRelease;
+    query->isCancellable = isCancellable && shouldRelease;
     query->grid = this;
     query->m_isFinished = false;
 
     ChunkID id(query->chunkPos);
     query->chunk = accessor.acquire(id);
+    if (query->isCancellable) query->chunk->m_genQueryData.numCancellableRequests++;
+    // Once enqueued the query can finish and release its chunk on another thread,
+    // so the caller's handle has to be acquired first
+    if (outChunk) *outChunk = query->chunk.acquire();
     m_queries.enqueue(query);
-    // TODO(Ben): RACE CONDITION HERE: There is actually a very small chance that
-    // chunk will get freed before the callee can acquire the chunk, if this runs
-    // on another thread.
     return query;
 }
 
@@ -62,6 +105,21 @@ void ChunkGrid::releaseQuery(ChunkQuery* query) {
     }
 }
 
+void ChunkGrid::cancelQueries(ChunkHandle& chunk) {
+    std::atomic<i32>& numRequests = chunk->m_genQueryData.numCancellableRequests;
+    i32 n = numRequests.load(std::memory_order_relaxed);
+    while (n > 0 && !numRequests.compare_exchange_weak(n, n - 1, std::memory_order_relaxed)) {
+        // Retry
+    }
+}
+
+void ChunkGrid::setPriorityCenter(const i32v3& chunkPos) {
+    if (chunkPos != m_priorityCenter) {
+        m_priorityCenter = chunkPos;
+        m_isPriorityDirty = true;
+    }
+}
+
 ChunkGridData* ChunkGrid::getChunkGridData(const i32v2& gridPos) {
     std::lock_guard<std::mutex> l(m_lckGridData);
     auto it = m_chunkGridDataMap.find(gridPos);
@@ -69,9 +127,16 @@ ChunkGridData* ChunkGrid::getChunkGridData(const i32v2& gridPos) {
     return it->second;
 }
 
+ChunkGenerator& ChunkGrid::getGenerator(const i32v2& gridPos) {
+    i32 n = (i32)generatorsPerRow;
+    // Positive modulo so negative coordinates interleave the same way
+    i32 x = ((gridPos.x % n) + n) % n;
+    i32 y = ((gridPos.y % n) + n) % n;
+    return generators[y * n + x];
+}
+
 void ChunkGrid::update() {
-    // TODO(Ben): Handle generator distribution
-    generators[0].update();
+    updateGenerators();
 
     /* Update Queries */
     // Needs to be big so we can flush it every frame.
@@ -80,15 +145,105 @@ void ChunkGrid::update() {
     size_t numQueries = m_queries.try_dequeue_bulk(queries, MAX_QUERIES);
     for (size_t i = 0; i < numQueries; i++) {
         ChunkQuery* q = queries[i];
-        // TODO(Ben): Handle generator distribution
-        q->genTask.init(q, q->chunk->gridData->heightData, &generators[0]);
-        generators[0].submitQuery(q);
+        if (tryCancel(q)) continue;
+        // A column always goes to the same generator, which owns its pending queries
+        ChunkGenerator& generator = getGenerator(q->chunk->gridData->gridPosition.pos);
+        std::vector<QueuedQuery>& heap = m_queuedQueries[&generator - generators];
+        heap.push_back({ getPriority(q), q });
+        std::push_heap(heap.begin(), heap.end());
     }
+    // Reprioritize after the center moves
+    if (m_isPriorityDirty) {
+        for (auto& heap : m_queuedQueries) {
+            for (auto& e : heap) {
+                e.priority = getPriority(e.query);
+            }
+            std::make_heap(heap.begin(), heap.end());
+        }
+        m_isPriorityDirty = false;
+    }
+    dispatchQueries();
     
     // Place any needed nodes
     nodeSetter.update();
 }
 
+void ChunkGrid::dispatchQueries() {
+    size_t numQueued = 0;
+    for (ui32 i = 0; i < numGenerators; i++) {
+        ChunkGenerator& generator = generators[i];
+        std::vector<QueuedQuery>& heap = m_queuedQueries[i];
+        // The rest wait for the next update once the generator is full
+        while (heap.size() && generator.getActiveDepth() < MAX_ACTIVE_QUERIES_PER_GENERATOR) {
+            std::pop_heap(heap.begin(), heap.end());
+            ChunkQuery* q = heap.back().query;
+            heap.pop_back();
+            if (tryCancel(q)) continue;
+            q->genTask.init(q, q->chunk->gridData->heightData, &generator);
+            generator.submitQuery(q);
+        }
+        numQueued += heap.size();
+    }
+    m_numQueued = numQueued;
+}
+
+bool ChunkGrid::tryCancel(ChunkQuery* query) {
+    if (!query->isCancellable || query->chunk->m_genQueryData.numCancellableRequests > 0) return false;
+    m_numCancelled++;
+    query->chunk.release();
+    query->release();
+    return true;
+}
+
+i32 ChunkGrid::getPriority(const ChunkQuery* query) const {
+    i32v3 d = query->chunkPos - m_priorityCenter;
+    return d.x * d.x + d.y * d.y + d.z * d.z;
+}
+
+void ChunkGrid::updateGenerators() {
+    size_t numFinished = 0;
+    ui32 numBusy = 0;
+    for (ui32 i = 0; i < numGenerators; i++) {
+        size_t depth = generators[i].getFinishedDepth();
+        numFinished += depth;
+        if (depth) numBusy++;
+    }
+    if (!m_threadPool || numBusy < 2 || numFinished < PARALLEL_DRAIN_THRESHOLD) {
+        for (ui32 i = 0; i < numGenerators; i++) {
+            generators[i].update();
+        }
+        return;
+    }
+
+    // Generators own disjoint columns, so they can drain at the same time.
+    // This thread drains too, so it never waits on tasks that haven't started.
+    m_drainOrder.clear();
+    for (ui32 i = 0; i < numGenerators; i++) {
+        if (generators[i].getFinishedDepth()) m_drainOrder.push_back(i);
+    }
+    size_t numDrains = m_drainOrder.size();
+    m_numDrains.store(numDrains, std::memory_order_relaxed);
+    m_numDrained.store(0, std::memory_order_relaxed);
+    m_nextDrain.store(0, std::memory_order_release);
+    // Tasks still queued from earlier updates will help as well
+    for (size_t i = m_numDrainTasks; i < numDrains - 1; i++) {
+        m_threadPool->addTask(new GeneratorDrainTask(this));
+    }
+    drainGenerators();
+    while (m_numDrained.load(std::memory_order_acquire) < numDrains) {
+        std::this_thread::yield();
+    }
+    m_nextDrain.store(NO_DRAIN, std::memory_order_relaxed);
+}
+
+void ChunkGrid::drainGenerators() {
+    size_t i;
+    while ((i = m_nextDrain.fetch_add(1, std::memory_order_acq_rel)) < m_numDrains.load(std::memory_order_relaxed)) {
+        generators[m_drainOrder[i]].update();
+        m_numDrained.fetch_add(1, std::memory_order_release);
+    }
+}
+
 void ChunkGrid::onAccessorAdd(Sender s VORB_MAYBE_UNUSED, ChunkHandle& chunk) {
     { // Add to active list
         std::lock_guard<std::mutex> l(m_lckActiveChunks);
@@ -132,6 +287,9 @@ void ChunkGrid::onAccessorRemove(Sender s VORB_MAYBE_UNUSED, ChunkHandle& chunk)
         if (chunk->gridData->refCount == 0) {
             m_chunkGridDataMap.erase(chunk->getChunkPosition());
             l.unlock();
+            if (m_heightmapCache && chunk->gridData->isLoaded) {
+                m_heightmapCache->store(chunk->gridData->gridPosition, chunk->gridData->heightData);
+            }
             delete chunk->gridData;
             chunk->gridData = nullptr;
         }
@@ -28,25 +28,48 @@
 
 #include "VoxelNodeSetter.h"
 
+// Each face splits its columns across this many generators squared
+#define VOXEL_GENERATORS_PER_ROW 2
+
 class BlockPack;
+class HeightmapCache;
+class HeightSampleCache;
 
 class ChunkGrid {
+    friend class ChunkGenerator;
     friend class ChunkMeshManager;
+    friend class GeneratorDrainTask;
 public:
     void init(WorldCubeFace face,
               OPT vcore::ThreadPool<WorkerData>* threadPool,
               ui32 generatorsPerRow,
               PlanetGenData* genData,
-              PagedChunkAllocator* allocator);
+              PagedChunkAllocator* allocator,
+              OPT HeightmapCache* heightmapCache = nullptr,
+              OPT HeightSampleCache* sampleCache = nullptr);
     void dispose();
 
     /// Will generate chunk if it doesn't exist
     /// @param gridPos: The position of the chunk to get.
     /// @param genLevel: The required generation level.
-    /// @param shouldRelease: Will automatically release when true.
-    ChunkQuery* submitQuery(const i32v3& chunkPos, ChunkGenLevel genLevel, bool shouldRelease);
+    /// @param shouldRelease: Will automatically release when true. The query may then be
+    /// recycled before this returns, so use outChunk rather than the returned query.
+    /// @param outChunk: Optional handle to the chunk, acquired before the query is submitted.
+    /// @param isCancellable: The query may be dropped by cancelQueries() before it generates.
+    /// Only applies when shouldRelease is true.
+    ChunkQuery* submitQuery(const i32v3& chunkPos, ChunkGenLevel genLevel, bool shouldRelease,
+                            OPT ChunkHandle* outChunk = nullptr, bool isCancellable = false);
     /// Releases and recycles a query.
     void releaseQuery(ChunkQuery* query);
+    /// Withdraws one cancellable query the caller submitted for a chunk. Once every
+    /// requester has withdrawn, the chunk's cancellable queries that haven't started
+    /// generating are dropped. A later cancellable submitQuery for the chunk undoes this.
+    void cancelQueries(ChunkHandle& chunk);
+
+    /// Queries are handed to the generators closest first. Call from the
+    /// thread that updates the grid.
+    /// @param chunkPos: Chunk position to prioritize around
+    void setPriorityCenter(const i32v3& chunkPos);
 
     /// Gets a chunkGridData for a specific 2D position
     /// @param gridPos: The grid position for the data
@@ -55,6 +78,11 @@ class ChunkGrid {
     // Processes chunk queries and set active chunks
     void update();
 
+    /// Gets the generator that owns a chunk column. Columns are interleaved
+    /// across generators so neighboring columns are generated independently.
+    /// @param gridPos: The grid position of the column
+    ChunkGenerator& getGenerator(const i32v2& gridPos);
+
     // Locks and gets active chunks. Must call releaseActiveChunks() later.
     const std::vector<ChunkHandle>& acquireActiveChunks() { 
         m_lckActiveChunks.lock(); 
@@ -62,6 +90,14 @@ class ChunkGrid {
     }
     void releaseActiveChunks() { m_lckActiveChunks.unlock(); }
 
+    /// Metrics, safe to read from any thread
+    /// @return Queries waiting for room in a generator
+    size_t getQueuedDepth() const { return m_numQueued; }
+    /// @return Queries dropped before generating
+    size_t getCancelledCount() const { return m_numCancelled; }
+    /// @return Chunks that finished generating after they were cancelled
+    size_t getWastedCount() const { return m_numWasted; }
+
     ChunkGenerator* generators = nullptr;
     ui32 generatorsPerRow;
     ui32 numGenerators;
@@ -80,7 +116,39 @@ class ChunkGrid {
     void onAccessorAdd(Sender s, ChunkHandle& chunk);
     void onAccessorRemove(Sender s, ChunkHandle& chunk);
 
+    /// Drains the finished queries of every generator, in parallel when there are many
+    void updateGenerators();
+    /// Claims and drains generators in m_drainOrder until none are left. Called by
+    /// the update thread and by drain tasks on the thread pool.
+    void drainGenerators();
+    /// Hands each generator its queued queries closest first, while it has room
+    void dispatchQueries();
+    /// Releases the query if it was cancelled
+    /// @return true if it was
+    bool tryCancel(ChunkQuery* query);
+    i32 getPriority(const ChunkQuery* query) const;
+
+    struct QueuedQuery {
+        i32 priority; ///< Lower goes first
+        ChunkQuery* query;
+        bool operator<(const QueuedQuery& o) const { return priority > o.priority; }
+    };
+
     moodycamel::ConcurrentQueue<ChunkQuery*> m_queries;
+    std::vector<std::vector<QueuedQuery>> m_queuedQueries; ///< Heap per generator of queries not yet given to it
+    i32v3 m_priorityCenter = i32v3(0);
+    bool m_isPriorityDirty = false;
+
+    vcore::ThreadPool<WorkerData>* m_threadPool = nullptr;
+    std::vector<ui32> m_drainOrder; ///< Generators to drain this update
+    std::atomic<size_t> m_numDrains{ 0 }; ///< Size of m_drainOrder
+    std::atomic<size_t> m_nextDrain; ///< Next index of m_drainOrder to claim
+    std::atomic<size_t> m_numDrained{ 0 }; ///< Generators finished draining this update
+    std::atomic<size_t> m_numDrainTasks{ 0 }; ///< Drain tasks that haven't been destroyed
+
+    std::atomic<size_t> m_numQueued{ 0 };
+    std::atomic<size_t> m_numCancelled{ 0 };
+    std::atomic<size_t> m_numWasted{ 0 };
 
     std::mutex m_lckActiveChunks;
     std::vector<ChunkHandle> m_activeChunks;
@@ -91,6 +159,8 @@ class ChunkGrid {
     
     vcore::IDGenerator<ChunkID> m_idGenerator;
 
+    HeightmapCache* m_heightmapCache = nullptr; ///< Keeps heightmaps of released grid data
+
     std::mutex m_lckQueryRecycler;
     PtrRecycler<ChunkQuery> m_queryRecycler;
 
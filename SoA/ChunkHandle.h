@@ -30,7 +30,8 @@ class ChunkHandle {
     }
     ChunkHandle(const ChunkHandle& other);
     ChunkHandle& operator= (const ChunkHandle& other);
-    ChunkHandle(ChunkHandle&& other) :
+    // noexcept so containers move rather than copy, copies are never acquired
+    ChunkHandle(ChunkHandle&& other) noexcept :
         m_chunk(other.m_chunk),
         m_id(other.m_id),
         m_acquired(other.m_acquired) {
@@ -39,7 +40,7 @@ class ChunkHandle {
         other.m_chunk = nullptr;
         other.m_id = 0;
     }
-    ChunkHandle& operator= (ChunkHandle&& other) {
+    ChunkHandle& operator= (ChunkHandle&& other) noexcept {
         m_acquired = other.m_acquired;
         m_chunk = other.m_chunk;
         m_id = other.m_id;
@@ -23,6 +23,20 @@ ChunkMeshData::ChunkMeshData(MeshTaskType type) : type(type) {
     // Empty
 }
 
+void ChunkMeshData::clear() {
+    chunkMeshRenderData = ChunkMeshRenderData();
+    opaqueQuads.clear();
+    transQuads.clear();
+    cutoutQuads.clear();
+    waterVertices.clear();
+    packedOpaqueVertices.clear();
+    opaquePalette.clear();
+    type = MeshTaskType::DEFAULT;
+    transVertIndex = 0;
+    transQuadPositions.clear();
+    transQuadIndices.clear();
+}
+
 void ChunkMeshData::addTransQuad(const i8v3& pos) {
     transQuadPositions.push_back(pos);
 
@@ -2,8 +2,11 @@
 #include "Vertex.h"
 #include "BlockTextureMethods.h"
 #include "ChunkHandle.h"
+#include "Constants.h"
 #include <Vorb/io/Keg.h>
 #include <Vorb/graphics/gtypes.h>
+#include <memory>
+#include <mutex>
 
 enum class MeshType {
     NONE, 
@@ -89,6 +92,8 @@ class ChunkMeshData
     ChunkMeshData(MeshTaskType type);
 
     void addTransQuad(const i8v3& pos);
+    /// Empties the mesh but keeps the capacity of every buffer, for reuse
+    void clear();
 
     ChunkMeshRenderData chunkMeshRenderData;
 
@@ -97,6 +102,9 @@ class ChunkMeshData
     std::vector <VoxelQuad> transQuads;
     std::vector <VoxelQuad> cutoutQuads;
     std::vector <LiquidVertex> waterVertices;
+    // Used instead of opaqueQuads when the mesh was packed
+    std::vector <PackedBlockVertex> packedOpaqueVertices;
+    std::vector <BlockVertexPaletteEntry> opaquePalette;
     MeshTaskType type;
 
     //*** Transparency info for sorting ***
@@ -105,7 +113,24 @@ class ChunkMeshData
     std::vector <ui32> transQuadIndices;
 };
 
+// Chunks are remeshed in horizontal slabs of CHUNK_SECTION_HEIGHT layers when edited
+#define CHUNK_MESH_SECTIONS 8
+#define CHUNK_SECTION_HEIGHT (CHUNK_WIDTH / CHUNK_MESH_SECTIONS)
+#define CHUNK_SECTIONS_ALL 0xFF
+
+/// Quads of an edited chunk split by section and kept between meshes, so that
+/// only the sections that changed have to be meshed again. Quads never span sections.
+class ChunkMeshSections {
+public:
+    std::mutex lock; ///< Held for a whole mesh task, which also keeps meshes in order
+    std::vector<VoxelQuad> quads[CHUNK_MESH_SECTIONS][6]; ///< Opaque quads per face
+    std::vector<VoxelQuad> floraQuads[CHUNK_MESH_SECTIONS];
+    bool isValid = false; ///< False until every section was meshed once
+};
+
 #define ACTIVE_MESH_INDEX_NONE UINT_MAX
+// Coarsest level of detail, meshed at 4x4x4 voxels per block
+#define MAX_CHUNK_MESH_LOD 2
 
 class ChunkMesh
 {
@@ -135,10 +160,16 @@ class ChunkMesh
         VGVertexArray vaos[4];
     };
 
+    VGTexture paletteTextureID = 0; ///< Palette of the packed opaque vertices
+    bool isPacked = false; ///< True if vboID holds PackedBlockVertex
+
     f64 distance2 = 32.0;
     f64v3 position;
     ui32 activeMeshesIndex = ACTIVE_MESH_INDEX_NONE; ///< Index into active meshes array
     ui32 updateVersion;
+    ui8 lodLevel = 0; ///< Level of detail of the newest mesh task
+    ChunkHandle chunk; ///< Acquired while the mesh exists, so it can be remeshed when lodLevel changes
+    std::shared_ptr<ChunkMeshSections> sections; ///< Only kept for edited chunks at lodLevel 0
     bool inFrustum = false;
     bool needsSort = true;
     ChunkID id;
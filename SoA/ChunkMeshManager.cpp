@@ -5,10 +5,15 @@
 #include "ChunkMeshTask.h"
 #include "ChunkMesher.h"
 #include "ChunkRenderer.h"
+#include "SoaOptions.h"
 #include "SpaceSystemComponents.h"
 #include "soaUtils.h"
 
 #define MAX_UPDATES_PER_FRAME 300
+// Enough for a frame of uploads, more would only hold on to memory
+#define MAX_POOLED_MESH_DATA MAX_UPDATES_PER_FRAME
+// How far past a band edge a mesh has to move before its level changes
+#define LOD_HYSTERESIS (f64)CHUNK_WIDTH
 
 ChunkMeshManager::ChunkMeshManager(vcore::ThreadPool<WorkerData>* threadPool, BlockPack* blockPack) {
     m_threadPool = threadPool;
@@ -30,7 +35,7 @@ void ChunkMeshManager::update(const f64v3& cameraPosition, bool shouldSort) {
     {
         std::lock_guard<std::mutex> l(m_lckPendingMesh);
         for (auto it = m_pendingMesh.begin(); it != m_pendingMesh.end();) {
-            ChunkMeshTask* task = createMeshTask(it->second);
+            ChunkMeshTask* task = createMeshTask(it->second.chunk);
             if (task) {
                 {
                     std::lock_guard<std::mutex> l(m_lckActiveChunks);
@@ -38,10 +43,23 @@ void ChunkMeshManager::update(const f64v3& cameraPosition, bool shouldSort) {
                     auto iter=m_activeChunks.find(it->first);
 
                     assert(iter!=m_activeChunks.end());
-                    iter->second->updateVersion = it->second->updateVersion;
+                    ChunkMesh* mesh = iter->second;
+                    mesh->updateVersion = it->second.chunk->getUpdateVersion();
+                    // New meshes don't have a distance yet, so the level is picked here too
+                    f64v3 closestPoint = getClosestPointOnAABB(cameraPosition, mesh->position, f64v3(CHUNK_WIDTH));
+                    mesh->lodLevel = getLodLevel(selfDot(closestPoint - cameraPosition), mesh->lodLevel);
+                    task->lodLevel = mesh->lodLevel;
+                    // Edited chunks keep their sections, so further edits only remesh what they touch
+                    if (mesh->lodLevel == 0 && (mesh->sections || it->second.dirtySections != CHUNK_SECTIONS_ALL)) {
+                        if (!mesh->sections) mesh->sections = std::make_shared<ChunkMeshSections>();
+                        task->sections = mesh->sections;
+                        task->dirtySections = it->second.dirtySections;
+                    } else {
+                        mesh->sections.reset();
+                    }
                 }
                 m_threadPool->addTask(task);
-                it->second.release();
+                it->second.chunk.release();
                 m_pendingMesh.erase(it++);
             } else {
                 ++it;
@@ -51,6 +69,8 @@ void ChunkMeshManager::update(const f64v3& cameraPosition, bool shouldSort) {
 
     // TODO(Ben): This is redundant with the chunk manager! Find a way to share! (Pointer?)
     updateMeshDistances(cameraPosition);
+    // Picked up with the other pending meshes next frame
+    if (m_lodRemeshes.size()) queueLodRemeshes();
     if (shouldSort) {
         
     }
@@ -60,6 +80,11 @@ void ChunkMeshManager::destroy() {
     std::vector <ChunkMesh*>().swap(m_activeChunkMeshes);
     moodycamel::ConcurrentQueue<ChunkMeshUpdateMessage>().swap(m_messages);
     std::unordered_map<ChunkID, ChunkMesh*>().swap(m_activeChunks);
+    {
+        std::lock_guard<std::mutex> l(m_lckMeshDataPool);
+        for (auto& meshData : m_meshDataPool) delete meshData;
+        std::vector<ChunkMeshData*>().swap(m_meshDataPool);
+    }
 }
 
 ChunkMesh* ChunkMeshManager::createMesh(ChunkHandle& h) {
@@ -69,6 +94,8 @@ ChunkMesh* ChunkMeshManager::createMesh(ChunkHandle& h) {
         mesh = m_meshRecycler.create();
     }
     mesh->id = h.getID();
+    mesh->chunk = h.acquire();
+    mesh->lodLevel = 0;
 
     // Set the position
     mesh->position = h->m_voxelPosition;
@@ -77,6 +104,8 @@ ChunkMesh* ChunkMeshManager::createMesh(ChunkHandle& h) {
     memset(mesh->vbos, 0, sizeof(mesh->vbos));
     memset(mesh->vaos, 0, sizeof(mesh->vaos));
     mesh->transIndexID = 0;
+    mesh->paletteTextureID = 0;
+    mesh->isPacked = false;
     mesh->activeMeshesIndex = ACTIVE_MESH_INDEX_NONE;
 
     { // Register chunk as active and give it a mesh
@@ -104,8 +133,17 @@ ChunkMeshTask* ChunkMeshManager::createMeshTask(ChunkHandle& chunk) {
         back->genLevel != GEN_DONE || front->genLevel != GEN_DONE ||
         bottom->genLevel != GEN_DONE || top->genLevel != GEN_DONE) return nullptr;
 
-    // TODO(Ben): Recycler
-    ChunkMeshTask* meshTask = new ChunkMeshTask;
+    ChunkMeshTask* meshTask;
+    {
+        std::lock_guard<std::mutex> l(m_lckTaskRecycler);
+        meshTask = m_taskRecycler.create();
+        if (m_numPooledTasks) {
+            m_numPooledTasks--;
+            m_poolStats.tasksReused++;
+        } else {
+            m_poolStats.tasksAllocated++;
+        }
+    }
     meshTask->init(chunk, MeshTaskType::DEFAULT, m_blockPack, this);
 
     // Set dependencies
@@ -118,11 +156,63 @@ ChunkMeshTask* ChunkMeshManager::createMeshTask(ChunkHandle& chunk) {
     return meshTask;
 }
 
+ChunkMeshData* ChunkMeshManager::acquireMeshData() {
+    std::lock_guard<std::mutex> l(m_lckMeshDataPool);
+    if (m_meshDataPool.empty()) {
+        m_poolStats.meshDataAllocated++;
+        return new ChunkMeshData(MeshTaskType::DEFAULT);
+    }
+    ChunkMeshData* meshData = m_meshDataPool.back();
+    m_meshDataPool.pop_back();
+    m_poolStats.meshDataReused++;
+    return meshData;
+}
+
+void ChunkMeshManager::recycleMeshTask(ChunkMeshTask* task) {
+    std::lock_guard<std::mutex> l(m_lckTaskRecycler);
+    m_taskRecycler.recycle(task);
+    m_numPooledTasks++;
+}
+
+ChunkMeshPoolStats ChunkMeshManager::getPoolStats() {
+    std::lock_guard<std::mutex> l(m_lckTaskRecycler);
+    std::lock_guard<std::mutex> l2(m_lckMeshDataPool);
+    ChunkMeshPoolStats stats = m_poolStats;
+    stats.tasksPooled = m_numPooledTasks;
+    stats.meshDataPooled = m_meshDataPool.size();
+    return stats;
+}
+
+void ChunkMeshManager::recycleMeshData(ChunkMeshData* meshData) {
+    std::lock_guard<std::mutex> l(m_lckMeshDataPool);
+    if (m_meshDataPool.size() >= MAX_POOLED_MESH_DATA) {
+        m_poolStats.meshDataDeleted++;
+        delete meshData;
+        return;
+    }
+    meshData->clear();
+    m_meshDataPool.push_back(meshData);
+}
+
+void ChunkMeshManager::addPendingMesh(ChunkHandle& chunk, ui8 dirtySections) {
+    auto it = m_pendingMesh.find(chunk.getID());
+    if (it != m_pendingMesh.end()) {
+        it->second.dirtySections |= dirtySections;
+    } else {
+        PendingChunkMesh& pending = m_pendingMesh[chunk.getID()];
+        pending.chunk = chunk.acquire();
+        pending.dirtySections = dirtySections;
+    }
+}
+
 void ChunkMeshManager::disposeMesh(ChunkMesh* mesh) {
     // De-allocate buffer objects
     glDeleteBuffers(4, mesh->vbos);
     glDeleteVertexArrays(4, mesh->vaos);
     if (mesh->transIndexID) glDeleteBuffers(1, &mesh->transIndexID);
+    if (mesh->paletteTextureID) glDeleteTextures(1, &mesh->paletteTextureID);
+    // Tasks in flight keep their own reference
+    mesh->sections.reset();
 
     { // Remove from mesh list
         std::lock_guard<std::mutex> l(lckActiveChunkMeshes);
@@ -146,7 +236,7 @@ void ChunkMeshManager::updateMesh(ChunkMeshUpdateMessage& message) {
         std::lock_guard<std::mutex> l(m_lckActiveChunks);
         auto it = m_activeChunks.find(message.chunkID);
         if (it == m_activeChunks.end()) {
-            delete message.meshData;
+            recycleMeshData(message.meshData);
             return; /// The mesh was already released, so ignore!
         }
         mesh = it->second;
@@ -171,8 +261,7 @@ void ChunkMeshManager::updateMesh(ChunkMeshUpdateMessage& message) {
         }
     }
 
-    // TODO(Ben): come on...
-    delete message.meshData;
+    recycleMeshData(message.meshData);
 }
 
 void ChunkMeshManager::updateMeshDistances(const f64v3& cameraPosition) {
@@ -184,9 +273,38 @@ void ChunkMeshManager::updateMeshDistances(const f64v3& cameraPosition) {
         f64v3 closestPoint = getClosestPointOnAABB(cameraPosition, mesh->position, CHUNK_DIMS);
         // Omit sqrt for faster calculation
         mesh->distance2 = selfDot(closestPoint - cameraPosition);
+
+        // Remeshed in the background, the old level is drawn until then
+        ui8 lodLevel = getLodLevel(mesh->distance2, mesh->lodLevel);
+        if (lodLevel != mesh->lodLevel) {
+            mesh->lodLevel = lodLevel;
+            m_lodRemeshes.push_back(mesh->id);
+        }
     }
 }
 
+void ChunkMeshManager::queueLodRemeshes() {
+    std::lock_guard<std::mutex> l(m_lckPendingMesh);
+    std::lock_guard<std::mutex> l2(m_lckActiveChunks);
+    for (auto& id : m_lodRemeshes) {
+        // Could have been released since
+        auto it = m_activeChunks.find(id);
+        if (it == m_activeChunks.end()) continue;
+        addPendingMesh(it->second->chunk, CHUNK_SECTIONS_ALL);
+    }
+    m_lodRemeshes.clear();
+}
+
+ui8 ChunkMeshManager::getLodLevel(f64 distance2, ui8 currentLevel) {
+    f64 threshold = soaOptions.get(OPT_VOXEL_LOD_THRESHOLD).value.f;
+    if (threshold <= 0.0) return 0;
+    // Level n starts n thresholds away
+    f64 distance = sqrt(distance2);
+    ui8 minLevel = (ui8)glm::min(glm::max(distance - LOD_HYSTERESIS, 0.0) / threshold, (f64)MAX_CHUNK_MESH_LOD);
+    ui8 maxLevel = (ui8)glm::min((distance + LOD_HYSTERESIS) / threshold, (f64)MAX_CHUNK_MESH_LOD);
+    return (ui8)glm::clamp(currentLevel, minLevel, maxLevel);
+}
+
 void ChunkMeshManager::onAddSphericalVoxelComponent(Sender s VORB_MAYBE_UNUSED, SphericalVoxelComponent& cmp, vecs::EntityID e VORB_MAYBE_UNUSED) {
     for (ui32 i = 0; i < 6; i++) {
         for (ui32 j = 0; j < cmp.chunkGrids[i].numGenerators; j++) {
@@ -213,7 +331,7 @@ void ChunkMeshManager::onGenFinish(Sender s VORB_MAYBE_UNUSED, ChunkHandle& chun
     // Check if can be meshed.
     if (chunk->genLevel == GEN_DONE && chunk->neighbor.left.isAquired() && chunk->numBlocks) {
         std::lock_guard<std::mutex> l(m_lckPendingMesh);
-        m_pendingMesh.emplace(chunk.getID(), chunk.acquire());
+        addPendingMesh(chunk, CHUNK_SECTIONS_ALL);
     }
 }
 
@@ -222,7 +340,7 @@ void ChunkMeshManager::onNeighborsAcquire(Sender s VORB_UNUSED, ChunkHandle& chu
     // Check if can be meshed.
     if (chunk->genLevel == GEN_DONE && chunk->numBlocks) {
         std::lock_guard<std::mutex> l(m_lckPendingMesh);
-        m_pendingMesh.emplace(chunk.getID(), chunk.acquire());
+        addPendingMesh(chunk, CHUNK_SECTIONS_ALL);
     }
 }
 
@@ -239,11 +357,12 @@ void ChunkMeshManager::onNeighborsRelease(Sender s VORB_MAYBE_UNUSED, ChunkHandl
             m_activeChunks.erase(it);
         }
     }
+    mesh->chunk.release();
     {
         std::lock_guard<std::mutex> l(m_lckPendingMesh);
         auto it = m_pendingMesh.find(chunk.getID());
         if (it != m_pendingMesh.end()) {
-            it->second.release();
+            it->second.chunk.release();
             m_pendingMesh.erase(it);
         }
     }
@@ -255,7 +374,21 @@ void ChunkMeshManager::onDataChange(Sender s VORB_MAYBE_UNUSED, ChunkHandle& chu
     // Have to have neighbors
     // TODO(Ben): Race condition with neighbor removal here.
     if (chunk->neighbor.left.isAquired()) {
+        ui8 dirtySections = chunk->dirtySections.exchange(0);
         std::lock_guard<std::mutex> l(m_lckPendingMesh);
-        m_pendingMesh.emplace(chunk.getID(), chunk.acquire());
+        // Nothing was flagged, so anything could have changed
+        addPendingMesh(chunk, dirtySections ? dirtySections : CHUNK_SECTIONS_ALL);
+
+        // Neighbors are only remeshed if the change touched their border
+        for (int i = 0; i < 6; i++) {
+            ui8 borderSections = chunk->borderSections[i].exchange(0);
+            if (!borderSections) continue;
+            ChunkHandle& neighbor = chunk->neighbors[i];
+            // Without a mesh it will be fully meshed once it gets one
+            std::lock_guard<std::mutex> l2(m_lckActiveChunks);
+            if (m_activeChunks.find(neighbor.getID()) != m_activeChunks.end()) {
+                addPendingMesh(neighbor, borderSections);
+            }
+        }
     }
 }
@@ -19,9 +19,25 @@
 #include "Vorb/concurrentqueue.h"
 #include "Chunk.h"
 #include "ChunkMesh.h"
+#include "ChunkMeshTask.h"
 #include "SpaceSystemAssemblages.h"
 #include <mutex>
 
+struct ChunkMeshPoolStats {
+    size_t tasksAllocated = 0;
+    size_t tasksReused = 0;
+    size_t tasksPooled = 0; ///< Currently waiting for reuse
+    size_t meshDataAllocated = 0;
+    size_t meshDataReused = 0;
+    size_t meshDataDeleted = 0; ///< Returned while the pool was full
+    size_t meshDataPooled = 0; ///< Currently waiting for reuse
+};
+
+struct PendingChunkMesh {
+    ChunkHandle chunk;
+    ui8 dirtySections; ///< See ChunkMeshTask::dirtySections
+};
+
 struct ChunkMeshUpdateMessage {
     ChunkID chunkID;
     ChunkMeshData* meshData = nullptr;
@@ -37,6 +53,13 @@ class ChunkMeshManager {
     /// Destroys all meshes
     void destroy();
 
+    /// Gets an empty ChunkMeshData, reusing the buffers of uploaded meshes. Thread safe.
+    ChunkMeshData* acquireMeshData();
+    /// Returns a finished task to the pool. Thread safe.
+    void recycleMeshTask(ChunkMeshTask* task);
+    /// Thread safe
+    ChunkMeshPoolStats getPoolStats();
+
     // Be sure to lock lckActiveChunkMeshes
     const std::vector <ChunkMesh*>& getChunkMeshes() { return m_activeChunkMeshes; }
     std::mutex lckActiveChunkMeshes;
@@ -46,13 +69,23 @@ class ChunkMeshManager {
     ChunkMesh* createMesh(ChunkHandle& h);
 
     ChunkMeshTask* createMeshTask(ChunkHandle& chunk);
+    /// Queues chunk for meshing, or adds dirtySections if it already is. Lock m_lckPendingMesh first.
+    void addPendingMesh(ChunkHandle& chunk, ui8 dirtySections);
 
     void disposeMesh(ChunkMesh* mesh);
+    /// Keeps meshData for acquireMeshData, or deletes it if the pool is full
+    void recycleMeshData(ChunkMeshData* meshData);
 
     /// Uploads a mesh and adds to list if needed
     void updateMesh(ChunkMeshUpdateMessage& message);
 
     void updateMeshDistances(const f64v3& cameraPosition);
+    /// Queues the meshes in m_lodRemeshes for meshing at their new level
+    void queueLodRemeshes();
+
+    /// Picks the level of detail for a mesh distance2 away from the camera. Stays at
+    /// currentLevel close to band edges so meshes don't flip between levels.
+    static ui8 getLodLevel(f64 distance2, ui8 currentLevel);
 
     /************************************************************************/
     /* Event Handlers                                                       */
@@ -74,12 +107,19 @@ class ChunkMeshManager {
     vcore::ThreadPool<WorkerData>* m_threadPool = nullptr;
 
     std::mutex m_lckPendingMesh;
-    std::map<ChunkID, ChunkHandle> m_pendingMesh;
+    std::map<ChunkID, PendingChunkMesh> m_pendingMesh;
 
     std::mutex m_lckMeshRecycler;
     PtrRecycler<ChunkMesh> m_meshRecycler;
+    std::mutex m_lckTaskRecycler;
+    PtrRecycler<ChunkMeshTask> m_taskRecycler;
+    size_t m_numPooledTasks = 0;
+    std::mutex m_lckMeshDataPool;
+    std::vector<ChunkMeshData*> m_meshDataPool;
+    ChunkMeshPoolStats m_poolStats; ///< Task counts are guarded by m_lckTaskRecycler, the rest by m_lckMeshDataPool
     std::mutex m_lckActiveChunks;
     std::unordered_map<ChunkID, ChunkMesh*> m_activeChunks; ///< Stores chunk IDs that have meshes
+    std::vector<ChunkID> m_lodRemeshes; ///< Meshes that changed distance band this frame
 };
 
 #endif // ChunkMeshManager_h__
@@ -7,8 +7,10 @@
 #include "BlockPack.h"
 #include "ChunkMeshManager.h"
 #include "ChunkMesher.h"
+#include "ChunkRenderer.h"
 #include "GameManager.h"
 #include "Chunk.h"
+#include "SoaOptions.h"
 #include "VoxelLightEngine.h"
 #include "VoxelUtils.h"
 
@@ -26,6 +28,17 @@ void ChunkMeshTask::execute(WorkerData* workerData) {
         workerData->chunkMesher = new ChunkMesher;
         workerData->chunkMesher->init(blockPack);
     }
+    // Picked per task so the backends can be A/B compared at runtime
+    workerData->chunkMesher->backend = soaOptions.get(OPT_VOXEL_BINARY_MESHER).value.b ?
+        ChunkMesherBackend::BINARY_GREEDY : ChunkMesherBackend::DEFAULT;
+    workerData->chunkMesher->usePackedVertices = soaOptions.get(OPT_VOXEL_PACKED_VERTICES).value.b &&
+        ChunkRenderer::isPackedSupported;
+    workerData->chunkMesher->lodLevel = lodLevel;
+    workerData->chunkMesher->sections = sections.get();
+    workerData->chunkMesher->dirtySections = dirtySections;
+    // Held until the mesh is sent, so tasks of one chunk can't reorder its meshes
+    std::unique_lock<std::mutex> l;
+    if (sections) l = std::unique_lock<std::mutex>(sections->lock);
     // Prepare message
     ChunkMeshUpdateMessage msg;
     msg.chunkID = chunk.getID();
@@ -34,14 +47,24 @@ void ChunkMeshTask::execute(WorkerData* workerData) {
     workerData->chunkMesher->prepareDataAsync(chunk, neighborHandles);
 
     // Create the actual mesh
-    msg.meshData = workerData->chunkMesher->createChunkMeshData(type);
+    msg.meshData = workerData->chunkMesher->createChunkMeshData(type, meshManager->acquireMeshData());
 
     // Send it for update
     meshManager->sendMessage(msg);
 }
 
+void ChunkMeshTask::cleanup() {
+    // Don't keep the sections alive while pooled
+    sections.reset();
+    meshManager->recycleMeshTask(this);
+}
+
 void ChunkMeshTask::init(ChunkHandle& ch, MeshTaskType cType, const BlockPack* blockPack, ChunkMeshManager* meshManager) {
     type = cType;
+    // Tasks are pooled, so reset everything that is optional
+    lodLevel = 0;
+    sections.reset();
+    dirtySections = CHUNK_SECTIONS_ALL;
     chunk = ch.acquire();
     this->blockPack = blockPack;
     this->meshManager = meshManager;
@@ -18,13 +18,12 @@
 #include <Vorb/IThreadPoolTask.h>
 
 #include "ChunkHandle.h"
+#include "ChunkMesh.h"
 #include "Constants.h"
 #include "VoxPool.h"
 
 class Chunk;
 class ChunkGridData;
-class ChunkMesh;
-class ChunkMeshData;
 class ChunkMeshManager;
 class VoxelLightEngine;
 class BlockPack;
@@ -51,10 +50,16 @@ class ChunkMeshTask : public vcore::IThreadPoolTask<WorkerData> {
     // Executes the task
     void execute(WorkerData* workerData) override;
 
+    // Returns the task to the mesh manager's pool
+    void cleanup() override;
+
     // Initializes the task
     void init(ChunkHandle& ch, MeshTaskType cType, const BlockPack* blockPack, ChunkMeshManager* meshManager);
 
     MeshTaskType type; 
+    ui8 lodLevel = 0; ///< See ChunkMesher::lodLevel
+    std::shared_ptr<ChunkMeshSections> sections; ///< See ChunkMesher::sections
+    ui8 dirtySections = CHUNK_SECTIONS_ALL;
     ChunkHandle chunk;
     ChunkMeshManager* meshManager = nullptr;
     const BlockPack* blockPack = nullptr;
@@ -2,6 +2,7 @@
 #include "ChunkMesher.h"
 
 #include <random>
+#include <unordered_map>
 
 
 #include "Biome.h"
@@ -19,6 +20,7 @@
 #include "SoaOptions.h"
 #include "VoxelBits.h"
 #include "VoxelMesher.h"
+#include "VoxelRunKernels.h"
 #include "VoxelUtils.h"
 
 #define GETBLOCK(a) blocks->operator[](a)
@@ -35,7 +37,10 @@ const int PADDED_WIDTH_M1 = PADDED_WIDTH - 1;
 
 #define NO_QUAD_INDEX 0xFFFF
 
-#define QUAD_SIZE 7
+#define QUAD_SIZE BLOCK_QUAD_SIZE
+
+// Times prepareDataAsync recopies when a chunk changes mid-copy
+#define MAX_PREPARE_RETRIES 2
 
 //#define USE_AO
 
@@ -60,8 +65,33 @@ const int FACE_AXIS[6][2] = { { 2, 1 }, { 2, 1 }, { 0, 2 }, { 0, 2 }, { 0, 1 },
 
 const int FACE_AXIS_SIGN[6][2] = { { 1, 1 }, { -1, 1 }, { 1, 1 }, { -1, 1 }, { -1, 1 }, { 1, 1 } };
 
+// Merge parameters of each face, the same ones addBlock passes to addQuad
+const int FACE_RIGHT_AXIS[6] = { 2, 2, 0, 0, 0, 0 };
+const int FACE_FRONT_AXIS[6] = { 1, 1, 2, 2, 1, 1 };
+const int FACE_RIGHT_STRETCH_INDEX[6] = { 2, 0, 2, 0, 0, 2 };
+const int FACE_TEX_OFFSET[6][2] = { { 1, 1 }, { -1, 1 }, { 1, 1 }, { -1, 1 }, { -1, 1 }, { 1, 1 } };
+
 PlanetHeightData ChunkMesher::defaultChunkHeightData[CHUNK_LAYER] = {};
 
+namespace {
+    struct PaletteEntryHash {
+        size_t operator()(const BlockVertexPaletteEntry& e) const {
+            // FNV-1a
+            const ui8* bytes = (const ui8*)&e;
+            ui64 hash = 14695981039346656037ull;
+            for (size_t i = 0; i < sizeof(e); i++) {
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            }
+            return (size_t)hash;
+        }
+    };
+    struct PaletteEntryEqual {
+        bool operator()(const BlockVertexPaletteEntry& a, const BlockVertexPaletteEntry& b) const {
+            return memcmp(&a, &b, sizeof(a)) == 0;
+        }
+    };
+}
+
 void ChunkMesher::init(const BlockPack* blocks) {
     this->blocks = blocks;
 
@@ -86,18 +116,12 @@ void ChunkMesher::init(const BlockPack* blocks) {
 }
 
 void ChunkMesher::prepareData(const Chunk* chunk) {
-    int x, y, z, off1, off2;
-
     const Chunk* left = chunk->neighbor.left;
     const Chunk* right = chunk->neighbor.right;
     const Chunk* bottom = chunk->neighbor.bottom;
     const Chunk* top = chunk->neighbor.top;
     const Chunk* back = chunk->neighbor.back;
     const Chunk* front = chunk->neighbor.front;
-    int wc;
-    int c = 0;
-
-    i32v3 pos;
 
     wSize = 0;
     chunkVoxelPos = chunk->getVoxelPosition();
@@ -108,149 +132,138 @@ void ChunkMesher::prepareData(const Chunk* chunk) {
     }
 
     // TODO(Ben): Do this last so we can be queued for mesh longer?
-    // TODO(Ben): Dude macro this or something.
 
     memset(blockData, 0, sizeof(blockData));
-    memset(tertiaryData, 0, sizeof(tertiaryData));
- 
-    if (chunk->blocks.getState() == vvox::VoxelStorageState::INTERVAL_TREE) {
-
-        int s = 0;
-        //block data
-        auto& dataTree = chunk->blocks.getTree();
-        for (size_t i = 0; i < dataTree.size(); i++) {
-            for (size_t j = 0; j < dataTree[i].length; j++) {
-                c = dataTree[i].getStart() + j;
-
-                getPosFromBlockIndex(c, pos);
-
-                wc = (pos.y + 1)*PADDED_LAYER + (pos.z + 1)*PADDED_WIDTH + (pos.x + 1);
-                blockData[wc] = dataTree[i].data;
-                if (GETBLOCK(blockData[wc]).meshType == MeshType::LIQUID) {
-                    m_wvec[s++] = wc;
-                }
-
-            }
-        }
-        wSize = s;
-    } else {
-        int s = 0;
-        for (y = 0; y < CHUNK_WIDTH; y++) {
-            for (z = 0; z < CHUNK_WIDTH; z++) {
-                for (x = 0; x < CHUNK_WIDTH; x++, c++) {
-                    wc = (y + 1)*PADDED_LAYER + (z + 1)*PADDED_WIDTH + (x + 1);
-                    blockData[wc] = chunk->blocks[c];
-                    if (GETBLOCK(blockData[wc]).meshType == MeshType::LIQUID) {
-                        m_wvec[s++] = wc;
-                    }
-                }
-            }
-        }
-        wSize = s;
+    // Most chunks have no tertiary data, so the buffer usually stays clear between meshes
+    if (!m_isTertiaryClear) {
+        memset(tertiaryData, 0, sizeof(tertiaryData));
+        m_isTertiaryClear = true;
     }
-    if (chunk->tertiary.getState() == vvox::VoxelStorageState::INTERVAL_TREE) {
-        //tertiary data
-        c = 0;
-        auto& dataTree = chunk->tertiary.getTree();
-        for (size_t i = 0; i < dataTree.size(); i++) {
-            for (size_t j = 0; j < dataTree[i].length; j++) {
-                c = dataTree[i].getStart() + j;
+    m_hasTertiary = false;
 
-                getPosFromBlockIndex(c, pos);
-                wc = (pos.y + 1)*PADDED_LAYER + (pos.z + 1)*PADDED_WIDTH + (pos.x + 1);
+    copyChunkData(chunk);
 
-                tertiaryData[wc] = dataTree[i].data;
-            }
-        }
-
-    } else {
-        c = 0;
-        for (y = 0; y < CHUNK_WIDTH; y++) {
-            for (z = 0; z < CHUNK_WIDTH; z++) {
-                for (x = 0; x < CHUNK_WIDTH; x++, c++) {
-                    wc = (y + 1)*PADDED_LAYER + (z + 1)*PADDED_WIDTH + (x + 1);
-                    tertiaryData[wc] = chunk->tertiary.get(c);
-                }
-            }
-        }
-    }
+    if (left) copyNeighborFace(left, X_NEG);
+    if (right) copyNeighborFace(right, X_POS);
+    if (bottom) copyNeighborFace(bottom, Y_NEG);
+    if (top) copyNeighborFace(top, Y_POS);
+    if (back) copyNeighborFace(back, Z_NEG);
+    if (front) copyNeighborFace(front, Z_POS);
 
-    if (left) {
-        for (y = 1; y < PADDED_WIDTH - 1; y++) {
-            for (z = 1; z < PADDED_WIDTH - 1; z++) {
-                off1 = (z - 1)*CHUNK_WIDTH + (y - 1)*CHUNK_LAYER;
-                off2 = z*PADDED_WIDTH + y*PADDED_LAYER;
+    if (!m_hasTertiary) m_isTertiaryClear = true;
+}
 
-                blockData[off2] = left->getBlockData(off1 + CHUNK_WIDTH - 1);
-                tertiaryData[off2] = left->getTertiaryData(off1 + CHUNK_WIDTH - 1);
+void ChunkMesher::copyChunkData(const Chunk* chunk) {
+    m_isUniform = chunk->blocks.isUniform();
+    bool copyTertiary = needsTertiaryCopy(chunk);
+    if (m_isUniform && GETBLOCK(chunk->blocks.getUniformValue()).meshType != MeshType::LIQUID) {
+        // Single value, so just fill the rows and skip the liquid scan
+        ui16 blockID = chunk->blocks.getUniformValue();
+        for (int y = 0; y < CHUNK_WIDTH; y++) {
+            for (int z = 0; z < CHUNK_WIDTH; z++) {
+                int c = y * CHUNK_LAYER + z * CHUNK_WIDTH;
+                int wc = (y + 1) * PADDED_LAYER + (z + 1) * PADDED_WIDTH + 1;
+                vvox::fillRun(&blockData[wc], CHUNK_WIDTH, blockID);
+                if (copyTertiary) chunk->tertiary.copyRange(c, CHUNK_WIDTH, &tertiaryData[wc]);
             }
         }
+        wSize = 0;
+        return;
     }
-
-    if (right) {
-        for (y = 1; y < PADDED_WIDTH - 1; y++) {
-            for (z = 1; z < PADDED_WIDTH - 1; z++) {
-                off1 = (z - 1)*CHUNK_WIDTH + (y - 1)*CHUNK_LAYER;
-                off2 = z*PADDED_WIDTH + y*PADDED_LAYER;
-
-                blockData[off2 + PADDED_WIDTH - 1] = (right->getBlockData(off1));
-                tertiaryData[off2 + PADDED_WIDTH - 1] = right->getTertiaryData(off1);
+    int s = 0;
+    for (int y = 0; y < CHUNK_WIDTH; y++) {
+        for (int z = 0; z < CHUNK_WIDTH; z++) {
+            int c = y * CHUNK_LAYER + z * CHUNK_WIDTH;
+            int wc = (y + 1) * PADDED_LAYER + (z + 1) * PADDED_WIDTH + 1;
+            // Rows are contiguous in both layouts
+            chunk->blocks.copyRange(c, CHUNK_WIDTH, &blockData[wc]);
+            if (copyTertiary) chunk->tertiary.copyRange(c, CHUNK_WIDTH, &tertiaryData[wc]);
+            for (int x = 0; x < CHUNK_WIDTH; x++) {
+                if (GETBLOCK(blockData[wc + x]).meshType == MeshType::LIQUID) {
+                    m_wvec[s++] = wc + x;
+                }
             }
         }
     }
+    wSize = s;
+}
 
-    if (bottom) {
-        for (z = 1; z < PADDED_WIDTH - 1; z++) {
-            for (x = 1; x < PADDED_WIDTH - 1; x++) {
-                off1 = (z - 1)*CHUNK_WIDTH + x - 1;
-                off2 = z*PADDED_WIDTH + x;
-                //data
-                blockData[off2] = (bottom->getBlockData(CHUNK_SIZE - CHUNK_LAYER + off1)); //bottom
-                tertiaryData[off2] = bottom->getTertiaryData(CHUNK_SIZE - CHUNK_LAYER + off1);
-            }
-        }
+void ChunkMesher::copyNeighborFace(const Chunk* neighbor, int side) {
+    ui16 blockFace[CHUNK_LAYER];
+    ui16 tertiaryFace[CHUNK_LAYER];
+    // The neighbor's opposite face is the one touching us
+    vvox::Cardinal srcFace = (vvox::Cardinal)(side ^ 1);
+    neighbor->blocks.copyFace(srcFace, blockFace);
+    bool copyTertiary = needsTertiaryCopy(neighbor);
+    if (copyTertiary) neighbor->tertiary.copyFace(srcFace, tertiaryFace);
+
+    // Face buffers are indexed as a * CHUNK_WIDTH + b, see SmartVoxelContainer::copyFace
+    int base, strideA, strideB;
+    switch (side) {
+        case X_NEG:
+            base = PADDED_LAYER + PADDED_WIDTH;
+            strideA = PADDED_LAYER;
+            strideB = PADDED_WIDTH;
+            break;
+        case X_POS:
+            base = PADDED_LAYER + PADDED_WIDTH + PADDED_WIDTH_M1;
+            strideA = PADDED_LAYER;
+            strideB = PADDED_WIDTH;
+            break;
+        case Y_NEG:
+            base = PADDED_WIDTH + 1;
+            strideA = PADDED_WIDTH;
+            strideB = 1;
+            break;
+        case Y_POS:
+            base = PADDED_SIZE - PADDED_LAYER + PADDED_WIDTH + 1;
+            strideA = PADDED_WIDTH;
+            strideB = 1;
+            break;
+        case Z_NEG:
+            base = PADDED_LAYER + 1;
+            strideA = PADDED_LAYER;
+            strideB = 1;
+            break;
+        default: // Z_POS
+            base = PADDED_LAYER + PADDED_LAYER - PADDED_WIDTH + 1;
+            strideA = PADDED_LAYER;
+            strideB = 1;
+            break;
     }
 
-    if (top) {
-        for (z = 1; z < PADDED_WIDTH - 1; z++) {
-            for (x = 1; x < PADDED_WIDTH - 1; x++) {
-                off1 = (z - 1)*CHUNK_WIDTH + x - 1;
-                off2 = z*PADDED_WIDTH + x;
-
-                blockData[off2 + PADDED_SIZE - PADDED_LAYER] = (top->getBlockData(off1)); //top
-                tertiaryData[off2 + PADDED_SIZE - PADDED_LAYER] = top->getTertiaryData(off1);
+    for (int a = 0; a < CHUNK_WIDTH; a++) {
+        int destIndex = base + a * strideA;
+        const ui16* srcBlocks = blockFace + a * CHUNK_WIDTH;
+        const ui16* srcTertiary = tertiaryFace + a * CHUNK_WIDTH;
+        if (strideB == 1) {
+            memcpy(&blockData[destIndex], srcBlocks, CHUNK_WIDTH * sizeof(ui16));
+            if (copyTertiary) memcpy(&tertiaryData[destIndex], srcTertiary, CHUNK_WIDTH * sizeof(ui16));
+        } else if (copyTertiary) {
+            for (int b = 0; b < CHUNK_WIDTH; b++, destIndex += strideB) {
+                blockData[destIndex] = srcBlocks[b];
+                tertiaryData[destIndex] = srcTertiary[b];
             }
-        }
-    }
-
-    if (back) {
-        for (y = 1; y < PADDED_WIDTH - 1; y++) {
-            for (x = 1; x < PADDED_WIDTH - 1; x++) {
-                off1 = (x - 1) + (y - 1)*CHUNK_LAYER;
-                off2 = x + y*PADDED_LAYER;
-
-                blockData[off2] = back->getBlockData(off1 + CHUNK_LAYER - CHUNK_WIDTH);
-                tertiaryData[off2] = back->getTertiaryData(off1 + CHUNK_LAYER - CHUNK_WIDTH);
+        } else {
+            for (int b = 0; b < CHUNK_WIDTH; b++, destIndex += strideB) {
+                blockData[destIndex] = srcBlocks[b];
             }
         }
     }
+}
 
-    if (front) {
-        for (y = 1; y < PADDED_WIDTH - 1; y++) {
-            for (x = 1; x < PADDED_WIDTH - 1; x++) {
-                off1 = (x - 1) + (y - 1)*CHUNK_LAYER;
-                off2 = x + y*PADDED_LAYER;
-
-                blockData[off2 + PADDED_LAYER - PADDED_WIDTH] = (front->getBlockData(off1));
-                tertiaryData[off2 + PADDED_LAYER - PADDED_WIDTH] = front->getTertiaryData(off1);
-            }
-        }
+bool ChunkMesher::needsTertiaryCopy(const Chunk* chunk) {
+    if (chunk->hasTertiaryData()) {
+        m_hasTertiary = true;
+        m_isTertiaryClear = false;
     }
+    // Absent data is all 0, which a clear buffer already holds
+    return !m_isTertiaryClear;
 }
 
 #define GET_EDGE_X(ch, sy, sz, dy, dz) \
     { \
-      std::lock_guard<std::mutex> l(ch->dataMutex); \
+      std::shared_lock<ChunkDataLock> l(ch->dataMutex); \
       for (int x = 0; x < CHUNK_WIDTH; x++) { \
           srcIndex = (sy) * CHUNK_LAYER + (sz) * CHUNK_WIDTH + x; \
           destIndex = (dy) * PADDED_LAYER + (dz) * PADDED_WIDTH + (x + 1); \
@@ -262,7 +275,7 @@ void ChunkMesher::prepareData(const Chunk* chunk) {
 
 #define GET_EDGE_Y(ch, sx, sz, dx, dz) \
     { \
-      std::lock_guard<std::mutex> l(ch->dataMutex); \
+      std::shared_lock<ChunkDataLock> l(ch->dataMutex); \
       for (int y = 0; y < CHUNK_WIDTH; y++) { \
         srcIndex = y * CHUNK_LAYER + (sz) * CHUNK_WIDTH + (sx); \
         destIndex = (y + 1) * PADDED_LAYER + (dz) * PADDED_WIDTH + (dx); \
@@ -274,7 +287,7 @@ void ChunkMesher::prepareData(const Chunk* chunk) {
 
 #define GET_EDGE_Z(ch, sx, sy, dx, dy) \
     { \
-      std::lock_guard<std::mutex> l(ch->dataMutex); \
+      std::shared_lock<ChunkDataLock> l(ch->dataMutex); \
       for (int z = 0; z < CHUNK_WIDTH; z++) { \
         srcIndex = z * CHUNK_WIDTH + (sy) * CHUNK_LAYER + (sx); \
         destIndex = (z + 1) * PADDED_WIDTH + (dy) * PADDED_LAYER + (dx); \
@@ -288,7 +301,7 @@ void ChunkMesher::prepareData(const Chunk* chunk) {
     srcIndex = (sy) * CHUNK_LAYER + (sz) * CHUNK_WIDTH + (sx); \
     destIndex = (dy) * PADDED_LAYER + (dz) * PADDED_WIDTH + (dx); \
     { \
-      std::lock_guard<std::mutex> l(ch->dataMutex); \
+      std::shared_lock<ChunkDataLock> l(ch->dataMutex); \
       blockData[destIndex] = ch->getBlockData(srcIndex); \
       tertiaryData[destIndex] = ch->getTertiaryData(srcIndex); \
     } \
@@ -297,11 +310,6 @@ void ChunkMesher::prepareData(const Chunk* chunk) {
 void ChunkMesher::prepareDataAsync(ChunkHandle& chunk, ChunkHandle neighbors[NUM_NEIGHBOR_HANDLES]) {
     int x, y, z, srcIndex, destIndex;
 
-    int wc;
-    int c = 0;
-
-    i32v3 pos;
-
     wSize = 0;
     chunkVoxelPos = chunk->getVoxelPosition();
     if (chunk->gridData) {
@@ -312,162 +320,62 @@ void ChunkMesher::prepareDataAsync(ChunkHandle& chunk, ChunkHandle neighbors[NUM
         m_chunkHeightData = defaultChunkHeightData;
     }
 
-    // TODO(Ben): Do this last so we can be queued for mesh longer?
-    // TODO(Ben): Dude macro this or something.
-    { // Main chunk
-        std::lock_guard<std::mutex> l(chunk->dataMutex);
-        if (chunk->blocks.getState() == vvox::VoxelStorageState::INTERVAL_TREE) {
-
-            int s = 0;
-            //block data
-            auto& dataTree = chunk->blocks.getTree();
-            for (size_t i = 0; i < dataTree.size(); i++) {
-                for (size_t j = 0; j < dataTree[i].length; j++) {
-                    c = dataTree[i].getStart() + j;
-
-                    getPosFromBlockIndex(c, pos);
-
-                    wc = (pos.y + 1)*PADDED_LAYER + (pos.z + 1)*PADDED_WIDTH + (pos.x + 1);
-                    blockData[wc] = dataTree[i].data;
-                    if (GETBLOCK(blockData[wc]).meshType == MeshType::LIQUID) {
-                        m_wvec[s++] = wc;
-                    }
-                }
-            }
-            wSize = s;
-        } else {
-            int s = 0;
-            for (y = 0; y < CHUNK_WIDTH; y++) {
-                for (z = 0; z < CHUNK_WIDTH; z++) {
-                    for (x = 0; x < CHUNK_WIDTH; x++, c++) {
-                        wc = (y + 1)*PADDED_LAYER + (z + 1)*PADDED_WIDTH + (x + 1);
-                        blockData[wc] = chunk->blocks[c];
-                        if (GETBLOCK(blockData[wc]).meshType == MeshType::LIQUID) {
-                            m_wvec[s++] = wc;
-                        }
-                    }
-                }
-            }
-            wSize = s;
+    ChunkHandle& left = neighbors[NEIGHBOR_HANDLE_LEFT];
+    ChunkHandle& right = neighbors[NEIGHBOR_HANDLE_RIGHT];
+    ChunkHandle& bottom = neighbors[NEIGHBOR_HANDLE_BOT];
+    ChunkHandle& top = neighbors[NEIGHBOR_HANDLE_TOP];
+    ChunkHandle& back = neighbors[NEIGHBOR_HANDLE_BACK];
+    ChunkHandle& front = neighbors[NEIGHBOR_HANDLE_FRONT];
+    ChunkHandle* sources[7] = { &chunk, &left, &right, &bottom, &top, &back, &front };
+
+    // Each chunk is copied under its own shared lock, so a write to one of them
+    // between copies can leave mismatched faces. Retry if that happens.
+    ui32 versions[7];
+    for (int attempt = 0;; attempt++) {
+        m_hasTertiary = false;
+        for (int i = 0; i < 7; i++) {
+            versions[i] = (*sources[i])->dataMutex.readBegin();
         }
-        if (chunk->tertiary.getState() == vvox::VoxelStorageState::INTERVAL_TREE) {
-            //tertiary data
-            c = 0;
-            auto& dataTree = chunk->tertiary.getTree();
-            for (size_t i = 0; i < dataTree.size(); i++) {
-                for (size_t j = 0; j < dataTree[i].length; j++) {
-                    c = dataTree[i].getStart() + j;
-
-                    getPosFromBlockIndex(c, pos);
-                    wc = (pos.y + 1)*PADDED_LAYER + (pos.z + 1)*PADDED_WIDTH + (pos.x + 1);
-
-                    tertiaryData[wc] = dataTree[i].data;
-                }
-            }
 
-        } else {
-            c = 0;
-            for (y = 0; y < CHUNK_WIDTH; y++) {
-                for (z = 0; z < CHUNK_WIDTH; z++) {
-                    for (x = 0; x < CHUNK_WIDTH; x++, c++) {
-                        wc = (y + 1)*PADDED_LAYER + (z + 1)*PADDED_WIDTH + (x + 1);
-                        tertiaryData[wc] = chunk->tertiary.get(c);
-                    }
-                }
-            }
+        { // Main chunk
+            std::shared_lock<ChunkDataLock> l(chunk->dataMutex);
+            copyChunkData(chunk);
         }
-    }
-    chunk.release();
-
-    ChunkHandle& left = neighbors[NEIGHBOR_HANDLE_LEFT];
-    { // Left
-        std::lock_guard<std::mutex> l(left->dataMutex);
-        for (y = 1; y < PADDED_WIDTH - 1; y++) {
-            for (z = 1; z < PADDED_WIDTH - 1; z++) {
-                srcIndex = (z - 1)*CHUNK_WIDTH + (y - 1)*CHUNK_LAYER;
-                destIndex = z*PADDED_WIDTH + y*PADDED_LAYER;
-
-                blockData[destIndex] = left->getBlockData(srcIndex + CHUNK_WIDTH - 1);
-                tertiaryData[destIndex] = left->getTertiaryData(srcIndex + CHUNK_WIDTH - 1);
-            }
+        { // Left
+            std::shared_lock<ChunkDataLock> l(left->dataMutex);
+            copyNeighborFace(left, X_NEG);
         }
-    }
-    left.release();
-
-    ChunkHandle& right = neighbors[NEIGHBOR_HANDLE_RIGHT];
-    { // Right
-        std::lock_guard<std::mutex> l(right->dataMutex);
-        for (y = 1; y < PADDED_WIDTH - 1; y++) {
-            for (z = 1; z < PADDED_WIDTH - 1; z++) {
-                srcIndex = (z - 1)*CHUNK_WIDTH + (y - 1)*CHUNK_LAYER;
-                destIndex = z*PADDED_WIDTH + y*PADDED_LAYER + PADDED_WIDTH - 1;
-
-                blockData[destIndex] = (right->getBlockData(srcIndex));
-                tertiaryData[destIndex] = right->getTertiaryData(srcIndex);
-            }
+        { // Right
+            std::shared_lock<ChunkDataLock> l(right->dataMutex);
+            copyNeighborFace(right, X_POS);
         }
-    }
-    right.release();
-
-    ChunkHandle& bottom = neighbors[NEIGHBOR_HANDLE_BOT];
-    { // Bottom
-        std::lock_guard<std::mutex> l(bottom->dataMutex);
-        for (z = 1; z < PADDED_WIDTH - 1; z++) {
-            for (x = 1; x < PADDED_WIDTH - 1; x++) {
-                srcIndex = (z - 1)*CHUNK_WIDTH + x - 1 + CHUNK_SIZE - CHUNK_LAYER;
-                destIndex = z*PADDED_WIDTH + x;
-                //data
-                blockData[destIndex] = (bottom->getBlockData(srcIndex)); //bottom
-                tertiaryData[destIndex] = bottom->getTertiaryData(srcIndex);
-            }
+        { // Bottom
+            std::shared_lock<ChunkDataLock> l(bottom->dataMutex);
+            copyNeighborFace(bottom, Y_NEG);
         }
-    }
-    bottom.release();
-
-    ChunkHandle& top = neighbors[NEIGHBOR_HANDLE_TOP];
-    { // Top
-        std::lock_guard<std::mutex> l(top->dataMutex);
-        for (z = 1; z < PADDED_WIDTH - 1; z++) {
-            for (x = 1; x < PADDED_WIDTH - 1; x++) {
-                srcIndex = (z - 1)*CHUNK_WIDTH + x - 1;
-                destIndex = z*PADDED_WIDTH + x + PADDED_SIZE - PADDED_LAYER;
-
-                blockData[destIndex] = (top->getBlockData(srcIndex)); //top
-                tertiaryData[destIndex] = top->getTertiaryData(srcIndex);
-            }
+        { // Top
+            std::shared_lock<ChunkDataLock> l(top->dataMutex);
+            copyNeighborFace(top, Y_POS);
         }
-    }
-    top.release();
-
-    ChunkHandle& back = neighbors[NEIGHBOR_HANDLE_BACK];
-    { // Back
-        std::lock_guard<std::mutex> l(back->dataMutex);
-        for (y = 1; y < PADDED_WIDTH - 1; y++) {
-            for (x = 1; x < PADDED_WIDTH - 1; x++) {
-                srcIndex = (x - 1) + (y - 1)*CHUNK_LAYER + CHUNK_LAYER - CHUNK_WIDTH;
-                destIndex = x + y*PADDED_LAYER;
-
-                blockData[destIndex] = back->getBlockData(srcIndex);
-                tertiaryData[destIndex] = back->getTertiaryData(srcIndex);
-            }
+        { // Back
+            std::shared_lock<ChunkDataLock> l(back->dataMutex);
+            copyNeighborFace(back, Z_NEG);
+        }
+        { // Front
+            std::shared_lock<ChunkDataLock> l(front->dataMutex);
+            copyNeighborFace(front, Z_POS);
         }
-    }
-    back.release();
 
-    ChunkHandle& front = neighbors[NEIGHBOR_HANDLE_FRONT];
-    { // Front
-        std::lock_guard<std::mutex> l(front->dataMutex);
-        for (y = 1; y < PADDED_WIDTH - 1; y++) {
-            for (x = 1; x < PADDED_WIDTH - 1; x++) {
-                srcIndex = (x - 1) + (y - 1)*CHUNK_LAYER;
-                destIndex = x + y*PADDED_LAYER + PADDED_LAYER - PADDED_WIDTH;
-
-                blockData[destIndex] = front->getBlockData(srcIndex);
-                tertiaryData[destIndex] = front->getTertiaryData(srcIndex);
-            }
+        bool isStale = false;
+        for (int i = 0; i < 7; i++) {
+            if ((*sources[i])->dataMutex.readRetry(versions[i])) isStale = true;
         }
+        // A newer mesh will be requested for the writes anyway, so don't spin forever
+        if (!isStale || attempt == MAX_PREPARE_RETRIES) break;
+    }
+    for (int i = 0; i < 7; i++) {
+        sources[i]->release();
     }
-    front.release();
     // Clone edge data
     // TODO(Ben): Light gradient calc
     // X horizontal rows
@@ -541,9 +449,11 @@ void ChunkMesher::prepareDataAsync(ChunkHandle& chunk, ChunkHandle neighbors[NUM
         blockData[destIndex] = blockData[srcIndex];
         tertiaryData[destIndex] = tertiaryData[srcIndex];
     }
+    // Without tertiary data every padded voxel is now 0
+    if (!m_hasTertiary) m_isTertiaryClear = true;
 }
 
-CALLER_DELETE ChunkMeshData* ChunkMesher::createChunkMeshData(MeshTaskType type VORB_UNUSED) {
+CALLER_DELETE ChunkMeshData* ChunkMesher::createChunkMeshData(MeshTaskType type VORB_UNUSED, OPT ChunkMeshData* meshData /*= nullptr*/) {
     m_numQuads = 0;
     m_highestY = 0;
     m_lowestY = 256;
@@ -552,8 +462,15 @@ CALLER_DELETE ChunkMeshData* ChunkMesher::createChunkMeshData(MeshTaskType type
     m_highestZ = 0;
     m_lowestZ = 256;
 
-    // Clear quad indices
-    memset(m_quadIndices, 0xFF, sizeof(m_quadIndices));
+    // A uniform chunk looks the same at every level
+    bool isLod = (lodLevel && !m_isUniform && !sections);
+    // Only the per voxel merge needs quad indices. Sections are always meshed
+    // per voxel, since greedy quads would span them.
+    bool isBinaryGreedy = (backend == ChunkMesherBackend::BINARY_GREEDY && !m_isUniform && !sections && !isLod);
+    if (!isBinaryGreedy) {
+        // Clear quad indices
+        memset(m_quadIndices, 0xFF, sizeof(m_quadIndices));
+    }
 
     for (int i = 0; i < 6; i++) {
         m_quads[i].clear();
@@ -563,35 +480,22 @@ CALLER_DELETE ChunkMeshData* ChunkMesher::createChunkMeshData(MeshTaskType type
     _waterVboVerts.clear();
 
     // Stores the data for a chunk mesh
-    // TODO(Ben): new is bad mkay
-    m_chunkMeshData = new ChunkMeshData(MeshTaskType::DEFAULT);
-
-    // Loop through blocks
-    for (by = 0; by < CHUNK_WIDTH; by++) {
-        for (bz = 0; bz < CHUNK_WIDTH; bz++) {
-            for (bx = 0; bx < CHUNK_WIDTH; bx++) {
-                // Get data for this voxel
-                // TODO(Ben): Could optimize out -1
-                blockIndex = (by + 1) * PADDED_CHUNK_LAYER + (bz + 1) * PADDED_CHUNK_WIDTH + (bx + 1);
-                blockID = blockData[blockIndex];
-                if (blockID == 0) continue; // Skip air blocks
-                heightData = &m_chunkHeightData[bz * CHUNK_WIDTH + bx];
-                block = &blocks->operator[](blockID);
-                // TODO(Ben) Don't think bx needs to be member
-                voxelPosOffset = ui8v3(bx * QUAD_SIZE, by * QUAD_SIZE, bz * QUAD_SIZE);
-
-                switch (block->meshType) {
-                    case MeshType::BLOCK:
-                        addBlock();
-                        break;
-                    case MeshType::LEAVES:
-                    case MeshType::CROSSFLORA:
-                    case MeshType::TRIANGLE:
-                        addFlora();
-                        break;
-                    default:
-                        //No mesh, do nothing
-                        break;
+    m_chunkMeshData = meshData ? meshData : new ChunkMeshData(MeshTaskType::DEFAULT);
+
+    if (sections) {
+        addDirtySections();
+    } else if (m_isUniform) {
+        addUniformChunk();
+    } else if (isLod) {
+        addLodChunk(1 << lodLevel);
+    } else if (isBinaryGreedy) {
+        addBinaryGreedyChunk();
+    } else {
+        // Loop through blocks
+        for (by = 0; by < CHUNK_WIDTH; by++) {
+            for (bz = 0; bz < CHUNK_WIDTH; bz++) {
+                for (bx = 0; bx < CHUNK_WIDTH; bx++) {
+                    addVoxel();
                 }
             }
         }
@@ -623,6 +527,12 @@ CALLER_DELETE ChunkMeshData* ChunkMesher::createChunkMeshData(MeshTaskType type
     renderData.cutoutVboSize = m_floraQuads.size() * INDICES_PER_QUAD;
     m_chunkMeshData->cutoutQuads.swap(m_floraQuads);
 
+    // Packing keeps the quad order, so the offsets below still apply
+    if (usePackedVertices && finalQuads.size() &&
+        packQuads(finalQuads, m_chunkMeshData->packedOpaqueVertices, m_chunkMeshData->opaquePalette)) {
+        finalQuads.clear();
+    }
+
     m_highestY /= QUAD_SIZE;
     m_lowestY /= QUAD_SIZE;
     m_highestX /= QUAD_SIZE;
@@ -632,7 +542,7 @@ CALLER_DELETE ChunkMeshData* ChunkMesher::createChunkMeshData(MeshTaskType type
 
 #define INDICES_PER_QUAD 6
 
-    if (finalQuads.size()) {
+    if (m_numQuads) {
         renderData.nxVboOff = 0;
         renderData.nxVboSize = sizes[0] * INDICES_PER_QUAD;
         renderData.pxVboOff = renderData.nxVboSize;
@@ -645,7 +555,7 @@ CALLER_DELETE ChunkMeshData* ChunkMesher::createChunkMeshData(MeshTaskType type
         renderData.nzVboSize = sizes[4] * INDICES_PER_QUAD;
         renderData.pzVboOff = renderData.nzVboOff + renderData.nzVboSize;
         renderData.pzVboSize = sizes[5] * INDICES_PER_QUAD;
-        renderData.indexSize = finalQuads.size() * INDICES_PER_QUAD;
+        renderData.indexSize = m_numQuads * INDICES_PER_QUAD;
 
         // Redundant
         renderData.highestX = m_highestX;
@@ -659,6 +569,78 @@ CALLER_DELETE ChunkMeshData* ChunkMesher::createChunkMeshData(MeshTaskType type
     return m_chunkMeshData;
 }
 
+bool ChunkMesher::packQuads(const std::vector<VoxelQuad>& quads, OUT std::vector<PackedBlockVertex>& vertices,
+                            OUT std::vector<BlockVertexPaletteEntry>& palette) {
+    std::unordered_map<BlockVertexPaletteEntry, ui16, PaletteEntryHash, PaletteEntryEqual> lookup;
+    vertices.resize(quads.size() * 4);
+    palette.clear();
+    ui16 lastIndex = 0;
+    for (size_t i = 0; i < quads.size(); i++) {
+        for (int j = 0; j < 4; j++) {
+            const BlockVertex& v = quads[i].verts[j];
+            // Opaque positions always sit on voxel corners
+            if (v.position.x % QUAD_SIZE || v.position.y % QUAD_SIZE || v.position.z % QUAD_SIZE) return false;
+            if (v.face >= 6 || v.blendMode >= 32) return false;
+
+            BlockVertexPaletteEntry entry = {};
+            entry.texturePosition = v.texturePosition;
+            entry.normTexturePosition = v.normTexturePosition;
+            entry.dispTexturePosition = v.dispTexturePosition;
+            entry.textureDims = v.textureDims;
+            entry.overlayTextureDims = v.overlayTextureDims;
+            entry.color = v.color;
+            entry.overlayColor = v.overlayColor;
+
+            // Neighboring vertices nearly always share a look
+            ui16 index;
+            if (palette.size() && PaletteEntryEqual()(entry, palette[lastIndex])) {
+                index = lastIndex;
+            } else {
+                auto it = lookup.find(entry);
+                if (it != lookup.end()) {
+                    index = it->second;
+                } else {
+                    if (palette.size() > UINT16_MAX) return false;
+                    index = (ui16)palette.size();
+                    palette.push_back(entry);
+                    lookup.emplace(entry, index);
+                }
+                lastIndex = index;
+            }
+
+            PackedBlockVertex& p = vertices[i * 4 + j];
+            p.positionFace = (ui32)(v.position.x / QUAD_SIZE) |
+                             ((ui32)(v.position.y / QUAD_SIZE) << 6) |
+                             ((ui32)(v.position.z / QUAD_SIZE) << 12) |
+                             ((ui32)v.face << 18) |
+                             ((ui32)v.blendMode << 21);
+            p.texPalette = (ui32)v.tex.x | ((ui32)v.tex.y << 8) | ((ui32)index << 16);
+        }
+    }
+    return true;
+}
+
+void ChunkMesher::unpackVertex(const PackedBlockVertex& vertex, const std::vector<BlockVertexPaletteEntry>& palette,
+                               OUT BlockVertex& result) {
+    memset((void*)&result, 0, sizeof(result));
+    result.position.x = (ui8)((vertex.positionFace & 0x3F) * QUAD_SIZE);
+    result.position.y = (ui8)(((vertex.positionFace >> 6) & 0x3F) * QUAD_SIZE);
+    result.position.z = (ui8)(((vertex.positionFace >> 12) & 0x3F) * QUAD_SIZE);
+    result.face = (ui8)((vertex.positionFace >> 18) & 0x7);
+    result.blendMode = (ui8)((vertex.positionFace >> 21) & 0x1F);
+    result.tex.x = (ui8)(vertex.texPalette & 0xFF);
+    result.tex.y = (ui8)((vertex.texPalette >> 8) & 0xFF);
+
+    const BlockVertexPaletteEntry& entry = palette[vertex.texPalette >> 16];
+    result.texturePosition = entry.texturePosition;
+    result.normTexturePosition = entry.normTexturePosition;
+    result.dispTexturePosition = entry.dispTexturePosition;
+    result.textureDims = entry.textureDims;
+    result.overlayTextureDims = entry.overlayTextureDims;
+    result.color = entry.color;
+    result.overlayColor = entry.overlayColor;
+}
+
 inline bool mapBufferData(GLuint& vboID, GLsizeiptr size, void* src, GLenum usage) {
     // Block Vertices
     if (vboID == 0) {
@@ -686,11 +668,29 @@ bool ChunkMesher::uploadMeshData(ChunkMesh& mesh, ChunkMeshData* meshData) {
 
     switch (meshData->type) {
         case MeshTaskType::DEFAULT:
-            if (meshData->opaqueQuads.size()) {
+            if (meshData->packedOpaqueVertices.size()) {
+
+                mapBufferData(mesh.vboID, meshData->packedOpaqueVertices.size() * sizeof(PackedBlockVertex), &(meshData->packedOpaqueVertices[0]), GL_STATIC_DRAW);
+                uploadPalette(mesh, meshData->opaquePalette);
+                canRender = true;
+
+                // The attributes differ between formats, so switching needs a new vao
+                if (mesh.vaoID && !mesh.isPacked) {
+                    glDeleteVertexArrays(1, &(mesh.vaoID));
+                    mesh.vaoID = 0;
+                }
+                mesh.isPacked = true;
+                if (!mesh.vaoID) buildPackedVao(mesh);
+            } else if (meshData->opaqueQuads.size()) {
 
                 mapBufferData(mesh.vboID, meshData->opaqueQuads.size() * sizeof(VoxelQuad), &(meshData->opaqueQuads[0]), GL_STATIC_DRAW);
                 canRender = true;
 
+                if (mesh.vaoID && mesh.isPacked) {
+                    glDeleteVertexArrays(1, &(mesh.vaoID));
+                    mesh.vaoID = 0;
+                }
+                mesh.isPacked = false;
                 if (!mesh.vaoID) buildVao(mesh);
             } else {
                 if (mesh.vboID != 0) {
@@ -701,6 +701,11 @@ bool ChunkMesher::uploadMeshData(ChunkMesh& mesh, ChunkMeshData* meshData) {
                     glDeleteVertexArrays(1, &(mesh.vaoID));
                     mesh.vaoID = 0;
                 }
+                mesh.isPacked = false;
+            }
+            if (!mesh.isPacked && mesh.paletteTextureID != 0) {
+                glDeleteTextures(1, &(mesh.paletteTextureID));
+                mesh.paletteTextureID = 0;
             }
 
             if (meshData->transQuads.size()) {
@@ -777,6 +782,9 @@ void ChunkMesher::freeChunkMesh(CALLEE_DELETE ChunkMesh* mesh) {
     if (mesh->vaoID != 0) {
         glDeleteVertexArrays(1, &mesh->vaoID);
     }
+    if (mesh->paletteTextureID != 0) {
+        glDeleteTextures(1, &mesh->paletteTextureID);
+    }
     // Transparent
     if (mesh->transVaoID != 0) {
         glDeleteVertexArrays(1, &mesh->transVaoID);
@@ -855,6 +863,327 @@ void ChunkMesher::freeBuffers() {
 
 #define CompareVerticesLight(v1, v2) (v1.sunlight == v2.sunlight && !memcmp(&v1.lampColor, &v2.lampColor, 3) && !memcmp(&v1.color, &v2.color, 3))
 
+void ChunkMesher::addVoxel() {
+    // Get data for this voxel
+    // TODO(Ben): Could optimize out -1
+    blockIndex = (by + 1) * PADDED_CHUNK_LAYER + (bz + 1) * PADDED_CHUNK_WIDTH + (bx + 1);
+    blockID = blockData[blockIndex];
+    if (blockID == 0) return; // Skip air blocks
+    heightData = &m_chunkHeightData[bz * CHUNK_WIDTH + bx];
+    block = &blocks->operator[](blockID);
+    // TODO(Ben) Don't think bx needs to be member
+    voxelPosOffset = ui8v3(bx * QUAD_SIZE, by * QUAD_SIZE, bz * QUAD_SIZE);
+
+    switch (block->meshType) {
+        case MeshType::BLOCK:
+            addBlock();
+            break;
+        case MeshType::LEAVES:
+        case MeshType::CROSSFLORA:
+        case MeshType::TRIANGLE:
+            addFlora();
+            break;
+        default:
+            //No mesh, do nothing
+            break;
+    }
+}
+
+void ChunkMesher::addUniformChunk() {
+    blockID = blockData[PADDED_CHUNK_LAYER + PADDED_CHUNK_WIDTH + 1];
+    if (blockID == 0) return; // Nothing to mesh in air
+    const Block& uniformBlock = blocks->operator[](blockID);
+    if (uniformBlock.meshType == MeshType::NONE) return;
+    if (uniformBlock.meshType != MeshType::BLOCK || getOcclusion(uniformBlock) == 0) {
+        // Interior voxels can be seen, mesh everything
+        for (by = 0; by < CHUNK_WIDTH; by++) {
+            for (bz = 0; bz < CHUNK_WIDTH; bz++) {
+                for (bx = 0; bx < CHUNK_WIDTH; bx++) {
+                    addVoxel();
+                }
+            }
+        }
+        return;
+    }
+    // Only voxels touching a neighbor can have faces
+    addBorderVoxels();
+}
+
+void ChunkMesher::addBorderVoxels() {
+    for (by = 0; by < CHUNK_WIDTH; by++) {
+        bool isEdgeLayer = (by == 0 || by == CHUNK_WIDTH - 1);
+        for (bz = 0; bz < CHUNK_WIDTH; bz++) {
+            if (isEdgeLayer || bz == 0 || bz == CHUNK_WIDTH - 1) {
+                for (bx = 0; bx < CHUNK_WIDTH; bx++) {
+                    addVoxel();
+                }
+            } else {
+                bx = 0;
+                addVoxel();
+                bx = CHUNK_WIDTH - 1;
+                addVoxel();
+            }
+        }
+    }
+}
+
+void ChunkMesher::addBinaryGreedyChunk() {
+    buildOccupancyMasks();
+
+    for (int face = 0; face < 6; face++) {
+        buildFaceMasks(face);
+        for (int slice = 0; slice < CHUNK_WIDTH; slice++) {
+            addGreedySlice(face, slice);
+        }
+    }
+
+    // Flora isn't merged, so it goes through addVoxel
+    for (int y = 0; y < CHUNK_WIDTH; y++) {
+        for (int z = 0; z < CHUNK_WIDTH; z++) {
+            ui32 bits = m_floraMasks[y][z];
+            while (bits) {
+                by = y;
+                bz = z;
+                bx = (int)vvox::impl::lowestBit(bits);
+                bits &= bits - 1;
+                addVoxel();
+            }
+        }
+    }
+}
+
+void ChunkMesher::buildOccupancyMasks() {
+    for (int y = 0; y < PADDED_WIDTH; y++) {
+        bool isInnerY = (y > 0 && y < PADDED_WIDTH_M1);
+        for (int z = 0; z < PADDED_WIDTH; z++) {
+            const ui16* row = &blockData[y * PADDED_LAYER + z * PADDED_WIDTH];
+            ui64 blockBits = 0;
+            ui64 occludeBits = 0;
+            ui64 selfBits = 0;
+            ui64 floraBits = 0;
+            for (int x = 0; x < PADDED_WIDTH; x++) {
+                const Block& b = GETBLOCK(row[x]);
+                ui64 bit = 1ull << x;
+                if (b.occlude == BlockOcclusion::ALL) {
+                    occludeBits |= bit;
+                } else if (b.occlude == BlockOcclusion::SELF) {
+                    selfBits |= bit;
+                }
+                if (row[x] == 0) continue;
+                if (b.meshType == MeshType::BLOCK) {
+                    blockBits |= bit;
+                } else if (b.meshType == MeshType::LEAVES || b.meshType == MeshType::CROSSFLORA ||
+                           b.meshType == MeshType::TRIANGLE) {
+                    floraBits |= bit;
+                }
+            }
+            m_blockMasks[y][z] = blockBits;
+            m_occludeMasks[y][z] = occludeBits;
+            m_selfMasks[y][z] = selfBits;
+            if (isInnerY && z > 0 && z < PADDED_WIDTH_M1) {
+                m_floraMasks[y - 1][z - 1] = (ui32)(floraBits >> 1);
+            }
+        }
+    }
+}
+
+void ChunkMesher::buildFaceMasks(int face) {
+    // X faces are transposed into place one bit at a time
+    if (face == X_NEG || face == X_POS) memset(m_faceMasks, 0, sizeof(m_faceMasks));
+
+    for (int y = 1; y < PADDED_WIDTH_M1; y++) {
+        for (int z = 1; z < PADDED_WIDTH_M1; z++) {
+            // Neighbor occlusion lined up with this row
+            ui64 occlude, self;
+            int offset;
+            switch (face) {
+                case X_NEG:
+                    occlude = m_occludeMasks[y][z] << 1;
+                    self = m_selfMasks[y][z] << 1;
+                    offset = -1;
+                    break;
+                case X_POS:
+                    occlude = m_occludeMasks[y][z] >> 1;
+                    self = m_selfMasks[y][z] >> 1;
+                    offset = 1;
+                    break;
+                case Y_NEG:
+                    occlude = m_occludeMasks[y - 1][z];
+                    self = m_selfMasks[y - 1][z];
+                    offset = -PADDED_LAYER;
+                    break;
+                case Y_POS:
+                    occlude = m_occludeMasks[y + 1][z];
+                    self = m_selfMasks[y + 1][z];
+                    offset = PADDED_LAYER;
+                    break;
+                case Z_NEG:
+                    occlude = m_occludeMasks[y][z - 1];
+                    self = m_selfMasks[y][z - 1];
+                    offset = -PADDED_WIDTH;
+                    break;
+                default: // Z_POS
+                    occlude = m_occludeMasks[y][z + 1];
+                    self = m_selfMasks[y][z + 1];
+                    offset = PADDED_WIDTH;
+                    break;
+            }
+            // Drop the padding so bit i is voxel x = i
+            ui32 visible = (ui32)((m_blockMasks[y][z] & ~occlude) >> 1);
+            // Neighbors that only occlude their own block need an ID check
+            ui32 candidates = visible & (ui32)(self >> 1);
+            int rowIndex = y * PADDED_LAYER + z * PADDED_WIDTH + 1;
+            while (candidates) {
+                ui32 x = vvox::impl::lowestBit(candidates);
+                candidates &= candidates - 1;
+                int index = rowIndex + (int)x;
+                if (blockData[index] == blockData[index + offset]) visible &= ~(1u << x);
+            }
+
+            switch (face) {
+                case X_NEG:
+                case X_POS:
+                    while (visible) {
+                        ui32 x = vvox::impl::lowestBit(visible);
+                        visible &= visible - 1;
+                        m_faceMasks[x][y - 1] |= 1u << (z - 1);
+                    }
+                    break;
+                case Y_NEG:
+                case Y_POS:
+                    m_faceMasks[y - 1][z - 1] = visible;
+                    break;
+                default: // Z faces
+                    m_faceMasks[z - 1][y - 1] = visible;
+                    break;
+            }
+        }
+    }
+}
+
+void ChunkMesher::setGreedyVoxel(int face, int slice, int front, int right) {
+    switch (face) {
+        case X_NEG:
+        case X_POS:
+            bx = slice; by = front; bz = right;
+            break;
+        case Y_NEG:
+        case Y_POS:
+            bx = right; by = slice; bz = front;
+            break;
+        default: // Z faces
+            bx = right; by = front; bz = slice;
+            break;
+    }
+    blockIndex = (by + 1) * PADDED_CHUNK_LAYER + (bz + 1) * PADDED_CHUNK_WIDTH + (bx + 1);
+    blockID = blockData[blockIndex];
+    heightData = &m_chunkHeightData[bz * CHUNK_WIDTH + bx];
+    block = &blocks->operator[](blockID);
+    voxelPosOffset = ui8v3(bx * QUAD_SIZE, by * QUAD_SIZE, bz * QUAD_SIZE);
+}
+
+void ChunkMesher::addGreedySlice(int face, int slice) {
+    ui32* rows = m_faceMasks[slice];
+
+    // Texturing can depend on neighbors, so every visible face gets its own vertex to compare
+    for (int front = 0; front < CHUNK_WIDTH; front++) {
+        ui32 bits = rows[front];
+        while (bits) {
+            int right = (int)vvox::impl::lowestBit(bits);
+            bits &= bits - 1;
+            setGreedyVoxel(face, slice, front, right);
+            getQuadVertex(face, m_sliceVertices[front][right]);
+        }
+    }
+
+    for (int front = 0; front < CHUNK_WIDTH; front++) {
+        while (rows[front]) {
+            int right = (int)vvox::impl::lowestBit(rows[front]);
+            const BlockVertex& vertex = m_sliceVertices[front][right];
+
+            // Grow right along the run of set bits
+            int width = 1;
+            while (right + width < CHUNK_WIDTH && (rows[front] & (1u << (right + width))) &&
+                   m_sliceVertices[front][right + width] == vertex) {
+                width++;
+            }
+            ui32 span = (width == 32) ? 0xFFFFFFFFu : (((1u << width) - 1) << right);
+
+            // Grow front while the next row covers the whole span with matching faces
+            int height = 1;
+            for (; front + height < CHUNK_WIDTH; height++) {
+                int nextFront = front + height;
+                if ((rows[nextFront] & span) != span) break;
+                bool isMatch = true;
+                for (int i = right; i < right + width; i++) {
+                    if (!(m_sliceVertices[nextFront][i] == vertex)) {
+                        isMatch = false;
+                        break;
+                    }
+                }
+                if (!isMatch) break;
+            }
+            for (int i = 0; i < height; i++) {
+                rows[front + i] &= ~span;
+            }
+
+            setGreedyVoxel(face, slice, front, right);
+            addGreedyQuad(face, vertex, width, height);
+        }
+    }
+}
+
+void ChunkMesher::addGreedyQuad(int face, const BlockVertex& vertex, int width, int height) {
+    const int rightAxis = FACE_RIGHT_AXIS[face];
+    const int frontAxis = FACE_FRONT_AXIS[face];
+    const int rightStretchIndex = FACE_RIGHT_STRETCH_INDEX[face];
+
+    std::vector<VoxelQuad>& quads = m_quads[face];
+    quads.emplace_back();
+    m_numQuads++;
+    VoxelQuad& quad = quads.back();
+    for (int i = 0; i < 4; i++) {
+        BlockVertex& v = quad.verts[i];
+        v = vertex;
+        v.position = VoxelMesher::VOXEL_POSITIONS[face][i] + voxelPosOffset;
+    }
+    quad.v.v0.mesherFlags = MESH_FLAG_ACTIVE;
+
+    i32v3 pos(bx, by, bz);
+    ui8 uOffset = (ui8)(pos[FACE_AXIS[face][0]] * FACE_AXIS_SIGN[face][0]);
+    ui8 vOffset = (ui8)(pos[FACE_AXIS[face][1]] * FACE_AXIS_SIGN[face][1]);
+    quad.verts[0].tex.x = (ui8)(UV_0 + uOffset);
+    quad.verts[0].tex.y = (ui8)(UV_1 + vOffset);
+    quad.verts[1].tex.x = (ui8)(UV_0 + uOffset);
+    quad.verts[1].tex.y = (ui8)(UV_0 + vOffset);
+    quad.verts[2].tex.x = (ui8)(UV_1 + uOffset);
+    quad.verts[2].tex.y = (ui8)(UV_0 + vOffset);
+    quad.verts[3].tex.x = (ui8)(UV_1 + uOffset);
+    quad.verts[3].tex.y = (ui8)(UV_1 + vOffset);
+
+    // The origin voxel and the far corner bound every face that was merged
+    updateBounds(quad.v.v0.position);
+
+    // Stretch it the same way tryMergeQuad does one voxel at a time
+    ui8 rightStretch = (ui8)((width - 1) * QUAD_SIZE);
+    ui8 frontStretch = (ui8)((height - 1) * QUAD_SIZE);
+    ui8 texStretchX = (ui8)((width - 1) * FACE_TEX_OFFSET[face][0]);
+    ui8 texStretchY = (ui8)((height - 1) * FACE_TEX_OFFSET[face][1]);
+    quad.verts[rightStretchIndex].position[rightAxis] += rightStretch;
+    quad.verts[rightStretchIndex].tex.x += texStretchX;
+    quad.verts[rightStretchIndex + 1].position[rightAxis] += rightStretch;
+    quad.verts[rightStretchIndex + 1].tex.x += texStretchX;
+    quad.v.v0.position[frontAxis] += frontStretch;
+    quad.v.v0.tex.y += texStretchY;
+    quad.v.v3.position[frontAxis] += frontStretch;
+    quad.v.v3.tex.y += texStretchY;
+
+    ui8v3 farCorner = VoxelMesher::VOXEL_POSITIONS[face][0] + voxelPosOffset;
+    farCorner[rightAxis] += rightStretch;
+    farCorner[frontAxis] += frontStretch;
+    updateBounds(farCorner);
+}
+
 void ChunkMesher::addBlock()
 {
     // Ambient occlusion buffer for vertices
@@ -927,38 +1256,11 @@ void ChunkMesher::computeAmbientOcclusion(int upOffset VORB_UNUSED, int frontOff
 }
 
 void ChunkMesher::addQuad(int face, int rightAxis, int frontAxis, int leftOffset, int backOffset, int rightStretchIndex, const ui8v2& texOffset, f32 ambientOcclusion VORB_UNUSED[]) {
-    // Get texture TODO(Ben): Null check?
-    const BlockTexture* texture = block->textures[face];
-
-    // Get colors
-    // TODO(Ben): altColors
-    color3 blockColor[2];
-    texture->layers.base.getFinalColor(blockColor[B_INDEX],
-                                heightData->temperature,
-                                heightData->humidity, 0);
-    texture->layers.base.getFinalColor(blockColor[O_INDEX],
-                                heightData->temperature,
-                                heightData->humidity, 0);
-
     std::vector<VoxelQuad>& quads = m_quads[face];
 
-    // Get texturing parameters
-    ui8 blendMode = getBlendMode(texture->blendMode);
-    // TODO(Ben): Make this better
-    BlockTextureMethodData methodDatas[6];
-    texture->layers.base.getBlockTextureMethodData(m_textureMethodParams[face][B_INDEX], blockColor[B_INDEX], methodDatas[0]);
-    texture->layers.base.getNormalTextureMethodData(m_textureMethodParams[face][B_INDEX], blockColor[B_INDEX], methodDatas[1]);
-    texture->layers.base.getDispTextureMethodData(m_textureMethodParams[face][B_INDEX], blockColor[B_INDEX], methodDatas[2]);
-    texture->layers.overlay.getBlockTextureMethodData(m_textureMethodParams[face][O_INDEX], blockColor[O_INDEX], methodDatas[3]);
-    texture->layers.overlay.getNormalTextureMethodData(m_textureMethodParams[face][O_INDEX], blockColor[O_INDEX], methodDatas[4]);
-    texture->layers.overlay.getDispTextureMethodData(m_textureMethodParams[face][O_INDEX], blockColor[O_INDEX], methodDatas[5]);
+    BlockVertex vertex;
+    getQuadVertex(face, vertex);
 
-    ui8 atlasIndices[6];
-    for (int i = 0; i < 6; i++) {
-        atlasIndices[i] = (ui8)(methodDatas[i].index / ATLAS_SIZE);
-        methodDatas[i].index &= ATLAS_MODULUS_BITS;
-    }
-    
     i32v3 pos(bx, by, bz);
     ui8 uOffset = (ui8)(pos[FACE_AXIS[face][0]] * FACE_AXIS_SIGN[face][0]);
     ui8 vOffset = (ui8)(pos[FACE_AXIS[face][1]] * FACE_AXIS_SIGN[face][1]);
@@ -968,42 +1270,22 @@ void ChunkMesher::addQuad(int face, int rightAxis, int frontAxis, int leftOffset
     quads.emplace_back();
     m_numQuads++;
     VoxelQuad* quad = &quads.back();
-    quad->v.v0.mesherFlags = MESH_FLAG_ACTIVE;
 
     for (int i = 0; i < 4; i++) {
         BlockVertex& v = quad->verts[i];
+        v = vertex;
         v.position = VoxelMesher::VOXEL_POSITIONS[face][i] + voxelPosOffset;
 #ifdef USE_AO
         f32& ao = ambientOcclusion[i];
-        v.color.r = (ui8)(blockColor[B_INDEX].r * ao);
-        v.color.g = (ui8)(blockColor[B_INDEX].g * ao);
-        v.color.b = (ui8)(blockColor[B_INDEX].b * ao);
-        v.overlayColor.r = (ui8)(blockColor[O_INDEX].r * ao);
-        v.overlayColor.g = (ui8)(blockColor[O_INDEX].g * ao);
-        v.overlayColor.b = (ui8)(blockColor[O_INDEX].b * ao);
-#else
-        v.color = blockColor[B_INDEX];
-        v.overlayColor = blockColor[O_INDEX];
+        v.color.r = (ui8)(v.color.r * ao);
+        v.color.g = (ui8)(v.color.g * ao);
+        v.color.b = (ui8)(v.color.b * ao);
+        v.overlayColor.r = (ui8)(v.overlayColor.r * ao);
+        v.overlayColor.g = (ui8)(v.overlayColor.g * ao);
+        v.overlayColor.b = (ui8)(v.overlayColor.b * ao);
 #endif
-        // TODO(Ben) array?
-        v.texturePosition.base.index = (ui8)methodDatas[0].index;
-        v.texturePosition.base.atlas = atlasIndices[0];
-        v.normTexturePosition.base.index = (ui8)methodDatas[1].index;
-        v.normTexturePosition.base.atlas = atlasIndices[1];
-        v.dispTexturePosition.base.index = (ui8)methodDatas[2].index;
-        v.dispTexturePosition.base.atlas = atlasIndices[2];
-        v.texturePosition.overlay.index = (ui8)methodDatas[3].index;
-        v.texturePosition.overlay.atlas = atlasIndices[3];
-        v.normTexturePosition.overlay.index = (ui8)methodDatas[4].index;
-        v.normTexturePosition.overlay.atlas = atlasIndices[4];
-        v.dispTexturePosition.overlay.index = (ui8)methodDatas[5].index;
-        v.dispTexturePosition.overlay.atlas = atlasIndices[5];
-        
-        v.textureDims = methodDatas[0].size;
-        v.overlayTextureDims = methodDatas[3].size;
-        v.blendMode = blendMode;
-        v.face = (ui8)face;
     }
+    quad->v.v0.mesherFlags = MESH_FLAG_ACTIVE;
     // Set texture coordinates
     quad->verts[0].tex.x = (ui8)(UV_0 + uOffset);
     quad->verts[0].tex.y = (ui8)(UV_1 + vOffset);
@@ -1016,16 +1298,274 @@ void ChunkMesher::addQuad(int face, int rightAxis, int frontAxis, int leftOffset
 
     // Check against lowest and highest for culling in render
     // TODO(Ben): Think about this more
-    if (quad->v.v0.position.x < m_lowestX) m_lowestX = quad->v.v0.position.x;
-    if (quad->v.v0.position.x > m_highestX) m_highestX = quad->v.v0.position.x;
-    if (quad->v.v0.position.y < m_lowestY) m_lowestY = quad->v.v0.position.y;
-    if (quad->v.v0.position.y > m_highestY) m_highestY = quad->v.v0.position.y;
-    if (quad->v.v0.position.z < m_lowestZ) m_lowestZ = quad->v.v0.position.z;
-    if (quad->v.v0.position.z > m_highestZ) m_highestZ = quad->v.v0.position.z;
+    updateBounds(quad->v.v0.position);
 
     m_numQuads -= tryMergeQuad(quad, quads, face, rightAxis, frontAxis, leftOffset, backOffset, rightStretchIndex, texOffset);
 }
 
+void ChunkMesher::getQuadVertex(int face, OUT BlockVertex& vertex) {
+    // Get texture TODO(Ben): Null check?
+    const BlockTexture* texture = block->textures[face];
+
+    // Get colors
+    // TODO(Ben): altColors
+    color3 blockColor[2];
+    texture->layers.base.getFinalColor(blockColor[B_INDEX],
+                                heightData->temperature,
+                                heightData->humidity, 0);
+    texture->layers.base.getFinalColor(blockColor[O_INDEX],
+                                heightData->temperature,
+                                heightData->humidity, 0);
+
+    // Get texturing parameters
+    ui8 blendMode = getBlendMode(texture->blendMode);
+    // TODO(Ben): Make this better
+    BlockTextureMethodData methodDatas[6];
+    texture->layers.base.getBlockTextureMethodData(m_textureMethodParams[face][B_INDEX], blockColor[B_INDEX], methodDatas[0]);
+    texture->layers.base.getNormalTextureMethodData(m_textureMethodParams[face][B_INDEX], blockColor[B_INDEX], methodDatas[1]);
+    texture->layers.base.getDispTextureMethodData(m_textureMethodParams[face][B_INDEX], blockColor[B_INDEX], methodDatas[2]);
+    texture->layers.overlay.getBlockTextureMethodData(m_textureMethodParams[face][O_INDEX], blockColor[O_INDEX], methodDatas[3]);
+    texture->layers.overlay.getNormalTextureMethodData(m_textureMethodParams[face][O_INDEX], blockColor[O_INDEX], methodDatas[4]);
+    texture->layers.overlay.getDispTextureMethodData(m_textureMethodParams[face][O_INDEX], blockColor[O_INDEX], methodDatas[5]);
+
+    ui8 atlasIndices[6];
+    for (int i = 0; i < 6; i++) {
+        atlasIndices[i] = (ui8)(methodDatas[i].index / ATLAS_SIZE);
+        methodDatas[i].index &= ATLAS_MODULUS_BITS;
+    }
+
+    vertex.color = blockColor[B_INDEX];
+    vertex.overlayColor = blockColor[O_INDEX];
+    // TODO(Ben) array?
+    vertex.texturePosition.base.index = (ui8)methodDatas[0].index;
+    vertex.texturePosition.base.atlas = atlasIndices[0];
+    vertex.normTexturePosition.base.index = (ui8)methodDatas[1].index;
+    vertex.normTexturePosition.base.atlas = atlasIndices[1];
+    vertex.dispTexturePosition.base.index = (ui8)methodDatas[2].index;
+    vertex.dispTexturePosition.base.atlas = atlasIndices[2];
+    vertex.texturePosition.overlay.index = (ui8)methodDatas[3].index;
+    vertex.texturePosition.overlay.atlas = atlasIndices[3];
+    vertex.normTexturePosition.overlay.index = (ui8)methodDatas[4].index;
+    vertex.normTexturePosition.overlay.atlas = atlasIndices[4];
+    vertex.dispTexturePosition.overlay.index = (ui8)methodDatas[5].index;
+    vertex.dispTexturePosition.overlay.atlas = atlasIndices[5];
+
+    vertex.textureDims = methodDatas[0].size;
+    vertex.overlayTextureDims = methodDatas[3].size;
+    vertex.blendMode = blendMode;
+    vertex.face = (ui8)face;
+    vertex.mesherFlags = 0;
+}
+
+void ChunkMesher::updateBounds(const ui8v3& position) {
+    if (position.x < m_lowestX) m_lowestX = position.x;
+    if (position.x > m_highestX) m_highestX = position.x;
+    if (position.y < m_lowestY) m_lowestY = position.y;
+    if (position.y > m_highestY) m_highestY = position.y;
+    if (position.z < m_lowestZ) m_lowestZ = position.z;
+    if (position.z > m_highestZ) m_highestZ = position.z;
+}
+
+void ChunkMesher::addDirtySections() {
+    if (!sections->isValid) dirtySections = CHUNK_SECTIONS_ALL;
+    for (int s = 0; s < CHUNK_MESH_SECTIONS; s++) {
+        if (!(dirtySections & (1 << s))) continue;
+        for (int i = 0; i < 6; i++) m_quads[i].clear();
+        m_floraQuads.clear();
+        // Quads only merge with the voxels behind them, so forgetting
+        // the layer below keeps them inside the section
+        if (s > 0) {
+            memset(m_quadIndices[s * CHUNK_SECTION_HEIGHT * PADDED_CHUNK_LAYER], 0xFF,
+                   sizeof(m_quadIndices[0]) * PADDED_CHUNK_LAYER);
+        }
+        for (by = s * CHUNK_SECTION_HEIGHT; by < (s + 1) * CHUNK_SECTION_HEIGHT; by++) {
+            for (bz = 0; bz < CHUNK_WIDTH; bz++) {
+                for (bx = 0; bx < CHUNK_WIDTH; bx++) {
+                    addVoxel();
+                }
+            }
+        }
+        for (int i = 0; i < 6; i++) {
+            std::vector<VoxelQuad>& quads = sections->quads[s][i];
+            quads.clear();
+            for (auto& q : m_quads[i]) {
+                if (q.v.v0.mesherFlags & MESH_FLAG_ACTIVE) quads.push_back(q);
+            }
+        }
+        sections->floraQuads[s].swap(m_floraQuads);
+    }
+    sections->isValid = true;
+
+    // Splice the new sections in with the kept ones
+    m_numQuads = 0;
+    m_floraQuads.clear();
+    for (int i = 0; i < 6; i++) {
+        m_quads[i].clear();
+        for (int s = 0; s < CHUNK_MESH_SECTIONS; s++) {
+            m_quads[i].insert(m_quads[i].end(), sections->quads[s][i].begin(), sections->quads[s][i].end());
+        }
+        m_numQuads += (ui32)m_quads[i].size();
+    }
+    for (int s = 0; s < CHUNK_MESH_SECTIONS; s++) {
+        m_floraQuads.insert(m_floraQuads.end(), sections->floraQuads[s].begin(), sections->floraQuads[s].end());
+    }
+    // Bounds of the kept sections weren't seen
+    for (int i = 0; i < 6; i++) {
+        for (auto& q : m_quads[i]) updateBounds(q.v.v0.position);
+    }
+}
+
+void ChunkMesher::downsampleBlockData(int cellWidth) {
+    const int lodWidth = CHUNK_WIDTH / cellWidth;
+    const int cellVolume = cellWidth * cellWidth * cellWidth;
+    m_lodFloraVoxels.clear();
+    for (int cy = 0; cy < CHUNK_WIDTH; cy += cellWidth) {
+        for (int cz = 0; cz < CHUNK_WIDTH; cz += cellWidth) {
+            for (int cx = 0; cx < CHUNK_WIDTH; cx += cellWidth) {
+                int numSolid = 0;
+                ui16 surfaceID = 0;
+                size_t floraStart = m_lodFloraVoxels.size();
+                // Top down, so the first solid voxel found is on the surface
+                for (int y = cy + cellWidth - 1; y >= cy; y--) {
+                    bool isBorderY = (y == 0 || y == CHUNK_WIDTH - 1);
+                    for (int z = cz; z < cz + cellWidth; z++) {
+                        bool isBorderZ = isBorderY || z == 0 || z == CHUNK_WIDTH - 1;
+                        const ui16* row = &blockData[(y + 1) * PADDED_CHUNK_LAYER + (z + 1) * PADDED_CHUNK_WIDTH + 1];
+                        for (int x = cx; x < cx + cellWidth; x++) {
+                            if (row[x] == 0) continue;
+                            const Block& b = blocks->operator[](row[x]);
+                            if (b.meshType == MeshType::BLOCK) {
+                                numSolid++;
+                                if (!surfaceID) surfaceID = row[x];
+                            } else if ((b.meshType == MeshType::LEAVES || b.meshType == MeshType::CROSSFLORA ||
+                                        b.meshType == MeshType::TRIANGLE) &&
+                                       !isBorderZ && x != 0 && x != CHUNK_WIDTH - 1) {
+                                // The border layer meshes its own flora
+                                m_lodFloraVoxels.push_back((ui16)(y * CHUNK_LAYER + z * CHUNK_WIDTH + x));
+                            }
+                        }
+                    }
+                }
+                bool isSolid = numSolid * 2 >= cellVolume;
+                // Flora inside a solid cell is buried
+                if (isSolid) m_lodFloraVoxels.resize(floraStart);
+                m_lodBlockData[((cy / cellWidth) * lodWidth + cz / cellWidth) * lodWidth + cx / cellWidth] =
+                    isSolid ? surfaceID : 0;
+            }
+        }
+    }
+
+    // The border layer is meshed against the layer inside it, which has to look like the cells
+    for (int y = 1; y < CHUNK_WIDTH - 1; y++) {
+        bool isShellLayer = (y == 1 || y == CHUNK_WIDTH - 2);
+        for (int z = 1; z < CHUNK_WIDTH - 1; z++) {
+            ui16* row = &blockData[(y + 1) * PADDED_CHUNK_LAYER + (z + 1) * PADDED_CHUNK_WIDTH + 1];
+            int xStep = (isShellLayer || z == 1 || z == CHUNK_WIDTH - 2) ? 1 : CHUNK_WIDTH - 3;
+            for (int x = 1; x < CHUNK_WIDTH - 1; x += xStep) {
+                ui16 cellID = m_lodBlockData[((y / cellWidth) * lodWidth + z / cellWidth) * lodWidth + x / cellWidth];
+                if (cellID) {
+                    row[x] = cellID;
+                } else if (blocks->operator[](row[x]).meshType == MeshType::BLOCK) {
+                    // Flora and liquids in empty cells are left alone
+                    row[x] = 0;
+                }
+            }
+        }
+    }
+}
+
+void ChunkMesher::addLodChunk(int cellWidth) {
+    downsampleBlockData(cellWidth);
+    const int lodWidth = CHUNK_WIDTH / cellWidth;
+
+    // Neighbours cull their faces against our full resolution voxels, so the
+    // border layer of the chunk is meshed as is to keep the seams sealed.
+    addBorderVoxels();
+
+    // Everything inside it is meshed a cell at a time
+    i32v3 cell;
+    for (cell.y = 0; cell.y < lodWidth; cell.y++) {
+        for (cell.z = 0; cell.z < lodWidth; cell.z++) {
+            for (cell.x = 0; cell.x < lodWidth; cell.x++) {
+                ui16 cellID = m_lodBlockData[(cell.y * lodWidth + cell.z) * lodWidth + cell.x];
+                if (cellID == 0) continue;
+                for (int face = 0; face < 6; face++) {
+                    addLodFace(face, cell, cellWidth, cellID);
+                }
+            }
+        }
+    }
+
+    for (ui16 i : m_lodFloraVoxels) {
+        by = i / CHUNK_LAYER;
+        bz = (i % CHUNK_LAYER) / CHUNK_WIDTH;
+        bx = i % CHUNK_WIDTH;
+        addVoxel();
+    }
+}
+
+void ChunkMesher::setLodVoxel(const i32v3& pos, ui16 cellID) {
+    bx = pos.x;
+    by = pos.y;
+    bz = pos.z;
+    blockIndex = (by + 1) * PADDED_CHUNK_LAYER + (bz + 1) * PADDED_CHUNK_WIDTH + (bx + 1);
+    // Only the shell of the cells was written back to blockData
+    blockID = cellID;
+    heightData = &m_chunkHeightData[bz * CHUNK_WIDTH + bx];
+    block = &blocks->operator[](blockID);
+    voxelPosOffset = ui8v3(bx * QUAD_SIZE, by * QUAD_SIZE, bz * QUAD_SIZE);
+}
+
+void ChunkMesher::addLodFace(int face, const i32v3& cell, int cellWidth, ui16 cellID) {
+    int axis, offset;
+    switch (face) {
+        case X_NEG: axis = 0; offset = -1; break;
+        case X_POS: axis = 0; offset = 1; break;
+        case Y_NEG: axis = 1; offset = -PADDED_CHUNK_LAYER; break;
+        case Y_POS: axis = 1; offset = PADDED_CHUNK_LAYER; break;
+        case Z_NEG: axis = 2; offset = -PADDED_CHUNK_WIDTH; break;
+        default: axis = 2; offset = PADDED_CHUNK_WIDTH; break;
+    }
+    const int lodWidth = CHUNK_WIDTH / cellWidth;
+    const int rightAxis = FACE_RIGHT_AXIS[face];
+    const int frontAxis = FACE_FRONT_AXIS[face];
+
+    // Cells are clipped to the inside of the border layer
+    i32v3 lo, hi;
+    for (int i = 0; i < 3; i++) {
+        lo[i] = glm::max(cell[i] * cellWidth, 1);
+        hi[i] = glm::min((cell[i] + 1) * cellWidth, CHUNK_WIDTH - 1);
+    }
+    // Quads grow right and front from the lowest voxel of the face
+    i32v3 origin = lo;
+    if (offset > 0) origin[axis] = hi[axis] - 1;
+
+    BlockVertex vertex;
+    i32v3 neighbor = cell;
+    neighbor[axis] += (offset > 0) ? 1 : -1;
+    if (neighbor[axis] >= 0 && neighbor[axis] < lodWidth) {
+        // Against another cell, so the whole face is either hidden or one quad
+        const Block& n = blocks->operator[](m_lodBlockData[(neighbor.y * lodWidth + neighbor.z) * lodWidth + neighbor.x]);
+        if (n.occlude == BlockOcclusion::ALL) return;
+        if (n.occlude == BlockOcclusion::SELF && n.ID == cellID) return;
+        setLodVoxel(origin, cellID);
+        getQuadVertex(face, vertex);
+        addGreedyQuad(face, vertex, hi[rightAxis] - lo[rightAxis], hi[frontAxis] - lo[frontAxis]);
+        return;
+    }
+
+    // Against the full resolution border layer, a voxel at a time
+    i32v3 pos = origin;
+    for (pos[frontAxis] = lo[frontAxis]; pos[frontAxis] < hi[frontAxis]; pos[frontAxis]++) {
+        for (pos[rightAxis] = lo[rightAxis]; pos[rightAxis] < hi[rightAxis]; pos[rightAxis]++) {
+            setLodVoxel(pos, cellID);
+            if (!shouldRenderFace(offset)) continue;
+            getQuadVertex(face, vertex);
+            addGreedyQuad(face, vertex, 1, 1);
+        }
+    }
+}
+
 struct FloraQuadData {
     color3 blockColor[2];
     BlockTextureMethodData methodDatas[6];
@@ -1134,12 +1674,7 @@ void ChunkMesher::addFloraQuad(const ui8v3* positions, FloraQuadData& data) {
 
     // Check against lowest and highest for culling in render
     // TODO(Ben): Think about this more
-    if (quad.v.v0.position.x < m_lowestX) m_lowestX = quad.v.v0.position.x;
-    if (quad.v.v0.position.x > m_highestX) m_highestX = quad.v.v0.position.x;
-    if (quad.v.v0.position.y < m_lowestY) m_lowestY = quad.v.v0.position.y;
-    if (quad.v.v0.position.y > m_highestY) m_highestY = quad.v.v0.position.y;
-    if (quad.v.v0.position.z < m_lowestZ) m_lowestZ = quad.v.v0.position.z;
-    if (quad.v.v0.position.z > m_highestZ) m_highestZ = quad.v.v0.position.z;
+    updateBounds(quad.v.v0.position);
 }
 
 
@@ -1634,6 +2169,44 @@ void ChunkMesher::buildVao(ChunkMesh& cm) {
     glBindVertexArray(0);
 }
 
+void ChunkMesher::buildPackedVao(ChunkMesh& cm) {
+    glGenVertexArrays(1, &(cm.vaoID));
+    glBindVertexArray(cm.vaoID);
+    glBindBuffer(GL_ARRAY_BUFFER, cm.vboID);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ChunkRenderer::sharedIBO);
+
+    // vPacked, the only attribute of the packed program. Everything else comes
+    // from the palette, see ChunkRenderer.
+    glEnableVertexAttribArray(0);
+    glVertexAttribIPointer(0, 2, GL_UNSIGNED_INT, sizeof(PackedBlockVertex), 0);
+
+    glBindVertexArray(0);
+}
+
+void ChunkMesher::uploadPalette(ChunkMesh& cm, std::vector<BlockVertexPaletteEntry>& palette) {
+    // Rows have to be full once there is more than one
+    size_t width = palette.size();
+    size_t height = 1;
+    if (width > PACKED_PALETTE_ENTRIES_PER_ROW) {
+        height = (width + PACKED_PALETTE_ENTRIES_PER_ROW - 1) / PACKED_PALETTE_ENTRIES_PER_ROW;
+        width = PACKED_PALETTE_ENTRIES_PER_ROW;
+        palette.resize(width * height);
+    }
+
+    if (cm.paletteTextureID == 0) {
+        glGenTextures(1, &(cm.paletteTextureID));
+        glBindTexture(GL_TEXTURE_2D, cm.paletteTextureID);
+        // Integer textures can't be filtered
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    } else {
+        glBindTexture(GL_TEXTURE_2D, cm.paletteTextureID);
+    }
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8UI, (GLsizei)(width * PACKED_PALETTE_TEXELS_PER_ENTRY), (GLsizei)height, 0,
+                 GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, &palette[0]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 void ChunkMesher::buildWaterVao(ChunkMesh& cm) {
     glGenVertexArrays(1, &(cm.waterVaoID));
     glBindVertexArray(cm.waterVaoID);
@@ -17,6 +17,11 @@ const int PADDED_CHUNK_WIDTH = (CHUNK_WIDTH + 2);
 const int PADDED_CHUNK_LAYER = (PADDED_CHUNK_WIDTH * PADDED_CHUNK_WIDTH);
 const int PADDED_CHUNK_SIZE = (PADDED_CHUNK_LAYER * PADDED_CHUNK_WIDTH);
 
+enum class ChunkMesherBackend {
+    DEFAULT, ///< Visits every voxel and merges quads one at a time
+    BINARY_GREEDY ///< Culls faces with row bitmasks and merges a slice at a time
+};
+
 // !!! IMPORTANT !!!
 // TODO(BEN): Make a class for complex Chunk Mesh Splicing. Store plenty of metadata in RAM about the regions in each mesh and just do a CPU copy to align them all and mix them around. Then meshes can be remeshed, rendered, recombined, at will.
 // Requirements: Each chunk is only meshed when it needs to, as they do now.
@@ -47,8 +52,9 @@ class ChunkMesher {
     void prepareDataAsync(ChunkHandle& chunk, ChunkHandle neighbors[NUM_NEIGHBOR_HANDLES]);
 
     // TODO(Ben): Unique ptr?
-    // Must call prepareData or prepareDataAsync first
-    CALLER_DELETE ChunkMeshData* createChunkMeshData(MeshTaskType type);
+    // Must call prepareData or prepareDataAsync first. Fills meshData if given,
+    // which has to be empty, otherwise allocates one.
+    CALLER_DELETE ChunkMeshData* createChunkMeshData(MeshTaskType type, OPT ChunkMeshData* meshData = nullptr);
 
     // Returns true if the mesh is renderable
     static bool uploadMeshData(ChunkMesh& mesh, ChunkMeshData* meshData);
@@ -56,6 +62,14 @@ class ChunkMesher {
     // Frees buffers AND deletes memory. mesh Pointer is invalid after calling.
     static void freeChunkMesh(CALLEE_DELETE ChunkMesh* mesh);
 
+    // Packs the vertices of quads, with one palette entry per distinct look.
+    // Returns false if a vertex doesn't fit the packed layout.
+    static bool packQuads(const std::vector<VoxelQuad>& quads, OUT std::vector<PackedBlockVertex>& vertices,
+                          OUT std::vector<BlockVertexPaletteEntry>& palette);
+    // Inverse of packQuads for a single vertex. Fields that aren't packed are 0.
+    static void unpackVertex(const PackedBlockVertex& vertex, const std::vector<BlockVertexPaletteEntry>& palette,
+                             OUT BlockVertex& result);
+
     void freeBuffers();
 
     int bx, by, bz; // Block iterators
@@ -74,9 +88,60 @@ class ChunkMesher {
     const BlockPack* blocks;
 
     VoxelPosition3D chunkVoxelPos;
+
+    // Both backends output the same quads, so this can be switched between meshes
+    ChunkMesherBackend backend = ChunkMesherBackend::DEFAULT;
+    // Packs opaque quads into PackedBlockVertex and a palette when possible
+    bool usePackedVertices = false;
+    // Meshes at 1 / (1 << lodLevel) resolution, up to MAX_CHUNK_MESH_LOD
+    ui8 lodLevel = 0;
+    // When set, quads are kept per section in it and only dirtySections are meshed.
+    // Caller should hold sections->lock.
+    ChunkMeshSections* sections = nullptr;
+    ui8 dirtySections = CHUNK_SECTIONS_ALL;
 private:
+    // Copies the chunk's voxels into the unpadded region of the voxel buffers
+    void copyChunkData(const Chunk* chunk);
+    // Copies the face of a neighbor into the padding on side of the voxel buffers
+    void copyNeighborFace(const Chunk* neighbor, int side);
+    // Returns true if the tertiary data of chunk has to be copied into the buffer
+    bool needsTertiaryCopy(const Chunk* chunk);
+
+    // Meshes the voxel at bx, by, bz
+    void addVoxel();
+    // Meshes a chunk that is a single block. Interior voxels are hidden, so only the shell is visited.
+    void addUniformChunk();
+    // Meshes every voxel on the border of the chunk
+    void addBorderVoxels();
     void addBlock();
     void addQuad(int face, int rightAxis, int frontAxis, int leftOffset, int backOffset, int rightStretchIndex, const ui8v2& texOffset, f32 ambientOcclusion[]);
+    // Fills everything but the position and tex coords of a face of the current voxel
+    void getQuadVertex(int face, OUT BlockVertex& vertex);
+    void updateBounds(const ui8v3& position);
+    // Fills m_lodBlockData with one block per cellWidth^3 cell, and writes the cells
+    // into the layer of blockData just inside the chunk border
+    void downsampleBlockData(int cellWidth);
+    // Meshes the border layer at full resolution and the inside of the chunk a cell at a time
+    void addLodChunk(int cellWidth);
+    // Points the voxel state used by texturing at pos, as part of a cell of cellID
+    void setLodVoxel(const i32v3& pos, ui16 cellID);
+    // Adds the visible part of a face of a cell
+    void addLodFace(int face, const i32v3& cell, int cellWidth, ui16 cellID);
+    // Meshes the dirty sections into sections, then gathers the quads of all of them
+    void addDirtySections();
+
+    // Binary greedy backend
+    // Meshes a non uniform chunk with ChunkMesherBackend::BINARY_GREEDY
+    void addBinaryGreedyChunk();
+    // Fills the padded row masks from blockData
+    void buildOccupancyMasks();
+    // Fills m_faceMasks with the visible faces in one direction
+    void buildFaceMasks(int face);
+    // Points the voxel state used by texturing at a cell of a face slice
+    void setGreedyVoxel(int face, int slice, int front, int right);
+    void addGreedySlice(int face, int slice);
+    // Adds a quad covering width x height faces, starting at the current voxel
+    void addGreedyQuad(int face, const BlockVertex& vertex, int width, int height);
     void computeAmbientOcclusion(int upOffset, int frontOffset, int rightOffset, f32 ambientOcclusion[]);
     void addFlora();
     void addFloraQuad(const ui8v3* positions, FloraQuadData& data);
@@ -93,11 +158,25 @@ class ChunkMesher {
     static void buildTransparentVao(ChunkMesh& cm);
     static void buildCutoutVao(ChunkMesh& cm);
     static void buildVao(ChunkMesh& cm);
+    static void buildPackedVao(ChunkMesh& cm);
+    static void uploadPalette(ChunkMesh& cm, std::vector<BlockVertexPaletteEntry>& palette);
     static void buildWaterVao(ChunkMesh& cm);
 
     ui16 m_quadIndices[PADDED_CHUNK_SIZE][6];
+
+    // Padded rows along x indexed [y][z], bit x is set for a padded voxel x
+    ui64 m_blockMasks[PADDED_CHUNK_WIDTH][PADDED_CHUNK_WIDTH]; ///< MeshType::BLOCK voxels
+    ui64 m_occludeMasks[PADDED_CHUNK_WIDTH][PADDED_CHUNK_WIDTH]; ///< Voxels that occlude everything
+    ui64 m_selfMasks[PADDED_CHUNK_WIDTH][PADDED_CHUNK_WIDTH]; ///< Voxels that only occlude their own block
+    ui32 m_floraMasks[CHUNK_WIDTH][CHUNK_WIDTH]; ///< Unpadded flora voxels, indexed [y][z]
+    // Visible faces of one direction indexed [slice][front], bit i is the face at right = i
+    ui32 m_faceMasks[CHUNK_WIDTH][CHUNK_WIDTH];
+    BlockVertex m_sliceVertices[CHUNK_WIDTH][CHUNK_WIDTH]; ///< Indexed [front][right]
     ui16 m_wvec[CHUNK_SIZE];
 
+    ui16 m_lodBlockData[CHUNK_SIZE / 8]; ///< One block per cell when lodLevel > 0, indexed [y][z][x]
+    std::vector<ui16> m_lodFloraVoxels; ///< Unpadded indices of the flora left in empty cells
+
     std::vector<BlockVertex> m_finalVerts[6];
 
     std::vector<VoxelQuad> m_floraQuads;
@@ -123,6 +202,9 @@ class ChunkMesher {
     static PlanetHeightData defaultChunkHeightData[CHUNK_LAYER];
 
     int wSize;
+    bool m_isUniform = false; ///< True if the chunk's blocks were a single value
+    bool m_hasTertiary = false; ///< True if any of the copied chunks had tertiary data
+    bool m_isTertiaryClear = false; ///< True if tertiaryData is known to be all 0
 
 //    ui32 m_finalQuads[7000];
 
@@ -0,0 +1,31 @@
+#include "stdafx.h"
+#include "ChunkNeighborhood.h"
+
+#include "ChunkAccessor.h"
+
+void ChunkNeighborhood::acquire(ChunkAccessor& accessor, const i32v3& minChunkPos, const i32v3& size) {
+    release();
+    m_minChunkPos = minChunkPos;
+    m_minVoxelPos = minChunkPos * CHUNK_WIDTH;
+    m_size = size;
+
+    // Handles are all released here, so resizing can't drop a reference
+    size_t numChunks = (size_t)(size.x * size.y * size.z);
+    m_chunks.resize(numChunks);
+    m_ids.resize(numChunks);
+    size_t i = 0;
+    for (int y = 0; y < size.y; y++) {
+        for (int z = 0; z < size.z; z++) {
+            for (int x = 0; x < size.x; x++) {
+                m_ids[i++] = ChunkID(minChunkPos + i32v3(x, y, z));
+            }
+        }
+    }
+    accessor.acquire(m_ids.data(), numChunks, m_chunks.data());
+}
+
+void ChunkNeighborhood::release() {
+    for (auto& chunk : m_chunks) {
+        chunk.release();
+    }
+}
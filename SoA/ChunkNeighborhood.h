@@ -0,0 +1,73 @@
+///
+/// ChunkNeighborhood.h
+/// Seed of Andromeda
+///
+/// Copyright 2014 Regrowth Studios
+/// MIT License
+///
+/// Summary:
+/// Box of chunks that are acquired and released together, with
+/// voxel addressing that crosses chunk borders.
+///
+
+#pragma once
+
+#ifndef ChunkNeighborhood_h__
+#define ChunkNeighborhood_h__
+
+#include "ChunkHandle.h"
+#include "Constants.h"
+
+class ChunkAccessor;
+
+class ChunkNeighborhood {
+public:
+    /// Acquires every chunk in the box [minChunkPos, minChunkPos + size)
+    /// Releases any chunks that were already held.
+    void acquire(ChunkAccessor& accessor, const i32v3& minChunkPos, const i32v3& size);
+    /// Acquires the 3x3x3 chunks around centerChunkPos
+    void acquire(ChunkAccessor& accessor, const i32v3& centerChunkPos) {
+        acquire(accessor, centerChunkPos - i32v3(1), i32v3(3));
+    }
+    /// Releases every chunk
+    void release();
+
+    /// @param chunkPos: Grid position of a chunk in the box
+    ChunkHandle& getChunk(const i32v3& chunkPos) {
+        return m_chunks[getChunkIndex(chunkPos - m_minChunkPos)];
+    }
+    /// Gets the chunk that holds a voxel.
+    /// @param voxelPos: Grid position of a voxel in the box
+    /// @param blockIndex: Receives the index of the voxel in the chunk
+    ChunkHandle& getChunkAt(const i32v3& voxelPos, OUT int& blockIndex) {
+        // Relative positions are never negative so we can mask and divide
+        i32v3 p = voxelPos - m_minVoxelPos;
+        blockIndex = (p.y & CHUNK_WIDTH_M1) * CHUNK_LAYER + (p.z & CHUNK_WIDTH_M1) * CHUNK_WIDTH + (p.x & CHUNK_WIDTH_M1);
+        return m_chunks[getChunkIndex(p / CHUNK_WIDTH)];
+    }
+    /// @return true if the voxel is inside the box
+    bool contains(const i32v3& voxelPos) const {
+        i32v3 p = voxelPos - m_minVoxelPos;
+        return p.x >= 0 && p.y >= 0 && p.z >= 0 &&
+            p.x < m_size.x * CHUNK_WIDTH && p.y < m_size.y * CHUNK_WIDTH && p.z < m_size.z * CHUNK_WIDTH;
+    }
+
+    /// Getters
+    const i32v3& getMinChunkPos() const { return m_minChunkPos; }
+    const i32v3& getSize() const { return m_size; }
+    size_t getNumChunks() const { return m_chunks.size(); }
+    ChunkHandle* begin() { return m_chunks.data(); }
+    ChunkHandle* end() { return m_chunks.data() + m_chunks.size(); }
+private:
+    size_t getChunkIndex(const i32v3& relPos) const {
+        return (size_t)((relPos.y * m_size.z + relPos.z) * m_size.x + relPos.x);
+    }
+
+    std::vector<ChunkHandle> m_chunks; ///< Indexed as (y * size.z + z) * size.x + x
+    std::vector<ChunkID> m_ids;
+    i32v3 m_minChunkPos = i32v3(0);
+    i32v3 m_minVoxelPos = i32v3(0);
+    i32v3 m_size = i32v3(0);
+};
+
+#endif // ChunkNeighborhood_h__
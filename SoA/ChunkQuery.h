@@ -45,6 +45,7 @@ class ChunkQuery {
     GenerateTask genTask; ///< For if the query results in generation
     ChunkHandle chunk; ///< Gets set on submitQuery
     bool shouldRelease;
+    bool isCancellable; ///< Dropped before generation once its requesters cancel, see ChunkGrid::cancelQueries
     ChunkGrid* grid;
 private:
     bool m_isFinished;
@@ -13,7 +13,9 @@
 #include "SoaOptions.h"
 #include "soaUtils.h"
 
+
 volatile f32 ChunkRenderer::fadeDist = 1.0f;
+volatile bool ChunkRenderer::isPackedSupported = false;
 f32m4 ChunkRenderer::worldMatrix = f32m4(1.0f);
 
 VGIndexBuffer ChunkRenderer::sharedIBO = 0;
@@ -48,6 +50,27 @@ void ChunkRenderer::init() {
         m_opaqueProgram.use();
         glUniform1i(m_opaqueProgram.getUniform("unTextures"), 0);
     }
+    { // Packed opaque
+        // packedShading.vert reads PackedBlockVertex as uvec2 vPacked and the face palette
+        // from usampler2D unPalette, unpacking it like ChunkMesher::unpackVertex.
+        // The layout constants are passed in so they can't drift from Vertex.h
+        nString defines = "#define QUAD_SIZE " + std::to_string(BLOCK_QUAD_SIZE) + "\n";
+        defines += "#define PALETTE_ENTRIES_PER_ROW " + std::to_string(PACKED_PALETTE_ENTRIES_PER_ROW) + "\n";
+        defines += "#define PALETTE_TEXELS_PER_ENTRY " + std::to_string(PACKED_PALETTE_TEXELS_PER_ENTRY) + "\n";
+        // Failing here is recoverable, so don't stop and wait for a recompile
+        m_packedOpaqueProgram = ShaderLoader::tryCreateProgramFromFile("Shaders/BlockShading/packedShading.vert",
+                                                                       "Shaders/BlockShading/standardShading.frag",
+                                                                       nullptr, defines.c_str());
+        isPackedSupported = m_packedOpaqueProgram.isLinked();
+        if (isPackedSupported) {
+            m_packedOpaqueProgram.use();
+            glUniform1i(m_packedOpaqueProgram.getUniform("unTextures"), 0);
+            glUniform1i(m_packedOpaqueProgram.getUniform("unPalette"), 1);
+        } else {
+            // Packed meshes couldn't be drawn, so don't make any this session
+            fprintf(stderr, "Failed to build the packed block shader, packed voxel vertices are disabled\n");
+        }
+    }
     // TODO(Ben): Fix the shaders
     { // Transparent
    //     m_transparentProgram = ShaderLoader::createProgramFromFile("Shaders/BlockShading/standardShading.vert",
@@ -68,6 +91,7 @@ void ChunkRenderer::init() {
 
 void ChunkRenderer::dispose() {
     if (m_opaqueProgram.isCreated()) m_opaqueProgram.dispose();
+    if (m_packedOpaqueProgram.isCreated()) m_packedOpaqueProgram.dispose();
     if (m_transparentProgram.isCreated()) m_transparentProgram.dispose();
     if (m_cutoutProgram.isCreated()) m_cutoutProgram.dispose();
     if (m_waterProgram.isCreated()) m_waterProgram.dispose();
@@ -76,32 +100,55 @@ void ChunkRenderer::dispose() {
 // TODO: blockAmbient variables were going unused, what are they for?
 
 void ChunkRenderer::beginOpaque(VGTexture textureAtlas, const f32v3& sunDir, const f32v3& lightColor VORB_MAYBE_UNUSED /*= f32v3(1.0f)*/, const f32v3& ambient /*= f32v3(0.0f)*/) {
+    // Packed meshes can be mixed in, so both programs get the same state
+    if (m_packedOpaqueProgram.isLinked()) {
+        m_packedOpaqueProgram.use();
+        setOpaqueUniforms(m_packedOpaqueProgram, sunDir, ambient);
+    }
     m_opaqueProgram.use();
-    glUniform3fv(m_opaqueProgram.getUniform("unLightDirWorld"), 1, &(sunDir[0]));
-    glUniform1f(m_opaqueProgram.getUniform("unSpecularExponent"), soaOptions.get(OPT_SPECULAR_EXPONENT).value.f);
-    glUniform1f(m_opaqueProgram.getUniform("unSpecularIntensity"), soaOptions.get(OPT_SPECULAR_INTENSITY).value.f * 0.3f);
+    setOpaqueUniforms(m_opaqueProgram, sunDir, ambient);
+    m_boundOpaqueProgram = &m_opaqueProgram;
 
     // Bind the block textures
     glActiveTexture(GL_TEXTURE0);
-    glUniform1i(m_opaqueProgram.getUniform("unTextures"), 0); // TODO(Ben): Temporary
     glBindTexture(GL_TEXTURE_2D_ARRAY, textureAtlas);
 
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sharedIBO);
+}
+
+void ChunkRenderer::setOpaqueUniforms(vg::GLProgram& program, const f32v3& sunDir, const f32v3& ambient) {
+    glUniform3fv(program.getUniform("unLightDirWorld"), 1, &(sunDir[0]));
+    glUniform1f(program.getUniform("unSpecularExponent"), soaOptions.get(OPT_SPECULAR_EXPONENT).value.f);
+    glUniform1f(program.getUniform("unSpecularIntensity"), soaOptions.get(OPT_SPECULAR_INTENSITY).value.f * 0.3f);
+
+    glUniform1i(program.getUniform("unTextures"), 0); // TODO(Ben): Temporary
+
     // f32 blockAmbient = 0.000f;
-    glUniform3fv(m_opaqueProgram.getUniform("unAmbientLight"), 1, &ambient[0]);
-    glUniform3fv(m_opaqueProgram.getUniform("unSunColor"), 1, &sunDir[0]);
+    glUniform3fv(program.getUniform("unAmbientLight"), 1, &ambient[0]);
+    glUniform3fv(program.getUniform("unSunColor"), 1, &sunDir[0]);
 
-    glUniform1f(m_opaqueProgram.getUniform("unFadeDist"), 100000.0f/*ChunkRenderer::fadeDist*/);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sharedIBO);
+    glUniform1f(program.getUniform("unFadeDist"), 100000.0f/*ChunkRenderer::fadeDist*/);
 }
 
-void ChunkRenderer::drawOpaque(const ChunkMesh *cm, const f64v3 &PlayerPos, const f32m4 &VP) const {
+void ChunkRenderer::drawOpaque(const ChunkMesh *cm, const f64v3 &PlayerPos, const f32m4 &VP) {
     if (cm->vaoID == 0) return;
+
+    vg::GLProgram& program = cm->isPacked ? m_packedOpaqueProgram : m_opaqueProgram;
+    if (&program != m_boundOpaqueProgram) {
+        program.use();
+        m_boundOpaqueProgram = &program;
+    }
+    if (cm->isPacked) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, cm->paletteTextureID);
+        glActiveTexture(GL_TEXTURE0);
+    }
     
     setMatrixTranslation(worldMatrix, f64v3(cm->position), PlayerPos);
 
     f32m4 MVP = VP * worldMatrix;
-    glUniformMatrix4fv(m_opaqueProgram.getUniform("unWVP"), 1, GL_FALSE, &MVP[0][0]);
-    glUniformMatrix4fv(m_opaqueProgram.getUniform("unW"), 1, GL_FALSE, &worldMatrix[0][0]);
+    glUniformMatrix4fv(program.getUniform("unWVP"), 1, GL_FALSE, &MVP[0][0]);
+    glUniformMatrix4fv(program.getUniform("unW"), 1, GL_FALSE, &worldMatrix[0][0]);
 
     glBindVertexArray(cm->vaoID);
 
@@ -135,7 +182,8 @@ void ChunkRenderer::drawOpaque(const ChunkMesh *cm, const f64v3 &PlayerPos, cons
 }
 
 void ChunkRenderer::drawOpaqueCustom(const ChunkMesh* cm, vg::GLProgram& m_program, const f64v3& PlayerPos, const f32m4& VP) {
-    if (cm->vaoID == 0) return;
+    // Custom programs only read BlockVertex
+    if (cm->vaoID == 0 || cm->isPacked) return;
     
     setMatrixTranslation(worldMatrix, f64v3(cm->position), PlayerPos);
 
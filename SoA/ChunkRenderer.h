@@ -19,7 +19,8 @@ class ChunkRenderer {
     void dispose();
 
     void beginOpaque(VGTexture textureAtlas, const f32v3& sunDir, const f32v3& lightColor = f32v3(1.0f), const f32v3& ambient = f32v3(0.0f));
-    void drawOpaque(const ChunkMesh* cm, const f64v3& PlayerPos, const f32m4& VP) const;
+    // Picks the packed program for packed meshes
+    void drawOpaque(const ChunkMesh* cm, const f64v3& PlayerPos, const f32m4& VP);
     static void drawOpaqueCustom(const ChunkMesh* cm, vg::GLProgram& m_program, const f64v3& PlayerPos, const f32m4& VP);
 
     void beginTransparent(VGTexture textureAtlas, const f32v3& sunDir, const f32v3& lightColor = f32v3(1.0f), const f32v3& ambient = f32v3(0.0f));
@@ -35,10 +36,16 @@ class ChunkRenderer {
     static void end();
 
     static volatile f32 fadeDist;
+    /// False if the packed shader failed to build, then OPT_VOXEL_PACKED_VERTICES is ignored
+    static volatile bool isPackedSupported;
     static VGIndexBuffer sharedIBO;
 private:
+    void setOpaqueUniforms(vg::GLProgram& program, const f32v3& sunDir, const f32v3& ambient);
+
     static f32m4 worldMatrix; ///< Reusable world matrix for chunks
     vg::GLProgram m_opaqueProgram;
+    vg::GLProgram m_packedOpaqueProgram; ///< Reads PackedBlockVertex and a palette
+    vg::GLProgram* m_boundOpaqueProgram = nullptr; ///< Program in use between beginOpaque and end
     vg::GLProgram m_transparentProgram;
     vg::GLProgram m_cutoutProgram;
     vg::GLProgram m_waterProgram;
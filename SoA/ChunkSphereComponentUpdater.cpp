@@ -12,6 +12,17 @@
 #define Y_AXIS 1
 #define Z_AXIS 2
 
+// Physics velocity is in voxels per update
+#define PREFETCH_UPDATES_PER_SECOND 60.0
+// How far ahead the path is predicted
+#define PREFETCH_SECONDS 2.0
+// Predicted centers sampled along the path
+#define PREFETCH_MAX_STEPS 8
+// Queries submitted per update
+#define PREFETCH_BUDGET 32
+// Chunks held ahead of the sphere
+#define PREFETCH_MAX_CHUNKS 512
+
 void ChunkSphereComponentUpdater::update(GameSystem* gameSystem, SpaceSystem* spaceSystem) {
     for (auto& it : gameSystem->chunkSphere) {
         ChunkSphereComponent& cmp = it.second;
@@ -20,6 +31,7 @@ void ChunkSphereComponentUpdater::update(GameSystem* gameSystem, SpaceSystem* sp
 
         // Check for grid shift or init
         if (cmp.currentCubeFace != chunkPos.face) {
+            releasePrefetch(cmp);
             releaseHandles(cmp);
             cmp.centerPosition = chunkPos;
             cmp.currentCubeFace = chunkPos.face;
@@ -27,6 +39,8 @@ void ChunkSphereComponentUpdater::update(GameSystem* gameSystem, SpaceSystem* sp
             cmp.chunkGrid = &sphericalVoxel.chunkGrids[chunkPos.face];
             initSphere(cmp);
         }
+        // The grid generates the chunks closest to us first
+        cmp.chunkGrid->setPriorityCenter(chunkPos.pos);
 
         // Check for shift
         if (chunkPos.pos != cmp.centerPosition) {
@@ -85,7 +99,6 @@ void ChunkSphereComponentUpdater::update(GameSystem* gameSystem, SpaceSystem* sp
                                 i32v3 chunkPos(cmp.centerPosition.x + x,
                                                cmp.centerPosition.y + y,
                                                cmp.centerPosition.z + z);
-                                // TODO(Ben): Sort
                                 cmp.handleGrid[index] = submitAndConnect(cmp, chunkPos);
                             }
                         }
@@ -93,9 +106,16 @@ void ChunkSphereComponentUpdater::update(GameSystem* gameSystem, SpaceSystem* sp
                 }
             }
         }
+
+        if (cmp.physics) updatePrefetch(gameSystem, cmp, voxelPos);
     }
 }
 
+f64 ChunkSphereComponentUpdater::getPrefetchHitRate(const ChunkSphereComponent& cmp) {
+    ui32 total = cmp.prefetchHits + cmp.prefetchMisses;
+    return total ? (f64)cmp.prefetchHits / (f64)total : 0.0;
+}
+
 void ChunkSphereComponentUpdater::setRadius(ChunkSphereComponent& cmp, ui32 radius) {
     // Release old handles
     releaseHandles(cmp);
@@ -198,41 +218,28 @@ void ChunkSphereComponentUpdater::shiftDirection(ChunkSphereComponent& cmp, int
 #undef GET_INDEX
 
 ChunkHandle ChunkSphereComponentUpdater::submitAndConnect(ChunkSphereComponent& cmp, const i32v3& chunkPos) {
-    ChunkHandle h = cmp.chunkGrid->submitQuery(chunkPos, GEN_DONE, true)->chunk.acquire();
-    // TODO(Ben): meshableNeighbors
-    // Acquire the 26 neighbors
-    // TODO(Ben): Could optimize
-    ChunkAccessor& accessor = cmp.chunkGrid->accessor;
-    { // Left
-        ChunkID id = h.getID();
-        id.x--;
-        h->neighbor.left = accessor.acquire(id);
-    }
-    { // Right
-        ChunkID id = h.getID();
-        id.x++;
-        h->neighbor.right = accessor.acquire(id);
-    }
-    { // Bottom
-        ChunkID id = h.getID();
-        id.y--;
-        h->neighbor.bottom = accessor.acquire(id);
-    }
-    { // Top
-        ChunkID id = h.getID();
-        id.y++;
-        h->neighbor.top = accessor.acquire(id);
-    }
-    { // Back
-        ChunkID id = h.getID();
-        id.z--;
-        h->neighbor.back = accessor.acquire(id);
-    }
-    { // Front
-        ChunkID id = h.getID();
-        id.z++;
-        h->neighbor.front = accessor.acquire(id);
+    ChunkHandle h;
+    cmp.chunkGrid->submitQuery(chunkPos, GEN_DONE, true, &h, true);
+    // Take over the chunk if we prefetched it
+    auto it = cmp.prefetchHandles.find(h.getID());
+    if (it != cmp.prefetchHandles.end()) {
+        cmp.prefetchHits++;
+        // Our query replaces the prefetch one
+        cmp.chunkGrid->cancelQueries(it->second);
+        it->second.release();
+        cmp.prefetchHandles.erase(it);
     }
+    // TODO(Ben): meshableNeighbors
+    // Acquire the face neighbors in one pass, in the same order as Chunk::neighbor
+    const ChunkID& id = h.getID();
+    ChunkID ids[6] = { id, id, id, id, id, id };
+    ids[0].x--; // Left
+    ids[1].x++; // Right
+    ids[2].y--; // Bottom
+    ids[3].y++; // Top
+    ids[4].z--; // Back
+    ids[5].z++; // Front
+    cmp.chunkGrid->accessor.acquire(ids, 6, h->neighbors);
     cmp.chunkGrid->onNeighborsAcquire(h);
     return h;
 
@@ -242,6 +249,8 @@ ChunkHandle ChunkSphereComponentUpdater::submitAndConnect(ChunkSphereComponent&
 void ChunkSphereComponentUpdater::releaseAndDisconnect(ChunkSphereComponent& cmp, ChunkHandle& h) {
     // Call the event first to prevent race condition
     cmp.chunkGrid->onNeighborsRelease(h);
+    // Don't generate chunks that left the sphere before their turn
+    cmp.chunkGrid->cancelQueries(h);
     h->neighbor.left.release();
     h->neighbor.right.release();
     h->neighbor.back.release();
@@ -278,7 +287,6 @@ void ChunkSphereComponentUpdater::initSphere(ChunkSphereComponent& cmp) {
                     i32v3 chunkPos(cmp.centerPosition.x + x,
                                    cmp.centerPosition.y + y,
                                    cmp.centerPosition.z + z);
-                    // TODO(Ben): Sort
                     cmp.handleGrid[index] = submitAndConnect(cmp, chunkPos);
                 }
             }
@@ -297,4 +305,122 @@ void ChunkSphereComponentUpdater::initSphere(ChunkSphereComponent& cmp) {
             }
         }
     }
-}
\ No newline at end of file
+}
+
+void ChunkSphereComponentUpdater::updatePrefetch(GameSystem* gameSystem, ChunkSphereComponent& cmp, const VoxelPositionComponent& voxelPos) {
+    auto& pyCmp = gameSystem->physics.get(cmp.physics);
+    f64v3 velocity = pyCmp.velocity * PREFETCH_UPDATES_PER_SECOND;
+    f64 distance = glm::length(velocity) * PREFETCH_SECONDS;
+
+    // Furthest center we expect to reach
+    i32v3 target = cmp.centerPosition;
+    if (distance >= CHUNK_WIDTH) {
+        VoxelPosition3D end = voxelPos.gridPosition;
+        end.pos += velocity * PREFETCH_SECONDS;
+        target = VoxelSpaceConversions::voxelToChunk(end).pos;
+    }
+    if (target != cmp.prefetchTarget || cmp.centerPosition != cmp.prefetchCenter) {
+        cmp.prefetchTarget = target;
+        cmp.prefetchCenter = cmp.centerPosition;
+        buildPrefetchCandidates(gameSystem, cmp, voxelPos, velocity, target == cmp.centerPosition ? 0.0 : distance);
+    }
+
+    // Submit the best candidates. They are further than anything in the sphere,
+    // so the grid generates them after the sphere's own chunks.
+    ui32 numSubmitted = 0;
+    while (cmp.prefetchCandidates.size() && numSubmitted < PREFETCH_BUDGET &&
+           cmp.prefetchHandles.size() < PREFETCH_MAX_CHUNKS) {
+        i32v3 chunkPos = cmp.prefetchCandidates.back();
+        cmp.prefetchCandidates.pop_back();
+        ChunkID id(chunkPos);
+        if (cmp.prefetchHandles.find(id) != cmp.prefetchHandles.end()) continue;
+        ChunkHandle h;
+        cmp.chunkGrid->submitQuery(chunkPos, GEN_DONE, true, &h, true);
+        // Moved so the map owns the reference the query acquired
+        cmp.prefetchHandles[id] = std::move(h);
+        cmp.prefetchSubmitted++;
+        numSubmitted++;
+    }
+}
+
+void ChunkSphereComponentUpdater::buildPrefetchCandidates(GameSystem* gameSystem, ChunkSphereComponent& cmp, const VoxelPositionComponent& voxelPos,
+                                                          const f64v3& velocity, f64 distance) {
+    cmp.prefetchCandidates.clear();
+    std::unordered_map<ChunkID, i32> scores; ///< Lower is better
+
+    if (distance > 0.0) {
+        // Look direction, same as the frustum
+        f64q orientation = voxelPos.orientation;
+        if (cmp.head) orientation = orientation * gameSystem->head.get(cmp.head).relativeOrientation;
+        f64v3 viewDir = orientation * f64v3(0.0, 0.0, 1.0);
+        f64v3 moveDir = glm::normalize(velocity);
+
+        int radius2 = cmp.radius * cmp.radius;
+        int numSteps = glm::min(PREFETCH_MAX_STEPS, (int)glm::ceil(distance / CHUNK_WIDTH));
+        i32v3 lastCenter = cmp.centerPosition;
+        for (int s = 1; s <= numSteps; s++) {
+            VoxelPosition3D p = voxelPos.gridPosition;
+            p.pos += moveDir * (distance * s / numSteps);
+            i32v3 center = VoxelSpaceConversions::voxelToChunk(p).pos;
+            if (center == lastCenter) continue;
+            lastCenter = center;
+            // Chunks in the sphere around this center that aren't in the current one
+            for (int y = -cmp.radius; y <= cmp.radius; y++) {
+                for (int z = -cmp.radius; z <= cmp.radius; z++) {
+                    for (int x = -cmp.radius; x <= cmp.radius; x++) {
+                        if (x * x + y * y + z * z > radius2) continue;
+                        i32v3 chunkPos = center + i32v3(x, y, z);
+                        i32v3 diff = chunkPos - cmp.centerPosition;
+                        int d2 = selfDot(diff);
+                        if (d2 <= radius2) continue;
+                        // Closest first, and chunks behind the view wait up to twice as long
+                        f64 facing = glm::dot(viewDir, glm::normalize(f64v3(diff)));
+                        i32 score = (i32)(d2 * (1.5 - 0.5 * facing));
+                        auto it = scores.find(ChunkID(chunkPos));
+                        if (it == scores.end()) {
+                            scores[ChunkID(chunkPos)] = score;
+                        } else if (score < it->second) {
+                            it->second = score;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Drop prefetched chunks that are off the path
+    for (auto it = cmp.prefetchHandles.begin(); it != cmp.prefetchHandles.end();) {
+        if (scores.find(it->first) == scores.end()) {
+            cmp.prefetchMisses++;
+            cmp.chunkGrid->cancelQueries(it->second);
+            it->second.release();
+            it = cmp.prefetchHandles.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    std::vector<std::pair<i32, ChunkID>> sorted;
+    sorted.reserve(scores.size());
+    for (auto& it : scores) sorted.emplace_back(it.second, it.first);
+    // Best last so candidates pop off the back
+    std::sort(sorted.begin(), sorted.end(), [](const std::pair<i32, ChunkID>& a, const std::pair<i32, ChunkID>& b) {
+        return a.first > b.first;
+    });
+    if (sorted.size() > PREFETCH_MAX_CHUNKS) {
+        sorted.erase(sorted.begin(), sorted.end() - PREFETCH_MAX_CHUNKS);
+    }
+    for (auto& it : sorted) {
+        cmp.prefetchCandidates.emplace_back((i32)it.second.x, (i32)it.second.y, (i32)it.second.z);
+    }
+}
+
+void ChunkSphereComponentUpdater::releasePrefetch(ChunkSphereComponent& cmp) {
+    for (auto& it : cmp.prefetchHandles) {
+        cmp.prefetchMisses++;
+        cmp.chunkGrid->cancelQueries(it.second);
+        it.second.release();
+    }
+    cmp.prefetchHandles.clear();
+    cmp.prefetchCandidates.clear();
+}
@@ -28,7 +28,17 @@ class ChunkSphereComponentUpdater {
 
     void setRadius(ChunkSphereComponent& cmp, ui32 radius);
 
+    /// @return Fraction of released prefetched chunks that the sphere used
+    static f64 getPrefetchHitRate(const ChunkSphereComponent& cmp);
+
 private:
+    /// Acquires chunks the sphere is about to move into
+    void updatePrefetch(GameSystem* gameSystem, ChunkSphereComponent& cmp, const VoxelPositionComponent& voxelPos);
+    /// Lists the chunks the sphere will enter along the predicted path, best last,
+    /// and releases prefetched chunks that are no longer on it
+    void buildPrefetchCandidates(GameSystem* gameSystem, ChunkSphereComponent& cmp, const VoxelPositionComponent& voxelPos,
+                                 const f64v3& velocity, f64 distance);
+    void releasePrefetch(ChunkSphereComponent& cmp);
     void shiftDirection(ChunkSphereComponent& cmp, int axis1, int axis2, int axis3, int offset);
     // Submits a gen query and connects to neighbors
     ChunkHandle submitAndConnect(ChunkSphereComponent& cmp, const i32v3& chunkPos);
@@ -126,7 +126,7 @@ void ChunkUpdater::placeBlockSafe(Chunk* chunk VORB_UNUSED, Chunk*& lockedChunk
 void ChunkUpdater::placeBlockNoUpdate(Chunk* chunk, BlockIndex blockIndex, BlockID blockType) {
  
     chunk->blocks.set(blockIndex, blockType);
-    chunk->flagDirty();
+    chunk->flagDirty(blockIndex);
 
     //Block &block = GETBLOCK(blockType);
 
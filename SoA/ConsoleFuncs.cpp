@@ -107,9 +107,34 @@ void registerFuncs(vscript::Environment& env) {
     env.addCRDelegate("create", makeRDelegate(createCASData));
     env.addCDelegate("run", makeDelegate(runCAS));
     env.addCDelegate("free", makeDelegate(freeCAS));
+    env.addCDelegate("scale", makeDelegate(runCASScaling));
 
     env.setNamespaces("CHS");
     env.addCDelegate("run", makeDelegate(runCHS));
 
+    env.setNamespaces("CDL");
+    env.addCDelegate("run", makeDelegate(runCDL));
+
+    env.setNamespaces("VRC");
+    env.addCDelegate("run", makeDelegate(runVRC));
+
+    env.setNamespaces("NBK");
+    env.addCDelegate("run", makeDelegate(runNBK));
+
+    env.setNamespaces("NPE");
+    env.addCDelegate("run", makeDelegate(runNPE));
+
+    env.setNamespaces("HMB");
+    env.addCDelegate("run", makeDelegate(runHMB));
+
+    env.setNamespaces("CGB");
+    env.addCDelegate("run", makeDelegate(runCGB));
+
+    env.setNamespaces("CVP");
+    env.addCDelegate("run", makeDelegate(runCVP));
+
+    env.setNamespaces("CLM");
+    env.addCDelegate("run", makeDelegate(runCLM));
+
     env.setNamespaces();
 }
@@ -1,8 +1,23 @@
 #include "stdafx.h"
 #include "ConsoleTests.h"
 
+#include "BlockLoader.h"
+#include "BlockPack.h"
 #include "ChunkAllocator.h"
 #include "ChunkAccessor.h"
+#include "ChunkMesher.h"
+#include "FloraGenerator.h"
+#include "GenerateTask.h"
+#include "Noise.h"
+#include "PlanetGenData.h"
+#include "PlanetGenLoader.h"
+#include "PlanetHeightData.h"
+#include "ProceduralChunkGenerator.h"
+#include "SoAState.h"
+#include "SoaEngine.h"
+#include "SphericalHeightmapGenerator.h"
+#include "VoxPool.h"
+#include "VoxelRunKernels.h"
 
 #include <random>
 #include <Vorb/Timing.h>
@@ -82,6 +97,11 @@ void runCAS(ChunkAccessSpeedData* data) {
 
 void freeCAS(ChunkAccessSpeedData* data) {
     printf("Chunks Alive: %zu\n", data->accessor.getCountAlive());
+    ChunkAllocatorStats stats = data->allocator.getStats();
+    printf("Allocator Pages: %zu, Live Chunks: %zu, Free Chunks: %zu\n",
+           stats.numPages, stats.numLiveChunks, stats.numFreeChunks);
+    printf("Allocator Magazine Hits: %zu, Free List Hits: %zu, Page Misses: %zu\n",
+           stats.magazineHits, stats.freeListHits, stats.pageMisses);
     fflush(stdout);
     data->accessor.destroy();
     delete[] data->ids;
@@ -90,6 +110,116 @@ void freeCAS(ChunkAccessSpeedData* data) {
     delete data;
 }
 
+#define CAS_MAX_HELD 32
+
+static f64 timeChunkAccess(ChunkAccessor& accessor, size_t numThreads, size_t requestsPerThread, ui64 maxID) {
+    std::vector<std::thread> threads(numThreads);
+    PreciseTimer timer;
+    timer.start();
+    for (size_t threadID = 0; threadID < numThreads; threadID++) {
+        threads[threadID] = std::thread([=, &accessor] () {
+            std::mt19937 rEngine((ui32)threadID);
+            std::uniform_int_distribution<ui64> idDist(0, maxID - 1);
+            std::uniform_int_distribution<int> opDist(0, 3);
+            // Ring of handles this thread holds, oldest is released first
+            ChunkHandle held[CAS_MAX_HELD];
+            size_t head = 0, count = 0;
+            for (size_t i = 0; i < requestsPerThread; i++) {
+                int op = opDist(rEngine);
+                if (count && (op == 0 || count == CAS_MAX_HELD)) {
+                    held[head].release();
+                    head = (head + 1) % CAS_MAX_HELD;
+                    count--;
+                    if (op == 0) continue;
+                }
+                ChunkHandle& dst = held[(head + count) % CAS_MAX_HELD];
+                if (count == 0 || op == 1) {
+                    dst = accessor.acquire(ChunkID(idDist(rEngine)));
+                } else if (op == 2) {
+                    // Copy an acquired handle
+                    dst = held[(head + rEngine() % count) % CAS_MAX_HELD].acquire();
+                } else {
+                    // Reacquire an unacquired copy by ID
+                    ChunkHandle copy(held[(head + rEngine() % count) % CAS_MAX_HELD]);
+                    copy.acquireSelf();
+                    dst = std::move(copy);
+                }
+                count++;
+            }
+            for (; count; count--, head = (head + 1) % CAS_MAX_HELD) {
+                held[head].release();
+            }
+            PagedChunkAllocator::flushThreadCache();
+        });
+    }
+    for (auto& t : threads) t.join();
+    return timer.stop();
+}
+
+#define CAS_ALLOC_BATCH 256
+
+static f64 timeChunkAllocation(PagedChunkAllocator& allocator, size_t numThreads, size_t allocsPerThread) {
+    std::vector<std::thread> threads(numThreads);
+    std::vector<std::vector<Chunk*>> batches(numThreads);
+    PreciseTimer timer;
+    timer.start();
+    for (size_t threadID = 0; threadID < numThreads; threadID++) {
+        threads[threadID] = std::thread([=, &allocator, &batches] () {
+            std::vector<Chunk*>& batch = batches[threadID];
+            batch.reserve(CAS_ALLOC_BATCH);
+            for (size_t i = 0; i < allocsPerThread; i += CAS_ALLOC_BATCH) {
+                size_t n = std::min((size_t)CAS_ALLOC_BATCH, allocsPerThread - i);
+                for (size_t j = 0; j < n; j++) {
+                    batch.push_back(allocator.alloc());
+                    // Flatten like generation does, so the voxel array recycler is measured too
+                    batch.back()->blocks.init(vvox::VoxelStorageState::FLAT_ARRAY);
+                }
+                // Keep the last batch so another thread can free it
+                if (i + n >= allocsPerThread) break;
+                for (auto& chunk : batch) allocator.free(chunk);
+                batch.clear();
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    // Free every batch from a thread that didn't allocate it, then give back what it cached
+    std::thread([&allocator, &batches] () {
+        for (auto& batch : batches) {
+            for (auto& chunk : batch) allocator.free(chunk);
+        }
+        PagedChunkAllocator::flushThreadCache();
+    }).join();
+    return timer.stop();
+}
+
+void runCASScaling(size_t maxThreads, size_t requestsPerThread, ui64 maxID) {
+    printf("Threads | ms | requests/ms | chunks alive after | alloc ms | allocs/ms | pages | magazine hits | free list hits | page misses | recycler hits | recycler misses\n");
+    if (maxThreads == 0) maxThreads = 1;
+    if (maxID == 0) maxID = 1;
+    for (size_t numThreads = 1;; numThreads *= 2) {
+        if (numThreads > maxThreads) numThreads = maxThreads;
+        PagedChunkAllocator allocator = {};
+        ChunkAccessor accessor = {};
+        accessor.init(&allocator);
+
+        f64 ms = timeChunkAccess(accessor, numThreads, requestsPerThread, maxID);
+        size_t numAlive = accessor.getCountAlive();
+        // Raw allocator churn, with the same number of operations
+        f64 allocMs = timeChunkAllocation(allocator, numThreads, requestsPerThread);
+        ChunkAllocatorStats stats = allocator.getStats();
+        printf("%7zu | %lf | %lf | %zu | %lf | %lf | %zu | %zu | %zu | %zu | %zu | %zu\n", numThreads, ms,
+               (numThreads * requestsPerThread) / ms, numAlive, allocMs, (numThreads * requestsPerThread) / allocMs,
+               stats.numPages, stats.magazineHits, stats.freeListHits, stats.pageMisses,
+               stats.recyclerHits, stats.recyclerMisses);
+        if (numAlive) printf("ERROR: Every handle was released but %zu chunks are alive\n", numAlive);
+        if (stats.numLiveChunks) printf("ERROR: Every chunk was freed but the allocator counts %zu live\n", stats.numLiveChunks);
+
+        accessor.destroy();
+        if (numThreads == maxThreads) break;
+    }
+    fflush(stdout);
+}
+
 void runCHS() {
     PagedChunkAllocator allocator = {};
     ChunkAccessor accessor = {};
@@ -102,3 +232,792 @@ void runCHS() {
     h2.release();
     h1.release();
 }
+
+template<typename Lock, typename ReadGuard>
+static f64 timeChunkDataAccess(Chunk* chunk, Lock& lock, size_t numThreads, size_t accessesPerThread, size_t writeInterval) {
+    std::vector<std::thread> threads(numThreads);
+    std::atomic<ui64> checksum(0);
+    PreciseTimer timer;
+    timer.start();
+    for (size_t threadID = 0; threadID < numThreads; threadID++) {
+        threads[threadID] = std::thread([=, &lock, &checksum] () {
+            ui16 row[CHUNK_WIDTH];
+            ui64 sum = 0;
+            for (size_t i = 0; i < accessesPerThread; i++) {
+                size_t index = ((threadID * 7919 + i) * CHUNK_WIDTH) % CHUNK_SIZE;
+                if (writeInterval && i % writeInterval == 0) {
+                    std::lock_guard<Lock> l(lock);
+                    chunk->blocks.set(index, (ui16)i);
+                } else {
+                    ReadGuard l(lock);
+                    chunk->blocks.copyRange(index, CHUNK_WIDTH, row);
+                    sum += row[0] + row[CHUNK_WIDTH - 1];
+                }
+            }
+            checksum += sum;
+        });
+    }
+    for (auto& t : threads) t.join();
+    return timer.stop();
+}
+
+void runCDL(size_t maxThreads, size_t accessesPerThread, size_t writeInterval) {
+    PagedChunkAllocator allocator = {};
+    ChunkAccessor accessor = {};
+    accessor.init(&allocator);
+
+    ChunkHandle chunk = accessor.acquire(0);
+    chunk->initAndFillEmpty(FACE_TOP);
+    chunk->blocks.changeState(vvox::VoxelStorageState::FLAT_ARRAY, chunk->dataMutex);
+
+    std::mutex plainMutex;
+    printf("Threads | std::mutex ms | ChunkDataLock ms\n");
+    if (maxThreads == 0) maxThreads = 1;
+    for (size_t numThreads = 1;; numThreads *= 2) {
+        if (numThreads > maxThreads) numThreads = maxThreads;
+        f64 plain = timeChunkDataAccess<std::mutex, std::lock_guard<std::mutex>>(chunk, plainMutex, numThreads, accessesPerThread, writeInterval);
+        f64 shared = timeChunkDataAccess<ChunkDataLock, std::shared_lock<ChunkDataLock>>(chunk, chunk->dataMutex, numThreads, accessesPerThread, writeInterval);
+        printf("%7zu | %13lf | %16lf\n", numThreads, plain, shared);
+        if (numThreads == maxThreads) break;
+    }
+    fflush(stdout);
+
+    chunk.release();
+    accessor.destroy();
+}
+
+void runVRC(SoaState* state, vecs::EntityID planet, size_t numChunks) {
+    typedef IntervalTree<ui16>::LNode LNode;
+
+    ProceduralChunkGenerator generator;
+    generator.init(state->spaceSystem->sphericalTerrain.getFromEntity(planet).planetGenData);
+
+    PagedChunkAllocator allocator = {};
+    ChunkAccessor accessor = {};
+    accessor.init(&allocator);
+
+    // Generate a row of chunks that straddle the surface so the data has real runs
+    std::vector<ui16> flat(numChunks * CHUNK_SIZE);
+    PlanetHeightData heightData[CHUNK_LAYER];
+    for (size_t i = 0; i < numChunks; i++) {
+        ChunkHandle probe = accessor.acquire(ChunkID((i32)i, 0, 0));
+        probe->init(FACE_TOP);
+        generator.generateHeightmap(probe, heightData);
+        probe.release();
+
+        i32 surfaceY = (i32)floor(heightData[CHUNK_LAYER / 2].height / CHUNK_WIDTH);
+        ChunkHandle chunk = accessor.acquire(ChunkID((i32)i, surfaceY, 0));
+        chunk->init(FACE_TOP);
+        generator.generateChunk(chunk, heightData);
+        chunk->blocks.copyRange(0, CHUNK_SIZE, &flat[i * CHUNK_SIZE]);
+        chunk->floraToGenerate.clear();
+        chunk.release();
+    }
+
+    std::vector<LNode> runsScalar(CHUNK_SIZE);
+    std::vector<LNode> runsKernel(CHUNK_SIZE);
+    std::vector<ui16> outScalar(CHUNK_SIZE);
+    std::vector<ui16> outKernel(CHUNK_SIZE);
+    f64 compressScalar = 0.0, compressKernel = 0.0;
+    f64 expandScalar = 0.0, expandKernel = 0.0;
+    size_t totalRuns = 0;
+    bool matches = true;
+    PreciseTimer timer;
+    for (size_t i = 0; i < numChunks; i++) {
+        const ui16* data = &flat[i * CHUNK_SIZE];
+
+        // Scalar compression, as done before the kernels existed
+        timer.start();
+        size_t index = 0;
+        runsScalar[0].set(0, 1, data[0]);
+        for (size_t j = 1; j < CHUNK_SIZE; j++) {
+            if (data[j] == runsScalar[index].data) {
+                ++runsScalar[index].length;
+            } else {
+                runsScalar[++index].set((ui16)j, 1, data[j]);
+            }
+        }
+        size_t numScalar = index + 1;
+        compressScalar += timer.stop();
+
+        timer.start();
+        size_t numKernel = 0;
+        vvox::appendRuns(data, CHUNK_SIZE, 0, &runsKernel[0], numKernel);
+        compressKernel += timer.stop();
+
+        timer.start();
+        index = 0;
+        for (size_t j = 0; j < numScalar; j++) {
+            for (int k = 0; k < runsScalar[j].length; k++) {
+                outScalar[index++] = runsScalar[j].data;
+            }
+        }
+        expandScalar += timer.stop();
+
+        timer.start();
+        for (size_t j = 0; j < numKernel; j++) {
+            vvox::fillRun(&outKernel[runsKernel[j].start], runsKernel[j].length, runsKernel[j].data);
+        }
+        expandKernel += timer.stop();
+
+        totalRuns += numKernel;
+        if (numScalar != numKernel || outScalar != outKernel ||
+            memcmp(data, &outKernel[0], CHUNK_SIZE * sizeof(ui16))) {
+            matches = false;
+        }
+    }
+
+    printf("Chunks: %zu, Average Runs: %zu, Results %s\n", numChunks,
+           numChunks ? totalRuns / numChunks : 0, matches ? "match" : "DIFFER");
+    printf("Compress   scalar %lf ms, kernel %lf ms\n", compressScalar, compressKernel);
+    printf("Decompress scalar %lf ms, kernel %lf ms\n", expandScalar, expandKernel);
+    fflush(stdout);
+
+    accessor.destroy();
+}
+
+void runNBK(size_t numPoints, int octaves) {
+    std::mt19937 rEngine(1337);
+    std::uniform_real_distribution<f64> coord(-10000.0, 10000.0);
+    std::vector<f64> x(numPoints), y(numPoints), z(numPoints), w(numPoints);
+    for (size_t i = 0; i < numPoints; i++) {
+        x[i] = coord(rEngine);
+        y[i] = coord(rEngine);
+        z[i] = coord(rEngine);
+        w[i] = coord(rEngine);
+    }
+    // Cell borders are where the two floors are most likely to disagree
+    for (size_t i = 0; i < numPoints / 16; i++) {
+        x[i] = floor(x[i]);
+        y[i] = floor(y[i]);
+    }
+
+    std::vector<f64> scalar(numPoints), batch(numPoints);
+    PreciseTimer timer;
+    auto compare = [&] (const char* name, f64 scalarMs, f64 batchMs) {
+        f64 maxError = 0.0;
+        size_t numExact = 0;
+        for (size_t i = 0; i < numPoints; i++) {
+            f64 error = glm::abs(scalar[i] - batch[i]);
+            if (error > maxError) maxError = error;
+            if (scalar[i] == batch[i]) numExact++;
+        }
+        printf("%-10s scalar %lf ms, batch %lf ms, max error %g, exact %zu/%zu, Results %s\n", name,
+               scalarMs, batchMs, maxError, numExact, numPoints,
+               maxError <= Noise::BATCH_TOLERANCE ? "match" : "DIFFER");
+    };
+
+    f64 scalarMs, batchMs;
+    timer.start();
+    for (size_t i = 0; i < numPoints; i++) scalar[i] = Noise::raw(x[i], y[i]);
+    scalarMs = timer.stop();
+    timer.start();
+    Noise::rawBatch(&x[0], &y[0], numPoints, &batch[0]);
+    batchMs = timer.stop();
+    compare("raw 2D", scalarMs, batchMs);
+
+    timer.start();
+    for (size_t i = 0; i < numPoints; i++) scalar[i] = Noise::raw(x[i], y[i], z[i]);
+    scalarMs = timer.stop();
+    timer.start();
+    Noise::rawBatch(&x[0], &y[0], &z[0], numPoints, &batch[0]);
+    batchMs = timer.stop();
+    compare("raw 3D", scalarMs, batchMs);
+
+    timer.start();
+    for (size_t i = 0; i < numPoints; i++) scalar[i] = Noise::raw(x[i], y[i], z[i], w[i]);
+    scalarMs = timer.stop();
+    timer.start();
+    Noise::rawBatch(&x[0], &y[0], &z[0], &w[0], numPoints, &batch[0]);
+    batchMs = timer.stop();
+    compare("raw 4D", scalarMs, batchMs);
+
+    const f64 persistence = 0.6, frequency = 0.001;
+    timer.start();
+    for (size_t i = 0; i < numPoints; i++) scalar[i] = Noise::fractal(octaves, persistence, frequency, x[i], y[i], z[i]);
+    scalarMs = timer.stop();
+    timer.start();
+    Noise::fractalBatch(octaves, persistence, frequency, &x[0], &y[0], &z[0], numPoints, &batch[0]);
+    batchMs = timer.stop();
+    compare("fractal 3D", scalarMs, batchMs);
+    fflush(stdout);
+}
+
+namespace {
+    f64 doNoiseOperation(TerrainOp op, f64 a, f64 b) {
+        switch (op) {
+            case TerrainOp::ADD: return a + b;
+            case TerrainOp::SUB: return a - b;
+            case TerrainOp::MUL: return a * b;
+            case TerrainOp::DIV: return a / b;
+        }
+        return 0.0;
+    }
+
+    /// The recursive walk that NoiseProgram replaced, kept as the reference.
+    /// A CONSTANT at the root skips its clamp rather than reading the missing modifier.
+    void walkNoiseFuncs(const f64v3& pos, const Array<TerrainFuncProperties>& funcs, f64* modifier, TerrainOp op, f64& height) {
+        for (size_t f = 0; f < funcs.size(); ++f) {
+            const TerrainFuncProperties& fn = funcs[f];
+            bool hasClamp = fn.clamp[0] != 0.0 || fn.clamp[1] != 0.0;
+
+            f64 h = 0.0;
+            f64* nextMod;
+            TerrainOp nextOp;
+            if (fn.func == TerrainStage::CONSTANT) {
+                nextMod = &h;
+                h = fn.low;
+                if (modifier) {
+                    h = doNoiseOperation(op, h, *modifier);
+                    if (hasClamp) h = glm::clamp(*modifier, fn.clamp[0], fn.clamp[1]);
+                }
+                nextOp = fn.op;
+            } else if (fn.func == TerrainStage::PASS_THROUGH) {
+                nextMod = modifier;
+                if (modifier) {
+                    h = doNoiseOperation(op, *modifier, fn.low);
+                    if (hasClamp) h = glm::clamp(h, fn.clamp[0], fn.clamp[1]);
+                }
+                nextOp = op;
+            } else if (fn.func == TerrainStage::SQUARED || fn.func == TerrainStage::CUBED) {
+                nextMod = modifier;
+                if (modifier) {
+                    f64 m = *modifier;
+                    *modifier = fn.func == TerrainStage::SQUARED ? m * m : m * m * m;
+                    if (hasClamp) h = glm::clamp(h, fn.clamp[0], fn.clamp[1]);
+                }
+                nextOp = op;
+            } else {
+                nextMod = &h;
+                f64 total = 0.0;
+                f64 maxAmplitude = 0.0;
+                f64 amplitude = 1.0;
+                f64 frequency = fn.frequency;
+                for (int i = 0; i < fn.octaves; i++) {
+                    f64 noise;
+                    switch (fn.func) {
+                        case TerrainStage::CELLULAR_NOISE:
+                        case TerrainStage::CELLULAR_SQUARED_NOISE:
+                        case TerrainStage::CELLULAR_CUBED_NOISE: {
+                            f64v2 ff = Noise::cellular(pos * frequency);
+                            noise = ff.y - ff.x;
+                        } break;
+                        default:
+                            noise = Noise::raw(pos.x * frequency, pos.y * frequency, pos.z * frequency);
+                            break;
+                    }
+                    switch (fn.func) {
+                        case TerrainStage::RIDGED_NOISE:
+                            total += ((1.0 - glm::abs(noise)) * 2.0 - 1.0) * amplitude;
+                            break;
+                        case TerrainStage::ABS_NOISE:
+                            total += glm::abs(noise) * amplitude;
+                            break;
+                        case TerrainStage::CELLULAR_SQUARED_NOISE:
+                            total += noise * noise * amplitude;
+                            break;
+                        case TerrainStage::CELLULAR_CUBED_NOISE:
+                            total += noise * noise * noise * amplitude;
+                            break;
+                        default:
+                            total += noise * amplitude;
+                            break;
+                    }
+                    frequency *= 2.0;
+                    maxAmplitude += amplitude;
+                    amplitude *= fn.persistence;
+                }
+                total = (total / maxAmplitude);
+                if (fn.func == TerrainStage::CUBED_NOISE) {
+                    total = total * total * total;
+                } else if (fn.func == TerrainStage::SQUARED_NOISE) {
+                    total = total * total;
+                }
+                if (fn.low != -1.0 || fn.high != 1.0) {
+                    h = total * (fn.high - fn.low) * 0.5 + (fn.high + fn.low) * 0.5;
+                } else {
+                    h = total;
+                }
+                if (hasClamp) h = glm::clamp(h, fn.clamp[0], fn.clamp[1]);
+                if (modifier) h = doNoiseOperation(op, h, *modifier);
+                nextOp = fn.op;
+            }
+
+            if (fn.children.size()) {
+                // Early exit for speed
+                if (!(nextOp == TerrainOp::MUL && *nextMod == 0.0)) {
+                    walkNoiseFuncs(pos, fn.children, nextMod, nextOp, height);
+                }
+            } else {
+                height = doNoiseOperation(fn.op, height, h);
+            }
+        }
+    }
+
+    void randomNoiseFuncs(std::mt19937& rEngine, Array<TerrainFuncProperties>& funcs, int depth) {
+        std::uniform_int_distribution<int> countDist(1, 3);
+        std::uniform_int_distribution<int> stageDist(0, (int)TerrainStage::PASS_THROUGH);
+        std::uniform_int_distribution<int> opDist(0, (int)TerrainOp::DIV);
+        std::uniform_int_distribution<int> octaveDist(1, 4);
+        std::uniform_real_distribution<f64> unit(-1.0, 1.0);
+
+        size_t count = countDist(rEngine);
+        funcs.setData(count);
+        for (size_t i = 0; i < count; i++) {
+            // Copying nested Arrays is shallow, so children are built in place
+            TerrainFuncProperties& fn = *new (&funcs[i]) TerrainFuncProperties();
+            fn.func = (TerrainStage)stageDist(rEngine);
+            fn.op = (TerrainOp)opDist(rEngine);
+            fn.octaves = octaveDist(rEngine);
+            fn.persistence = 0.5 + 0.25 * unit(rEngine);
+            fn.frequency = 0.01 * (1.5 + unit(rEngine));
+            // Zero constants exercise the MUL early exit
+            fn.low = rEngine() % 4 ? 2.0 * unit(rEngine) : 0.0;
+            fn.high = rEngine() % 2 ? fn.low + 1.5 + unit(rEngine) : 1.0;
+            if (rEngine() % 3 == 0) {
+                fn.clamp.x = unit(rEngine);
+                fn.clamp.y = fn.clamp.x + 1.0 + unit(rEngine);
+            }
+            if (depth > 0 && rEngine() % 2) randomNoiseFuncs(rEngine, fn.children, depth - 1);
+        }
+    }
+    /// Destroys what randomNoiseFuncs constructed in place
+    void freeNoiseFuncs(Array<TerrainFuncProperties>& funcs) {
+        for (size_t i = 0; i < funcs.size(); i++) {
+            freeNoiseFuncs(funcs[i].children);
+            funcs[i].~TerrainFuncProperties();
+        }
+        funcs.setData();
+    }
+}
+
+void runNPE(size_t numTrees, size_t numPoints) {
+    std::mt19937 rEngine(1337);
+    std::uniform_real_distribution<f64> coord(-1000.0, 1000.0);
+    std::vector<f64> x(numPoints), y(numPoints), z(numPoints);
+    std::vector<f64> walked(numPoints), scalar(numPoints), batch(numPoints);
+
+    PreciseTimer timer;
+    f64 walkMs = 0.0, scalarMs = 0.0, batchMs = 0.0;
+    size_t numExact = 0, numBatchExact = 0, numOutside = 0;
+    f64 maxError = 0.0;
+    for (size_t t = 0; t < numTrees; t++) {
+        NoiseBase noise;
+        noise.base = coord(rEngine) * 0.001;
+        randomNoiseFuncs(rEngine, noise.funcs, 3);
+        noise.compile();
+        for (size_t i = 0; i < numPoints; i++) {
+            x[i] = coord(rEngine);
+            y[i] = coord(rEngine);
+            z[i] = coord(rEngine);
+        }
+
+        timer.start();
+        for (size_t i = 0; i < numPoints; i++) {
+            walked[i] = noise.base;
+            walkNoiseFuncs(f64v3(x[i], y[i], z[i]), noise.funcs, nullptr, TerrainOp::ADD, walked[i]);
+        }
+        walkMs += timer.stop();
+        timer.start();
+        for (size_t i = 0; i < numPoints; i++) scalar[i] = noise.evaluate(f64v3(x[i], y[i], z[i]));
+        scalarMs += timer.stop();
+        timer.start();
+        noise.evaluateBatch(&x[0], &y[0], &z[0], numPoints, &batch[0]);
+        batchMs += timer.stop();
+
+        for (size_t i = 0; i < numPoints; i++) {
+            // Both sides may divide by zero the same way
+            bool isSameNaN = std::isnan(scalar[i]) && std::isnan(batch[i]);
+            if (walked[i] == scalar[i] || (std::isnan(walked[i]) && std::isnan(scalar[i]))) numExact++;
+            if (scalar[i] == batch[i] || isSameNaN) {
+                numBatchExact++;
+                continue;
+            }
+            // Rounding grows with the magnitude of the result
+            f64 error = glm::abs(scalar[i] - batch[i]) / glm::max(1.0, glm::abs(scalar[i]));
+            if (!(error <= Noise::BATCH_TOLERANCE)) numOutside++;
+            if (error > maxError || std::isnan(error)) maxError = error;
+        }
+        freeNoiseFuncs(noise.funcs);
+    }
+
+    size_t total = numTrees * numPoints;
+    printf("Trees: %zu, Points: %zu\n", numTrees, numPoints);
+    printf("walk %lf ms, evaluate %lf ms, exact %zu/%zu, Results %s\n",
+           walkMs, scalarMs, numExact, total, numExact == total ? "match" : "DIFFER");
+    printf("evaluateBatch %lf ms, exact %zu/%zu, max relative error %g, outside tolerance %zu, Results %s\n",
+           batchMs, numBatchExact, total, maxError, numOutside, numOutside ? "DIFFER" : "match");
+    fflush(stdout);
+}
+
+void runHMB(SoaState* state, vecs::EntityID planet, size_t resolution) {
+    const PlanetGenData* genData = state->spaceSystem->sphericalTerrain.getFromEntity(planet).planetGenData;
+    SphericalHeightmapGenerator generator;
+    generator.init(genData);
+
+    // Columns span the whole face so every base biome gets blended
+    const f64 faceRadius = genData->radius * VOXELS_PER_KM;
+    const f64 step = resolution > 1 ? 2.0 * faceRadius / (f64)(resolution - 1) : 0.0;
+    VoxelPosition2D facePosition;
+    facePosition.face = FACE_TOP;
+    PlanetHeightData height;
+    f64 checksum = 0.0;
+    PreciseTimer timer;
+    timer.start();
+    for (size_t z = 0; z < resolution; z++) {
+        facePosition.pos.y = -faceRadius + (f64)z * step;
+        for (size_t x = 0; x < resolution; x++) {
+            facePosition.pos.x = -faceRadius + (f64)x * step;
+            generator.generateHeightData(height, facePosition);
+            checksum += height.height;
+        }
+    }
+    f64 ms = timer.stop();
+
+    size_t numColumns = resolution * resolution;
+    printf("Columns: %zu, %lf ms, %.0lf columns/sec, checksum %lf\n", numColumns, ms,
+           ms > 0.0 ? (f64)numColumns / (ms * 0.001) : 0.0, checksum);
+    fflush(stdout);
+}
+
+struct ChunkGenBenchData {
+    ProceduralChunkGenerator generator;
+    ChunkAccessor accessor;
+    size_t chunksPerColumn;
+    std::atomic<size_t> numFinished{ 0 };
+};
+
+class ChunkGenBenchTask : public vcore::IThreadPoolTask<WorkerData> {
+public:
+    ChunkGenBenchTask() : vcore::IThreadPoolTask<WorkerData>(GENERATE_TASK_ID) {}
+
+    void execute(WorkerData* workerData) override;
+
+    ChunkGenBenchData* data = nullptr;
+    i32v2 column;
+
+    // Results
+    f64 heightmapMs = 0.0;
+    f64 terrainMs = 0.0;
+    std::vector<f64> floraMs; ///< Per chunk
+    ui64 checksum = 0; ///< Sum of chunk hashes so completion order doesn't matter
+    size_t storageStates[4] = {}; ///< Chunks per vvox::VoxelStorageState
+};
+
+namespace {
+    inline ui64 fnv1a(ui64 h, const void* data, size_t size) {
+        const ui8* bytes = (const ui8*)data;
+        for (size_t i = 0; i < size; i++) {
+            h ^= bytes[i];
+            h *= 0x100000001B3ull;
+        }
+        return h;
+    }
+
+    inline f64 percentile(std::vector<f64>& samples, f64 q) {
+        if (samples.empty()) return 0.0;
+        std::sort(samples.begin(), samples.end());
+        size_t i = (size_t)(q * (f64)samples.size());
+        return samples[std::min(i, samples.size() - 1)];
+    }
+}
+
+void ChunkGenBenchTask::execute(WorkerData* workerData) {
+    PreciseTimer timer;
+    PlanetHeightData heightData[CHUNK_LAYER];
+
+    // Heightmap, generated through the bottom chunk like GenerateTask does
+    ChunkHandle probe = data->accessor.acquire(ChunkID(column.x, 0, column.y));
+    probe->init(FACE_TOP);
+    timer.start();
+    data->generator.generateHeightmap(probe, heightData);
+    heightmapMs = timer.stop();
+    probe.release();
+
+    // Terrain for the stack around the surface
+    i32 surfaceY = (i32)floor(heightData[CHUNK_LAYER / 2].height / CHUNK_WIDTH);
+    i32 bottomY = surfaceY - (i32)data->chunksPerColumn / 2;
+    std::vector<ChunkHandle> handles(data->chunksPerColumn);
+    std::vector<Chunk*> chunks(data->chunksPerColumn);
+    for (size_t i = 0; i < data->chunksPerColumn; i++) {
+        handles[i] = data->accessor.acquire(ChunkID(column.x, bottomY + (i32)i, column.y));
+        handles[i]->init(FACE_TOP);
+        chunks[i] = handles[i];
+    }
+    timer.start();
+    data->generator.generateColumn(chunks.data(), chunks.size(), heightData);
+    terrainMs = timer.stop();
+
+    // Flora. Nodes are hashed rather than placed, there is no grid to place them in.
+    if (!workerData->floraGenerator) {
+        workerData->floraGenerator = new FloraGenerator;
+    }
+    std::vector<FloraNode> fNodes, wNodes;
+    std::vector<ui16> blocks(CHUNK_SIZE);
+    floraMs.resize(chunks.size());
+    for (size_t i = 0; i < chunks.size(); i++) {
+        Chunk* chunk = chunks[i];
+        fNodes.clear();
+        wNodes.clear();
+        timer.start();
+        workerData->floraGenerator->generateChunkFlora(chunk, heightData, fNodes, wNodes);
+        floraMs[i] = timer.stop();
+
+        chunk->blocks.copyRange(0, CHUNK_SIZE, blocks.data());
+        ui64 h = 0xCBF29CE484222325ull;
+        ui64 id = chunk->getID().id;
+        h = fnv1a(h, &id, sizeof(id));
+        h = fnv1a(h, blocks.data(), CHUNK_SIZE * sizeof(ui16));
+        for (auto& n : fNodes) h = fnv1a(h, &n, sizeof(FloraNode));
+        for (auto& n : wNodes) h = fnv1a(h, &n, sizeof(FloraNode));
+        checksum += h;
+        storageStates[(size_t)chunk->blocks.getState()]++;
+        chunk->floraToGenerate.clear();
+    }
+
+    for (auto& h : handles) h.release();
+    data->numFinished++;
+}
+
+void runCGB(const cString searchDir, const cString terrainPath, f64 radius,
+            size_t columnsPerSide, size_t chunksPerColumn, size_t numThreads) {
+    // Planet and blocks, loaded without touching GL
+    vio::IOManager iom;
+    iom.setSearchDirectory(searchDir);
+    PlanetGenLoader loader;
+    loader.init(&iom);
+    PlanetGenData* genData = loader.loadPlanetGenData(terrainPath);
+    if (!genData) {
+        printf("Failed to load %s%s\n", searchDir, terrainPath);
+        fflush(stdout);
+        return;
+    }
+    genData->radius = radius;
+
+    BlockPack blocks;
+    vio::IOManager blockIom;
+    blockIom.setSearchDirectory("Data/Blocks/");
+    if (!BlockLoader::loadBlocks(blockIom, &blocks)) {
+        printf("Failed to load Data/Blocks/BlockData.yml\n");
+        fflush(stdout);
+        delete genData;
+        return;
+    }
+    SoaEngine::initVoxelGen(genData, blocks);
+
+    PagedChunkAllocator allocator;
+    ChunkGenBenchData data;
+    data.generator.init(genData);
+    data.accessor.init(&allocator);
+    data.chunksPerColumn = chunksPerColumn;
+
+    // One task per column, centered on the face
+    size_t numColumns = columnsPerSide * columnsPerSide;
+    std::vector<ChunkGenBenchTask> tasks(numColumns);
+    i32 start = -(i32)columnsPerSide / 2;
+    for (size_t z = 0; z < columnsPerSide; z++) {
+        for (size_t x = 0; x < columnsPerSide; x++) {
+            ChunkGenBenchTask& task = tasks[z * columnsPerSide + x];
+            task.data = &data;
+            task.column = i32v2(start + (i32)x, start + (i32)z);
+        }
+    }
+
+    VoxPool threadPool;
+    threadPool.init(std::max(numThreads, (size_t)1));
+    PreciseTimer timer;
+    timer.start();
+    for (auto& task : tasks) {
+        threadPool.addTask(&task);
+    }
+    while (data.numFinished < numColumns) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    f64 totalMs = timer.stop();
+    threadPool.destroy();
+
+    std::vector<f64> heightmapMs, terrainMs, floraMs;
+    ui64 checksum = 0;
+    size_t storageStates[4] = {};
+    for (auto& task : tasks) {
+        heightmapMs.push_back(task.heightmapMs);
+        terrainMs.push_back(task.terrainMs);
+        floraMs.insert(floraMs.end(), task.floraMs.begin(), task.floraMs.end());
+        checksum += task.checksum;
+        for (int i = 0; i < 4; i++) storageStates[i] += task.storageStates[i];
+    }
+    size_t numChunks = numColumns * chunksPerColumn;
+    ChunkAllocatorStats stats = allocator.getStats();
+
+    printf("Chunks: %zu in %zu columns on %zu threads, %lf ms, %.0lf chunks/sec\n", numChunks, numColumns,
+           std::max(numThreads, (size_t)1), totalMs, totalMs > 0.0 ? (f64)numChunks / (totalMs * 0.001) : 0.0);
+    printf("Heightmap per column  p50 %lf ms, p99 %lf ms\n", percentile(heightmapMs, 0.5), percentile(heightmapMs, 0.99));
+    printf("Terrain per column    p50 %lf ms, p99 %lf ms\n", percentile(terrainMs, 0.5), percentile(terrainMs, 0.99));
+    printf("Flora per chunk       p50 %lf ms, p99 %lf ms\n", percentile(floraMs, 0.5), percentile(floraMs, 0.99));
+    printf("Storage: %zu flat, %zu interval tree, %zu palette, %zu uniform\n",
+           storageStates[(size_t)vvox::VoxelStorageState::FLAT_ARRAY],
+           storageStates[(size_t)vvox::VoxelStorageState::INTERVAL_TREE],
+           storageStates[(size_t)vvox::VoxelStorageState::PALETTE],
+           storageStates[(size_t)vvox::VoxelStorageState::UNIFORM]);
+    printf("Allocator: %zu pages, %zu magazine hits, %zu free list hits, %zu page misses, %zu recycler hits, %zu recycler misses\n",
+           stats.numPages, stats.magazineHits, stats.freeListHits, stats.pageMisses,
+           stats.recyclerHits, stats.recyclerMisses);
+    printf("Checksum: %016llx\n", (unsigned long long)checksum);
+    fflush(stdout);
+
+    data.accessor.destroy();
+    delete genData;
+}
+
+void runCVP(size_t numQuads, size_t numMaterials) {
+    std::mt19937 rEngine(1337);
+    std::uniform_int_distribution<int> byteDist(0, 255);
+    std::uniform_int_distribution<int> cornerDist(0, CHUNK_WIDTH);
+    std::uniform_int_distribution<int> faceDist(0, 5);
+    std::uniform_int_distribution<size_t> materialDist(0, numMaterials ? numMaterials - 1 : 0);
+    // Every value ChunkMesher::getBlendMode can return
+    const ui8 BLEND_MODES[5] = { 0x14, 0x15, 0x18, 0x10, 0x04 };
+    std::uniform_int_distribution<int> blendDist(0, 4);
+    auto randomAtlasPosition = [&] () {
+        AtlasTexturePosition p;
+        p.base.atlas = (ui8)byteDist(rEngine);
+        p.base.index = (ui8)byteDist(rEngine);
+        p.overlay.atlas = (ui8)byteDist(rEngine);
+        p.overlay.index = (ui8)byteDist(rEngine);
+        return p;
+    };
+
+    std::vector<BlockVertexPaletteEntry> materials(numMaterials ? numMaterials : 1);
+    for (auto& m : materials) {
+        m = {};
+        m.texturePosition = randomAtlasPosition();
+        m.normTexturePosition = randomAtlasPosition();
+        m.dispTexturePosition = randomAtlasPosition();
+        m.textureDims = ui8v2(byteDist(rEngine), byteDist(rEngine));
+        m.overlayTextureDims = ui8v2(byteDist(rEngine), byteDist(rEngine));
+        m.color = color3((ui8)byteDist(rEngine), (ui8)byteDist(rEngine), (ui8)byteDist(rEngine));
+        m.overlayColor = color3((ui8)byteDist(rEngine), (ui8)byteDist(rEngine), (ui8)byteDist(rEngine));
+    }
+
+    std::vector<VoxelQuad> quads(numQuads);
+    for (auto& q : quads) {
+        const BlockVertexPaletteEntry& m = materials[materialDist(rEngine)];
+        ui8 face = (ui8)faceDist(rEngine);
+        ui8 blendMode = BLEND_MODES[blendDist(rEngine)];
+        for (int i = 0; i < 4; i++) {
+            BlockVertex& v = q.verts[i];
+            memset((void*)&v, 0, sizeof(v));
+            // Mesher positions are voxel corners scaled by 7
+            v.position = ui8v3(cornerDist(rEngine) * 7, cornerDist(rEngine) * 7, cornerDist(rEngine) * 7);
+            v.face = face;
+            v.blendMode = blendMode;
+            v.tex = ui8v2(byteDist(rEngine), byteDist(rEngine));
+            v.texturePosition = m.texturePosition;
+            v.normTexturePosition = m.normTexturePosition;
+            v.dispTexturePosition = m.dispTexturePosition;
+            v.textureDims = m.textureDims;
+            v.overlayTextureDims = m.overlayTextureDims;
+            v.color = m.color;
+            v.overlayColor = m.overlayColor;
+        }
+    }
+
+    std::vector<PackedBlockVertex> vertices;
+    std::vector<BlockVertexPaletteEntry> palette;
+    PreciseTimer timer;
+    timer.start();
+    bool isPacked = ChunkMesher::packQuads(quads, vertices, palette);
+    f64 packMs = timer.stop();
+    if (!isPacked) {
+        printf("packQuads rejected valid quads\n");
+        fflush(stdout);
+        return;
+    }
+
+    size_t numMismatched = 0;
+    BlockVertex result;
+    for (size_t i = 0; i < quads.size(); i++) {
+        for (int j = 0; j < 4; j++) {
+            const BlockVertex& v = quads[i].verts[j];
+            ChunkMesher::unpackVertex(vertices[i * 4 + j], palette, result);
+            bool isMatch = result.position == v.position && result.face == v.face &&
+                result.blendMode == v.blendMode && result.tex == v.tex &&
+                result.texturePosition == v.texturePosition &&
+                result.normTexturePosition == v.normTexturePosition &&
+                result.dispTexturePosition == v.dispTexturePosition &&
+                result.textureDims == v.textureDims && result.overlayTextureDims == v.overlayTextureDims &&
+                !memcmp(&result.color, &v.color, sizeof(v.color)) &&
+                !memcmp(&result.overlayColor, &v.overlayColor, sizeof(v.overlayColor));
+            if (!isMatch) numMismatched++;
+        }
+    }
+
+    // Off corner positions don't fit the layout and must be refused
+    std::vector<VoxelQuad> badQuads(1, quads.empty() ? VoxelQuad() : quads[0]);
+    badQuads[0].verts[0].position.x = 3;
+    bool isBadRefused = !ChunkMesher::packQuads(badQuads, vertices, palette) || quads.empty();
+
+    size_t quadBytes = numQuads * sizeof(VoxelQuad);
+    ChunkMesher::packQuads(quads, vertices, palette);
+    size_t packedBytes = vertices.size() * sizeof(PackedBlockVertex) + palette.size() * sizeof(BlockVertexPaletteEntry);
+    printf("%zu quads, %zu palette entries, packed in %lf ms\n", numQuads, palette.size(), packMs);
+    printf("VoxelQuad %zu bytes, packed %zu bytes (%.1f%%)\n", quadBytes, packedBytes,
+           quadBytes ? 100.0 * packedBytes / quadBytes : 0.0);
+    printf("Round trip %s, %zu/%zu vertices differ, bad positions %s\n",
+           numMismatched == 0 && isBadRefused ? "passed" : "FAILED", numMismatched, numQuads * 4,
+           isBadRefused ? "refused" : "ACCEPTED");
+    fflush(stdout);
+}
+
+void runCLM(SoaState* state, vecs::EntityID planet, size_t numChunks) {
+    ProceduralChunkGenerator generator;
+    generator.init(state->spaceSystem->sphericalTerrain.getFromEntity(planet).planetGenData);
+
+    PagedChunkAllocator allocator = {};
+    ChunkAccessor accessor = {};
+    accessor.init(&allocator);
+
+    // Too big for the stack
+    ChunkMesher* mesher = new ChunkMesher;
+    mesher->init(&state->blocks);
+
+    f64 meshMs[MAX_CHUNK_MESH_LOD + 1] = {};
+    size_t numQuads[MAX_CHUNK_MESH_LOD + 1] = {};
+    PlanetHeightData heightData[CHUNK_LAYER];
+    PreciseTimer timer;
+    for (size_t i = 0; i < numChunks; i++) {
+        ChunkHandle probe = accessor.acquire(ChunkID((i32)i, 0, 0));
+        probe->init(FACE_TOP);
+        generator.generateHeightmap(probe, heightData);
+        probe.release();
+
+        i32 surfaceY = (i32)floor(heightData[CHUNK_LAYER / 2].height / CHUNK_WIDTH);
+        ChunkHandle chunk = accessor.acquire(ChunkID((i32)i, surfaceY, 0));
+        chunk->init(FACE_TOP);
+        generator.generateChunk(chunk, heightData);
+        chunk->floraToGenerate.clear();
+
+        for (int lod = 0; lod <= MAX_CHUNK_MESH_LOD; lod++) {
+            // Downsampling writes into the voxel buffer, so each level starts from a fresh copy
+            mesher->prepareData(chunk);
+            mesher->lodLevel = (ui8)lod;
+            timer.start();
+            ChunkMeshData* meshData = mesher->createChunkMeshData(MeshTaskType::DEFAULT);
+            meshMs[lod] += timer.stop();
+            numQuads[lod] += meshData->opaqueQuads.size() + meshData->packedOpaqueVertices.size() / 4;
+            delete meshData;
+        }
+        chunk.release();
+    }
+    delete mesher;
+
+    printf("Chunks: %zu\n", numChunks);
+    for (int lod = 0; lod <= MAX_CHUNK_MESH_LOD; lod++) {
+        printf("LOD %d: %lf ms, %zu quads", lod, meshMs[lod], numQuads[lod]);
+        if (lod > 0) printf(", %s than LOD 0", meshMs[lod] < meshMs[0] ? "faster" : "NOT FASTER");
+        printf("\n");
+    }
+    fflush(stdout);
+
+    accessor.destroy();
+}
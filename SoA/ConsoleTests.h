@@ -17,6 +17,10 @@
 
 #include "Chunk.h"
 
+#include <Vorb/ecs/Entity.h>
+
+struct SoaState;
+
 /************************************************************************/
 /* Chunk Access Speed                                                   */
 /************************************************************************/
@@ -24,7 +28,78 @@ struct ChunkAccessSpeedData;
 ChunkAccessSpeedData* createCASData(size_t numThreads, size_t requestCount, ui64 maxID);
 void runCAS(ChunkAccessSpeedData* data);
 void freeCAS(ChunkAccessSpeedData* data);
+/// Acquires, copies and releases random handles to maxID chunk IDs from 1, 2, 4...
+/// up to maxThreads threads at once, timing each round and checking no chunk is
+/// left alive once every handle is released. Then times as many raw allocator
+/// alloc/free pairs on the same threads, each flattening the chunk's blocks so the
+/// voxel array recycler is used, freeing the last batches on another
+/// thread, and prints the allocator stats.
+void runCASScaling(size_t maxThreads, size_t requestsPerThread, ui64 maxID);
 
 void runCHS();
 
+/************************************************************************/
+/* Chunk Data Lock                                                      */
+/************************************************************************/
+/// Times concurrent reads of one chunk's voxels under a plain mutex and under
+/// the chunk's reader/writer lock, for 1, 2, 4... up to maxThreads workers.
+/// One access in writeInterval is a write.
+void runCDL(size_t maxThreads, size_t accessesPerThread, size_t writeInterval);
+
+/************************************************************************/
+/* Voxel Run Compression                                                */
+/************************************************************************/
+/// Generates numChunks surface chunks of the planet and times the scalar
+/// run-length loops against the vectorized kernels in VoxelRunKernels.h
+void runVRC(SoaState* state, vecs::EntityID planet, size_t numChunks);
+
+/************************************************************************/
+/* Noise Batch Kernels                                                  */
+/************************************************************************/
+/// Evaluates numPoints random points with the scalar noise functions and the
+/// batched kernels, times both and checks they agree within Noise::BATCH_TOLERANCE
+void runNBK(size_t numPoints, int octaves);
+
+/************************************************************************/
+/* Noise Program Equivalence                                            */
+/************************************************************************/
+/// Compiles numTrees random function trees and evaluates each at numPoints random
+/// positions with the recursive walk, NoiseProgram::evaluate and evaluateBatch.
+/// The walk and evaluate should agree exactly, evaluateBatch within Noise::BATCH_TOLERANCE.
+void runNPE(size_t numTrees, size_t numPoints);
+
+/************************************************************************/
+/* Heightmap Biome Blending                                             */
+/************************************************************************/
+/// Generates a resolution x resolution grid of height columns spread over the
+/// top face of the planet and reports columns per second
+void runHMB(SoaState* state, vecs::EntityID planet, size_t resolution);
+
+/************************************************************************/
+/* Chunk Generation Benchmark                                           */
+/************************************************************************/
+/// Loads terrainPath from searchDir with the given radius in km, then generates a
+/// columnsPerSide x columnsPerSide region of the top face, chunksPerColumn chunks
+/// around the surface of each column, on numThreads workers. Needs no GL context.
+/// Reports chunks per second, per stage latencies, voxel storage and allocator
+/// counts, and a checksum that must match between runs and thread counts.
+void runCGB(const cString searchDir, const cString terrainPath, f64 radius,
+            size_t columnsPerSide, size_t chunksPerColumn, size_t numThreads);
+
+/************************************************************************/
+/* Compact Vertex Packing                                               */
+/************************************************************************/
+/// Packs numQuads random opaque quads drawn from numMaterials looks with
+/// ChunkMesher::packQuads, unpacks every vertex and checks it round trips.
+/// Reports the mesh size in both formats and the packing time.
+void runCVP(size_t numQuads, size_t numMaterials);
+
+/************************************************************************/
+/* Chunk LOD Meshing                                                    */
+/************************************************************************/
+/// Generates numChunks chunks that straddle the surface of planet and meshes
+/// each of them at every level of detail. Reports the meshing time and quad
+/// count of each level, which should both fall as the level rises.
+void runCLM(SoaState* state, vecs::EntityID planet, size_t numChunks);
+
 #endif // !ConsoleTests_h__
@@ -9,10 +9,12 @@
 #include <Vorb/utils.h>
 
 #include "App.h"
+#include "ChunkGrid.h"
 #include "ChunkMesh.h"
 #include "ChunkMeshManager.h"
 #include "ChunkMesher.h"
 #include "ChunkRenderer.h"
+#include "ChunkSphereComponentUpdater.h"
 #include "Collision.h"
 #include "DebugRenderer.h"
 #include "DevConsole.h"
@@ -472,6 +474,43 @@ void GameplayScreen::initConsole() {
     DevConsole::getInstance().addListener("exit", [](void*, const nString&) {
         exit(0);
     }, nullptr);
+    // Prints the generation queue depths of the starting planet and how well prefetching works
+    DevConsole::getInstance().addCommand("genstats");
+    DevConsole::getInstance().addListener("genstats", [](void* meta, const nString&) {
+        GameplayScreen* screen = (GameplayScreen*)meta;
+        SoaState* state = screen->m_soaState;
+        if (!state->clientState.startingPlanet) return;
+        auto& svcmp = state->spaceSystem->sphericalVoxel.getFromEntity(state->clientState.startingPlanet);
+        if (!svcmp.chunkGrids) return;
+        for (int face = 0; face < 6; face++) {
+            ChunkGrid& grid = svcmp.chunkGrids[face];
+            printf("Face %d: %zu queued, %zu cancelled, %zu wasted\n", face, grid.getQueuedDepth(),
+                   grid.getCancelledCount(), grid.getWastedCount());
+            for (ui32 i = 0; i < grid.numGenerators; i++) {
+                ChunkGenerator& generator = grid.generators[i];
+                printf("  Generator %u: %zu active, %zu waiting on heightmaps, %zu finished\n", i,
+                       generator.getActiveDepth(), generator.getWaitingDepth(), generator.getFinishedDepth());
+            }
+        }
+        for (auto& it : state->gameSystem->chunkSphere) {
+            const ChunkSphereComponent& cmp = it.second;
+            printf("Sphere %u: %u prefetched, %u hits, %u misses, %.1f%% hit rate\n", (ui32)it.first,
+                   cmp.prefetchSubmitted, cmp.prefetchHits, cmp.prefetchMisses,
+                   ChunkSphereComponentUpdater::getPrefetchHitRate(cmp) * 100.0);
+        }
+        fflush(stdout);
+    }, this);
+    // Prints how well mesh tasks and mesh data are being reused
+    DevConsole::getInstance().addCommand("meshstats");
+    DevConsole::getInstance().addListener("meshstats", [](void* meta, const nString&) {
+        GameplayScreen* screen = (GameplayScreen*)meta;
+        ChunkMeshPoolStats stats = screen->m_soaState->clientState.chunkMeshManager->getPoolStats();
+        printf("Mesh tasks: %zu allocated, %zu reused, %zu pooled\n",
+               stats.tasksAllocated, stats.tasksReused, stats.tasksPooled);
+        printf("Mesh data: %zu allocated, %zu reused, %zu deleted, %zu pooled\n",
+               stats.meshDataAllocated, stats.meshDataReused, stats.meshDataDeleted, stats.meshDataPooled);
+        fflush(stdout);
+    }, this);
 }
 
 void GameplayScreen::initRenderPipeline() {
@@ -88,7 +88,9 @@ void GameSystemAssemblages::removeVoxelPosition(GameSystem* gameSystem, vecs::En
 vecs::ComponentID GameSystemAssemblages::addChunkSphere(GameSystem* gameSystem, vecs::EntityID entity,
                                  vecs::ComponentID voxelPosition,
                                  const i32v3& centerPosition,
-                                 ui32 radius) {
+                                 ui32 radius,
+                                 vecs::ComponentID physics /* = 0 */,
+                                 vecs::ComponentID head /* = 0 */) {
     vecs::ComponentID id = gameSystem->addComponent("ChunkSphere", entity);
     auto& cmp = gameSystem->chunkSphere.get(id);
 
@@ -96,6 +98,8 @@ vecs::ComponentID GameSystemAssemblages::addChunkSphere(GameSystem* gameSystem,
     cmp.centerPosition = centerPosition;
     cmp.offset = i32v3(0);
     cmp.voxelPosition = voxelPosition;
+    cmp.physics = physics;
+    cmp.head = head;
 
     cmp.radius = radius;
     cmp.width = cmp.radius * 2 + 1;
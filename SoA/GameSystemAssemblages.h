@@ -55,10 +55,14 @@ namespace GameSystemAssemblages {
                                                const VoxelPosition3D& gridPosition);
     void removeVoxelPosition(GameSystem* gameSystem, vecs::EntityID entity);
     /// Voxel Position Component
+    /// @param physics: Optional, enables prefetching along its velocity
+    /// @param head: Optional, prefetches what the head looks at first
     vecs::ComponentID addChunkSphere(GameSystem* gameSystem, vecs::EntityID entity,
                                      vecs::ComponentID voxelPosition,
                                      const i32v3& centerPosition,
-                                     ui32 radius);
+                                     ui32 radius,
+                                     vecs::ComponentID physics = 0,
+                                     vecs::ComponentID head = 0);
     void removeChunkSphere(GameSystem* gameSystem, vecs::EntityID entity);
     /// Frustum Component
     vecs::ComponentID addFrustumComponent(GameSystem* gameSystem, vecs::EntityID entity,
@@ -152,11 +152,24 @@ struct ChunkSphereComponent {
     i32 width = 0;
     i32 layer = 0;
     i32 size = 0;
+
+    // Prefetching ahead of the sphere. Needs a physics component, head is optional.
+    vecs::ComponentID physics = 0;
+    vecs::ComponentID head = 0;
+    std::unordered_map<ChunkID, ChunkHandle> prefetchHandles; ///< Chunks held ahead of the sphere
+    std::vector<i32v3> prefetchCandidates; ///< Chunks left to prefetch, best last
+    i32v3 prefetchCenter = i32v3(0); ///< Center when the candidates were built
+    i32v3 prefetchTarget = i32v3(0); ///< Predicted center when the candidates were built
+    ui32 prefetchSubmitted = 0;
+    ui32 prefetchHits = 0; ///< Prefetched chunks the sphere went on to use
+    ui32 prefetchMisses = 0; ///< Prefetched chunks released unused
 };
 class ChunkSphereComponentTable : public vecs::ComponentTable<ChunkSphereComponent> {
 public:
     virtual void disposeComponent(vecs::ComponentID cID, vecs::EntityID eID VORB_MAYBE_UNUSED) override {
         ChunkSphereComponent& cmp = _components[cID].second;
+        for (auto& it : cmp.prefetchHandles) it.second.release();
+        cmp.prefetchHandles.clear();
         delete[] cmp.handleGrid;
         cmp.handleGrid = nullptr;
         cmp.chunkGrid = nullptr;
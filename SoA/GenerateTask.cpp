@@ -11,21 +11,18 @@ void GenerateTask::execute(WorkerData* workerData) {
 
     // Check if this is a heightmap gen
     if (chunk.gridData->isLoading) {
-        chunkGenerator->m_proceduralGenerator.generateHeightmap(&chunk, heightData);
+        chunkGenerator->generateHeightmap(&chunk, heightData);
+    } else if (columnQueries.size()) {
+        executeColumn(workerData);
+        return;
     } else { // Its a chunk gen
 
         switch (query->genLevel) {
             case ChunkGenLevel::GEN_DONE:
             case ChunkGenLevel::GEN_TERRAIN:
                 chunkGenerator->m_proceduralGenerator.generateChunk(&chunk, heightData);
-                chunk.genLevel = GEN_TERRAIN;
-                // TODO(Ben): Not lazy load.
-                if (!workerData->floraGenerator) {
-                    workerData->floraGenerator = new FloraGenerator;
-                }
-                generateFlora(workerData, chunk);
-                chunk.genLevel = ChunkGenLevel::GEN_DONE;
-                break;
+                finishTerrain(workerData, query, heightData, query->grid, chunkGenerator);
+                return;
             case ChunkGenLevel::GEN_FLORA:
                 chunk.genLevel = ChunkGenLevel::GEN_DONE;
                 break;
@@ -43,12 +40,51 @@ void GenerateTask::execute(WorkerData* workerData) {
     chunkGenerator->finishQuery(query);
 }
 
+void GenerateTask::executeColumn(WorkerData* workerData) {
+    // This task belongs to the first query, which may be recycled once it finishes,
+    // so nothing may read members after that point.
+    std::vector<ChunkQuery*> queries;
+    queries.swap(columnQueries);
+    PlanetHeightData* heightData = this->heightData;
+    ChunkGrid* grid = query->grid;
+    ChunkGenerator* chunkGenerator = this->chunkGenerator;
+
+    Chunk** chunks = (Chunk**)alloca(sizeof(Chunk*) * queries.size());
+    for (size_t i = 0; i < queries.size(); i++) {
+        chunks[i] = &queries[i]->chunk;
+    }
+    chunkGenerator->m_proceduralGenerator.generateColumn(chunks, queries.size(), heightData);
+    // Finish the owning query last
+    for (size_t i = queries.size(); i-- > 0;) {
+        finishTerrain(workerData, queries[i], heightData, grid, chunkGenerator);
+    }
+}
+
+void GenerateTask::finishTerrain(WorkerData* workerData, ChunkQuery* q,
+                                 PlanetHeightData* heightData, ChunkGrid* grid,
+                                 ChunkGenerator* chunkGenerator) {
+    Chunk& chunk = q->chunk;
+    chunk.genLevel = GEN_TERRAIN;
+    // TODO(Ben): Not lazy load.
+    if (!workerData->floraGenerator) {
+        workerData->floraGenerator = new FloraGenerator;
+    }
+    generateFlora(workerData, chunk, heightData, grid);
+    chunk.genLevel = ChunkGenLevel::GEN_DONE;
+    q->m_isFinished = true;
+    q->m_cond.notify_one();
+    // TODO(Ben): Not true for all gen?
+    chunk.isAccessible = true;
+    chunkGenerator->finishQuery(q);
+}
+
 struct ChunkFloraArrays {
     std::vector<VoxelToPlace> fNodes;
     std::vector<VoxelToPlace> wNodes;
 };
 
-void GenerateTask::generateFlora(WorkerData* workerData, Chunk& chunk) {
+void GenerateTask::generateFlora(WorkerData* workerData, Chunk& chunk,
+                                 PlanetHeightData* heightData, ChunkGrid* grid) {
     std::vector<FloraNode> fNodes, wNodes;
     workerData->floraGenerator->generateChunkFlora(&chunk, heightData, fNodes, wNodes);
 
@@ -74,26 +110,38 @@ void GenerateTask::generateFlora(WorkerData* workerData, Chunk& chunk) {
         chunkMap[id].wNodes.emplace_back(it.blockID, it.blockIndex);
     }
 
+    // Acquire every touched chunk in one pass
+    std::vector<ChunkID> ids;
+    ids.reserve(chunkMap.size());
+    for (auto& it : chunkMap) {
+        ids.push_back(it.first);
+    }
+    std::vector<ChunkHandle> handles(ids.size());
+    grid->accessor.acquire(ids.data(), ids.size(), handles.data());
+
     // Traverse chunks
+    size_t i = 0;
     for (auto& it : chunkMap) {
-        ChunkHandle h = query->grid->accessor.acquire(it.first);
+        ChunkHandle& h = handles[i++];
         // TODO(Ben): Handle other case
         if (h->genLevel >= GEN_TERRAIN) {
             {
-                std::lock_guard<std::mutex> l(h->dataMutex);
+                std::lock_guard<ChunkDataLock> l(h->dataMutex);
                 for (auto& node : it.second.wNodes) {
                     h->blocks.set(node.blockIndex, node.blockID);
+                    h->flagDirty(node.blockIndex);
                 }
                 for (auto& node : it.second.fNodes) {
                     if (h->blocks.get(node.blockIndex) == 0) {
                         h->blocks.set(node.blockIndex, node.blockID);
+                        h->flagDirty(node.blockIndex);
                     }
                 }
             }
 
             if (h->genLevel == GEN_DONE) h->DataChange(h);
         } else {
-            query->grid->nodeSetter.setNodes(h, GEN_TERRAIN, it.second.wNodes, it.second.fNodes);
+            grid->nodeSetter.setNodes(h, GEN_TERRAIN, it.second.wNodes, it.second.fNodes);
         }
         h.release();
     }
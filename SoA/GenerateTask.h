@@ -21,6 +21,7 @@
 
 class Chunk;
 class ChunkGenerator;
+class ChunkGrid;
 class ChunkQuery;
 struct PlanetHeightData;
 
@@ -38,6 +39,12 @@ class GenerateTask : public vcore::IThreadPoolTask<WorkerData> {
         this->query = query;
         this->heightData = heightData;
         this->chunkGenerator = chunkGenerator;
+        columnQueries.clear();
+    }
+    /// Makes this a column task that generates the terrain of every query in one pass.
+    /// The queries must share this task's grid data, and query should be the first.
+    void initColumn(std::vector<ChunkQuery*>& queries) {
+        columnQueries.swap(queries);
     }
 
     void execute(WorkerData* workerData) override;
@@ -48,9 +55,17 @@ class GenerateTask : public vcore::IThreadPoolTask<WorkerData> {
 
     // Loading Information
     PlanetHeightData* heightData;
+    std::vector<ChunkQuery*> columnQueries; ///< Vertical stack for column tasks
 
 private:
-    void generateFlora(WorkerData* workerData, Chunk& chunk);
+    void executeColumn(WorkerData* workerData);
+    /// Adds flora and signals the query once its terrain is generated.
+    /// Takes the task state explicitly since q may own this task.
+    void finishTerrain(WorkerData* workerData, ChunkQuery* q,
+                       PlanetHeightData* heightData, ChunkGrid* grid,
+                       ChunkGenerator* chunkGenerator);
+    void generateFlora(WorkerData* workerData, Chunk& chunk,
+                       PlanetHeightData* heightData, ChunkGrid* grid);
 };
 
 #endif // LoadTask_h__
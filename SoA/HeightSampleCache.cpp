@@ -0,0 +1,90 @@
+#include "stdafx.h"
+#include "HeightSampleCache.h"
+
+#include "Flora.h"
+
+HeightSampleCache::HeightSampleCache(size_t capacity /*= DEFAULT_HEIGHT_SAMPLE_CAPACITY*/) {
+    // Each shard keeps up to two generations
+    m_shardCapacity = std::max(capacity / (HEIGHT_SAMPLE_CACHE_SHARDS * 2), (size_t)1);
+}
+
+size_t HeightSampleCache::KeyHash::operator()(const Key& k) const {
+    ui64 h = ((ui64)(ui32)k.x << 32) | (ui32)k.z;
+    h ^= (ui64)k.face * 0x9E3779B97F4A7C15ull;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    return (size_t)h;
+}
+
+bool HeightSampleCache::get(WorldCubeFace face, i32 x, i32 z, OUT PlanetHeightData& height) {
+    Key key = makeKey(face, x, z);
+    Shard& s = getShard(key);
+    {
+        std::lock_guard<std::mutex> l(s.lock);
+        auto it = s.current.find(key);
+        if (it != s.current.end()) {
+            height = it->second;
+            m_hits++;
+            return true;
+        }
+        it = s.previous.find(key);
+        if (it != s.previous.end()) {
+            height = it->second;
+            // Still in use, so keep it around for another generation
+            if (s.current.size() < m_shardCapacity) {
+                s.current.emplace(key, height);
+                s.previous.erase(it);
+            }
+            m_hits++;
+            return true;
+        }
+    }
+    m_misses++;
+    return false;
+}
+
+void HeightSampleCache::put(WorldCubeFace face, i32 x, i32 z, const PlanetHeightData& height) {
+    Key key = makeKey(face, x, z);
+    Shard& s = getShard(key);
+    std::lock_guard<std::mutex> l(s.lock);
+    if (s.current.size() >= m_shardCapacity) {
+        s.previous.swap(s.current);
+        s.current.clear();
+    }
+    PlanetHeightData& sample = s.current[key];
+    sample = height;
+    // Flora is only picked for voxel columns, so never share it
+    sample.flora = FLORA_ID_NONE;
+}
+
+void HeightSampleCache::clear() {
+    for (auto& s : m_shards) {
+        std::lock_guard<std::mutex> l(s.lock);
+        s.current.clear();
+        s.previous.clear();
+    }
+}
+
+f64 HeightSampleCache::getHitRate() const {
+    ui64 hits = m_hits;
+    ui64 total = hits + m_misses;
+    return total ? (f64)hits / (f64)total : 0.0;
+}
+
+void HeightSampleCache::resetCounters() {
+    m_hits = 0;
+    m_misses = 0;
+}
+
+HeightSampleCache::Shard& HeightSampleCache::getShard(const Key& k) {
+    return m_shards[KeyHash()(k) % HEIGHT_SAMPLE_CACHE_SHARDS];
+}
+
+HeightSampleCache::Key HeightSampleCache::makeKey(WorldCubeFace face, i32 x, i32 z) {
+    Key key;
+    key.x = x;
+    key.z = z;
+    key.face = face;
+    return key;
+}
@@ -0,0 +1,75 @@
+///
+/// HeightSampleCache.h
+/// Seed of Andromeda
+///
+/// Copyright 2014 Regrowth Studios
+/// MIT License
+///
+/// Summary:
+/// Concurrent cache of surface height samples keyed by voxel column,
+/// shared by terrain patch meshing and voxel heightmap generation.
+///
+
+#pragma once
+
+#ifndef HeightSampleCache_h__
+#define HeightSampleCache_h__
+
+#include "PlanetHeightData.h"
+#include "VoxelCoordinateSpaces.h"
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+#define HEIGHT_SAMPLE_CACHE_SHARDS 16
+#define DEFAULT_HEIGHT_SAMPLE_CAPACITY (1 << 18)
+
+class HeightSampleCache {
+public:
+    /// @param capacity: Roughly the number of samples kept
+    HeightSampleCache(size_t capacity = DEFAULT_HEIGHT_SAMPLE_CAPACITY);
+
+    /// Copies the sample at a voxel column into height. Thread safe.
+    /// @return true on a hit
+    bool get(WorldCubeFace face, i32 x, i32 z, OUT PlanetHeightData& height);
+    /// Stores a sample without flora. Thread safe.
+    void put(WorldCubeFace face, i32 x, i32 z, const PlanetHeightData& height);
+    /// Drops every sample, e.g. when the generation data changes
+    void clear();
+
+    /// Counters for tuning
+    ui64 getHits() const { return m_hits; }
+    ui64 getMisses() const { return m_misses; }
+    f64 getHitRate() const;
+    void resetCounters();
+private:
+    struct Key {
+        i32 x;
+        i32 z;
+        WorldCubeFace face;
+        bool operator==(const Key& o) const { return x == o.x && z == o.z && face == o.face; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const;
+    };
+    typedef std::unordered_map<Key, PlanetHeightData, KeyHash> SampleMap;
+    /// Samples age out a generation at a time. When current fills up it
+    /// replaces previous, and hits in previous move back to current.
+    struct Shard {
+        std::mutex lock;
+        SampleMap current;
+        SampleMap previous;
+    };
+
+    Shard& getShard(const Key& k);
+    static Key makeKey(WorldCubeFace face, i32 x, i32 z);
+
+    Shard m_shards[HEIGHT_SAMPLE_CACHE_SHARDS];
+    size_t m_shardCapacity; ///< Samples per generation in a shard
+
+    std::atomic<ui64> m_hits{ 0 };
+    std::atomic<ui64> m_misses{ 0 };
+};
+
+#endif // HeightSampleCache_h__
@@ -0,0 +1,363 @@
+#include "stdafx.h"
+#include "HeightmapCache.h"
+
+#include "Biome.h"
+#include "PlanetGenData.h"
+
+#ifndef VORB_OS_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define HEIGHTMAP_CACHE_MAGIC 0x50414d48 // "HMAP"
+// Bump whenever DiskHeader, DiskSlot or DiskColumn change
+#define HEIGHTMAP_CACHE_VERSION 1
+#define DISK_BIOME_NONE 0xFFFF
+
+namespace {
+    struct DiskHeader {
+        ui32 magic;
+        ui32 version;
+        ui64 genHash;
+        ui64 numEntries;
+    };
+
+    /// PlanetHeightData with the biome stored as an index into the biome table
+    struct DiskColumn {
+        f32 height;
+        ui16 biome;
+        ui16 flora;
+        ui8 temperature;
+        ui8 humidity;
+        ui8 flags;
+        ui8 padding;
+    };
+
+    /// Biomes that can show up in PlanetHeightData, in a stable order. Base biomes
+    /// that live outside of genData->biomes (e.g. the default one) come last.
+    void buildBiomeTable(const PlanetGenData* genData, OUT std::vector<const Biome*>& table) {
+        table.clear();
+        for (auto& b : genData->biomes) table.push_back(&b);
+        for (int y = 0; y < BIOME_MAP_WIDTH; y++) {
+            for (int x = 0; x < BIOME_MAP_WIDTH; x++) {
+                const Biome* b = genData->baseBiomeLookup[y][x];
+                if (b && std::find(table.begin(), table.end(), b) == table.end()) {
+                    table.push_back(b);
+                }
+            }
+        }
+    }
+
+    /// FNV-1a
+    class Hasher {
+    public:
+        template<typename T>
+        void add(const T& v) {
+            const ui8* bytes = (const ui8*)&v;
+            for (size_t i = 0; i < sizeof(T); i++) {
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            }
+        }
+        void add(const NoiseBase& noise) {
+            add(noise.base);
+            add(noise.program.getCode().size());
+            // Field by field so padding doesn't leak in
+            for (auto& in : noise.program.getCode()) {
+                add(in.code);
+                add(in.op);
+                add(in.func);
+                add(in.dst);
+                add(in.a);
+                add(in.b);
+                add(in.skip);
+                add(in.octaves);
+                add(in.value);
+                add(in.frequency);
+                add(in.persistence);
+                add(in.low);
+                add(in.high);
+                add(in.clamp.x);
+                add(in.clamp.y);
+            }
+        }
+
+        ui64 hash = 14695981039346656037ull;
+    };
+}
+
+struct HeightmapCache::DiskSlot {
+    i32 x;
+    i32 z;
+    i32 face;
+    ui32 isValid;
+    DiskColumn columns[CHUNK_LAYER];
+};
+
+size_t HeightmapCache::KeyHash::operator()(const Key& k) const {
+    // Mixed so neighbouring columns spread over the direct mapped disk slots
+    ui64 h = ((ui64)(ui32)k.x << 32) | (ui32)k.z;
+    h ^= (ui64)k.face * 0x9E3779B97F4A7C15ull;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    return (size_t)h;
+}
+
+HeightmapCache::~HeightmapCache() {
+    dispose();
+}
+
+void HeightmapCache::init(const PlanetGenData* genData, const nString& diskPath,
+                          size_t memoryEntries /*= DEFAULT_HEIGHTMAP_MEMORY_ENTRIES*/,
+                          size_t diskEntries /*= DEFAULT_HEIGHTMAP_DISK_ENTRIES*/) {
+    m_genData = genData;
+    m_genHash = hashGenData(genData);
+    buildBiomeTable(genData, m_biomeTable);
+    m_biomeIndices.clear();
+    for (size_t i = 0; i < m_biomeTable.size(); i++) {
+        m_biomeIndices[m_biomeTable[i]] = (ui16)i;
+    }
+    m_memoryEntries = memoryEntries;
+    m_diskEntries = diskEntries;
+    // Biomes that don't fit the index can't go to disk
+    if (diskPath.size() && diskEntries && m_biomeTable.size() < DISK_BIOME_NONE) {
+        if (!openDisk(diskPath)) {
+            fprintf(stderr, "Warning: Failed to open heightmap cache %s, heightmaps will only be cached in memory\n",
+                    diskPath.c_str());
+        }
+    }
+}
+
+void HeightmapCache::dispose() {
+    std::lock_guard<std::mutex> l(m_lock);
+    if (m_diskData) {
+        for (auto& e : m_lru) {
+            writeDisk(e.key, e.heightData);
+        }
+    }
+    m_lru.clear();
+    m_lruMap.clear();
+    closeDisk();
+}
+
+bool HeightmapCache::load(const ChunkPosition2D& gridPos, OUT PlanetHeightData* heightData) {
+    Key key = makeKey(gridPos);
+    std::lock_guard<std::mutex> l(m_lock);
+    auto it = m_lruMap.find(key);
+    if (it != m_lruMap.end()) {
+        // Still in memory, move it to the front
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        memcpy(heightData, it->second->heightData, sizeof(it->second->heightData));
+        m_memoryHits++;
+        return true;
+    }
+    if (readDisk(key, heightData)) {
+        m_diskHits++;
+        return true;
+    }
+    m_misses++;
+    return false;
+}
+
+void HeightmapCache::store(const ChunkPosition2D& gridPos, const PlanetHeightData* heightData) {
+    if (m_memoryEntries == 0) return;
+    Key key = makeKey(gridPos);
+    std::lock_guard<std::mutex> l(m_lock);
+    auto it = m_lruMap.find(key);
+    if (it != m_lruMap.end()) {
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+    } else if (m_lru.size() >= m_memoryEntries) {
+        // Reuse the least recently used entry, writing it back first
+        auto last = std::prev(m_lru.end());
+        if (m_diskData) writeDisk(last->key, last->heightData);
+        m_lruMap.erase(last->key);
+        m_lru.splice(m_lru.begin(), m_lru, last);
+        m_lruMap[key] = m_lru.begin();
+    } else {
+        m_lru.emplace_front();
+        m_lruMap[key] = m_lru.begin();
+    }
+    MemoryEntry& e = m_lru.front();
+    e.key = key;
+    memcpy(e.heightData, heightData, sizeof(e.heightData));
+}
+
+ui64 HeightmapCache::hashGenData(const PlanetGenData* genData) {
+    std::vector<const Biome*> table;
+    buildBiomeTable(genData, table);
+    auto indexOf = [&](const Biome* b) -> ui32 {
+        if (!b) return DISK_BIOME_NONE;
+        return (ui32)(std::find(table.begin(), table.end(), b) - table.begin());
+    };
+
+    Hasher h;
+    h.add(genData->radius);
+    h.add(genData->tempLatitudeFalloff);
+    h.add(genData->tempHeightFalloff);
+    h.add(genData->humLatitudeFalloff);
+    h.add(genData->humHeightFalloff);
+    h.add(genData->baseTerrainFuncs);
+    h.add(genData->tempTerrainFuncs);
+    h.add(genData->humTerrainFuncs);
+    for (int y = 0; y < BIOME_MAP_WIDTH; y++) {
+        for (int x = 0; x < BIOME_MAP_WIDTH; x++) {
+            h.add(indexOf(genData->baseBiomeLookup[y][x]));
+        }
+    }
+    h.add(genData->baseBiomeCellOffsets.size());
+    for (auto& o : genData->baseBiomeCellOffsets) h.add(o);
+    for (auto& c : genData->baseBiomeCellInfluences) {
+        h.add(indexOf(c.b));
+        h.add(c.weight);
+        for (int i = 0; i < 4; i++) h.add(c.cornerWeights[i]);
+    }
+    h.add(table.size());
+    for (auto& b : table) {
+        h.add(b->terrainNoise);
+        h.add(b->childNoise);
+        h.add(b->heightRange);
+        h.add(b->heightScale);
+        h.add(b->noiseRange);
+        h.add(b->noiseScale);
+        h.add(b->children.size());
+        for (auto& c : b->children) h.add(indexOf(c));
+        h.add(b->flora.size());
+        for (auto& f : b->flora) {
+            h.add(f.chance);
+            h.add(f.id);
+        }
+        h.add(b->trees.size());
+        for (auto& t : b->trees) {
+            h.add(t.chance);
+            h.add(t.id);
+        }
+    }
+    return h.hash;
+}
+
+HeightmapCache::Key HeightmapCache::makeKey(const ChunkPosition2D& gridPos) {
+    Key key;
+    key.x = gridPos.x;
+    key.z = gridPos.z;
+    key.face = gridPos.face;
+    return key;
+}
+
+bool HeightmapCache::openDisk(const nString& path) {
+    m_diskBytes = sizeof(DiskHeader) + m_diskEntries * sizeof(DiskSlot);
+#ifdef VORB_OS_WINDOWS
+    m_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    GetFileSizeEx(m_file, &size);
+    bool isNew = (size_t)size.QuadPart != m_diskBytes;
+    if (isNew) {
+        // Empty it so the mapping grows it with zeros
+        LARGE_INTEGER zero = {};
+        SetFilePointerEx(m_file, zero, nullptr, FILE_BEGIN);
+        SetEndOfFile(m_file);
+    }
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, (DWORD)((ui64)m_diskBytes >> 32), (DWORD)m_diskBytes, nullptr);
+    if (!m_mapping) {
+        closeDisk();
+        return false;
+    }
+    m_diskData = (ui8*)MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, m_diskBytes);
+#else
+    m_file = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (m_file < 0) return false;
+    off_t size = lseek(m_file, 0, SEEK_END);
+    bool isNew = (size_t)size != m_diskBytes;
+    // Empty it first so the whole file reads as zeros
+    if (isNew && (ftruncate(m_file, 0) != 0 || ftruncate(m_file, (off_t)m_diskBytes) != 0)) {
+        closeDisk();
+        return false;
+    }
+    void* mapped = mmap(nullptr, m_diskBytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+    m_diskData = mapped == MAP_FAILED ? nullptr : (ui8*)mapped;
+#endif
+    if (!m_diskData) {
+        closeDisk();
+        return false;
+    }
+
+    // Anything written for other gen data or another layout is stale
+    DiskHeader* header = (DiskHeader*)m_diskData;
+    if (isNew || header->magic != HEIGHTMAP_CACHE_MAGIC || header->version != HEIGHTMAP_CACHE_VERSION ||
+        header->genHash != m_genHash || header->numEntries != m_diskEntries) {
+        header->magic = 0;
+        // A new file is all zeros already, which keeps it sparse
+        if (!isNew) {
+            for (size_t i = 0; i < m_diskEntries; i++) {
+                ((DiskSlot*)(m_diskData + sizeof(DiskHeader)))[i].isValid = 0;
+            }
+        }
+        header->version = HEIGHTMAP_CACHE_VERSION;
+        header->genHash = m_genHash;
+        header->numEntries = m_diskEntries;
+        header->magic = HEIGHTMAP_CACHE_MAGIC;
+    }
+    return true;
+}
+
+void HeightmapCache::closeDisk() {
+#ifdef VORB_OS_WINDOWS
+    if (m_diskData) UnmapViewOfFile(m_diskData);
+    if (m_mapping) CloseHandle(m_mapping);
+    if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+    m_mapping = nullptr;
+    m_file = INVALID_HANDLE_VALUE;
+#else
+    if (m_diskData) munmap(m_diskData, m_diskBytes);
+    if (m_file >= 0) close(m_file);
+    m_file = -1;
+#endif
+    m_diskData = nullptr;
+    m_diskBytes = 0;
+}
+
+HeightmapCache::DiskSlot* HeightmapCache::getDiskSlot(const Key& key) {
+    // Direct mapped, a column simply replaces whatever shared its slot
+    size_t index = KeyHash()(key) % m_diskEntries;
+    return (DiskSlot*)(m_diskData + sizeof(DiskHeader)) + index;
+}
+
+void HeightmapCache::writeDisk(const Key& key, const PlanetHeightData* heightData) {
+    DiskSlot* slot = getDiskSlot(key);
+    // Invalidate first so a crash mid write can't leave a bad column behind
+    slot->isValid = 0;
+    slot->x = key.x;
+    slot->z = key.z;
+    slot->face = (i32)key.face;
+    for (size_t i = 0; i < CHUNK_LAYER; i++) {
+        const PlanetHeightData& src = heightData[i];
+        DiskColumn& dst = slot->columns[i];
+        auto it = m_biomeIndices.find(src.biome);
+        dst.biome = it == m_biomeIndices.end() ? DISK_BIOME_NONE : it->second;
+        dst.height = src.height;
+        dst.flora = src.flora;
+        dst.temperature = src.temperature;
+        dst.humidity = src.humidity;
+        dst.flags = src.flags;
+        dst.padding = 0;
+    }
+    slot->isValid = 1;
+}
+
+bool HeightmapCache::readDisk(const Key& key, OUT PlanetHeightData* heightData) {
+    if (!m_diskData) return false;
+    DiskSlot* slot = getDiskSlot(key);
+    if (!slot->isValid || slot->x != key.x || slot->z != key.z || slot->face != (i32)key.face) return false;
+    for (size_t i = 0; i < CHUNK_LAYER; i++) {
+        const DiskColumn& src = slot->columns[i];
+        PlanetHeightData& dst = heightData[i];
+        dst.biome = src.biome < m_biomeTable.size() ? m_biomeTable[src.biome] : nullptr;
+        dst.height = src.height;
+        dst.flora = src.flora;
+        dst.temperature = src.temperature;
+        dst.humidity = src.humidity;
+        dst.flags = src.flags;
+    }
+    return true;
+}
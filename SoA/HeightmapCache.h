@@ -0,0 +1,113 @@
+///
+/// HeightmapCache.h
+/// Seed of Andromeda
+///
+/// Copyright 2014 Regrowth Studios
+/// MIT License
+///
+/// Summary:
+/// Keeps the heightmaps of released ChunkGridData so columns that are
+/// reloaded don't have to be generated again. Recently released columns
+/// stay in memory, older ones go to a memory mapped file per planet.
+///
+
+#pragma once
+
+#ifndef HeightmapCache_h__
+#define HeightmapCache_h__
+
+#include "Constants.h"
+#include "PlanetHeightData.h"
+#include "VoxelCoordinateSpaces.h"
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+struct Biome;
+struct PlanetGenData;
+
+#define DEFAULT_HEIGHTMAP_MEMORY_ENTRIES 256
+#define DEFAULT_HEIGHTMAP_DISK_ENTRIES 4096
+
+class HeightmapCache {
+public:
+    ~HeightmapCache();
+
+    /// @param genData: Planet the heightmaps are generated for
+    /// @param diskPath: File for the on disk store, or empty to only cache in memory.
+    /// It is reset when it was written for different generation data.
+    /// @param memoryEntries: Columns kept in memory
+    /// @param diskEntries: Column slots in the on disk store
+    void init(const PlanetGenData* genData, const nString& diskPath,
+              size_t memoryEntries = DEFAULT_HEIGHTMAP_MEMORY_ENTRIES,
+              size_t diskEntries = DEFAULT_HEIGHTMAP_DISK_ENTRIES);
+    /// Writes back the columns in memory and closes the on disk store
+    void dispose();
+
+    /// Copies a cached column into heightData. Thread safe.
+    /// @return true if the column was cached
+    bool load(const ChunkPosition2D& gridPos, OUT PlanetHeightData* heightData);
+    /// Caches a fully generated column. Thread safe.
+    void store(const ChunkPosition2D& gridPos, const PlanetHeightData* heightData);
+
+    /// Hash of everything in genData that changes generated heightmaps
+    static ui64 hashGenData(const PlanetGenData* genData);
+
+    /// Getters
+    ui64 getGenHash() const { return m_genHash; }
+    size_t getMemoryHits() const { return m_memoryHits; }
+    size_t getDiskHits() const { return m_diskHits; }
+    size_t getMisses() const { return m_misses; }
+private:
+    struct Key {
+        i32 x;
+        i32 z;
+        WorldCubeFace face;
+        bool operator==(const Key& o) const { return x == o.x && z == o.z && face == o.face; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const;
+    };
+    struct MemoryEntry {
+        Key key;
+        PlanetHeightData heightData[CHUNK_LAYER];
+    };
+    struct DiskSlot;
+
+    static Key makeKey(const ChunkPosition2D& gridPos);
+
+    bool openDisk(const nString& path);
+    void closeDisk();
+    DiskSlot* getDiskSlot(const Key& key);
+    void writeDisk(const Key& key, const PlanetHeightData* heightData);
+    bool readDisk(const Key& key, OUT PlanetHeightData* heightData);
+
+    const PlanetGenData* m_genData = nullptr;
+    ui64 m_genHash = 0;
+    // Biomes are stored by index on disk
+    std::vector<const Biome*> m_biomeTable;
+    std::unordered_map<const Biome*, ui16> m_biomeIndices;
+
+    std::mutex m_lock; ///< Guards both tiers
+    // Most recently used at the front
+    std::list<MemoryEntry> m_lru;
+    std::unordered_map<Key, std::list<MemoryEntry>::iterator, KeyHash> m_lruMap;
+    size_t m_memoryEntries = 0;
+
+    ui8* m_diskData = nullptr; ///< Mapped file, nullptr when there is no on disk store
+    size_t m_diskBytes = 0;
+    size_t m_diskEntries = 0;
+#ifdef VORB_OS_WINDOWS
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#else
+    int m_file = -1;
+#endif
+
+    size_t m_memoryHits = 0;
+    size_t m_diskHits = 0;
+    size_t m_misses = 0;
+};
+
+#endif // HeightmapCache_h__
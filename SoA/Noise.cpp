@@ -590,3 +590,362 @@ f64 Noise::raw(const f64 x, const f64 y, const f64 z, const f64 w) {
     // Sum up and scale the result to cover the range [-1,1]
     return 27.0 * (n0 + n1 + n2 + n3 + n4);
 }
+
+/************************************************************************/
+/* Batched Simplex noise                                                */
+/************************************************************************/
+// The kernels below are the scalar functions above with every lane doing
+// the same arithmetic in the same order. The hashing stays scalar per lane.
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define NOISE_BATCH_AVX2
+#define NOISE_BATCH_SIMD
+#elif defined(__SSE4_1__) || defined(__AVX__)
+#include <smmintrin.h>
+#define NOISE_BATCH_SSE4
+#define NOISE_BATCH_SIMD
+#endif
+
+// Points per block in fractalBatch
+#define FRACTAL_BATCH_SIZE 64
+
+namespace {
+#if defined(NOISE_BATCH_AVX2)
+    struct f64s {
+        static const int WIDTH = 4;
+        __m256d v;
+    };
+    inline f64s load(const f64* p) { return { _mm256_loadu_pd(p) }; }
+    inline void store(f64* p, const f64s& a) { _mm256_storeu_pd(p, a.v); }
+    inline f64s splat(f64 a) { return { _mm256_set1_pd(a) }; }
+    inline f64s operator+(const f64s& a, const f64s& b) { return { _mm256_add_pd(a.v, b.v) }; }
+    inline f64s operator-(const f64s& a, const f64s& b) { return { _mm256_sub_pd(a.v, b.v) }; }
+    inline f64s operator*(const f64s& a, const f64s& b) { return { _mm256_mul_pd(a.v, b.v) }; }
+    inline f64s operator&(const f64s& a, const f64s& b) { return { _mm256_and_pd(a.v, b.v) }; }
+    inline f64s operator|(const f64s& a, const f64s& b) { return { _mm256_or_pd(a.v, b.v) }; }
+    /// ~a & b
+    inline f64s andNot(const f64s& a, const f64s& b) { return { _mm256_andnot_pd(a.v, b.v) }; }
+    inline f64s vfloor(const f64s& a) { return { _mm256_floor_pd(a.v) }; }
+    // Comparisons set every bit of the lanes where they are true
+    inline f64s operator>(const f64s& a, const f64s& b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ) }; }
+    inline f64s operator>=(const f64s& a, const f64s& b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_GE_OQ) }; }
+    inline f64s notLess(const f64s& a, const f64s& b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_NLT_UQ) }; }
+    /// @return One bit per lane of a comparison result
+    inline int laneMask(const f64s& a) { return _mm256_movemask_pd(a.v); }
+    /// Stores integral lanes as ints
+    inline void storeInts(i32* p, const f64s& a) { _mm_storeu_si128((__m128i*)p, _mm256_cvttpd_epi32(a.v)); }
+#elif defined(NOISE_BATCH_SSE4)
+    struct f64s {
+        static const int WIDTH = 2;
+        __m128d v;
+    };
+    inline f64s load(const f64* p) { return { _mm_loadu_pd(p) }; }
+    inline void store(f64* p, const f64s& a) { _mm_storeu_pd(p, a.v); }
+    inline f64s splat(f64 a) { return { _mm_set1_pd(a) }; }
+    inline f64s operator+(const f64s& a, const f64s& b) { return { _mm_add_pd(a.v, b.v) }; }
+    inline f64s operator-(const f64s& a, const f64s& b) { return { _mm_sub_pd(a.v, b.v) }; }
+    inline f64s operator*(const f64s& a, const f64s& b) { return { _mm_mul_pd(a.v, b.v) }; }
+    inline f64s operator&(const f64s& a, const f64s& b) { return { _mm_and_pd(a.v, b.v) }; }
+    inline f64s operator|(const f64s& a, const f64s& b) { return { _mm_or_pd(a.v, b.v) }; }
+    /// ~a & b
+    inline f64s andNot(const f64s& a, const f64s& b) { return { _mm_andnot_pd(a.v, b.v) }; }
+    inline f64s vfloor(const f64s& a) { return { _mm_floor_pd(a.v) }; }
+    // Comparisons set every bit of the lanes where they are true
+    inline f64s operator>(const f64s& a, const f64s& b) { return { _mm_cmpgt_pd(a.v, b.v) }; }
+    inline f64s operator>=(const f64s& a, const f64s& b) { return { _mm_cmpge_pd(a.v, b.v) }; }
+    inline f64s notLess(const f64s& a, const f64s& b) { return { _mm_cmpnlt_pd(a.v, b.v) }; }
+    /// @return One bit per lane of a comparison result
+    inline int laneMask(const f64s& a) { return _mm_movemask_pd(a.v); }
+    /// Stores integral lanes as ints
+    inline void storeInts(i32* p, const f64s& a) { _mm_storel_epi64((__m128i*)p, _mm_cvttpd_epi32(a.v)); }
+#endif
+
+#ifdef NOISE_BATCH_SIMD
+    const int W = f64s::WIDTH;
+
+    /// Falloff times gradient dot product for one simplex corner.
+    /// The scalar code skips corners with t < 0, here they are masked to 0.
+    inline f64s corner(f64s t, const f64s& dot) {
+        f64s keep = notLess(t, splat(0.0));
+        t = t * t;
+        return (t * t * dot) & keep;
+    }
+
+    void rawBlock(const f64* xp, const f64* yp, OUT f64* out) {
+        const f64 F2 = 0.5 * (sqrtf(3.0) - 1.0);
+        const f64 G2 = (3.0 - sqrtf(3.0)) / 6.0;
+        const f64s one = splat(1.0);
+        f64s x = load(xp);
+        f64s y = load(yp);
+
+        f64s s = (x + y) * splat(F2);
+        f64s i = vfloor(x + s);
+        f64s j = vfloor(y + s);
+        f64s t = (i + j) * splat(G2);
+        f64s x0 = x - (i - t);
+        f64s y0 = y - (j - t);
+
+        f64s lower = x0 > y0;
+        f64s i1 = lower & one;
+        f64s j1 = one - i1;
+        f64s x1 = x0 - i1 + splat(G2);
+        f64s y1 = y0 - j1 + splat(G2);
+        f64s x2 = x0 - one + splat(2.0 * G2);
+        f64s y2 = y0 - one + splat(2.0 * G2);
+
+        // Hashed gradients, grad[corner][axis][lane]
+        i32 is[W], js[W];
+        storeInts(is, i);
+        storeInts(js, j);
+        int lowerBits = laneMask(lower);
+        f64 grad[3][2][W];
+        for (int l = 0; l < W; l++) {
+            int ii = is[l] & 255;
+            int jj = js[l] & 255;
+            int li1 = (lowerBits >> l) & 1;
+            int gi[3] = {
+                Noise::perm[ii + Noise::perm[jj]] % 12,
+                Noise::perm[ii + li1 + Noise::perm[jj + 1 - li1]] % 12,
+                Noise::perm[ii + 1 + Noise::perm[jj + 1]] % 12
+            };
+            for (int cn = 0; cn < 3; cn++) {
+                grad[cn][0][l] = Noise::grad3[gi[cn]][0];
+                grad[cn][1][l] = Noise::grad3[gi[cn]][1];
+            }
+        }
+
+        f64s half = splat(0.5);
+        f64s n0 = corner(half - x0 * x0 - y0 * y0, load(grad[0][0]) * x0 + load(grad[0][1]) * y0);
+        f64s n1 = corner(half - x1 * x1 - y1 * y1, load(grad[1][0]) * x1 + load(grad[1][1]) * y1);
+        f64s n2 = corner(half - x2 * x2 - y2 * y2, load(grad[2][0]) * x2 + load(grad[2][1]) * y2);
+        store(out, splat(70.0) * (n0 + n1 + n2));
+    }
+
+    void rawBlock(const f64* xp, const f64* yp, const f64* zp, OUT f64* out) {
+        const f64 F3 = 1.0 / 3.0;
+        const f64 G3 = 1.0 / 6.0;
+        const f64s one = splat(1.0);
+        f64s x = load(xp);
+        f64s y = load(yp);
+        f64s z = load(zp);
+
+        f64s s = (x + y + z) * splat(F3);
+        f64s i = vfloor(x + s);
+        f64s j = vfloor(y + s);
+        f64s k = vfloor(z + s);
+        f64s t = (i + j + k) * splat(G3);
+        f64s x0 = x - (i - t);
+        f64s y0 = y - (j - t);
+        f64s z0 = z - (k - t);
+
+        // Branchless form of the scalar corner ordering
+        f64s xy = x0 >= y0;
+        f64s yz = y0 >= z0;
+        f64s xz = x0 >= z0;
+        f64s i1 = (xy & xz) & one;
+        f64s j1 = andNot(xy, yz) & one;
+        f64s k1 = one - i1 - j1;
+        f64s i2 = (xy | xz) & one;
+        f64s j2 = andNot(xy, one) | (yz & one);
+        f64s k2 = andNot(yz & xz, one);
+
+        f64s x1 = x0 - i1 + splat(G3);
+        f64s y1 = y0 - j1 + splat(G3);
+        f64s z1 = z0 - k1 + splat(G3);
+        f64s x2 = x0 - i2 + splat(2.0 * G3);
+        f64s y2 = y0 - j2 + splat(2.0 * G3);
+        f64s z2 = z0 - k2 + splat(2.0 * G3);
+        f64s x3 = x0 - one + splat(3.0 * G3);
+        f64s y3 = y0 - one + splat(3.0 * G3);
+        f64s z3 = z0 - one + splat(3.0 * G3);
+
+        // Hashed gradients, grad[corner][axis][lane]
+        i32 is[W], js[W], ks[W];
+        storeInts(is, i);
+        storeInts(js, j);
+        storeInts(ks, k);
+        int xyBits = laneMask(xy), yzBits = laneMask(yz), xzBits = laneMask(xz);
+        f64 grad[4][3][W];
+        for (int l = 0; l < W; l++) {
+            int ii = is[l] & 255;
+            int jj = js[l] & 255;
+            int kk = ks[l] & 255;
+            int a = (xyBits >> l) & 1, b = (yzBits >> l) & 1, c = (xzBits >> l) & 1;
+            int li1 = a & c, lj1 = (1 - a) & b, lk1 = 1 - li1 - lj1;
+            int li2 = a | c, lj2 = (1 - a) | b, lk2 = 1 - (b & c);
+            int gi[4] = {
+                Noise::perm[ii + Noise::perm[jj + Noise::perm[kk]]] % 12,
+                Noise::perm[ii + li1 + Noise::perm[jj + lj1 + Noise::perm[kk + lk1]]] % 12,
+                Noise::perm[ii + li2 + Noise::perm[jj + lj2 + Noise::perm[kk + lk2]]] % 12,
+                Noise::perm[ii + 1 + Noise::perm[jj + 1 + Noise::perm[kk + 1]]] % 12
+            };
+            for (int cn = 0; cn < 4; cn++) {
+                for (int axis = 0; axis < 3; axis++) grad[cn][axis][l] = Noise::grad3[gi[cn]][axis];
+            }
+        }
+
+        f64s r = splat(0.6);
+        f64s n0 = corner(r - x0 * x0 - y0 * y0 - z0 * z0,
+                         load(grad[0][0]) * x0 + load(grad[0][1]) * y0 + load(grad[0][2]) * z0);
+        f64s n1 = corner(r - x1 * x1 - y1 * y1 - z1 * z1,
+                         load(grad[1][0]) * x1 + load(grad[1][1]) * y1 + load(grad[1][2]) * z1);
+        f64s n2 = corner(r - x2 * x2 - y2 * y2 - z2 * z2,
+                         load(grad[2][0]) * x2 + load(grad[2][1]) * y2 + load(grad[2][2]) * z2);
+        f64s n3 = corner(r - x3 * x3 - y3 * y3 - z3 * z3,
+                         load(grad[3][0]) * x3 + load(grad[3][1]) * y3 + load(grad[3][2]) * z3);
+        store(out, splat(32.0) * (n0 + n1 + n2 + n3));
+    }
+
+    void rawBlock(const f64* xp, const f64* yp, const f64* zp, const f64* wp, OUT f64* out) {
+        const f64 F4 = (sqrtf(5.0) - 1.0) / 4.0;
+        const f64 G4 = (5.0 - sqrtf(5.0)) / 20.0;
+        f64s x = load(xp);
+        f64s y = load(yp);
+        f64s z = load(zp);
+        f64s w = load(wp);
+
+        f64s s = (x + y + z + w) * splat(F4);
+        f64s i = vfloor(x + s);
+        f64s j = vfloor(y + s);
+        f64s k = vfloor(z + s);
+        f64s l = vfloor(w + s);
+        f64s t = (i + j + k + l) * splat(G4);
+        f64s x0 = x - (i - t);
+        f64s y0 = y - (j - t);
+        f64s z0 = z - (k - t);
+        f64s w0 = w - (l - t);
+
+        // The simplex table holds the rank of each coordinate among x0, y0, z0, w0,
+        // so count the same pairwise comparisons the scalar version packs into c
+        const f64s one = splat(1.0);
+        f64s xy = x0 > y0, xz = x0 > z0, yz = y0 > z0;
+        f64s xw = x0 > w0, yw = y0 > w0, zw = z0 > w0;
+        f64s rank[4] = {
+            (xy & one) + (xz & one) + (xw & one),
+            andNot(xy, one) + (yz & one) + (yw & one),
+            andNot(xz, one) + andNot(yz, one) + (zw & one),
+            andNot(xw, one) + andNot(yw, one) + andNot(zw, one)
+        };
+
+        // Corner positions, [corner][axis]
+        f64s cp[5][4];
+        f64s c0[4] = { x0, y0, z0, w0 };
+        for (int axis = 0; axis < 4; axis++) {
+            cp[0][axis] = c0[axis];
+            for (int cn = 1; cn < 4; cn++) {
+                f64s offset = (rank[axis] >= splat((f64)(4 - cn))) & one;
+                cp[cn][axis] = c0[axis] - offset + splat(cn * G4);
+            }
+            cp[4][axis] = c0[axis] - one + splat(4.0 * G4);
+        }
+
+        // Hashed gradients, grad[corner][axis][lane]
+        i32 cell[4][W], ranks[4][W];
+        storeInts(cell[0], i);
+        storeInts(cell[1], j);
+        storeInts(cell[2], k);
+        storeInts(cell[3], l);
+        for (int axis = 0; axis < 4; axis++) storeInts(ranks[axis], rank[axis]);
+        f64 grad[5][4][W];
+        for (int lane = 0; lane < W; lane++) {
+            int ii = cell[0][lane] & 255;
+            int jj = cell[1][lane] & 255;
+            int kk = cell[2][lane] & 255;
+            int ll = cell[3][lane] & 255;
+            for (int cn = 0; cn < 5; cn++) {
+                // Corner cn steps along every axis whose rank is at least 4 - cn
+                int o[4];
+                for (int axis = 0; axis < 4; axis++) o[axis] = ranks[axis][lane] >= 4 - cn ? 1 : 0;
+                int gi = Noise::perm[ii + o[0] + Noise::perm[jj + o[1] + Noise::perm[kk + o[2] + Noise::perm[ll + o[3]]]]] % 32;
+                for (int axis = 0; axis < 4; axis++) grad[cn][axis][lane] = Noise::grad4[gi][axis];
+            }
+        }
+
+        f64s r = splat(0.6);
+        f64s total = splat(0.0);
+        for (int cn = 0; cn < 5; cn++) {
+            const f64s* p = cp[cn];
+            f64s n = corner(r - p[0] * p[0] - p[1] * p[1] - p[2] * p[2] - p[3] * p[3],
+                            load(grad[cn][0]) * p[0] + load(grad[cn][1]) * p[1] +
+                            load(grad[cn][2]) * p[2] + load(grad[cn][3]) * p[3]);
+            total = cn ? total + n : n;
+        }
+        store(out, splat(27.0) * total);
+    }
+#endif
+
+    /// Shared octave loop for fractalBatch, coords holds one array per dimension
+    void fractalBatchImpl(const int octaves, const f64 persistence, const f64 freq,
+                          const f64* const* coords, int dims, size_t n, OUT f64* out) {
+        f64 scaled[4][FRACTAL_BATCH_SIZE];
+        f64 noise[FRACTAL_BATCH_SIZE];
+        f64 total[FRACTAL_BATCH_SIZE];
+        for (size_t b = 0; b < n; b += FRACTAL_BATCH_SIZE) {
+            size_t count = std::min((size_t)FRACTAL_BATCH_SIZE, n - b);
+            f64 frequency = freq;
+            f64 amplitude = 1.0;
+            f64 maxAmplitude = 0.0;
+            for (size_t i = 0; i < count; i++) total[i] = 0.0;
+
+            for (int o = 0; o < octaves; o++) {
+                for (int d = 0; d < dims; d++) {
+                    for (size_t i = 0; i < count; i++) scaled[d][i] = coords[d][b + i] * frequency;
+                }
+                switch (dims) {
+                    case 2: Noise::rawBatch(scaled[0], scaled[1], count, noise); break;
+                    case 3: Noise::rawBatch(scaled[0], scaled[1], scaled[2], count, noise); break;
+                    default: Noise::rawBatch(scaled[0], scaled[1], scaled[2], scaled[3], count, noise); break;
+                }
+                for (size_t i = 0; i < count; i++) total[i] += noise[i] * amplitude;
+
+                frequency *= 2.0;
+                maxAmplitude += amplitude;
+                amplitude *= persistence;
+            }
+            for (size_t i = 0; i < count; i++) out[b + i] = total[i] / maxAmplitude;
+        }
+    }
+}
+
+void Noise::rawBatch(const f64* x, const f64* y, size_t n, OUT f64* out) {
+    size_t i = 0;
+#ifdef NOISE_BATCH_SIMD
+    for (; i + W <= n; i += W) rawBlock(x + i, y + i, out + i);
+#endif
+    for (; i < n; i++) out[i] = raw(x[i], y[i]);
+}
+
+void Noise::rawBatch(const f64* x, const f64* y, const f64* z, size_t n, OUT f64* out) {
+    size_t i = 0;
+#ifdef NOISE_BATCH_SIMD
+    for (; i + W <= n; i += W) rawBlock(x + i, y + i, z + i, out + i);
+#endif
+    for (; i < n; i++) out[i] = raw(x[i], y[i], z[i]);
+}
+
+void Noise::rawBatch(const f64* x, const f64* y, const f64* z, const f64* w, size_t n, OUT f64* out) {
+    size_t i = 0;
+#ifdef NOISE_BATCH_SIMD
+    for (; i + W <= n; i += W) rawBlock(x + i, y + i, z + i, w + i, out + i);
+#endif
+    for (; i < n; i++) out[i] = raw(x[i], y[i], z[i], w[i]);
+}
+
+void Noise::fractalBatch(const int octaves, const f64 persistence, const f64 freq,
+                         const f64* x, const f64* y, size_t n, OUT f64* out) {
+    const f64* coords[2] = { x, y };
+    fractalBatchImpl(octaves, persistence, freq, coords, 2, n, out);
+}
+
+void Noise::fractalBatch(const int octaves, const f64 persistence, const f64 freq,
+                         const f64* x, const f64* y, const f64* z, size_t n, OUT f64* out) {
+    const f64* coords[3] = { x, y, z };
+    fractalBatchImpl(octaves, persistence, freq, coords, 3, n, out);
+}
+
+void Noise::fractalBatch(const int octaves, const f64 persistence, const f64 freq,
+                         const f64* x, const f64* y, const f64* z, const f64* w, size_t n, OUT f64* out) {
+    const f64* coords[4] = { x, y, z, w };
+    fractalBatchImpl(octaves, persistence, freq, coords, 4, n, out);
+}
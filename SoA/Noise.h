@@ -17,6 +17,8 @@
 
 #include <Vorb/io/Keg.h>
 
+#include "NoiseProgram.h"
+
 enum class TerrainStage {
     NOISE,
     SQUARED,
@@ -55,8 +57,27 @@ struct TerrainFuncProperties {
 KEG_TYPE_DECL(TerrainFuncProperties);
 
 struct NoiseBase {
+    /// Compiles funcs into program, call whenever funcs change
+    void compile() {
+        program.compile(funcs.size() ? &funcs[0] : nullptr, funcs.size());
+    }
+    /// @return value with every function in funcs applied at pos
+    f64 evaluate(const f64v3& pos, f64 value) const {
+        assert(program.getNumRootFuncs() == funcs.size());
+        return program.evaluate(pos, value);
+    }
+    f64 evaluate(const f64v3& pos) const { return evaluate(pos, base); }
+    /// Same as evaluate(pos) for n positions given as separate coordinate arrays.
+    /// Agrees with it to within Noise::BATCH_TOLERANCE per noise function.
+    void evaluateBatch(const f64* x, const f64* y, const f64* z, size_t n, OUT f64* values) const {
+        assert(program.getNumRootFuncs() == funcs.size());
+        for (size_t i = 0; i < n; i++) values[i] = base;
+        program.evaluateBatch(x, y, z, n, values);
+    }
+
     f64 base = 0.0f;
     Array<TerrainFuncProperties> funcs;
+    NoiseProgram program; ///< Not parsed, built by compile()
 };
 KEG_TYPE_DECL(NoiseBase);
 
@@ -88,6 +109,20 @@ namespace Noise {
     f64 raw(const f64 x, const f64 y, const f64 z);
     f64 raw(const f64 x, const f64 y, const f64, const f64 w);
 
+    // Batched noise, evaluates n points given as separate coordinate arrays.
+    // Uses AVX2 or SSE4.1 when the target supports it and matches the scalar
+    // functions above to within BATCH_TOLERANCE. out may alias an input array.
+    const f64 BATCH_TOLERANCE = 1e-12;
+    void rawBatch(const f64* x, const f64* y, size_t n, OUT f64* out);
+    void rawBatch(const f64* x, const f64* y, const f64* z, size_t n, OUT f64* out);
+    void rawBatch(const f64* x, const f64* y, const f64* z, const f64* w, size_t n, OUT f64* out);
+    void fractalBatch(const int octaves, const f64 persistence, const f64 freq,
+                      const f64* x, const f64* y, size_t n, OUT f64* out);
+    void fractalBatch(const int octaves, const f64 persistence, const f64 freq,
+                      const f64* x, const f64* y, const f64* z, size_t n, OUT f64* out);
+    void fractalBatch(const int octaves, const f64 persistence, const f64 freq,
+                      const f64* x, const f64* y, const f64* z, const f64* w, size_t n, OUT f64* out);
+
     // Scaled Multi-octave Simplex noise
     // The result will be between the two parameters passed.
     inline f64 scaledFractal(const int octaves, const f64 persistence, const f64 freq, const f64 loBound, const f64 hiBound, const f64 x, const f64 y) {
@@ -0,0 +1,361 @@
+#include "stdafx.h"
+#include "NoiseProgram.h"
+
+#include "Noise.h"
+
+// NOTE: Make sure these semantics match NoiseShaderGenerator::addNoiseFunctions()
+
+namespace {
+    inline f64 doOperation(TerrainOp op, f64 a, f64 b) {
+        switch (op) {
+            case TerrainOp::ADD: return a + b;
+            case TerrainOp::SUB: return a - b;
+            case TerrainOp::MUL: return a * b;
+            case TerrainOp::DIV: return a / b;
+        }
+        return 0.0;
+    }
+
+    inline bool hasClamp(const f64v2& clamp) {
+        return clamp[0] != 0.0 || clamp[1] != 0.0;
+    }
+
+    /// Adds one octave of noise to total
+    inline void addOctave(TerrainStage func, f64 noise, f64 amplitude, f64& total) {
+        switch (func) {
+            case TerrainStage::CUBED_NOISE:
+            case TerrainStage::SQUARED_NOISE:
+            case TerrainStage::NOISE:
+                total += noise * amplitude;
+                break;
+            case TerrainStage::RIDGED_NOISE:
+                total += ((1.0 - glm::abs(noise)) * 2.0 - 1.0) * amplitude;
+                break;
+            case TerrainStage::ABS_NOISE:
+                total += glm::abs(noise) * amplitude;
+                break;
+            case TerrainStage::CELLULAR_NOISE:
+                total += noise * amplitude;
+                break;
+            case TerrainStage::CELLULAR_SQUARED_NOISE:
+                total += noise * noise * amplitude;
+                break;
+            case TerrainStage::CELLULAR_CUBED_NOISE:
+                total += noise * noise * noise * amplitude;
+                break;
+            default:
+                break;
+        }
+    }
+
+    inline bool isCellular(TerrainStage func) {
+        return func == TerrainStage::CELLULAR_NOISE ||
+            func == TerrainStage::CELLULAR_SQUARED_NOISE ||
+            func == TerrainStage::CELLULAR_CUBED_NOISE;
+    }
+
+    /// Post processing, scaling and clamping of the summed octaves
+    inline f64 finishNoise(const NoiseInstruction& in, f64 total, f64 maxAmplitude) {
+        total = (total / maxAmplitude);
+        switch (in.func) {
+            case TerrainStage::CUBED_NOISE:
+                total = total * total * total;
+                break;
+            case TerrainStage::SQUARED_NOISE:
+                total = total * total;
+                break;
+            default:
+                break;
+        }
+        f64 h;
+        // Conditional scaling.
+        if (in.low != -1.0 || in.high != 1.0) {
+            h = total * (in.high - in.low) * 0.5 + (in.high + in.low) * 0.5;
+        } else {
+            h = total;
+        }
+        if (hasClamp(in.clamp)) {
+            h = glm::clamp(h, in.clamp[0], in.clamp[1]);
+        }
+        return h;
+    }
+
+    f64 computeNoise(const NoiseInstruction& in, const f64v3& pos) {
+        f64 total = 0.0;
+        f64 maxAmplitude = 0.0;
+        f64 amplitude = 1.0;
+        f64 frequency = in.frequency;
+        bool cellular = isCellular(in.func);
+        for (int i = 0; i < in.octaves; i++) {
+            f64 noise;
+            if (cellular) {
+                f64v2 ff = Noise::cellular(pos * frequency);
+                noise = ff.y - ff.x;
+            } else {
+                noise = Noise::raw(pos.x * frequency, pos.y * frequency, pos.z * frequency);
+            }
+            addOctave(in.func, noise, amplitude, total);
+            frequency *= 2.0;
+            maxAmplitude += amplitude;
+            amplitude *= in.persistence;
+        }
+        return finishNoise(in, total, maxAmplitude);
+    }
+
+    void computeNoiseBatch(const NoiseInstruction& in, const f64* x, const f64* y, const f64* z, size_t n, OUT f64* out) {
+        f64 total[NOISE_PROGRAM_BATCH_SIZE];
+        f64 scaled[3][NOISE_PROGRAM_BATCH_SIZE];
+        f64 noise[NOISE_PROGRAM_BATCH_SIZE];
+        f64 maxAmplitude = 0.0;
+        f64 amplitude = 1.0;
+        f64 frequency = in.frequency;
+        bool cellular = isCellular(in.func);
+        for (size_t i = 0; i < n; i++) total[i] = 0.0;
+        for (int o = 0; o < in.octaves; o++) {
+            if (cellular) {
+                for (size_t i = 0; i < n; i++) {
+                    f64v2 ff = Noise::cellular(f64v3(x[i], y[i], z[i]) * frequency);
+                    noise[i] = ff.y - ff.x;
+                }
+            } else {
+                for (size_t i = 0; i < n; i++) {
+                    scaled[0][i] = x[i] * frequency;
+                    scaled[1][i] = y[i] * frequency;
+                    scaled[2][i] = z[i] * frequency;
+                }
+                Noise::rawBatch(scaled[0], scaled[1], scaled[2], n, noise);
+            }
+            for (size_t i = 0; i < n; i++) addOctave(in.func, noise[i], amplitude, total[i]);
+            frequency *= 2.0;
+            maxAmplitude += amplitude;
+            amplitude *= in.persistence;
+        }
+        for (size_t i = 0; i < n; i++) out[i] = finishNoise(in, total[i], maxAmplitude);
+    }
+}
+
+void NoiseProgram::compile(const TerrainFuncProperties* funcs, size_t numFuncs) {
+    m_code.clear();
+    m_numRegisters = 1;
+    m_numRootFuncs = numFuncs;
+    compileFuncs(funcs, numFuncs, -1, TerrainOp::ADD);
+}
+
+// Each function writes its result h to a register, and children modify their
+// parent's register. modifier is that register, or -1 at the root.
+void NoiseProgram::compileFuncs(const TerrainFuncProperties* funcs, size_t numFuncs, int modifier, TerrainOp op) {
+    for (size_t f = 0; f < numFuncs; ++f) {
+        const TerrainFuncProperties& fn = funcs[f];
+        bool isLeaf = fn.children.size() == 0;
+
+        ui16 h = 0; ///< Register holding this function's result, if it needs one
+        int nextMod;
+        TerrainOp nextOp;
+        if (fn.func == TerrainStage::CONSTANT) {
+            h = allocRegister();
+            emit(NoiseOpcode::SET, h).value = fn.low;
+            if (modifier >= 0) {
+                NoiseInstruction& in = emit(NoiseOpcode::APPLY, h);
+                in.op = op;
+                in.a = h;
+                in.b = (ui16)modifier;
+                // Clamps the modifier rather than h
+                if (hasClamp(fn.clamp)) {
+                    NoiseInstruction& c = emit(NoiseOpcode::CLAMP, h);
+                    c.a = (ui16)modifier;
+                    c.clamp = fn.clamp;
+                }
+            }
+            nextMod = h;
+            nextOp = fn.op;
+        } else if (fn.func == TerrainStage::PASS_THROUGH ||
+                   fn.func == TerrainStage::SQUARED ||
+                   fn.func == TerrainStage::CUBED) {
+            // h stays 0 unless a pass through applies the modifier,
+            // and it is only read if there are no children
+            if (isLeaf) {
+                h = allocRegister();
+                emit(NoiseOpcode::SET, h).value = 0.0;
+            }
+            if (modifier >= 0) {
+                if (fn.func == TerrainStage::PASS_THROUGH) {
+                    if (isLeaf) {
+                        NoiseInstruction& in = emit(NoiseOpcode::APPLY_VALUE, h);
+                        in.op = op;
+                        in.a = (ui16)modifier;
+                        in.value = fn.low;
+                    }
+                } else {
+                    emit(fn.func == TerrainStage::SQUARED ? NoiseOpcode::SQUARE : NoiseOpcode::CUBE, (ui16)modifier);
+                }
+                if (isLeaf && hasClamp(fn.clamp)) {
+                    NoiseInstruction& c = emit(NoiseOpcode::CLAMP, h);
+                    c.a = h;
+                    c.clamp = fn.clamp;
+                }
+            }
+            nextMod = modifier;
+            nextOp = op;
+        } else {
+            h = allocRegister();
+            NoiseInstruction& in = emit(NoiseOpcode::NOISE, h);
+            in.func = fn.func;
+            in.octaves = fn.octaves;
+            in.frequency = fn.frequency;
+            in.persistence = fn.persistence;
+            in.low = fn.low;
+            in.high = fn.high;
+            in.clamp = fn.clamp;
+            if (modifier >= 0) {
+                NoiseInstruction& apply = emit(NoiseOpcode::APPLY, h);
+                apply.op = op;
+                apply.a = h;
+                apply.b = (ui16)modifier;
+            }
+            nextMod = h;
+            nextOp = fn.op;
+        }
+
+        if (!isLeaf) {
+            // Early exit for speed, which also keeps the children's ops from touching the result
+            size_t skipIndex = m_code.size();
+            if (nextOp == TerrainOp::MUL && nextMod >= 0) {
+                emit(NoiseOpcode::SKIP_IF_ZERO, 0).a = (ui16)nextMod;
+            }
+            compileFuncs(&fn.children[0], fn.children.size(), nextMod, nextOp);
+            if (skipIndex < m_code.size() && m_code[skipIndex].code == NoiseOpcode::SKIP_IF_ZERO) {
+                m_code[skipIndex].skip = (ui32)(m_code.size() - skipIndex - 1);
+            }
+        } else {
+            NoiseInstruction& in = emit(NoiseOpcode::APPLY, 0);
+            in.op = fn.op;
+            in.a = 0;
+            in.b = h;
+        }
+    }
+}
+
+ui16 NoiseProgram::allocRegister() {
+    return (ui16)m_numRegisters++;
+}
+
+NoiseInstruction& NoiseProgram::emit(NoiseOpcode code, ui16 dst) {
+    m_code.push_back(NoiseInstruction());
+    NoiseInstruction& in = m_code.back();
+    in.code = code;
+    in.dst = dst;
+    return in;
+}
+
+f64 NoiseProgram::evaluate(const f64v3& pos, f64 value) const {
+    // NOTE: Stack overflow bad mkay
+    f64* r = (f64*)alloca(sizeof(f64) * m_numRegisters);
+    r[0] = value;
+    for (size_t pc = 0; pc < m_code.size(); pc++) {
+        const NoiseInstruction& in = m_code[pc];
+        switch (in.code) {
+            case NoiseOpcode::SET:
+                r[in.dst] = in.value;
+                break;
+            case NoiseOpcode::NOISE:
+                r[in.dst] = computeNoise(in, pos);
+                break;
+            case NoiseOpcode::APPLY:
+                r[in.dst] = doOperation(in.op, r[in.a], r[in.b]);
+                break;
+            case NoiseOpcode::APPLY_VALUE:
+                r[in.dst] = doOperation(in.op, r[in.a], in.value);
+                break;
+            case NoiseOpcode::CLAMP:
+                r[in.dst] = glm::clamp(r[in.a], in.clamp[0], in.clamp[1]);
+                break;
+            case NoiseOpcode::SQUARE:
+                r[in.dst] = r[in.dst] * r[in.dst];
+                break;
+            case NoiseOpcode::CUBE:
+                r[in.dst] = r[in.dst] * r[in.dst] * r[in.dst];
+                break;
+            case NoiseOpcode::SKIP_IF_ZERO:
+                if (r[in.a] == 0.0) pc += in.skip;
+                break;
+        }
+    }
+    return r[0];
+}
+
+void NoiseProgram::evaluateBatch(const f64* x, const f64* y, const f64* z, size_t n, f64* values) const {
+    static_assert(NOISE_PROGRAM_BATCH_SIZE <= 64, "Lane masks are 64 bits");
+    static thread_local std::vector<f64> registers;
+    registers.resize(m_numRegisters * NOISE_PROGRAM_BATCH_SIZE);
+    // Where each pending skip ends and the lane mask to restore there
+    static thread_local std::vector<std::pair<size_t, ui64>> skips;
+
+    for (size_t b = 0; b < n; b += NOISE_PROGRAM_BATCH_SIZE) {
+        const size_t count = std::min((size_t)NOISE_PROGRAM_BATCH_SIZE, n - b);
+        const ui64 allLanes = count == 64 ? ~0ull : (1ull << count) - 1;
+        ui64 lanes = allLanes;
+        skips.clear();
+        f64* r0 = &registers[0];
+        for (size_t i = 0; i < count; i++) r0[i] = values[b + i];
+
+        // Only lanes set in the mask may be written
+#define NOISE_PROGRAM_WRITE(dst, expr) \
+        if (lanes == allLanes) { \
+            for (size_t i = 0; i < count; i++) dst[i] = (expr); \
+        } else { \
+            for (size_t i = 0; i < count; i++) if (lanes & (1ull << i)) dst[i] = (expr); \
+        }
+
+        for (size_t pc = 0; pc < m_code.size(); pc++) {
+            while (skips.size() && skips.back().first == pc) {
+                lanes = skips.back().second;
+                skips.pop_back();
+            }
+            const NoiseInstruction& in = m_code[pc];
+            f64* dst = &registers[in.dst * NOISE_PROGRAM_BATCH_SIZE];
+            const f64* ra = &registers[in.a * NOISE_PROGRAM_BATCH_SIZE];
+            const f64* rb = &registers[in.b * NOISE_PROGRAM_BATCH_SIZE];
+            switch (in.code) {
+                case NoiseOpcode::SET:
+                    NOISE_PROGRAM_WRITE(dst, in.value);
+                    break;
+                case NoiseOpcode::NOISE: {
+                    f64 noise[NOISE_PROGRAM_BATCH_SIZE];
+                    computeNoiseBatch(in, x + b, y + b, z + b, count, noise);
+                    NOISE_PROGRAM_WRITE(dst, noise[i]);
+                } break;
+                case NoiseOpcode::APPLY:
+                    NOISE_PROGRAM_WRITE(dst, doOperation(in.op, ra[i], rb[i]));
+                    break;
+                case NoiseOpcode::APPLY_VALUE:
+                    NOISE_PROGRAM_WRITE(dst, doOperation(in.op, ra[i], in.value));
+                    break;
+                case NoiseOpcode::CLAMP:
+                    NOISE_PROGRAM_WRITE(dst, glm::clamp(ra[i], in.clamp[0], in.clamp[1]));
+                    break;
+                case NoiseOpcode::SQUARE:
+                    NOISE_PROGRAM_WRITE(dst, dst[i] * dst[i]);
+                    break;
+                case NoiseOpcode::CUBE:
+                    NOISE_PROGRAM_WRITE(dst, dst[i] * dst[i] * dst[i]);
+                    break;
+                case NoiseOpcode::SKIP_IF_ZERO: {
+                    ui64 keep = 0;
+                    for (size_t i = 0; i < count; i++) {
+                        if (ra[i] != 0.0) keep |= 1ull << i;
+                    }
+                    if ((lanes & keep) == 0) {
+                        // Nobody runs the block
+                        pc += in.skip;
+                    } else if ((lanes & keep) != lanes) {
+                        skips.emplace_back(pc + 1 + in.skip, lanes);
+                        lanes &= keep;
+                    }
+                } break;
+            }
+        }
+#undef NOISE_PROGRAM_WRITE
+
+        for (size_t i = 0; i < count; i++) values[b + i] = r0[i];
+    }
+}
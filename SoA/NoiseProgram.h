@@ -0,0 +1,82 @@
+///
+/// NoiseProgram.h
+/// Seed of Andromeda
+///
+/// Copyright 2014 Regrowth Studios
+/// MIT License
+///
+/// Summary:
+/// Flat, register based form of a TerrainFuncProperties tree
+/// that can be evaluated for one position or a batch of them.
+///
+
+#pragma once
+
+#ifndef NoiseProgram_h__
+#define NoiseProgram_h__
+
+enum class TerrainStage;
+enum class TerrainOp;
+struct TerrainFuncProperties;
+
+// Positions per block in NoiseProgram::evaluateBatch, must be <= 64
+#define NOISE_PROGRAM_BATCH_SIZE 64
+
+enum class NoiseOpcode : ui8 {
+    SET,          ///< r[dst] = value
+    NOISE,        ///< r[dst] = fractal noise described by the instruction, scaled and clamped
+    APPLY,        ///< r[dst] = op(r[a], r[b])
+    APPLY_VALUE,  ///< r[dst] = op(r[a], value)
+    CLAMP,        ///< r[dst] = clamp(r[a], clamp.x, clamp.y)
+    SQUARE,       ///< r[dst] = r[dst] ^ 2
+    CUBE,         ///< r[dst] = r[dst] ^ 3
+    SKIP_IF_ZERO  ///< Skips the next skip instructions where r[a] == 0
+};
+
+struct NoiseInstruction {
+    NoiseOpcode code;
+    TerrainOp op;
+    TerrainStage func;
+    ui16 dst;
+    ui16 a;
+    ui16 b;
+    ui32 skip;
+    int octaves;
+    f64 value;
+    f64 frequency;
+    f64 persistence;
+    f64 low;
+    f64 high;
+    f64v2 clamp;
+};
+
+/// Register 0 holds the value being accumulated, the rest hold the
+/// intermediate results that the recursive walk kept on the stack.
+class NoiseProgram {
+public:
+    /// Lowers a function tree. Must be called again whenever the tree changes.
+    void compile(const TerrainFuncProperties* funcs, size_t numFuncs);
+
+    /// Runs the program for one position
+    /// @param value: Starting value, usually NoiseBase::base
+    /// @return The value after every function was applied
+    f64 evaluate(const f64v3& pos, f64 value) const;
+    /// Runs the program for n positions given as separate coordinate arrays.
+    /// @param values: Starting values, replaced by the results
+    void evaluateBatch(const f64* x, const f64* y, const f64* z, size_t n, f64* values) const;
+
+    /// Getters
+    size_t getNumRootFuncs() const { return m_numRootFuncs; }
+    size_t getNumRegisters() const { return m_numRegisters; }
+    const std::vector<NoiseInstruction>& getCode() const { return m_code; }
+private:
+    void compileFuncs(const TerrainFuncProperties* funcs, size_t numFuncs, int modifier, TerrainOp op);
+    ui16 allocRegister();
+    NoiseInstruction& emit(NoiseOpcode code, ui16 dst);
+
+    std::vector<NoiseInstruction> m_code;
+    size_t m_numRegisters = 1;
+    size_t m_numRootFuncs = 0;
+};
+
+#endif // NoiseProgram_h__
@@ -186,7 +186,9 @@ void PhysicsComponentUpdater::updateSpacePhysics(GameSystem* gameSystem, SpaceSy
                                                                                   stCmp.startVoxelPosition);
                 
                 // Make the Chunk Sphere component
-                GameSystemAssemblages::addChunkSphere(gameSystem, entity, vpid, VoxelSpaceConversions::voxelToChunk(stCmp.startVoxelPosition), 7);
+                GameSystemAssemblages::addChunkSphere(gameSystem, entity, vpid, VoxelSpaceConversions::voxelToChunk(stCmp.startVoxelPosition), 7,
+                                                      gameSystem->physics.getComponentID(entity),
+                                                      gameSystem->head.getComponentID(entity));
                 
                 auto& hcmp = gameSystem->head.getFromEntity(entity);
                 hcmp.voxelPosition = vpid;
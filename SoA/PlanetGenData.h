@@ -306,6 +306,10 @@ struct PlanetGenData {
     /************************************************************************/
     const Biome* baseBiomeLookup[BIOME_MAP_WIDTH][BIOME_MAP_WIDTH];
     std::vector<BiomeInfluence> baseBiomeInfluenceMap[BIOME_MAP_WIDTH][BIOME_MAP_WIDTH];
+    /// baseBiomeInfluenceMap merged per cell, sorted by biome. Cell y * BIOME_MAP_WIDTH + x
+    /// spans [baseBiomeCellOffsets[cell], baseBiomeCellOffsets[cell + 1]). Empty without biomes.
+    std::vector<BiomeCellInfluence> baseBiomeCellInfluences;
+    std::vector<ui32> baseBiomeCellOffsets;
     std::vector<Biome> biomes; ///< Biome object storage. DON'T EVER RESIZE AFTER GEN.
 
     nString terrainFilePath;
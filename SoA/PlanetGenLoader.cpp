@@ -153,6 +153,7 @@ CALLER_DELETE PlanetGenData* PlanetGenLoader::getRandomGenData(f32 radius, vcore
     // TODO(Ben): Radius is temporary hacky fix for small planet darkness!
     if (radius < 15.0) {
         genData->baseTerrainFuncs.funcs.setData();
+        genData->baseTerrainFuncs.compile();
     }
 
     // TODO: Reimplement these as suitable.
@@ -302,6 +303,41 @@ void blurBaseBiomeMap(const Biome* baseBiomeLookup[BIOME_MAP_WIDTH][BIOME_MAP_WI
     }
 }
 
+void buildBaseBiomeCellInfluences(PlanetGenData* genData) {
+    genData->baseBiomeCellInfluences.clear();
+    genData->baseBiomeCellOffsets.resize(BIOME_MAP_WIDTH * BIOME_MAP_WIDTH + 1);
+    std::vector<BiomeCellInfluence> merged;
+    for (int y = 0; y < BIOME_MAP_WIDTH; y++) {
+        for (int x = 0; x < BIOME_MAP_WIDTH; x++) {
+            // Corners are 0 1 / 2 3 and repeat the cell's own list at the map edges
+            int x1 = x < BIOME_MAP_WIDTH - 1 ? x + 1 : x;
+            int y1 = y < BIOME_MAP_WIDTH - 1 ? y + 1 : y;
+            const std::vector<BiomeInfluence>* corners[4] = {
+                &genData->baseBiomeInfluenceMap[y][x],
+                &genData->baseBiomeInfluenceMap[y][x1],
+                &genData->baseBiomeInfluenceMap[y1][x],
+                &genData->baseBiomeInfluenceMap[y1][x1]
+            };
+            merged.clear();
+            for (int c = 0; c < 4; c++) {
+                for (auto& b : *corners[c]) {
+                    auto it = std::find_if(merged.begin(), merged.end(), [&](const BiomeCellInfluence& m) { return m.b == b.b; });
+                    if (it == merged.end()) {
+                        merged.push_back({ b.b, b.weight, { 0.0f, 0.0f, 0.0f, 0.0f } });
+                        it = merged.end() - 1;
+                    }
+                    it->cornerWeights[c] = b.weight;
+                }
+            }
+            // Blend in the same order a std::map of the biomes would have
+            std::sort(merged.begin(), merged.end(), [](const BiomeCellInfluence& a, const BiomeCellInfluence& b) { return a.b < b.b; });
+            genData->baseBiomeCellOffsets[y * BIOME_MAP_WIDTH + x] = (ui32)genData->baseBiomeCellInfluences.size();
+            genData->baseBiomeCellInfluences.insert(genData->baseBiomeCellInfluences.end(), merged.begin(), merged.end());
+        }
+    }
+    genData->baseBiomeCellOffsets.back() = (ui32)genData->baseBiomeCellInfluences.size();
+}
+
 void recursiveInitBiomes(Biome& biome,
                          const BiomeKegProperties& kp,
                          ui32& biomeCounter,
@@ -320,7 +356,9 @@ void recursiveInitBiomes(Biome& biome,
     biome.noiseRange = kp.noiseRange;
     biome.noiseScale = kp.noiseScale;
     biome.terrainNoise = kp.terrainNoise;
+    biome.terrainNoise.compile();
     biome.childNoise = kp.childNoise;
+    biome.childNoise.compile();
 
     // Construct vectors in place for flora and trees
     auto& floraPropList = genData->blockInfo.biomeFlora.insert(
@@ -772,6 +810,7 @@ void PlanetGenLoader::loadBiomes(const nString& filePath, PlanetGenData* genData
             }
         }
     }
+    buildBaseBiomeCellInfluences(genData);
 }
 
 void PlanetGenLoader::parseTerrainFuncs(NoiseBase* terrainFuncs, keg::ReadContext& context, keg::Node node) {
@@ -785,6 +824,7 @@ void PlanetGenLoader::parseTerrainFuncs(NoiseBase* terrainFuncs, keg::ReadContex
         fprintf(stderr, "Keg error %d in parseTerrainFuncs()\n", (int)error);
         return;
     }
+    terrainFuncs->compile();
 }
 
 void PlanetGenLoader::parseLiquidColor(keg::ReadContext& context, keg::Node node, PlanetGenData* genData) {
@@ -66,6 +66,7 @@ CALLER_DELETE PlanetGenData* PlanetGenerator::generatePlanet(vcore::RPCManager*
                           -500.0f, 500.0f,
                           10.0f, 1000.0f);
     data->baseTerrainFuncs.funcs.setData(funcs.data(), funcs.size());
+    data->baseTerrainFuncs.compile();
     funcs.clear();
     // Temperature
 
@@ -78,6 +79,7 @@ CALLER_DELETE PlanetGenData* PlanetGenerator::generatePlanet(vcore::RPCManager*
                           -128.0f, -128.0f,
                           255.0f, 255.0f);
     data->tempTerrainFuncs.funcs.setData(funcs.data(), funcs.size());
+    data->tempTerrainFuncs.compile();
     funcs.clear();
     // Humidity
     data->humTerrainFuncs.base = 128.0f;
@@ -89,6 +91,7 @@ CALLER_DELETE PlanetGenData* PlanetGenerator::generatePlanet(vcore::RPCManager*
                           -128.0f, -128.0f,
                           255.0f, 255.0f);
     data->humTerrainFuncs.funcs.setData(funcs.data(), funcs.size());
+    data->humTerrainFuncs.compile();
     funcs.clear();
 
     return data;
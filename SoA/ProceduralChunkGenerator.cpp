@@ -6,13 +6,93 @@
 #include "VoxelSpaceConversions.h"
 
 #include "SmartVoxelContainer.hpp"
+#include "VoxelRunKernels.h"
 
-void ProceduralChunkGenerator::init(PlanetGenData* genData) {
+void ProceduralChunkGenerator::init(PlanetGenData* genData, OPT HeightSampleCache* sampleCache /*= nullptr*/) {
     m_genData = genData;
-    m_heightGenerator.init(genData);
+    m_heightGenerator.init(genData, sampleCache);
 }
 
 void ProceduralChunkGenerator::generateChunk(Chunk* chunk, PlanetHeightData* heightData) const {
+    ColumnData columns;
+    initColumnData(heightData, columns);
+    int bottom = (int)chunk->getVoxelPosition().pos.y;
+    for (size_t c = 0; c < CHUNK_LAYER; c++) {
+        int depth = columns.mapHeights[c] - bottom;
+        columns.layerIndices[c] = depth < 0 ? 0 : getBlockLayerIndex(depth);
+    }
+    generateChunk(chunk, heightData, columns);
+}
+
+void ProceduralChunkGenerator::generateColumn(Chunk* const* chunks, size_t numChunks, PlanetHeightData* heightData) const {
+    // Top down, so the layer at each chunk's bottom only ever moves deeper
+    Chunk** sorted = (Chunk**)alloca(sizeof(Chunk*) * numChunks);
+    std::copy(chunks, chunks + numChunks, sorted);
+    std::sort(sorted, sorted + numChunks, [](const Chunk* a, const Chunk* b) {
+        return a->getChunkPosition().pos.y > b->getChunkPosition().pos.y;
+    });
+
+    const std::vector<BlockLayer>& blockLayers = m_genData->blockLayers;
+    ColumnData columns;
+    initColumnData(heightData, columns);
+    ui32 deepestLayers[CHUNK_LAYER] = {}; ///< Layer reached by each column so far
+    for (size_t i = 0; i < numChunks; i++) {
+        int bottom = (int)sorted[i]->getVoxelPosition().pos.y;
+        for (size_t c = 0; c < CHUNK_LAYER; c++) {
+            int depth = columns.mapHeights[c] - bottom;
+            if (depth < 0) {
+                columns.layerIndices[c] = 0;
+                continue;
+            }
+            ui32& layer = deepestLayers[c];
+            while (layer + 1 < blockLayers.size() && blockLayers[layer + 1].start <= (ui32)depth) layer++;
+            columns.layerIndices[c] = layer;
+        }
+        generateChunk(sorted[i], heightData, columns);
+    }
+}
+
+void ProceduralChunkGenerator::initColumnData(const PlanetHeightData* heightData, OUT ColumnData& columns) const {
+    columns.minHeight = INT_MAX;
+    columns.maxHeight = INT_MIN;
+    for (size_t c = 0; c < CHUNK_LAYER; c++) {
+        int mapHeight = (int)heightData[c].height;
+        columns.mapHeights[c] = mapHeight;
+        if (mapHeight < columns.minHeight) columns.minHeight = mapHeight;
+        if (mapHeight > columns.maxHeight) columns.maxHeight = mapHeight;
+    }
+}
+
+bool ProceduralChunkGenerator::tryGenerateUniform(Chunk* chunk, const ColumnData& columns) const {
+    const std::vector<BlockLayer>& blockLayers = m_genData->blockLayers;
+    int bottom = (int)chunk->getVoxelPosition().pos.y;
+    int top = bottom + CHUNK_WIDTH - 1;
+    ui16 blockID;
+    if (bottom > columns.maxHeight + 1) {
+        // Above every column with no room for flora, so only air or liquid
+        if (!m_genData->liquidBlock || bottom >= 0) {
+            blockID = 0;
+        } else if (top < 0) {
+            blockID = m_genData->liquidBlock;
+        } else {
+            return false;
+        }
+    } else if (top < columns.minHeight) {
+        // Below every surface, uniform if one layer spans the chunk in every column
+        blockID = blockLayers[columns.layerIndices[0]].block;
+        for (size_t c = 0; c < CHUNK_LAYER; c++) {
+            const BlockLayer& layer = blockLayers[columns.layerIndices[c]];
+            if (layer.block != blockID || layer.start > (ui32)(columns.mapHeights[c] - top)) return false;
+        }
+    } else {
+        return false;
+    }
+    chunk->numBlocks = blockID ? CHUNK_SIZE : 0;
+    chunk->blocks.initUniform(blockID);
+    return true;
+}
+
+void ProceduralChunkGenerator::generateChunk(Chunk* chunk, const PlanetHeightData* heightData, const ColumnData& columns) const {
 
     //int temperature;
     //int rainfall;
@@ -22,31 +102,35 @@ void ProceduralChunkGenerator::generateChunk(Chunk* chunk, PlanetHeightData* hei
     int depth;
 
     ui16 blockID;
-    ui16 tertiaryData;
     //double CaveDensity1[9][5][5], CaveDensity2[9][5][5];
 
-    std::vector<BlockLayer>& blockLayers = m_genData->blockLayers;
+    const std::vector<BlockLayer>& blockLayers = m_genData->blockLayers;
     VoxelPosition3D voxPosition = chunk->getVoxelPosition();
     chunk->numBlocks = 0;
 
+    // Nothing generated uses tertiary data, so leave it unallocated until something writes it
+    chunk->tertiary.initUniform(0);
+
+    // Skip the per voxel work for chunks that are entirely air, liquid or one layer
+    if (tryGenerateUniform(chunk, columns)) return;
+
     // Generation data
     IntervalTree<ui16>::LNode blockDataArray[CHUNK_SIZE];
-    IntervalTree<ui16>::LNode tertiaryDataArray[CHUNK_SIZE];
     size_t blockDataSize = 0;
-    size_t tertiaryDataSize = 0;
+    // Each layer is generated flat, then appended to the run arrays in one pass
+    ui16 blockLayerData[CHUNK_LAYER];
 
     ui16 c = 0;
     bool allAir = true;
 
     ui32 layerIndices[CHUNK_LAYER];
 
-    // First pass at y = 0. We separate it so we can getBlockLayerIndex a single
+    // First pass at y = 0. We separate it so we can look up the layer a single
     // time and cut out some comparisons.
     for (size_t z = 0; z < CHUNK_WIDTH; ++z) {
         for (size_t x = 0; x < CHUNK_WIDTH; ++x, ++c) {
-            tertiaryData = 0;
 
-            mapHeight = (int)heightData[c].height;
+            mapHeight = columns.mapHeights[c];
             // TODO(Matthew): These statements weren't used, revisit this function to make sure it is behaving correctly.
             //temperature = heightData[c].temperature;
             //rainfall = heightData[c].humidity;
@@ -58,44 +142,24 @@ void ProceduralChunkGenerator::generateChunk(Chunk* chunk, PlanetHeightData* hei
             depth = mapHeight - height; // Get depth of voxel
 
             // Determine the layer
-            if (depth < 0) {
-                layerIndices[c] = 0;
-            } else {
-                allAir = false;
-                layerIndices[c] = getBlockLayerIndex(depth);
-            }
-            BlockLayer& layer = blockLayers[layerIndices[c]];
+            if (depth >= 0) allAir = false;
+            layerIndices[c] = columns.layerIndices[c];
+            const BlockLayer& layer = blockLayers[layerIndices[c]];
             // Get the block ID
             blockID = getBlockID(chunk, c, depth, mapHeight, height, heightData[c], layer);
 
             if (blockID != 0) chunk->numBlocks++;
 
-            // Set up the data arrays
-            if (blockDataSize == 0) {
-                blockDataArray[blockDataSize++].set(c, 1, blockID);
-                tertiaryDataArray[tertiaryDataSize++].set(c, 1, tertiaryData);
-            } else {
-                if (blockID == blockDataArray[blockDataSize - 1].data) {
-                    ++blockDataArray[blockDataSize - 1].length;
-                } else {
-                    blockDataArray[blockDataSize++].set(c, 1, blockID);
-                }
-                if (tertiaryData == tertiaryDataArray[tertiaryDataSize - 1].data) {
-                    ++tertiaryDataArray[tertiaryDataSize - 1].length;
-                } else {
-                    tertiaryDataArray[tertiaryDataSize++].set(c, 1, tertiaryData);
-                }
-            }
+            blockLayerData[c] = blockID;
         }
     }
+    // Set up the data arrays
+    vvox::appendRuns(blockLayerData, CHUNK_LAYER, 0, blockDataArray, blockDataSize);
 
     // Early exit optimization for solid air chunks
-    if (allAir && blockDataSize == 1 && tertiaryDataSize == 1) {
-        // Set up interval trees
-        blockDataArray[0].length = CHUNK_SIZE;
-        tertiaryDataArray[0].length = CHUNK_SIZE;
-        chunk->blocks.initFromSortedArray(vvox::VoxelStorageState::INTERVAL_TREE, blockDataArray, blockDataSize);
-        chunk->tertiary.initFromSortedArray(vvox::VoxelStorageState::INTERVAL_TREE, tertiaryDataArray, tertiaryDataSize);
+    if (allAir && blockDataSize == 1) {
+        // Single value, no need to allocate anything
+        chunk->blocks.initUniform(blockDataArray[0].data);
         return;
     }
 
@@ -103,10 +167,9 @@ void ProceduralChunkGenerator::generateChunk(Chunk* chunk, PlanetHeightData* hei
     for (size_t y = 1; y < CHUNK_WIDTH; ++y) {
         for (size_t z = 0; z < CHUNK_WIDTH; ++z) {
             for (size_t x = 0; x < CHUNK_WIDTH; ++x, ++c) {
-                tertiaryData = 0;
                 hIndex = (c & 0x3FF); // Same as % CHUNK_LAYER
 
-                mapHeight = heightData[hIndex].height;
+                mapHeight = columns.mapHeights[hIndex];
                 //temperature = heightData[hIndex].temperature;
                 //rainfall = heightData[hIndex].humidity;
 
@@ -118,7 +181,7 @@ void ProceduralChunkGenerator::generateChunk(Chunk* chunk, PlanetHeightData* hei
                 ui16 layerIndex = layerIndices[hIndex];
                 if (blockLayers[layerIndex].start > (ui32)depth && layerIndex > 0) layerIndex--;
                 // Get the block ID
-                BlockLayer& layer = blockLayers[layerIndex];
+                const BlockLayer& layer = blockLayers[layerIndex];
                 blockID = getBlockID(chunk, c, depth, mapHeight, height, heightData[hIndex], layer);
 
                 //if (tooSteep) dh += 3; // If steep, increase depth
@@ -129,23 +192,15 @@ void ProceduralChunkGenerator::generateChunk(Chunk* chunk, PlanetHeightData* hei
                 
                 if (blockID != 0) ++chunk->numBlocks;
 
-                // Add to the data arrays
-                if (blockID == blockDataArray[blockDataSize - 1].data) {
-                    ++blockDataArray[blockDataSize - 1].length;
-                } else {
-                    blockDataArray[blockDataSize++].set(c, 1, blockID);
-                }
-                if (tertiaryData == tertiaryDataArray[tertiaryDataSize - 1].data) {
-                    ++tertiaryDataArray[tertiaryDataSize - 1].length;
-                } else {
-                    tertiaryDataArray[tertiaryDataSize++].set(c, 1, tertiaryData);
-                }
+                blockLayerData[hIndex] = blockID;
             }
         }
+        // Add to the data arrays
+        vvox::appendRuns(blockLayerData, CHUNK_LAYER, y * CHUNK_LAYER, blockDataArray, blockDataSize);
     }
-    // Set up interval trees
-    chunk->blocks.initFromSortedArray(vvox::VoxelStorageState::INTERVAL_TREE, blockDataArray, blockDataSize);
-    chunk->tertiary.initFromSortedArray(vvox::VoxelStorageState::INTERVAL_TREE, tertiaryDataArray, tertiaryDataSize);
+    // Set up the interval tree, or a single value for deep chunks that are one block
+    chunk->blocks.initFromSortedArray(blockDataSize == 1 ? vvox::VoxelStorageState::UNIFORM : vvox::VoxelStorageState::INTERVAL_TREE,
+                                      blockDataArray, blockDataSize);
 }
 
 void ProceduralChunkGenerator::generateHeightmap(Chunk* chunk, PlanetHeightData* heightData) const {
@@ -155,14 +210,16 @@ void ProceduralChunkGenerator::generateHeightmap(Chunk* chunk, PlanetHeightData*
     cornerPos2D.pos.y = cornerPos3D.pos.z;
     cornerPos2D.face = cornerPos3D.face;
 
+    VoxelPosition2D positions[CHUNK_LAYER];
     for (int z = 0; z < CHUNK_WIDTH; z++) {
         for (int x = 0; x < CHUNK_WIDTH; x++) {
-            VoxelPosition2D pos = cornerPos2D;
+            VoxelPosition2D& pos = positions[z * CHUNK_WIDTH + x];
+            pos = cornerPos2D;
             pos.pos.x += x;
             pos.pos.y += z;
-            m_heightGenerator.generateHeightData(heightData[z * CHUNK_WIDTH + x], pos);
         }
     }
+    m_heightGenerator.generateHeightData(heightData, positions, CHUNK_LAYER);
 }
 
 // Gets layer in O(log(n)) where n is the number of layers
@@ -194,7 +251,7 @@ ui32 ProceduralChunkGenerator::getBlockLayerIndex(ui32 depth) const {
 }
 
 // TODO(Ben): Too many parameters?
-ui16 ProceduralChunkGenerator::getBlockID(Chunk* chunk, int blockIndex, int depth, int mapHeight VORB_MAYBE_UNUSED, int height, const PlanetHeightData& hd, BlockLayer& layer) const {
+ui16 ProceduralChunkGenerator::getBlockID(Chunk* chunk, int blockIndex, int depth, int mapHeight VORB_MAYBE_UNUSED, int height, const PlanetHeightData& hd, const BlockLayer& layer) const {
     ui16 blockID = 0;
     if (depth > 0) {
         blockID = layer.block;
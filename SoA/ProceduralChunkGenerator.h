@@ -19,17 +19,34 @@ struct PlanetGenData;
 struct PlanetHeightData;
 struct BlockLayer;
 class Chunk;
+class HeightSampleCache;
 
+#include "Constants.h"
 #include "SphericalHeightmapGenerator.h"
 
 class ProceduralChunkGenerator {
 public:
-    void init(PlanetGenData* genData);
+    void init(PlanetGenData* genData, OPT HeightSampleCache* sampleCache = nullptr);
     void generateChunk(Chunk* chunk, PlanetHeightData* heightData) const;
+    /// Generates chunks of one vertical stack that share heightData. Per column work is
+    /// done once for the stack instead of once per chunk.
+    void generateColumn(Chunk* const* chunks, size_t numChunks, PlanetHeightData* heightData) const;
     void generateHeightmap(Chunk* chunk, PlanetHeightData* heightData) const;
 private:
+    /// Per column data shared by the chunks of a stack
+    struct ColumnData {
+        int mapHeights[CHUNK_LAYER];
+        ui32 layerIndices[CHUNK_LAYER]; ///< Block layer at the chunk's bottom voxel, 0 above ground
+        int minHeight;
+        int maxHeight;
+    };
+    void initColumnData(const PlanetHeightData* heightData, OUT ColumnData& columns) const;
+    void generateChunk(Chunk* chunk, const PlanetHeightData* heightData, const ColumnData& columns) const;
+    /// Fills chunks that are entirely air, liquid or one block layer
+    /// @return false if the chunk needs per voxel generation
+    bool tryGenerateUniform(Chunk* chunk, const ColumnData& columns) const;
     ui32 getBlockLayerIndex(ui32 depth) const;
-    ui16 getBlockID(Chunk* chunk, int blockIndex, int depth, int mapHeight, int height, const PlanetHeightData& hd, BlockLayer& layer) const;
+    ui16 getBlockID(Chunk* chunk, int blockIndex, int depth, int mapHeight, int height, const PlanetHeightData& hd, const BlockLayer& layer) const;
 
     PlanetGenData* m_genData = nullptr;
     SphericalHeightmapGenerator m_heightGenerator;
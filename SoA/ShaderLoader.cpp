@@ -63,3 +63,18 @@ CALLER_DELETE vg::GLProgram ShaderLoader::createProgram(const cString displayNam
     vg::ShaderManager::onProgramLinkError -= makeDelegate(printLinkError);
     return program;
 }
+
+CALLER_DELETE vg::GLProgram ShaderLoader::tryCreateProgramFromFile(const vio::Path& vertPath, const vio::Path& fragPath,
+                                                                   vio::IOManager* iom /*= nullptr*/, const cString defines /*= nullptr*/) {
+    vg::ShaderManager::onFileIOFailure += makeDelegate(printFileIOError);
+    vg::ShaderManager::onShaderCompilationError += makeDelegate(printShaderError);
+    vg::ShaderManager::onProgramLinkError += makeDelegate(printLinkError);
+
+    vg::GLProgram program = vg::ShaderManager::createProgramFromFile(vertPath, fragPath, iom, defines);
+    if (!program.isLinked()) program.dispose();
+
+    vg::ShaderManager::onFileIOFailure -= makeDelegate(printFileIOError);
+    vg::ShaderManager::onShaderCompilationError -= makeDelegate(printShaderError);
+    vg::ShaderManager::onProgramLinkError -= makeDelegate(printLinkError);
+    return program;
+}
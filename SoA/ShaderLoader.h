@@ -33,6 +33,12 @@ class ShaderLoader {
     /// Does not register with global cache
     static CALLER_DELETE vg::GLProgram createProgram(const cString displayName, const cString vertSrc, const cString fragSrc,
                                                      vio::IOManager* iom = nullptr, const cString defines = nullptr);
+
+    /// Creates a program using code loaded from files and prints any errors, but tries only once
+    /// Does not register with global cache
+    /// @return The program, which is not linked if it failed
+    static CALLER_DELETE vg::GLProgram tryCreateProgramFromFile(const vio::Path& vertPath, const vio::Path& fragPath,
+                                                                vio::IOManager* iom = nullptr, const cString defines = nullptr);
 };
 
 #endif // ShaderLoader_h__
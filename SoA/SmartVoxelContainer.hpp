@@ -15,23 +15,24 @@
 #ifndef SmartVoxelContainer_h__
 #define SmartVoxelContainer_h__
 
+#include <atomic>
 #include <mutex>
+#include <vector>
 
 #include "Constants.h"
+#include "VoxelRunKernels.h"
 
-#include <Vorb/FixedSizeArrayRecycler.hpp>
 #include <Vorb/voxel/IntervalTree.h>
+#include <Vorb/voxel/VoxCommon.h>
 
 #define QUIET_FRAMES_UNTIL_COMPRESS 60
 #define ACCESS_COUNT_UNTIL_DECOMPRESS 5
+#define MAX_PALETTE_SIZE 256 ///< Largest palette before we give up and use another state
 
 // TODO(Cristian): We'll see how to fit it into Vorb
 namespace vorb {
     namespace voxel {
 
-        static ui32 MAX_COMPRESSIONS_PER_FRAME = UINT_MAX; ///< You can optionally set this in order to limit changes per frame
-        static ui32 totalContainerCompressions = 1; ///< Set this to 1 each frame
-
         template<typename T, size_t SIZE> class SmartVoxelContainer;
 
         template<typename T, size_t SIZE>
@@ -61,14 +62,69 @@ namespace vorb {
             size_t m_index; ///< The index of this handle into the smart container
         };
 
-        /// This should be called once per frame to reset totalContainerChanges
-        inline void clearContainerCompressionsCounter() {
-            totalContainerCompressions = 1; ///< Start at 1 so that integer overflow handles the default case
-        }
+        /// Caches freed voxel arrays for reuse, like vcore::FixedSizeArrayRecycler,
+        /// and counts how often create found one cached
+        template <size_t SIZE, typename T>
+        class VoxelArrayRecycler {
+        public:
+            /// @param maxSize: Most arrays to keep cached
+            VoxelArrayRecycler(size_t maxSize) : m_maxSize(maxSize) {
+                // Empty
+            }
+            ~VoxelArrayRecycler() {
+                destroy();
+            }
+
+            /// Frees every cached array
+            void destroy() {
+                std::lock_guard<std::mutex> l(m_lock);
+                for (T* data : m_arrays) delete[] data;
+                std::vector<T*>().swap(m_arrays);
+            }
+
+            /// Gets a cached array, or allocates one if there are none
+            T* create() {
+                {
+                    std::lock_guard<std::mutex> l(m_lock);
+                    if (m_arrays.size()) {
+                        T* data = m_arrays.back();
+                        m_arrays.pop_back();
+                        m_hits.fetch_add(1, std::memory_order_relaxed);
+                        return data;
+                    }
+                }
+                m_misses.fetch_add(1, std::memory_order_relaxed);
+                return new T[SIZE];
+            }
+            /// Caches data for reuse, or frees it if the cache is full
+            void recycle(T* data) {
+                {
+                    std::lock_guard<std::mutex> l(m_lock);
+                    if (m_arrays.size() < m_maxSize) {
+                        m_arrays.push_back(data);
+                        return;
+                    }
+                }
+                delete[] data;
+            }
+
+            /// Number of create calls that reused a cached array
+            size_t getHits() const { return m_hits.load(std::memory_order_relaxed); }
+            /// Number of create calls that had to allocate
+            size_t getMisses() const { return m_misses.load(std::memory_order_relaxed); }
+        private:
+            std::mutex m_lock; ///< Guards m_arrays
+            std::vector<T*> m_arrays; ///< Cached arrays
+            size_t m_maxSize;
+            std::atomic<size_t> m_hits{ 0 };
+            std::atomic<size_t> m_misses{ 0 };
+        };
 
         enum class VoxelStorageState {
             FLAT_ARRAY = 0,
-            INTERVAL_TREE = 1
+            INTERVAL_TREE = 1,
+            PALETTE = 2, ///< Small palette of values with a bit-packed index per voxel
+            UNIFORM = 3 ///< Every voxel has the same value, nothing is allocated
         };
 
         template <typename T, size_t SIZE = CHUNK_SIZE>
@@ -83,7 +139,7 @@ namespace vorb {
             *
             * @param arrayRecycler: The recycler to be used in place of the default generated recycler.
             */
-            SmartVoxelContainer(vcore::FixedSizeArrayRecycler<SIZE, T>* arrayRecycler) {
+            SmartVoxelContainer(VoxelArrayRecycler<SIZE, T>* arrayRecycler) {
                 setArrayRecycler(arrayRecycler);
             }
 
@@ -91,7 +147,7 @@ namespace vorb {
             *
             * @param arrayRecycler: The recycler to be used in place of the default generated recycler.
             */
-            void setArrayRecycler(vcore::FixedSizeArrayRecycler<SIZE, T>* arrayRecycler) {
+            void setArrayRecycler(VoxelArrayRecycler<SIZE, T>* arrayRecycler) {
                 _arrayRecycler = arrayRecycler;
             }
 
@@ -102,69 +158,111 @@ namespace vorb {
                 return (getters[(size_t)_state])(this, index);
             }
 
-            /// Initializes the container
+            /// Initializes the container, freeing any previous data
             inline void init(VoxelStorageState state) {
+                clear();
                 _state = state;
+                _writeCount++;
                 if (_state == VoxelStorageState::FLAT_ARRAY) {
                     _dataArray = _arrayRecycler->create();
                 }
             }
+            /// Initializes the container with every voxel set to value, without allocating.
+            /// Frees any previous data.
+            inline void initUniform(T value) {
+                clear();
+                _state = VoxelStorageState::UNIFORM;
+                _uniformValue = value;
+                _accessCount = 0;
+                _quietFrames = 0;
+                _writeCount++;
+            }
 
-            /// Creates the tree using a sorted array of data. 
+            /// Creates the tree using a sorted array of data, freeing any previous data.
             /// The number of voxels should add up to CHUNK_SIZE
             /// @param state: Initial state of the container
             /// @param data: The sorted array used to populate the container
             inline void initFromSortedArray(VoxelStorageState state,
                                             const std::vector <typename IntervalTree<T>::LNode>& data) {
+                clear();
                 _state = state;
                 _accessCount = 0;
                 _quietFrames = 0;
+                _writeCount++;
+                if (_state == VoxelStorageState::UNIFORM) {
+                    // Only a single run can be uniform
+                    if (data.size() == 1) {
+                        _uniformValue = data[0].data;
+                        return;
+                    }
+                    _state = VoxelStorageState::INTERVAL_TREE;
+                }
                 if (_state == VoxelStorageState::INTERVAL_TREE) {
                     _dataTree.initFromSortedArray(data);
                     _dataTree.checkTreeValidity();
+                } else if (_state == VoxelStorageState::PALETTE) {
+                    if (!initPaletteFromRuns(&data[0], data.size())) {
+                        _state = VoxelStorageState::INTERVAL_TREE;
+                        _dataTree.initFromSortedArray(data);
+                    }
                 } else {
                     _dataArray = _arrayRecycler->create();
-                    int index = 0;
                     for (size_t i = 0; i < data.size(); i++) {
-                        for (int j = 0; j < data[i].length; j++) {
-                            _dataArray[index++] = data[i].data;
-                        }
+                        fillRun(_dataArray + data[i].start, data[i].length, data[i].data);
                     }
                 }
             }
             inline void initFromSortedArray(VoxelStorageState state,
                                             const typename IntervalTree<T>::LNode data[], size_t size) {
+                clear();
                 _state = state;
                 _accessCount = 0;
                 _quietFrames = 0;
+                _writeCount++;
+                if (_state == VoxelStorageState::UNIFORM) {
+                    // Only a single run can be uniform
+                    if (size == 1) {
+                        _uniformValue = data[0].data;
+                        return;
+                    }
+                    _state = VoxelStorageState::INTERVAL_TREE;
+                }
                 if (_state == VoxelStorageState::INTERVAL_TREE) {
                     _dataTree.initFromSortedArray(data, size);
                     _dataTree.checkTreeValidity();
+                } else if (_state == VoxelStorageState::PALETTE) {
+                    // Too many unique values for a palette, fall back to the tree
+                    if (!initPaletteFromRuns(data, size)) {
+                        _state = VoxelStorageState::INTERVAL_TREE;
+                        _dataTree.initFromSortedArray(data, size);
+                    }
                 } else {
                     _dataArray = _arrayRecycler->create();
-                    int index = 0;
                     for (size_t i = 0; i < size; i++) {
-                        for (int j = 0; j < data[i].length; j++) {
-                            _dataArray[index++] = data[i].data;
-                        }
+                        fillRun(_dataArray + data[i].start, data[i].length, data[i].data);
                     }
                 }
             }
 
-            inline void changeState(VoxelStorageState newState, std::mutex& dataLock) {
+            template<typename DataLock>
+            inline void changeState(VoxelStorageState newState, DataLock& dataLock) {
                 if (newState == _state) return;
-                if (newState == VoxelStorageState::INTERVAL_TREE) {
-                    compress(dataLock);
-                } else {
+                // Compressed states always go through the flat array
+                if (_state != VoxelStorageState::FLAT_ARRAY) {
                     uncompress(dataLock);
                 }
+                if (newState != VoxelStorageState::FLAT_ARRAY) {
+                    compress(dataLock, newState);
+                }
                 _quietFrames = 0;
                 _accessCount = 0;
             }
 
             /// Updates the container. Call once per frame
+            /// Not needed when a ChunkCompressionService manages the container.
             /// @param dataLock: The mutex that guards the data
-            inline void update(std::mutex& dataLock) {
+            template<typename DataLock>
+            inline void update(DataLock& dataLock) {
                 // If access count is higher than the threshold, this is not a quiet frame
                 if (_accessCount >= ACCESS_COUNT_UNTIL_DECOMPRESS) {
                     _quietFrames = 0;
@@ -172,14 +270,19 @@ namespace vorb {
                     _quietFrames++;
                 }
 
-                if (_state == VoxelStorageState::INTERVAL_TREE) {
+                if (_state == VoxelStorageState::UNIFORM) {
+                    // Nothing to gain, the first differing write leaves this state anyway
+                } else if (_state != VoxelStorageState::FLAT_ARRAY) {
                     // Check if we should uncompress the data
                     if (_quietFrames == 0) {
                         uncompress(dataLock);
+                    } else if (_state == VoxelStorageState::PALETTE) {
+                        // Drop bits if enough palette entries died
+                        shrinkPalette(dataLock);
                     }
                 } else {
                     // Check if we should compress the data
-                    if (_quietFrames >= QUIET_FRAMES_UNTIL_COMPRESS && totalContainerCompressions <= MAX_COMPRESSIONS_PER_FRAME) {
+                    if (_quietFrames >= QUIET_FRAMES_UNTIL_COMPRESS) {
                         compress(dataLock);
                     }
                 }
@@ -190,19 +293,111 @@ namespace vorb {
             inline void clear() {
                 _accessCount = 0;
                 _quietFrames = 0;
+                _writeCount++;
                 if (_state == VoxelStorageState::INTERVAL_TREE) {
                     _dataTree.clear();
+                } else if (_state == VoxelStorageState::PALETTE) {
+                    clearPalette();
                 } else if (_dataArray) {
                     _arrayRecycler->recycle(_dataArray);
                     _dataArray = nullptr;
                 }
             }
 
-            /// Uncompressed the interval tree into a buffer.
-            /// May only be called when getState() == VoxelStorageState::INTERVAL_TREE
+            /************************************************************************/
+            /* Background Compression                                               */
+            /************************************************************************/
+            /// Ages the container by one service period. The caller must hold the data lock,
+            /// a shared lock is enough as long as only one thread ages the container.
+            /// @return Number of periods since the container was last heavily accessed
+            inline int age() {
+                if (_accessCount >= ACCESS_COUNT_UNTIL_DECOMPRESS) {
+                    _quietFrames = 0;
+                } else {
+                    _quietFrames++;
+                }
+                _accessCount = 0;
+                return _quietFrames;
+            }
+            /// @return Bytes of voxel data held by the container. The caller must hold the data lock.
+            inline size_t getMemoryUsage() const {
+                switch (_state) {
+                    case VoxelStorageState::INTERVAL_TREE:
+                        return _dataTree.size() * sizeof(typename IntervalTree<T>::Node);
+                    case VoxelStorageState::PALETTE:
+                        return _paletteIndices.size() * sizeof(ui32) +
+                            _palette.size() * (sizeof(T) + sizeof(ui16));
+                    case VoxelStorageState::UNIFORM:
+                        return 0;
+                    default:
+                        return _dataArray ? SIZE * sizeof(T) : 0;
+                }
+            }
+            /// Compresses the flat array while holding the lock only to take a
+            /// snapshot and to swap the result in. If the data was written while
+            /// encoding, the work is discarded and the container stays flat.
+            /// @param dataLock: The mutex that guards the data
+            /// @param target: Desired state. FLAT_ARRAY picks whichever compressed state is smaller.
+            /// @return true if the container is now compressed
+            template<typename DataLock>
+            inline bool compressAsync(DataLock& dataLock, VoxelStorageState target = VoxelStorageState::FLAT_ARRAY) {
+                SmartVoxelContainer<T, SIZE> staging(_arrayRecycler);
+                staging._dataArray = _arrayRecycler->create();
+                dataLock.lock();
+                if (_state != VoxelStorageState::FLAT_ARRAY || !_dataArray) {
+                    dataLock.unlock();
+                    _arrayRecycler->recycle(staging._dataArray);
+                    return false;
+                }
+                memcpy(staging._dataArray, _dataArray, SIZE * sizeof(T));
+                T* source = _dataArray;
+                ui32 writeCount = _writeCount;
+                dataLock.unlock();
+
+                // Encode off-lock
+                staging.encode(target);
+                _arrayRecycler->recycle(staging._dataArray);
+                staging._dataArray = nullptr;
+
+                dataLock.lock();
+                if (_state != VoxelStorageState::FLAT_ARRAY || _dataArray != source || _writeCount != writeCount) {
+                    // Stale, the staging container frees its data when it goes out of scope
+                    dataLock.unlock();
+                    return false;
+                }
+                std::swap(_dataTree, staging._dataTree);
+                _palette.swap(staging._palette);
+                _paletteRefCounts.swap(staging._paletteRefCounts);
+                _paletteIndices.swap(staging._paletteIndices);
+                _paletteBitsLog2 = staging._paletteBitsLog2;
+                _paletteLiveCount = staging._paletteLiveCount;
+                _uniformValue = staging._uniformValue;
+                _state = staging._state;
+                _dataArray = nullptr;
+                dataLock.unlock();
+
+                _arrayRecycler->recycle(source);
+                return true;
+            }
+
+            /// Uncompresses the interval tree or palette into a buffer.
+            /// May only be called when getState() != VoxelStorageState::FLAT_ARRAY
             /// or you will get a null access violation.
             /// @param buffer: Buffer of memory to store the result
-            inline void uncompressIntoBuffer(T* buffer) { _dataTree.uncompressIntoBuffer(buffer); }
+            inline void uncompressIntoBuffer(T* buffer) {
+                if (_state == VoxelStorageState::UNIFORM) {
+                    fillRun(buffer, SIZE, _uniformValue);
+                } else if (_state == VoxelStorageState::PALETTE) {
+                    for (size_t i = 0; i < SIZE; i++) {
+                        buffer[i] = _palette[getPaletteIndex(i)];
+                    }
+                } else {
+                    for (size_t i = 0; i < _dataTree.size(); i++) {
+                        const auto& node = _dataTree[i];
+                        fillRun(buffer + node.getStart(), node.length, node.data);
+                    }
+                }
+            }
 
             /// Getters
             const VoxelStorageState& getState() const {
@@ -220,6 +415,23 @@ namespace vorb {
             const IntervalTree<T>& getTree() const {
                 return _dataTree;
             }
+            /// Palette of unique values, only valid in VoxelStorageState::PALETTE.
+            /// Entries with a zero reference count are free slots.
+            const std::vector<T>& getPalette() const {
+                return _palette;
+            }
+            /// @return true if every voxel holds getUniformValue()
+            bool isUniform() const {
+                return _state == VoxelStorageState::UNIFORM;
+            }
+            /// Value of every voxel, only valid in VoxelStorageState::UNIFORM
+            const T& getUniformValue() const {
+                return _uniformValue;
+            }
+            /// @return Bits used per voxel index in VoxelStorageState::PALETTE
+            ui32 getPaletteBits() const {
+                return 1u << _paletteBitsLog2;
+            }
 
             /// Gets the element at index
             /// @param index: must be (0, SIZE]
@@ -232,8 +444,134 @@ namespace vorb {
             /// @param value: The value to set at index
             inline void set(size_t index, T value) {
                 _accessCount++;
+                _writeCount++;
                 (setters[(size_t)_state])(this, index, value);
             }
+
+            /************************************************************************/
+            /* Bulk Access                                                          */
+            /************************************************************************/
+            /// Visits every run of equal values in [begin, end).
+            /// Interval trees visit their nodes directly, other states coalesce equal neighbors.
+            /// @param fn: Called as fn(size_t start, size_t length, const T& value)
+            template<typename F>
+            inline void forEachRun(size_t begin, size_t end, F fn) const {
+                if (begin >= end) return;
+                switch (_state) {
+                    case VoxelStorageState::UNIFORM:
+                        fn(begin, end - begin, _uniformValue);
+                        break;
+                    case VoxelStorageState::INTERVAL_TREE:
+                        while (begin < end) {
+                            const auto& node = _dataTree[_dataTree.getInterval(begin)];
+                            size_t runEnd = (size_t)node.getStart() + node.length;
+                            if (runEnd > end) runEnd = end;
+                            fn(begin, runEnd - begin, node.data);
+                            begin = runEnd;
+                        }
+                        break;
+                    case VoxelStorageState::PALETTE: {
+                        ui32 entry = getPaletteIndex(begin);
+                        size_t start = begin;
+                        for (size_t i = begin + 1; i < end; i++) {
+                            ui32 next = getPaletteIndex(i);
+                            if (next != entry) {
+                                fn(start, i - start, _palette[entry]);
+                                entry = next;
+                                start = i;
+                            }
+                        }
+                        fn(start, end - start, _palette[entry]);
+                        break;
+                    }
+                    default:
+                        while (begin < end) {
+                            size_t runEnd = findRunEnd(_dataArray, begin, end);
+                            fn(begin, runEnd - begin, _dataArray[begin]);
+                            begin = runEnd;
+                        }
+                        break;
+                }
+            }
+            /// Copies count contiguous elements starting at start.
+            /// @param out: Buffer with room for count elements
+            inline void copyRange(size_t start, size_t count, T* out) const {
+                switch (_state) {
+                    case VoxelStorageState::UNIFORM:
+                        fillRun(out, count, _uniformValue);
+                        break;
+                    case VoxelStorageState::INTERVAL_TREE:
+                        forEachRun(start, start + count, [&](size_t runStart, size_t length, const T& value) {
+                            fillRun(out + (runStart - start), length, value);
+                        });
+                        break;
+                    case VoxelStorageState::PALETTE:
+                        for (size_t i = 0; i < count; i++) {
+                            out[i] = _palette[getPaletteIndex(start + i)];
+                        }
+                        break;
+                    default:
+                        memcpy(out, _dataArray + start, count * sizeof(T));
+                        break;
+                }
+            }
+            /// Copies a full XZ layer.
+            /// @param y: Layer to copy, in [0, CHUNK_WIDTH)
+            /// @param out: Buffer of CHUNK_LAYER elements, indexed as z * CHUNK_WIDTH + x
+            inline void copyLayer(size_t y, T* out) const {
+                copyRange(y * CHUNK_LAYER, CHUNK_LAYER, out);
+            }
+            /// Copies the outermost layer of voxels on a side of the chunk.
+            /// @param face: Side of the chunk to copy
+            /// @param out: Buffer of CHUNK_LAYER elements. X faces are indexed as y * CHUNK_WIDTH + z,
+            /// Y faces as z * CHUNK_WIDTH + x and Z faces as y * CHUNK_WIDTH + x.
+            inline void copyFace(Cardinal face, T* out) const {
+                if (_state == VoxelStorageState::UNIFORM) {
+                    fillRun(out, CHUNK_LAYER, _uniformValue);
+                    return;
+                }
+                switch (face) {
+                    case Cardinal::Y_NEG:
+                        copyLayer(0, out);
+                        break;
+                    case Cardinal::Y_POS:
+                        copyLayer(CHUNK_WIDTH - 1, out);
+                        break;
+                    case Cardinal::Z_NEG:
+                    case Cardinal::Z_POS: {
+                        // Rows along x are contiguous
+                        size_t offset = (face == Cardinal::Z_NEG) ? 0 : CHUNK_LAYER - CHUNK_WIDTH;
+                        for (size_t y = 0; y < CHUNK_WIDTH; y++) {
+                            copyRange(y * CHUNK_LAYER + offset, CHUNK_WIDTH, out + y * CHUNK_WIDTH);
+                        }
+                        break;
+                    }
+                    case Cardinal::X_NEG:
+                    case Cardinal::X_POS: {
+                        size_t x = (face == Cardinal::X_NEG) ? 0 : CHUNK_WIDTH - 1;
+                        if (_state == VoxelStorageState::INTERVAL_TREE) {
+                            // Strided, so pick the face voxels out of each run
+                            forEachRun(0, SIZE, [&](size_t runStart, size_t length, const T& value) {
+                                size_t i = runStart + ((x - (runStart & (CHUNK_WIDTH - 1))) & (CHUNK_WIDTH - 1));
+                                for (; i < runStart + length; i += CHUNK_WIDTH) {
+                                    out[i / CHUNK_WIDTH] = value;
+                                }
+                            });
+                        } else if (_state == VoxelStorageState::PALETTE) {
+                            for (size_t i = 0; i < CHUNK_LAYER; i++) {
+                                out[i] = _palette[getPaletteIndex(i * CHUNK_WIDTH + x)];
+                            }
+                        } else {
+                            for (size_t i = 0; i < CHUNK_LAYER; i++) {
+                                out[i] = _dataArray[i * CHUNK_WIDTH + x];
+                            }
+                        }
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            }
         private:
             typedef const T& (*Getter)(const SmartVoxelContainer*, size_t);
             typedef void(*Setter)(SmartVoxelContainer*, size_t, T);
@@ -250,58 +588,292 @@ namespace vorb {
             static void setFlat(SmartVoxelContainer* container, size_t index, T data) {
                 container->_dataArray[index] = data;
             }
+            static const T& getPaletted(const SmartVoxelContainer* container, size_t index) {
+                return container->_palette[container->getPaletteIndex(index)];
+            }
+            static void setPaletted(SmartVoxelContainer* container, size_t index, T data) {
+                container->setPaletteData(index, data);
+            }
+            static const T& getUniform(const SmartVoxelContainer* container, size_t index VORB_UNUSED) {
+                return container->_uniformValue;
+            }
+            static void setUniform(SmartVoxelContainer* container, size_t index, T data) {
+                if (data == container->_uniformValue) return;
+                // A single node tree splits cheaply on insert
+                container->uniformToTree();
+                container->_dataTree.insert(index, data);
+            }
+
+            static Getter getters[4];
+            static Setter setters[4];
+
+            /// Converts to a one node interval tree without locking. Used on the first differing set.
+            inline void uniformToTree() {
+                typename IntervalTree<T>::LNode node(0, (ui16)SIZE, _uniformValue);
+                _dataTree.initFromSortedArray(&node, 1);
+                _state = VoxelStorageState::INTERVAL_TREE;
+            }
+
+            /************************************************************************/
+            /* Palette                                                              */
+            /************************************************************************/
+            /// @return log2 of the number of bits needed to index paletteSize entries
+            static ui32 getPaletteBitsLog2(size_t paletteSize) {
+                if (paletteSize <= 2) return 0;
+                if (paletteSize <= 4) return 1;
+                if (paletteSize <= 16) return 2;
+                return 3;
+            }
+            /// @return Bytes needed for the packed index array at a bit width
+            static size_t getPaletteIndicesBytes(ui32 bitsLog2) {
+                return (SIZE << bitsLog2) >> 3;
+            }
+
+            inline ui32 getPaletteIndex(size_t index) const {
+                // Bit widths are powers of two so an index never straddles two words
+                const ui32 shift = (ui32)(index & ((32 >> _paletteBitsLog2) - 1)) << _paletteBitsLog2;
+                return (_paletteIndices[index >> (5 - _paletteBitsLog2)] >> shift) & ((1u << (1u << _paletteBitsLog2)) - 1);
+            }
+            inline void setPaletteIndex(size_t index, ui32 paletteIndex) {
+                const ui32 shift = (ui32)(index & ((32 >> _paletteBitsLog2) - 1)) << _paletteBitsLog2;
+                const ui32 mask = ((1u << (1u << _paletteBitsLog2)) - 1) << shift;
+                ui32& word = _paletteIndices[index >> (5 - _paletteBitsLog2)];
+                word = (word & ~mask) | (paletteIndex << shift);
+            }
+
+            /// Finds or adds a palette entry for data.
+            /// @return The palette index, or MAX_PALETTE_SIZE if the palette is full
+            inline ui32 acquirePaletteEntry(T data) {
+                ui32 freeSlot = MAX_PALETTE_SIZE;
+                for (size_t i = 0; i < _palette.size(); i++) {
+                    if (_paletteRefCounts[i] == 0) {
+                        if (freeSlot == MAX_PALETTE_SIZE) freeSlot = (ui32)i;
+                    } else if (_palette[i] == data) {
+                        return (ui32)i;
+                    }
+                }
+                // Reuse a dead slot
+                if (freeSlot != MAX_PALETTE_SIZE) {
+                    _palette[freeSlot] = data;
+                    return freeSlot;
+                }
+                if (_palette.size() == MAX_PALETTE_SIZE) return MAX_PALETTE_SIZE;
+                // Grow the bit width if the new entry won't fit
+                if (_palette.size() == (1u << (1u << _paletteBitsLog2))) {
+                    repackPalette(_paletteBitsLog2 + 1);
+                }
+                _palette.push_back(data);
+                _paletteRefCounts.push_back(0);
+                return (ui32)(_palette.size() - 1);
+            }
+
+            inline void setPaletteData(size_t index, T data) {
+                ui32 oldEntry = getPaletteIndex(index);
+                if (_palette[oldEntry] == data) return;
+                ui32 newEntry = acquirePaletteEntry(data);
+                if (newEntry == MAX_PALETTE_SIZE) {
+                    // Too many unique values, the palette can't hold this chunk
+                    paletteToFlat();
+                    _dataArray[index] = data;
+                    return;
+                }
+                if (_paletteRefCounts[newEntry]++ == 0) _paletteLiveCount++;
+                if (--_paletteRefCounts[oldEntry] == 0) {
+                    _paletteLiveCount--;
+                    if (getPaletteBitsLog2(_paletteLiveCount) < _paletteBitsLog2) {
+                        _isPaletteShrinkDue.store(true, std::memory_order_relaxed);
+                    }
+                }
+                setPaletteIndex(index, newEntry);
+            }
+
+            /// Re-encodes the index array at a new bit width. Does not compact the palette.
+            inline void repackPalette(ui32 newBitsLog2) {
+                std::vector<ui32> newIndices(getPaletteIndicesBytes(newBitsLog2) / sizeof(ui32), 0);
+                const ui32 newShiftMask = (32 >> newBitsLog2) - 1;
+                for (size_t i = 0; i < SIZE; i++) {
+                    newIndices[i >> (5 - newBitsLog2)] |= getPaletteIndex(i) << ((ui32)(i & newShiftMask) << newBitsLog2);
+                }
+                _paletteIndices.swap(newIndices);
+                _paletteBitsLog2 = newBitsLog2;
+            }
+
+            /// Builds the palette from sorted runs.
+            /// @return false if there are too many unique values for a palette
+            inline bool initPaletteFromRuns(const typename IntervalTree<T>::LNode data[], size_t size) {
+                _palette.clear();
+                _paletteRefCounts.clear();
+                // Runs are mostly long so lookups are per run, not per voxel
+                for (size_t i = 0; i < size; i++) {
+                    size_t e = 0;
+                    while (e < _palette.size() && _palette[e] != data[i].data) e++;
+                    if (e == _palette.size()) {
+                        if (e == MAX_PALETTE_SIZE) {
+                            clearPalette();
+                            return false;
+                        }
+                        _palette.push_back(data[i].data);
+                        _paletteRefCounts.push_back(0);
+                    }
+                    _paletteRefCounts[e] += data[i].length;
+                }
+                _paletteLiveCount = (ui16)_palette.size();
+                _paletteBitsLog2 = getPaletteBitsLog2(_palette.size());
+                _paletteIndices.assign(getPaletteIndicesBytes(_paletteBitsLog2) / sizeof(ui32), 0);
+                for (size_t i = 0; i < size; i++) {
+                    ui32 e = 0;
+                    while (_palette[e] != data[i].data) e++;
+                    if (e == 0) continue; // Already zeroed
+                    const size_t end = data[i].start + data[i].length;
+                    for (size_t j = data[i].start; j < end; j++) {
+                        setPaletteIndex(j, e);
+                    }
+                }
+                return true;
+            }
 
-            static Getter getters[2];
-            static Setter setters[2];
+            /// Compacts dead palette entries and drops to a smaller bit width when possible.
+            /// Only locks if a write flagged that enough entries died.
+            template<typename DataLock>
+            inline void shrinkPalette(DataLock& dataLock) {
+                if (!_isPaletteShrinkDue.load(std::memory_order_relaxed)) return;
+
+                std::lock_guard<DataLock> l(dataLock);
+                _isPaletteShrinkDue.store(false, std::memory_order_relaxed);
+                // Entries may have come back to life since the flag was set
+                if (_state != VoxelStorageState::PALETTE) return;
+                size_t liveCount = _paletteLiveCount;
+                ui32 newBitsLog2 = getPaletteBitsLog2(liveCount);
+                if (newBitsLog2 >= _paletteBitsLog2) return;
+
+                // Map old entries to compacted entries
+                ui8 remap[MAX_PALETTE_SIZE];
+                std::vector<T> newPalette;
+                std::vector<ui16> newRefCounts;
+                newPalette.reserve(liveCount);
+                newRefCounts.reserve(liveCount);
+                for (size_t i = 0; i < _palette.size(); i++) {
+                    if (_paletteRefCounts[i]) {
+                        remap[i] = (ui8)newPalette.size();
+                        newPalette.push_back(_palette[i]);
+                        newRefCounts.push_back(_paletteRefCounts[i]);
+                    }
+                }
+                std::vector<ui32> newIndices(getPaletteIndicesBytes(newBitsLog2) / sizeof(ui32), 0);
+                const ui32 newShiftMask = (32 >> newBitsLog2) - 1;
+                for (size_t i = 0; i < SIZE; i++) {
+                    newIndices[i >> (5 - newBitsLog2)] |= (ui32)remap[getPaletteIndex(i)] << ((ui32)(i & newShiftMask) << newBitsLog2);
+                }
+                _palette.swap(newPalette);
+                _paletteRefCounts.swap(newRefCounts);
+                _paletteIndices.swap(newIndices);
+                _paletteBitsLog2 = newBitsLog2;
+            }
 
-            inline void uncompress(std::mutex& dataLock) {
+            /// Converts to a flat array without locking. Used when the palette overflows mid-set.
+            inline void paletteToFlat() {
+                _dataArray = _arrayRecycler->create();
+                uncompressIntoBuffer(_dataArray);
+                clearPalette();
+                _state = VoxelStorageState::FLAT_ARRAY;
+            }
+
+            inline void clearPalette() {
+                std::vector<T>().swap(_palette);
+                std::vector<ui16>().swap(_paletteRefCounts);
+                std::vector<ui32>().swap(_paletteIndices);
+                _paletteBitsLog2 = 0;
+                _paletteLiveCount = 0;
+                _isPaletteShrinkDue.store(false, std::memory_order_relaxed);
+            }
+
+            template<typename DataLock>
+            inline void uncompress(DataLock& dataLock) {
                 dataLock.lock();
                 _dataArray = _arrayRecycler->create();
                 uncompressIntoBuffer(_dataArray);
                 // Free memory
-                _dataTree.clear();
+                if (_state == VoxelStorageState::PALETTE) {
+                    clearPalette();
+                } else if (_state == VoxelStorageState::INTERVAL_TREE) {
+                    _dataTree.clear();
+                }
                 // Set the new state
                 _state = VoxelStorageState::FLAT_ARRAY;
                 dataLock.unlock();
             }
-            inline void compress(std::mutex& dataLock) {
+            /// Compresses the flat array.
+            /// @param dataLock: The mutex that guards the data
+            /// @param target: Desired state. FLAT_ARRAY picks whichever compressed state is smaller.
+            template<typename DataLock>
+            inline void compress(DataLock& dataLock, VoxelStorageState target = VoxelStorageState::FLAT_ARRAY) {
                 dataLock.lock();
+                encode(target);
+                T* dataArray = _dataArray;
+                _dataArray = nullptr;
+                dataLock.unlock();
+
+                // Recycle memory
+                _arrayRecycler->recycle(dataArray);
+            }
+            /// Builds the compressed state from the flat array without locking.
+            /// The flat array is left for the caller to recycle.
+            /// @param target: Desired state. FLAT_ARRAY picks whichever compressed state is smaller.
+            inline void encode(VoxelStorageState target) {
                 // Sorted array for creating the interval tree
                 // Using stack array to avoid allocations, beware stack overflow
                 typename IntervalTree<T>::LNode data[CHUNK_SIZE];
-                int index = 0;
-                data[0].set(0, 1, _dataArray[0]);
-                // Set the data
-                for (int i = 1; i < CHUNK_SIZE; ++i) {
-                    if (_dataArray[i] == data[index].data) {
-                        ++(data[index].length);
-                    } else {
-                        data[++index].set(i, 1, _dataArray[i]);
+                size_t numRuns = 0;
+                appendRuns(_dataArray, CHUNK_SIZE, 0, data, numRuns);
+
+                if (numRuns == 1) {
+                    // Nothing beats a single value
+                    _uniformValue = data[0].data;
+                    target = VoxelStorageState::UNIFORM;
+                } else if (target == VoxelStorageState::UNIFORM) {
+                    target = VoxelStorageState::INTERVAL_TREE;
+                }
+                if (target == VoxelStorageState::FLAT_ARRAY) {
+                    // Noisy data makes big trees, so use a palette if it is smaller
+                    target = VoxelStorageState::INTERVAL_TREE;
+                    size_t treeBytes = numRuns * sizeof(typename IntervalTree<T>::Node);
+                    if (treeBytes > getPaletteIndicesBytes(0) && initPaletteFromRuns(data, numRuns)) {
+                        if (getPaletteIndicesBytes(_paletteBitsLog2) + _palette.size() * sizeof(T) < treeBytes) {
+                            target = VoxelStorageState::PALETTE;
+                        } else {
+                            clearPalette();
+                        }
                     }
+                } else if (target == VoxelStorageState::PALETTE && !initPaletteFromRuns(data, numRuns)) {
+                    target = VoxelStorageState::INTERVAL_TREE;
+                }
+                if (target == VoxelStorageState::INTERVAL_TREE) {
+                    // Create the tree
+                    _dataTree.initFromSortedArray(data, numRuns);
                 }
                 // Set new state
-                _state = VoxelStorageState::INTERVAL_TREE;
-                // Create the tree
-                _dataTree.initFromSortedArray(data, index + 1);
-
-                dataLock.unlock();
-
-                // Recycle memory
-                _arrayRecycler->recycle(_dataArray);
-                _dataArray = nullptr;
-
-                totalContainerCompressions++;
+                _state = target;
             }
 
             IntervalTree<T> _dataTree; ///< Interval tree of voxel data
 
+            std::vector<T> _palette; ///< Unique values for VoxelStorageState::PALETTE
+            std::vector<ui16> _paletteRefCounts; ///< Number of voxels using each palette entry
+            std::vector<ui32> _paletteIndices; ///< Bit-packed palette index per voxel
+            ui32 _paletteBitsLog2 = 0; ///< log2 of bits per index, so 1, 2, 4 or 8 bits
+            ui16 _paletteLiveCount = 0; ///< Palette entries with a non-zero ref count
+            std::atomic<bool> _isPaletteShrinkDue{ false }; ///< Set by writes, lets update() skip the lock
+
+            T _uniformValue = 0; ///< Value of every voxel in VoxelStorageState::UNIFORM
+
             T* _dataArray = nullptr; ///< pointer to an array of voxel data
             int _accessCount = 0; ///< Number of times the container was accessed this frame
             int _quietFrames = 0; ///< Number of frames since we have had heavy updates
+            ui32 _writeCount = 0; ///< Bumped on every write, lets compressAsync detect stale snapshots
 
             VoxelStorageState _state = VoxelStorageState::FLAT_ARRAY; ///< Current data structure state
 
-            vcore::FixedSizeArrayRecycler<CHUNK_SIZE, T>* _arrayRecycler = nullptr; ///< For recycling the voxel arrays
+            VoxelArrayRecycler<SIZE, T>* _arrayRecycler = nullptr; ///< For recycling the voxel arrays
         };
 
         /*template<typename T, size_t SIZE>
@@ -324,14 +896,18 @@ namespace vorb {
         }
 
         template<typename T, size_t SIZE>
-        typename SmartVoxelContainer<T, SIZE>::Getter SmartVoxelContainer<T, SIZE>::getters[2] = {
+        typename SmartVoxelContainer<T, SIZE>::Getter SmartVoxelContainer<T, SIZE>::getters[4] = {
             SmartVoxelContainer<T, SIZE>::getFlat,
-            SmartVoxelContainer<T, SIZE>::getInterval
+            SmartVoxelContainer<T, SIZE>::getInterval,
+            SmartVoxelContainer<T, SIZE>::getPaletted,
+            SmartVoxelContainer<T, SIZE>::getUniform
         };
         template<typename T, size_t SIZE>
-        typename SmartVoxelContainer<T, SIZE>::Setter SmartVoxelContainer<T, SIZE>::setters[2] = {
+        typename SmartVoxelContainer<T, SIZE>::Setter SmartVoxelContainer<T, SIZE>::setters[4] = {
             SmartVoxelContainer<T, SIZE>::setFlat,
-            SmartVoxelContainer<T, SIZE>::setInterval
+            SmartVoxelContainer<T, SIZE>::setInterval,
+            SmartVoxelContainer<T, SIZE>::setPaletted,
+            SmartVoxelContainer<T, SIZE>::setUniform
         };
 
     }
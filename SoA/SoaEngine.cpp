@@ -42,6 +42,9 @@ void SoaEngine::initOptions(SoaOptions& options) {
     options.addOption(OPT_BORDERLESS, "Borderless Window", OptionValue(false));
     options.addOption(OPT_SCREEN_WIDTH, "Screen Width", OptionValue(1280));
     options.addOption(OPT_SCREEN_HEIGHT, "Screen Height", OptionValue(720));
+    options.addOption(OPT_VOXEL_MEMORY_TARGET, "Voxel Memory Target MB", OptionValue(256));
+    options.addOption(OPT_VOXEL_BINARY_MESHER, "Binary Greedy Meshing", OptionValue(false));
+    options.addOption(OPT_VOXEL_PACKED_VERTICES, "Packed Voxel Vertices", OptionValue(false));
     options.addStringOption("Texture Pack", "Default");
 
     SoaEngine::optionsController.setDefault();
@@ -348,6 +351,7 @@ void SoaEngine::initVoxelGen(PlanetGenData* genData, const BlockPack& blocks) {
                         auto mit = genData->floraMap.find(kp.id);
                         if (mit != genData->floraMap.end()) {
                             biome.flora[i].chance = kp.chance;
+                            biome.flora[i].chance.compile();
                             biome.flora[i].data = &genData->flora[mit->second];
                             biome.flora[i].id = i;
                         } else {
@@ -367,6 +371,7 @@ void SoaEngine::initVoxelGen(PlanetGenData* genData, const BlockPack& blocks) {
                         auto mit = genData->treeMap.find(kp.id);
                         if (mit != genData->treeMap.end()) {
                             biome.trees[i].chance = kp.chance;
+                            biome.trees[i].chance.compile();
                             biome.trees[i].data = &genData->trees[mit->second];
                             // Trees and flora share IDs so we can use a single
                             // value in heightmap. Thus, add flora.size().
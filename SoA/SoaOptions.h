@@ -71,6 +71,9 @@ enum DefaultOptions : int {
     OPT_BORDERLESS,
     OPT_SCREEN_WIDTH,
     OPT_SCREEN_HEIGHT,
+    OPT_VOXEL_MEMORY_TARGET,
+    OPT_VOXEL_BINARY_MESHER,
+    OPT_VOXEL_PACKED_VERTICES,
     OPT_NUM_OPTIONS // This should be last
 };
 
@@ -1,11 +1,15 @@
 #include "stdafx.h"
 #include "SpaceSystemAssemblages.h"
 
+#include "ChunkCompressionService.h"
 #include "ChunkGrid.h"
 #include "ChunkIOManager.h"
 #include "ChunkAllocator.h"
 #include "FarTerrainPatch.h"
+#include "HeightmapCache.h"
+#include "HeightSampleCache.h"
 #include "OrbitComponentUpdater.h"
+#include "SoaOptions.h"
 #include "SoAState.h"
 #include "SpaceSystem.h"
 #include "SphericalTerrainComponentUpdater.h"
@@ -266,11 +270,25 @@ vecs::ComponentID SpaceSystemAssemblages::addSphericalVoxelComponent(SpaceSystem
 
     svcmp.chunkIo->beginThread();
 
+    // Only keep heightmaps on disk when there is a save to put them in
+    nString saveDir = soaState->saveFileIom.getSearchDirectory().getString();
+    nString heightmapPath;
+    if (saveDir.size()) {
+        // Saves made before the cache existed don't have the directory
+        soaState->saveFileIom.makeDirectory("cache");
+        heightmapPath = saveDir + "/cache/Heightmaps_" + spaceSystem->namePosition.get(namePositionComponent).name + ".bin";
+    }
+    svcmp.heightmapCache = new HeightmapCache;
+    svcmp.heightmapCache->init(ftcmp.planetGenData, heightmapPath);
+
     svcmp.chunkGrids = new ChunkGrid[6];
     for (int i = 0; i < 6; i++) {
-        svcmp.chunkGrids[i].init(static_cast<WorldCubeFace>(i), svcmp.threadPool, 1, ftcmp.planetGenData, &soaState->chunkAllocator);
+        svcmp.chunkGrids[i].init(static_cast<WorldCubeFace>(i), svcmp.threadPool, VOXEL_GENERATORS_PER_ROW, ftcmp.planetGenData, &soaState->chunkAllocator,
+                                 svcmp.heightmapCache, ftcmp.cpuGenerator->getSampleCache());
         svcmp.chunkGrids[i].blockPack = &soaState->blocks;
     }
+    svcmp.compressionService = new ChunkCompressionService;
+    svcmp.compressionService->init(svcmp.chunkGrids, 6, (size_t)soaOptions.get(OPT_VOXEL_MEMORY_TARGET).value.i * 1024 * 1024);
 
     svcmp.planetGenData = ftcmp.planetGenData;
     svcmp.sphericalTerrainData = ftcmp.sphericalTerrainData;
@@ -316,8 +334,9 @@ vecs::ComponentID SpaceSystemAssemblages::addSphericalTerrainComponent(SpaceSyst
 
     if (planetGenData) {
         stCmp.meshManager = new TerrainPatchMeshManager(planetGenData);
+        stCmp.sampleCache = new HeightSampleCache;
         stCmp.cpuGenerator = new SphericalHeightmapGenerator;
-        stCmp.cpuGenerator->init(planetGenData);
+        stCmp.cpuGenerator->init(planetGenData, stCmp.sampleCache);
     }
     
     stCmp.radius = radius;
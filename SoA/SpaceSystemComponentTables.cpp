@@ -5,8 +5,11 @@
 #include <Vorb/graphics/ShaderManager.h>
 
 #include "ChunkAllocator.h"
+#include "ChunkCompressionService.h"
 #include "ChunkIOManager.h"
 #include "FarTerrainPatch.h"
+#include "HeightmapCache.h"
+#include "HeightSampleCache.h"
 #include "ChunkGrid.h"
 #include "PlanetGenData.h"
 #include "SphericalHeightmapGenerator.h"
@@ -18,7 +21,14 @@ void SphericalVoxelComponentTable::disposeComponent(vecs::ComponentID cID, vecs:
     // Let the threadpool finish
     while (cmp.threadPool->getTasksSizeApprox() > 0);
     delete cmp.chunkIo;
+    // Must stop before the grids it walks are freed
+    if (cmp.compressionService) {
+        cmp.compressionService->dispose();
+        delete cmp.compressionService;
+    }
     delete[] cmp.chunkGrids;
+    // Must outlive the grids, which store into it as columns are released
+    delete cmp.heightmapCache;
     cmp = _components[0].second;
 }
 
@@ -31,6 +41,7 @@ void SphericalTerrainComponentTable::disposeComponent(vecs::ComponentID cID, vec
     if (cmp.planetGenData) {
         delete cmp.meshManager;
         delete cmp.cpuGenerator;
+        delete cmp.sampleCache;
     }
     // TODO(Ben): Memory leak
     delete cmp.sphericalTerrainData;
@@ -33,9 +33,12 @@
 #include "ChunkGrid.h"
 
 class BlockPack;
+class ChunkCompressionService;
 class ChunkIOManager;
 class ChunkManager;
 class FarTerrainPatch;
+class HeightmapCache;
+class HeightSampleCache;
 class PagedChunkAllocator;
 class ParticleEngine;
 class PhysicsEngine;
@@ -168,6 +171,8 @@ KEG_TYPE_DECL(SphericalGravityComponent);
 struct SphericalVoxelComponent {
     ChunkGrid* chunkGrids = nullptr; // should be size 6, one for each face
     ChunkIOManager* chunkIo = nullptr;
+    ChunkCompressionService* compressionService = nullptr; ///< Compresses cold chunks in the background
+    HeightmapCache* heightmapCache = nullptr; ///< Heightmaps of unloaded columns, shared by chunkGrids
 
     SphericalHeightmapGenerator* generator = nullptr;
 
@@ -204,6 +209,7 @@ struct SphericalTerrainComponent {
 
     TerrainPatchMeshManager* meshManager = nullptr;
     SphericalHeightmapGenerator* cpuGenerator = nullptr;
+    HeightSampleCache* sampleCache = nullptr; ///< Surface samples shared by patches and chunks
 
     PlanetGenData* planetGenData = nullptr;
     VoxelPosition3D startVoxelPosition;
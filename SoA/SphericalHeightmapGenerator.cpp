@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "SphericalHeightmapGenerator.h"
 
+#include "HeightSampleCache.h"
 #include "PlanetHeightData.h"
 #include "VoxelSpaceConversions.h"
 #include "Noise.h"
@@ -9,11 +10,89 @@
 
 #define WEIGHT_THRESHOLD 0.001
 
-void SphericalHeightmapGenerator::init(const PlanetGenData* planetGenData) {
+void SphericalHeightmapGenerator::init(const PlanetGenData* planetGenData, OPT HeightSampleCache* sampleCache /*= nullptr*/) {
     m_genData = planetGenData;
+    m_sampleCache = sampleCache;
 }
 
 void SphericalHeightmapGenerator::generateHeightData(OUT PlanetHeightData& height, const VoxelPosition2D& facePosition) const {
+    f64v3 pos = getFaceWorldPosition(facePosition);
+    generateSurfaceHeightData(height, facePosition, pos);
+
+    // For Voxel Position, automatically get tree or flora
+    height.flora = getTreeID(height.biome, facePosition, pos);
+    // If no tree, try flora
+    if (height.flora == FLORA_ID_NONE) {
+        height.flora = getFloraID(height.biome, facePosition, pos);
+    }
+}
+
+void SphericalHeightmapGenerator::generateSurfaceHeightData(OUT PlanetHeightData& height, const VoxelPosition2D& facePosition) const {
+    generateSurfaceHeightData(height, facePosition, getFaceWorldPosition(facePosition));
+}
+
+void SphericalHeightmapGenerator::generateHeightData(OUT PlanetHeightData& height, const f64v3& normal) const {
+    generateHeightData(height, normal * m_genData->radius, normal);
+}
+
+void SphericalHeightmapGenerator::generateHeightData(OUT PlanetHeightData* heights, const VoxelPosition2D* facePositions, size_t n) const {
+    generateSurfaceHeightData(heights, facePositions, n);
+    for (size_t i = 0; i < n; i++) {
+        f64v3 pos = getFaceWorldPosition(facePositions[i]);
+        heights[i].flora = getTreeID(heights[i].biome, facePositions[i], pos);
+        if (heights[i].flora == FLORA_ID_NONE) {
+            heights[i].flora = getFloraID(heights[i].biome, facePositions[i], pos);
+        }
+    }
+}
+
+void SphericalHeightmapGenerator::generateSurfaceHeightData(OUT PlanetHeightData* heights, const VoxelPosition2D* facePositions, size_t n) const {
+    // Cache misses are gathered and generated a batch at a time
+    size_t missed[NOISE_PROGRAM_BATCH_SIZE];
+    PlanetHeightData* missedHeights[NOISE_PROGRAM_BATCH_SIZE];
+    f64v3 normals[NOISE_PROGRAM_BATCH_SIZE];
+    size_t numMissed = 0;
+    auto generateMissed = [&]() {
+        generateHeightDataBatch(missedHeights, normals, numMissed);
+        if (m_sampleCache) {
+            for (size_t j = 0; j < numMissed; j++) {
+                const VoxelPosition2D& facePosition = facePositions[missed[j]];
+                i32 x = (i32)facePosition.pos.x;
+                i32 z = (i32)facePosition.pos.y;
+                if ((f64)x == facePosition.pos.x && (f64)z == facePosition.pos.y) {
+                    m_sampleCache->put(facePosition.face, x, z, *missedHeights[j]);
+                }
+            }
+        }
+        numMissed = 0;
+    };
+
+    for (size_t i = 0; i < n; i++) {
+        const VoxelPosition2D& facePosition = facePositions[i];
+        // Only whole voxel columns are shared
+        i32 x = (i32)facePosition.pos.x;
+        i32 z = (i32)facePosition.pos.y;
+        bool isShared = m_sampleCache && (f64)x == facePosition.pos.x && (f64)z == facePosition.pos.y;
+        if (isShared && m_sampleCache->get(facePosition.face, x, z, heights[i])) continue;
+
+        missed[numMissed] = i;
+        missedHeights[numMissed] = &heights[i];
+        normals[numMissed] = glm::normalize(getFaceWorldPosition(facePosition));
+        if (++numMissed == NOISE_PROGRAM_BATCH_SIZE) generateMissed();
+    }
+    if (numMissed) generateMissed();
+}
+
+void SphericalHeightmapGenerator::generateHeightData(OUT PlanetHeightData* heights, const f64v3* normals, size_t n) const {
+    PlanetHeightData* batch[NOISE_PROGRAM_BATCH_SIZE];
+    for (size_t b = 0; b < n; b += NOISE_PROGRAM_BATCH_SIZE) {
+        size_t count = std::min((size_t)NOISE_PROGRAM_BATCH_SIZE, n - b);
+        for (size_t i = 0; i < count; i++) batch[i] = &heights[b + i];
+        generateHeightDataBatch(batch, normals + b, count);
+    }
+}
+
+f64v3 SphericalHeightmapGenerator::getFaceWorldPosition(const VoxelPosition2D& facePosition) const {
     // Need to convert to world-space
     f32v2 coordMults = f32v2(VoxelSpaceConversions::FACE_TO_WORLD_MULTS[(int)facePosition.face]);
     i32v3 coordMapping = VoxelSpaceConversions::VOXEL_TO_WORLD[(int)facePosition.face];
@@ -22,21 +101,20 @@ void SphericalHeightmapGenerator::generateHeightData(OUT PlanetHeightData& heigh
     pos[coordMapping.x] = facePosition.pos.x * KM_PER_VOXEL * coordMults.x;
     pos[coordMapping.y] = m_genData->radius * (f64)VoxelSpaceConversions::FACE_Y_MULTS[(int)facePosition.face];
     pos[coordMapping.z] = facePosition.pos.y * KM_PER_VOXEL * coordMults.y;
+    return pos;
+}
 
-    f64v3 normal = glm::normalize(pos);
+void SphericalHeightmapGenerator::generateSurfaceHeightData(OUT PlanetHeightData& height, const VoxelPosition2D& facePosition, const f64v3& pos) const {
+    // Only whole voxel columns are shared
+    i32 x = (i32)facePosition.pos.x;
+    i32 z = (i32)facePosition.pos.y;
+    bool isShared = m_sampleCache && (f64)x == facePosition.pos.x && (f64)z == facePosition.pos.y;
+    if (isShared && m_sampleCache->get(facePosition.face, x, z, height)) return;
 
+    f64v3 normal = glm::normalize(pos);
     generateHeightData(height, normal * m_genData->radius, normal);
 
-    // For Voxel Position, automatically get tree or flora
-    height.flora = getTreeID(height.biome, facePosition, pos);
-    // If no tree, try flora
-    if (height.flora == FLORA_ID_NONE) {
-        height.flora = getFloraID(height.biome, facePosition, pos);
-    }
-}
-
-void SphericalHeightmapGenerator::generateHeightData(OUT PlanetHeightData& height, const f64v3& normal) const {
-    generateHeightData(height, normal * m_genData->radius, normal);
+    if (isShared) m_sampleCache->put(facePosition.face, x, z, height);
 }
 
 FloraID SphericalHeightmapGenerator::getTreeID(const Biome* biome, const VoxelPosition2D& facePosition, const f64v3& worldPos) const {
@@ -48,8 +126,7 @@ FloraID SphericalHeightmapGenerator::getTreeID(const Biome* biome, const VoxelPo
     // Determine chance
     for (size_t i = 0; i < biome->trees.size(); i++) {
         auto& t = biome->trees[i];
-        f64 c = t.chance.base;
-        getNoiseValue(worldPos, t.chance.funcs, nullptr, TerrainOp::ADD, c);
+        f64 c = t.chance.evaluate(worldPos);
         totalChance += c;
         chances[i] = totalChance;
         noTreeChance *= (1.0 - c);
@@ -81,8 +158,7 @@ FloraID SphericalHeightmapGenerator::getFloraID(const Biome* biome, const VoxelP
     // Determine chance
     for (size_t i = 0; i < biome->flora.size(); i++) {
         auto& t = biome->flora[i];
-        f64 c = t.chance.base;
-        getNoiseValue(worldPos, t.chance.funcs, nullptr, TerrainOp::ADD, c);
+        f64 c = t.chance.evaluate(worldPos);
         totalChance += c;
         chances[i] = totalChance;
         noFloraChance *= (1.0 - c);
@@ -104,96 +180,39 @@ FloraID SphericalHeightmapGenerator::getFloraID(const Biome* biome, const VoxelP
     return FLORA_ID_NONE;
 }
 
-void getBaseBiomes(const std::vector<BiomeInfluence> baseBiomeInfluenceMap[BIOME_MAP_WIDTH][BIOME_MAP_WIDTH], f64 x, f64 y, OUT std::map<BiomeInfluence, f64>& rvBiomes) {
-    int ix = (int)x;
-    int iy = (int)y;
-
-    //0 1
-    //2 3
-    /* Interpolate */
-    // Get weights
-    f64 fx = x - (f64)ix;
-    f64 fy = y - (f64)iy;
-    f64 fx1 = 1.0 - fx;
-    f64 fy1 = 1.0 - fy;
-    f64 w0 = fx1 * fy1;
-    f64 w1 = fx * fy1;
-    f64 w2 = fx1 * fy;
-    f64 w3 = fx * fy;
+inline void SphericalHeightmapGenerator::generateHeightData(OUT PlanetHeightData& height, const f64v3& pos, const f64v3& normal) const {
+    generateHeightData(height, pos, normal,
+                       m_genData->baseTerrainFuncs.evaluate(pos),
+                       m_genData->tempTerrainFuncs.evaluate(pos),
+                       m_genData->humTerrainFuncs.evaluate(pos));
+}
 
-    // Shorter handles
-#define BLIST_0 baseBiomeInfluenceMap[iy][ix]
-#define BLIST_1 baseBiomeInfluenceMap[iy][ix + 1]
-#define BLIST_2 baseBiomeInfluenceMap[iy + 1][ix]
-#define BLIST_3 baseBiomeInfluenceMap[iy + 1][ix + 1]
-
-    // TODO(Ben): Explore padding to ditch ifs?
-    /* Construct list of biomes to generate and assign weights from interpolation. */
-    // Top Left
-    for (auto& b : BLIST_0) {
-        auto it = rvBiomes.find(b);
-        if (it == rvBiomes.end()) {
-            rvBiomes[b] = w0 * b.weight;
-        } else {
-            it->second += w0 * b.weight;
-        }
-    }
-    // Top Right
-    if (ix < BIOME_MAP_WIDTH - 1) {
-        for (auto& b : BLIST_1) {
-            auto it = rvBiomes.find(b);
-            if (it == rvBiomes.end()) {
-                rvBiomes[b] = w1 * b.weight;
-            } else {
-                it->second += w1 * b.weight;
-            }
-        }
-    } else {
-        for (auto& b : BLIST_0) {
-            rvBiomes[b] += w1 * b.weight;
-        }
+void SphericalHeightmapGenerator::generateHeightDataBatch(OUT PlanetHeightData* const* heights, const f64v3* normals, size_t n) const {
+    assert(n <= NOISE_PROGRAM_BATCH_SIZE);
+    f64 x[NOISE_PROGRAM_BATCH_SIZE], y[NOISE_PROGRAM_BATCH_SIZE], z[NOISE_PROGRAM_BATCH_SIZE];
+    f64 baseHeights[NOISE_PROGRAM_BATCH_SIZE], tempHeights[NOISE_PROGRAM_BATCH_SIZE], humHeights[NOISE_PROGRAM_BATCH_SIZE];
+    for (size_t i = 0; i < n; i++) {
+        f64v3 pos = normals[i] * m_genData->radius;
+        x[i] = pos.x;
+        y[i] = pos.y;
+        z[i] = pos.z;
     }
-    // Bottom left
-    if (iy < BIOME_MAP_WIDTH - 1) {
-        for (auto& b : BLIST_2) {
-            auto it = rvBiomes.find(b);
-            if (it == rvBiomes.end()) {
-                rvBiomes[b] = w2 * b.weight;
-            } else {
-                it->second += w2 * b.weight;
-            }
-        }
-        // Bottom right
-        if (ix < BIOME_MAP_WIDTH - 1) {
-            for (auto& b : BLIST_3) {
-                auto it = rvBiomes.find(b);
-                if (it == rvBiomes.end()) {
-                    rvBiomes[b] = w3 * b.weight;
-                } else {
-                    it->second += w3 * b.weight;
-                }
-            }
-        } else {
-            for (auto& b : BLIST_2) {
-                rvBiomes[b] += w3 * b.weight;
-            }
-        }
-    } else {
-        for (auto& b : BLIST_0) {
-            rvBiomes[b] += w2 * b.weight;
-        }
-        for (auto& b : BLIST_1) {
-            rvBiomes[b] += w3 * b.weight;
-        }
+    m_genData->baseTerrainFuncs.evaluateBatch(x, y, z, n, baseHeights);
+    m_genData->tempTerrainFuncs.evaluateBatch(x, y, z, n, tempHeights);
+    m_genData->humTerrainFuncs.evaluateBatch(x, y, z, n, humHeights);
+    // Biome noise depends on the blended height, so it stays per column
+    for (size_t i = 0; i < n; i++) {
+        generateHeightData(*heights[i], f64v3(x[i], y[i], z[i]), normals[i], baseHeights[i], tempHeights[i], humHeights[i]);
     }
 }
 
-inline void SphericalHeightmapGenerator::generateHeightData(OUT PlanetHeightData& height, const f64v3& pos, const f64v3& normal) const {
-    f64 h = getBaseHeightValue(pos);
+void SphericalHeightmapGenerator::generateHeightData(OUT PlanetHeightData& height, const f64v3& pos, const f64v3& normal,
+                                                     f64 baseHeight, f64 tempHeight, f64 humHeight) const {
+    f64 h = baseHeight;
     height.height = (f32)(h * VOXELS_PER_M);
     h *= KM_PER_M;
-    f64 temperature = getTemperatureValue(pos, normal, h);
-    f64 humidity = getHumidityValue(pos, normal, h);
+    f64 temperature = getTemperatureValue(tempHeight, normal, h);
+    f64 humidity = getHumidityValue(humHeight, normal, h);
     height.temperature = (ui8)temperature;
     height.humidity = (ui8)humidity;
     height.flora = FLORA_ID_NONE;
@@ -202,15 +221,38 @@ inline void SphericalHeightmapGenerator::generateHeightData(OUT PlanetHeightData
     f64 biggestWeight = 0.0;
     const Biome* bestBiome = m_genData->baseBiomeLookup[height.humidity][height.temperature];
 
-    std::map<BiomeInfluence, f64> baseBiomes;
-    getBaseBiomes(m_genData->baseBiomeInfluenceMap, temperature, humidity, baseBiomes);
+    // Planets without base biomes have nothing to blend
+    if (m_genData->baseBiomeCellOffsets.empty()) {
+        height.biome = bestBiome;
+        return;
+    }
+
+    int ix = (int)temperature;
+    int iy = (int)humidity;
+    //0 1
+    //2 3
+    /* Interpolate */
+    // Get weights
+    f64 fx = temperature - (f64)ix;
+    f64 fy = humidity - (f64)iy;
+    f64 fx1 = 1.0 - fx;
+    f64 fy1 = 1.0 - fy;
+    f64 w0 = fx1 * fy1;
+    f64 w1 = fx * fy1;
+    f64 w2 = fx1 * fy;
+    f64 w3 = fx * fy;
 
-    for (auto& bb : baseBiomes) {
-        const Biome* biome = bb.first.b;
-        f64 baseWeight = bb.first.weight * bb.second;
+    // Biomes of the cell are premerged with their neighbors, see PlanetGenLoader
+    const ui32* offsets = &m_genData->baseBiomeCellOffsets[iy * BIOME_MAP_WIDTH + ix];
+    const BiomeCellInfluence* influences = m_genData->baseBiomeCellInfluences.data();
+    for (ui32 i = offsets[0]; i < offsets[1]; i++) {
+        const BiomeCellInfluence& bb = influences[i];
+        const Biome* biome = bb.b;
+        f64 influence = w0 * bb.cornerWeights[0] + w1 * bb.cornerWeights[1] +
+                        w2 * bb.cornerWeights[2] + w3 * bb.cornerWeights[3];
+        f64 baseWeight = bb.weight * influence;
         // Get base biome terrain
-        f64 newHeight = biome->terrainNoise.base + height.height;
-        getNoiseValue(pos, biome->terrainNoise.funcs, nullptr, TerrainOp::ADD, newHeight);
+        f64 newHeight = biome->terrainNoise.evaluate(pos, biome->terrainNoise.base + height.height);
         // Mix in height with squared interpolation
         height.height = (f32)((baseWeight * newHeight) + (1.0 - baseWeight) * (f64)height.height);
         // Sub biomes
@@ -222,8 +264,7 @@ inline void SphericalHeightmapGenerator::generateHeightData(OUT PlanetHeightData
 
 void SphericalHeightmapGenerator::recurseChildBiomes(const Biome* biome, const f64v3& pos, f32& height, f64& biggestWeight, const Biome*& bestBiome, f64 baseWeight) const {
     // Get child noise value
-    f64 noiseVal = biome->childNoise.base;
-    getNoiseValue(pos, biome->childNoise.funcs, nullptr, TerrainOp::ADD, noiseVal);
+    f64 noiseVal = biome->childNoise.evaluate(pos);
     // Sub biomes
     for (auto& child : biome->children) {
         f64 weight = 1.0;
@@ -281,8 +322,7 @@ void SphericalHeightmapGenerator::recurseChildBiomes(const Biome* biome, const f
             }
         }
         // If we reach here, the biome exists.
-        f64 newHeight = child->terrainNoise.base + height;
-        getNoiseValue(pos, child->terrainNoise.funcs, nullptr, TerrainOp::ADD, newHeight);
+        f64 newHeight = child->terrainNoise.evaluate(pos, child->terrainNoise.base + height);
         // Biggest weight biome is the next biome
         if (weight >= biggestWeight) {
             biggestWeight = weight;
@@ -298,21 +338,11 @@ void SphericalHeightmapGenerator::recurseChildBiomes(const Biome* biome, const f
     }
 }
 
-f64 SphericalHeightmapGenerator::getBaseHeightValue(const f64v3& pos) const {
-    f64 genHeight = m_genData->baseTerrainFuncs.base;
-    getNoiseValue(pos, m_genData->baseTerrainFuncs.funcs, nullptr, TerrainOp::ADD, genHeight);
-    return genHeight;
-}
-
-f64 SphericalHeightmapGenerator::getTemperatureValue(const f64v3& pos, const f64v3& normal, f64 height) const {
-    f64 genHeight = m_genData->tempTerrainFuncs.base;
-    getNoiseValue(pos, m_genData->tempTerrainFuncs.funcs, nullptr, TerrainOp::ADD, genHeight);
+f64 SphericalHeightmapGenerator::getTemperatureValue(f64 genHeight, const f64v3& normal, f64 height) const {
     return calculateTemperature(m_genData->tempLatitudeFalloff, computeAngleFromNormal(normal), genHeight - glm::max(0.0, m_genData->tempHeightFalloff * height));
 }
 
-f64 SphericalHeightmapGenerator::getHumidityValue(const f64v3& pos, const f64v3& normal, f64 height) const {
-    f64 genHeight = m_genData->humTerrainFuncs.base;
-    getNoiseValue(pos, m_genData->humTerrainFuncs.funcs, nullptr, TerrainOp::ADD, genHeight);
+f64 SphericalHeightmapGenerator::getHumidityValue(f64 genHeight, const f64v3& normal, f64 height) const {
     return SphericalHeightmapGenerator::calculateHumidity(m_genData->humLatitudeFalloff, computeAngleFromNormal(normal), genHeight - glm::max(0.0, m_genData->humHeightFalloff * height));
 }
 
@@ -345,155 +375,3 @@ f64 SphericalHeightmapGenerator::computeAngleFromNormal(const f64v3& normal) {
         return acos(glm::dot(equator, normal));
     }
 }
-
-f64 doOperation(const TerrainOp& op, f64 a, f64 b) {
-    switch (op) {
-        case TerrainOp::ADD: return a + b;
-        case TerrainOp::SUB: return a - b;
-        case TerrainOp::MUL: return a * b;
-        case TerrainOp::DIV: return a / b;
-    }
-    return 0.0;
-}
-
-void SphericalHeightmapGenerator::getNoiseValue(const f64v3& pos,
-                                                const Array<TerrainFuncProperties>& funcs,
-                                                f64* modifier,
-                                                const TerrainOp& op,
-                                                f64& height) const {
-
-    // NOTE: Make sure this implementation matches NoiseShaderGenerator::addNoiseFunctions()
-    for (size_t f = 0; f < funcs.size(); ++f) {
-        auto& fn = funcs[f];
-
-        f64 h = 0.0;
-        f64* nextMod;
-        TerrainOp nextOp;
-        // Check if its not a noise function
-        if (fn.func == TerrainStage::CONSTANT) {
-            nextMod = &h;
-            h = fn.low;
-            // Apply parent before clamping
-            if (modifier) {
-                h = doOperation(op, h, *modifier);
-            }
-            // Optional clamp if both fields are not 0.0
-            if (fn.clamp[0] != 0.0 || fn.clamp[1] != 0.0) {
-                h = glm::clamp(*modifier, (f64)fn.clamp[0], (f64)fn.clamp[1]);
-            }
-            nextOp = fn.op;
-        } else if (fn.func == TerrainStage::PASS_THROUGH) {
-            nextMod = modifier;
-            // Apply parent before clamping
-            if (modifier) {
-                h = doOperation(op, *modifier, fn.low);
-                // Optional clamp if both fields are not 0.0
-                if (fn.clamp[0] != 0.0 || fn.clamp[1] != 0.0) {
-                    h = glm::clamp(h, fn.clamp[0], fn.clamp[1]);
-                }
-            }
-            nextOp = op;
-        } else if (fn.func == TerrainStage::SQUARED) {
-            nextMod = modifier;
-            // Apply parent before clamping
-            if (modifier) {
-                *modifier = (*modifier) * (*modifier);
-                // Optional clamp if both fields are not 0.0
-                if (fn.clamp[0] != 0.0 || fn.clamp[1] != 0.0) {
-                    h = glm::clamp(h, fn.clamp[0], fn.clamp[1]);
-                }
-            }
-            nextOp = op;
-        } else if (fn.func == TerrainStage::CUBED) {
-            nextMod = modifier;
-            // Apply parent before clamping
-            if (modifier) {
-                *modifier = (*modifier) * (*modifier) * (*modifier);
-                // Optional clamp if both fields are not 0.0
-                if (fn.clamp[0] != 0.0 || fn.clamp[1] != 0.0) {
-                    h = glm::clamp(h, fn.clamp[0], fn.clamp[1]);
-                }
-            }
-            nextOp = op;
-        } else { // It's a noise function
-            nextMod = &h;
-            f64v2 ff;
-            f64 tmp;
-            f64 total = 0.0;
-            f64 maxAmplitude = 0.0;
-            f64 amplitude = 1.0;
-            f64 frequency = fn.frequency;
-            for (int i = 0; i < fn.octaves; i++) {
-                // TODO(Ben): Could cut branching
-                switch (fn.func) {
-                    case TerrainStage::CUBED_NOISE:
-                    case TerrainStage::SQUARED_NOISE:
-                    case TerrainStage::NOISE:
-                        total += Noise::raw(pos.x * frequency, pos.y * frequency, pos.z * frequency) * amplitude;
-                        break;
-                    case TerrainStage::RIDGED_NOISE:
-                        total += ((1.0 - glm::abs(Noise::raw(pos.x * frequency, pos.y * frequency, pos.z * frequency))) * 2.0 - 1.0) * amplitude;
-                        break;
-                    case TerrainStage::ABS_NOISE:
-                        total += glm::abs(Noise::raw(pos.x * frequency, pos.y * frequency, pos.z * frequency)) * amplitude;
-                        break;
-                    case TerrainStage::CELLULAR_NOISE:
-                        ff = Noise::cellular(pos * (f64)frequency);
-                        total += (ff.y - ff.x) * amplitude;
-                        break;
-                    case TerrainStage::CELLULAR_SQUARED_NOISE:
-                        ff = Noise::cellular(pos * (f64)frequency);
-                        tmp = ff.y - ff.x;
-                        total += tmp * tmp * amplitude;
-                        break;
-                    case TerrainStage::CELLULAR_CUBED_NOISE:
-                        ff = Noise::cellular(pos * (f64)frequency);
-                        tmp = ff.y - ff.x;
-                        total += tmp * tmp * tmp * amplitude;
-                        break;
-                    default:
-                        break;
-                }
-                frequency *= 2.0;
-                maxAmplitude += amplitude;
-                amplitude *= fn.persistence;
-            }
-            total = (total / maxAmplitude);
-            // Handle any post processes per noise
-            switch (fn.func) {
-                case TerrainStage::CUBED_NOISE:
-                    total = total * total * total;
-                    break;
-                case TerrainStage::SQUARED_NOISE:
-                    total = total * total;
-                    break;
-                default:
-                    break;
-            }
-            // Conditional scaling. 
-            if (fn.low != -1.0 || fn.high != 1.0) {
-                h = total * (fn.high - fn.low) * 0.5 + (fn.high + fn.low) * 0.5;
-            } else {
-                h = total;
-            }
-            // Optional clamp if both fields are not 0.0
-            if (fn.clamp[0] != 0.0 || fn.clamp[1] != 0.0) {
-                h = glm::clamp(h, (f64)fn.clamp[0], (f64)fn.clamp[1]);
-            }
-            // Apply modifier from parent if needed
-            if (modifier) {
-                h = doOperation(op, h, *modifier);
-            }
-            nextOp = fn.op;
-        }
-
-        if (fn.children.size()) {
-            // Early exit for speed
-            if (!(nextOp == TerrainOp::MUL && *nextMod == 0.0)) {
-                getNoiseValue(pos, fn.children, nextMod, nextOp, height);
-            }
-        } else {
-            height = doOperation(fn.op, height, h);
-        }
-    }
-}
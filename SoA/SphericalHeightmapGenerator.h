@@ -23,6 +23,7 @@
 
 #include <Vorb/Events.hpp>
 
+class HeightSampleCache;
 struct NoiseBase;
 struct PlanetHeightData;
 
@@ -31,11 +32,20 @@ typedef Delegate<PlanetHeightData&, f64v3, PlanetGenData> heightmapGenFunction;
 
 class SphericalHeightmapGenerator {
 public:
-    void init(const PlanetGenData* planetGenData);
+    /// @param sampleCache: Optional cache for samples at whole voxel columns, shared with
+    /// the other generators of the planet
+    void init(const PlanetGenData* planetGenData, OPT HeightSampleCache* sampleCache = nullptr);
 
     /// Gets the height at a specific face position.
     void generateHeightData(OUT PlanetHeightData& height, const VoxelPosition2D& facePosition) const;
+    /// Same as above, but without flora. Much cheaper when the column is in the sample cache.
+    void generateSurfaceHeightData(OUT PlanetHeightData& height, const VoxelPosition2D& facePosition) const;
     void generateHeightData(OUT PlanetHeightData& height, const f64v3& normal) const;
+    /// Batched versions of the above for n positions. The planet wide noise is evaluated
+    /// with NoiseProgram::evaluateBatch, so results agree to within Noise::BATCH_TOLERANCE.
+    void generateHeightData(OUT PlanetHeightData* heights, const VoxelPosition2D* facePositions, size_t n) const;
+    void generateSurfaceHeightData(OUT PlanetHeightData* heights, const VoxelPosition2D* facePositions, size_t n) const;
+    void generateHeightData(OUT PlanetHeightData* heights, const f64v3* normals, size_t n) const;
 
     // Gets the tree id that should be at a specific worldspace position
     FloraID getTreeID(const Biome* biome, const VoxelPosition2D& facePosition, const f64v3& worldPos) const;
@@ -43,21 +53,21 @@ class SphericalHeightmapGenerator {
     FloraID getFloraID(const Biome* biome, const VoxelPosition2D& facePosition, const f64v3& worldPos) const;
     
     const PlanetGenData* getGenData() const { return m_genData; }
+    HeightSampleCache* getSampleCache() const { return m_sampleCache; }
 private:
+    /// Position on the face cube in KM, not yet projected to the sphere
+    f64v3 getFaceWorldPosition(const VoxelPosition2D& facePosition) const;
+    void generateSurfaceHeightData(OUT PlanetHeightData& height, const VoxelPosition2D& facePosition, const f64v3& pos) const;
     void generateHeightData(OUT PlanetHeightData& height, const f64v3& pos, const f64v3& normal) const;
+    /// Generates up to NOISE_PROGRAM_BATCH_SIZE positions on the sphere
+    void generateHeightDataBatch(OUT PlanetHeightData* const* heights, const f64v3* normals, size_t n) const;
+    /// Biome blending, given the planet wide noise values at pos
+    void generateHeightData(OUT PlanetHeightData& height, const f64v3& pos, const f64v3& normal,
+                            f64 baseHeight, f64 tempHeight, f64 humHeight) const;
     void recurseChildBiomes(const Biome* biome, const f64v3& pos, f32& height, f64& biggestWeight, const Biome*& bestBiome, f64 baseWeight) const;
-    
-    /// Gets noise value using terrainFuncs
-    /// @return the noise value
-    void getNoiseValue(const f64v3& pos,
-                      const Array<TerrainFuncProperties>& funcs,
-                      f64* modifier,
-                      const TerrainOp& op,
-                      f64& height) const;
 
-    f64 getBaseHeightValue(const f64v3& pos) const;
-    f64 getTemperatureValue(const f64v3& pos, const f64v3& normal, f64 height) const;
-    f64 getHumidityValue(const f64v3& pos, const f64v3& normal, f64 height) const;
+    f64 getTemperatureValue(f64 genHeight, const f64v3& normal, f64 height) const;
+    f64 getHumidityValue(f64 genHeight, const f64v3& normal, f64 height) const;
 
     /// Calculates temperature based on angle with equator
     /// @param range: The range to scale between
@@ -74,6 +84,7 @@ class SphericalHeightmapGenerator {
     static f64 computeAngleFromNormal(const f64v3& normal);
 
     const PlanetGenData* m_genData = nullptr; ///< Planet generation data for this generator
+    HeightSampleCache* m_sampleCache = nullptr;
 };
 
 #endif // SphericalTerrainCpuGenerator_h__
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "SphericalTerrainComponentUpdater.h"
 
+#include "HeightSampleCache.h"
 #include "SoAState.h"
 #include "SpaceSystem.h"
 #include "SpaceSystemAssemblages.h"
@@ -29,8 +30,9 @@ void SphericalTerrainComponentUpdater::update(SoaState* state, const f64v3& came
             loader.init(state->systemIoManager);
             PlanetGenData* data = loader.getRandomGenData((f32)stCmp.radius);
             stCmp.meshManager = new TerrainPatchMeshManager(data);
+            stCmp.sampleCache = new HeightSampleCache;
             stCmp.cpuGenerator = new SphericalHeightmapGenerator;
-            stCmp.cpuGenerator->init(data);
+            stCmp.cpuGenerator->init(data, stCmp.sampleCache);
             // Do this last to prevent race condition with regular update
             data->radius = stCmp.radius;
             stCmp.planetGenData = data;
@@ -6,6 +6,10 @@
 #include "TerrainPatchMesher.h"
 #include "VoxelSpaceConversions.h"
 
+// Vertex spacing in voxels up to which patches snap samples to voxel columns,
+// so the finest LODs share samples with chunk heightmaps
+#define MAX_SHARED_SAMPLE_SPACING 8.0
+
 void TerrainPatchMeshTask::init(const TerrainPatchData* patchData,
                                 TerrainPatchMesh* mesh,
                                 const f32v3& startPos,
@@ -32,6 +36,12 @@ void TerrainPatchMeshTask::execute(WorkerData* workerData) {
     }
     const float VERT_WIDTH = m_width / (PATCH_WIDTH - 1);
     bool isSpherical = m_mesh->getIsSpherical();
+    // Snapping is only within half a voxel, and below a voxel apart vertices would snap together
+    f64 voxelSpacing = VERT_WIDTH * VOXELS_PER_KM;
+    bool shareSamples = generator->getSampleCache() && voxelSpacing >= 1.0 && voxelSpacing <= MAX_SHARED_SAMPLE_SPACING;
+    VoxelPosition2D facePositions[PADDED_PATCH_WIDTH];
+    for (int x = 0; x < PADDED_PATCH_WIDTH; x++) facePositions[x].face = m_cubeFace;
+    f64v3 normals[PADDED_PATCH_WIDTH];
 
     if (isSpherical) {
         const i32v3& coordMapping = VoxelSpaceConversions::VOXEL_TO_WORLD[(int)m_cubeFace];
@@ -39,15 +49,23 @@ void TerrainPatchMeshTask::execute(WorkerData* workerData) {
       
         m_startPos.y *= (f32)VoxelSpaceConversions::FACE_Y_MULTS[(int)m_cubeFace];
         for (int z = 0; z < PADDED_PATCH_WIDTH; z++) {
+            // Rows are generated in batches
             for (int x = 0; x < PADDED_PATCH_WIDTH; x++) {
                 pos[coordMapping.x] = (m_startPos.x + (x - 1) * VERT_WIDTH) * coordMults.x;
                 pos[coordMapping.y] = m_startPos.y;
                 pos[coordMapping.z] = (m_startPos.z + (z - 1) * VERT_WIDTH) * coordMults.y;
-                f64v3 normal(glm::normalize(pos));
-                generator->generateHeightData(heightData[z][x], normal);
-                
+                normals[x] = glm::normalize(pos);
+                facePositions[x].pos.x = glm::round((m_startPos.x + (x - 1) * VERT_WIDTH) * VOXELS_PER_KM);
+                facePositions[x].pos.y = glm::round((m_startPos.z + (z - 1) * VERT_WIDTH) * VOXELS_PER_KM);
+            }
+            if (shareSamples) {
+                generator->generateSurfaceHeightData(heightData[z], facePositions, PADDED_PATCH_WIDTH);
+            } else {
+                generator->generateHeightData(heightData[z], normals, PADDED_PATCH_WIDTH);
+            }
+            for (int x = 0; x < PADDED_PATCH_WIDTH; x++) {
                 // offset position by height;
-                positionData[z][x] = normal * (m_patchData->radius + heightData[z][x].height * KM_PER_VOXEL);
+                positionData[z][x] = normals[x] * (m_patchData->radius + heightData[z][x].height * KM_PER_VOXEL);
             }
         }
     } else { // Far terrain
@@ -56,18 +74,26 @@ void TerrainPatchMeshTask::execute(WorkerData* workerData) {
 
         m_startPos.y *= (f32)VoxelSpaceConversions::FACE_Y_MULTS[(int)m_cubeFace];
         for (int z = 0; z < PADDED_PATCH_WIDTH; z++) {
+            // Rows are generated in batches
+            f64v2 spos[PADDED_PATCH_WIDTH];
             for (int x = 0; x < PADDED_PATCH_WIDTH; x++) {
-                f64v2 spos;
-                spos.x = (m_startPos.x + (x - 1) * VERT_WIDTH);
-                spos.y = (m_startPos.z + (z - 1) * VERT_WIDTH);
-                pos[coordMapping.x] = spos.x * coordMults.x;
+                spos[x].x = (m_startPos.x + (x - 1) * VERT_WIDTH);
+                spos[x].y = (m_startPos.z + (z - 1) * VERT_WIDTH);
+                pos[coordMapping.x] = spos[x].x * coordMults.x;
                 pos[coordMapping.y] = m_startPos.y;
-                pos[coordMapping.z] = spos.y * coordMults.y;
-                f64v3 normal(glm::normalize(pos));
-                generator->generateHeightData(heightData[z][x], normal);
-
+                pos[coordMapping.z] = spos[x].y * coordMults.y;
+                normals[x] = glm::normalize(pos);
+                facePositions[x].pos.x = glm::round(spos[x].x * VOXELS_PER_KM);
+                facePositions[x].pos.y = glm::round(spos[x].y * VOXELS_PER_KM);
+            }
+            if (shareSamples) {
+                generator->generateSurfaceHeightData(heightData[z], facePositions, PADDED_PATCH_WIDTH);
+            } else {
+                generator->generateHeightData(heightData[z], normals, PADDED_PATCH_WIDTH);
+            }
+            for (int x = 0; x < PADDED_PATCH_WIDTH; x++) {
                 // offset position by height;
-                positionData[z][x] = f64v3(spos.x, heightData[z][x].height * KM_PER_VOXEL, spos.y);
+                positionData[z][x] = f64v3(spos[x].x, heightData[z][x].height * KM_PER_VOXEL, spos[x].y);
             }
         }
     }
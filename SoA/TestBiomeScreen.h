@@ -6,7 +6,6 @@
 #include <Vorb/graphics/SpriteFont.h>
 #include <Vorb/ui/IGameScreen.h>
 #include <Vorb/io/IOManager.h>
-#include <Vorb/FixedSizeArrayRecycler.hpp>
 
 #include "BlockPack.h"
 #include "Camera.h"
@@ -69,7 +68,7 @@ class TestBiomeScreen : public vui::IAppScreen < App > {
 
     std::vector <ViewableChunk> m_chunks;
     std::vector <ChunkGridData> m_heightData;
-    vcore::FixedSizeArrayRecycler<CHUNK_SIZE, ui16> m_blockArrayRecycler;
+    vvox::VoxelArrayRecycler<CHUNK_SIZE, ui16> m_blockArrayRecycler;
 
     vg::GBuffer m_hdrTarget; ///< Framebuffer needed for the HDR rendering
     vg::RTSwapChain<2> m_swapChain; ///< Swap chain of framebuffers used for post-processing
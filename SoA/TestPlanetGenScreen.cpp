@@ -71,6 +71,7 @@ void TestPlanetGenScreen::onEntry(const vui::GameTime& gameTime VORB_MAYBE_UNUSE
         tprops.high = 10;
         pProps.planetGenData->radius = PLANET_RADIUS;
         pProps.planetGenData->baseTerrainFuncs.funcs.setData(&tprops, 1);
+        pProps.planetGenData->baseTerrainFuncs.compile();
 
         SpaceSystemAssemblages::createPlanet(m_state.spaceSystem, &props, &pProps, &body, m_state.threadPool);
 
@@ -45,6 +45,9 @@ struct AtlasTexturePosition {
 };
 static_assert(sizeof(AtlasTexturePosition) == sizeof(ui32), "AtlasTexturePosition compare will fail.");
 
+// BlockVertex positions step this many units per voxel
+#define BLOCK_QUAD_SIZE 7
+
 // Size: 32 Bytes
 struct BlockVertex {
 
@@ -87,6 +90,31 @@ struct BlockVertex {
 };
 static_assert(sizeof(BlockVertex) == 32, "Size of BlockVertex is not 32");
 
+// Everything in a BlockVertex that a face shares with others of the same look.
+// Packed opaque meshes keep one of these per distinct look in a per chunk palette.
+struct BlockVertexPaletteEntry {
+    AtlasTexturePosition texturePosition;
+    AtlasTexturePosition normTexturePosition;
+    AtlasTexturePosition dispTexturePosition;
+    ui8v2 textureDims;
+    ui8v2 overlayTextureDims;
+    color3 color;
+    ui8 padding0;
+    color3 overlayColor;
+    ui8 padding1;
+};
+// Palettes are uploaded as RGBA8UI textures with this many entries per row
+#define PACKED_PALETTE_ENTRIES_PER_ROW 64
+#define PACKED_PALETTE_TEXELS_PER_ENTRY 6
+static_assert(sizeof(BlockVertexPaletteEntry) == 24, "Size of BlockVertexPaletteEntry is not 24");
+
+// Compact opaque vertex, see ChunkMesher::packQuads for the layout
+struct PackedBlockVertex {
+    ui32 positionFace; ///< x, y, z in voxels (6 bits each), face (3 bits), blend mode (5 bits)
+    ui32 texPalette; ///< tex.x, tex.y (8 bits each), palette index (16 bits)
+};
+static_assert(sizeof(PackedBlockVertex) == 8, "Size of PackedBlockVertex is not 8");
+
 class LiquidVertex {
 public:
     // TODO: x and z can be bytes?
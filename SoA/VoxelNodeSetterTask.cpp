@@ -6,14 +6,16 @@
 
 void VoxelNodeSetterTask::execute(WorkerData* workerData VORB_MAYBE_UNUSED) {
     {
-        std::lock_guard<std::mutex> l(h->dataMutex);
+        std::lock_guard<ChunkDataLock> l(h->dataMutex);
         for (auto& node : forcedNodes) {
             h->blocks.set(node.blockIndex, node.blockID);
+            h->flagDirty(node.blockIndex);
         }
         for (auto& node : condNodes) {
             // TODO(Ben): Custom condition
             if (h->blocks.get(node.blockIndex) == 0) {
                 h->blocks.set(node.blockIndex, node.blockID);
+                h->flagDirty(node.blockIndex);
             }
         }
     }
@@ -0,0 +1,134 @@
+///
+/// VoxelRunKernels.h
+/// Seed of Andromeda
+///
+/// Copyright 2014 Regrowth Studios
+/// MIT License
+///
+/// Summary:
+/// Run-length kernels used to convert between flat voxel
+/// arrays and interval tree runs. ui16 data uses SSE2/AVX2
+/// when the target supports it, everything else is scalar.
+///
+
+#pragma once
+
+#ifndef VoxelRunKernels_h__
+#define VoxelRunKernels_h__
+
+#include <algorithm>
+#include <Vorb/voxel/IntervalTree.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VOXEL_RUN_AVX2
+#define VOXEL_RUN_SSE2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VOXEL_RUN_SSE2
+#endif
+
+#if defined(VOXEL_RUN_SSE2) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace vorb {
+    namespace voxel {
+        namespace impl {
+            /// @return Index of the lowest set bit, v must not be 0
+            inline ui32 lowestBit(ui32 v) {
+#if defined(_MSC_VER)
+                unsigned long index;
+                _BitScanForward(&index, v);
+                return (ui32)index;
+#else
+                return (ui32)__builtin_ctz(v);
+#endif
+            }
+        }
+
+        /// Finds the end of the run that starts at begin.
+        /// @return First index in (begin, end] whose value differs from data[begin], or end
+        template<typename T>
+        inline size_t findRunEnd(const T* data, size_t begin, size_t end) {
+            const T value = data[begin];
+            size_t i = begin + 1;
+            while (i < end && data[i] == value) i++;
+            return i;
+        }
+        template<>
+        inline size_t findRunEnd<ui16>(const ui16* data, size_t begin, size_t end) {
+            const ui16 value = data[begin];
+            size_t i = begin + 1;
+#ifdef VOXEL_RUN_AVX2
+            const __m256i wide = _mm256_set1_epi16((short)value);
+            for (; i + 16 <= end; i += 16) {
+                __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+                ui32 mask = (ui32)_mm256_movemask_epi8(_mm256_cmpeq_epi16(v, wide));
+                if (mask != 0xFFFFFFFFu) return i + (impl::lowestBit(~mask) >> 1);
+            }
+#endif
+#ifdef VOXEL_RUN_SSE2
+            const __m128i narrow = _mm_set1_epi16((short)value);
+            for (; i + 8 <= end; i += 8) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+                ui32 mask = (ui32)_mm_movemask_epi8(_mm_cmpeq_epi16(v, narrow));
+                if (mask != 0xFFFFu) return i + (impl::lowestBit(~mask & 0xFFFFu) >> 1);
+            }
+#endif
+            while (i < end && data[i] == value) i++;
+            return i;
+        }
+
+        /// Writes length copies of value to out.
+        template<typename T>
+        inline void fillRun(T* out, size_t length, T value) {
+            std::fill_n(out, length, value);
+        }
+        template<>
+        inline void fillRun<ui16>(ui16* out, size_t length, ui16 value) {
+            size_t i = 0;
+#ifdef VOXEL_RUN_AVX2
+            const __m256i wide = _mm256_set1_epi16((short)value);
+            for (; i + 16 <= length; i += 16) {
+                _mm256_storeu_si256((__m256i*)(out + i), wide);
+            }
+#endif
+#ifdef VOXEL_RUN_SSE2
+            const __m128i narrow = _mm_set1_epi16((short)value);
+            for (; i + 8 <= length; i += 8) {
+                _mm_storeu_si128((__m128i*)(out + i), narrow);
+            }
+#endif
+            for (; i < length; i++) out[i] = value;
+        }
+
+        /// Appends the runs in data[0, count) to a sorted run array.
+        /// A leading run that continues the last appended run is merged into it,
+        /// so consecutive calls produce the same runs as one call over all data.
+        /// @param startIndex: Voxel index of data[0]
+        /// @param runs: Run array with room for count more entries
+        /// @param numRuns: Number of runs in runs, updated on return
+        template<typename T>
+        inline void appendRuns(const T* data, size_t count, size_t startIndex,
+                               typename IntervalTree<T>::LNode* runs, size_t& numRuns) {
+            size_t i = 0;
+            if (count == 0) return;
+            if (numRuns) {
+                auto& last = runs[numRuns - 1];
+                if (last.data == data[0] && (size_t)last.start + last.length == startIndex) {
+                    i = findRunEnd(data, 0, count);
+                    last.length += (ui16)i;
+                }
+            }
+            while (i < count) {
+                size_t runEnd = findRunEnd(data, i, count);
+                runs[numRuns++].set((ui16)(startIndex + i), (ui16)(runEnd - i), data[i]);
+                i = runEnd;
+            }
+        }
+    }
+}
+namespace vvox = vorb::voxel;
+
+#endif // VoxelRunKernels_h__